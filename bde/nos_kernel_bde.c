@@ -14,6 +14,11 @@
 #include <linux/string.h>
 #include <linux/delay.h>
 #include <linux/jiffies.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/bitops.h>
 
 #define PCI_VENDOR_ID_BROADCOM	0x14e4
 #define PCI_DEVICE_ID_BCM56846	0xb846
@@ -87,6 +92,36 @@
 
 #define SCHAN_POLL_MS         50
 
+/*
+ * CMIC interrupt registers (classic XGS map, xgs_cmic.h).  Tentative for
+ * BCM56846: 0x148 reads 0x80000000 after a cold boot and must never be
+ * written as 0 (see bcm56846_regs.h), so it is only ever read-modify-written
+ * one bit at a time.  Interrupt mode is opt-in (schan_intr=1) until the
+ * offsets are confirmed on hardware.
+ */
+#define CMIC_IRQ_STAT         0x0144
+#define CMIC_IRQ_MASK         0x0148
+#define CMIC_IRQ_SCH_MSG_DONE (1u << 0)
+
+/*
+ * Adaptive spin-then-sleep.  Most SCHAN ops complete in a few microseconds,
+ * far below usleep_range() granularity, so the waiter first busy-polls
+ * SCHAN_CTRL for about twice the recent average completion time (EWMA,
+ * clamped to [SCHAN_SPIN_MIN_NS, schan_spin_max_us]) and only then sleeps,
+ * on the completion in interrupt mode or in usleep_range() otherwise.
+ */
+#define SCHAN_SPIN_MIN_NS     2000u
+#define SCHAN_EWMA_SHIFT      3         /* avg += (sample - avg) / 8 */
+#define SCHAN_IRQ_MISS_MAX    8         /* missed IRQs before falling back to polling */
+
+static bool schan_intr;
+module_param(schan_intr, bool, 0444);
+MODULE_PARM_DESC(schan_intr, "Wait for SCHAN DONE via CMIC interrupt (default: 0, poll)");
+
+static unsigned int schan_spin_max_us = 20;
+module_param(schan_spin_max_us, uint, 0644);
+MODULE_PARM_DESC(schan_spin_max_us, "Upper bound on SCHAN busy-poll before sleeping (us)");
+
 /* Chip reset registers */
 #define CMIC_CONFIG           0x010C
 #define CMIC_SOFT_RESET       0x0580
@@ -116,12 +151,110 @@ static struct nos_bde_priv *bde_priv;
  */
 static DEFINE_MUTEX(schan_mutex);
 
+/* SCHAN completion state; all but schan_done are protected by schan_mutex. */
+static DECLARE_COMPLETION(schan_done);
+static bool schan_irq_active;		/* interrupt mode in use */
+static unsigned int schan_irq_missed;	/* DONE without the IRQ, for the fallback */
+static u32 schan_avg_ns = 4 * SCHAN_SPIN_MIN_NS;
+
+/*
+ * SCHAN telemetry, updated under schan_mutex.  Layout is shared with
+ * userspace (struct nos_bde_schan_stats in sdk/include/bde_ioctl.h) and read
+ * via debugfs (nos-bde/schan_stats) or the SCHAN_STATS ioctl.  Histogram
+ * bucket b counts samples in [2^b, 2^(b+1)) ns.
+ */
+#define SCHAN_STATS_OPCODES   64
+#define SCHAN_STATS_BLOCKS    64
+#define SCHAN_STATS_HIST      32
+
+struct nos_bde_schan_stats {
+	u64 ops;
+	u64 timeouts;		/* no DONE within SCHAN_POLL_MS */
+	u64 sbus_timeouts;	/* SCHAN_CTRL bit 22 */
+	u64 naks;		/* SCHAN_CTRL bit 21 */
+	u64 resp_errors;	/* response header ERR/NACK */
+	u64 irq_missed;		/* DONE seen without the IRQ */
+	u64 op_count[SCHAN_STATS_OPCODES];
+	u64 op_errors[SCHAN_STATS_OPCODES];
+	u64 blk_count[SCHAN_STATS_BLOCKS];
+	u64 blk_errors[SCHAN_STATS_BLOCKS];
+	u64 blk_ns[SCHAN_STATS_BLOCKS];	/* total op latency */
+	u64 lat_hist[SCHAN_STATS_HIST];		/* START -> DONE/timeout */
+	u64 wait_hist[SCHAN_STATS_HIST];	/* schan_mutex acquisition */
+};
+
+static struct nos_bde_schan_stats schan_stats;
+static struct dentry *bde_debugfs_dir;
+
+static void nos_bde_debugfs_init(void);
+static void nos_bde_debugfs_exit(void);
+
+static inline int schan_hist_bucket(u64 ns)
+{
+	int b = ns ? fls64(ns) - 1 : 0;
+
+	return b < SCHAN_STATS_HIST ? b : SCHAN_STATS_HIST - 1;
+}
+
+/* Account one completed op; caller holds schan_mutex. */
+static void schan_stats_record(u32 hdr, u32 ctrl, const u32 *data, int data_words,
+			       int status, u64 ns)
+{
+	struct nos_bde_schan_stats *st = &schan_stats;
+	unsigned int op = (hdr >> 26) & (SCHAN_STATS_OPCODES - 1);
+	unsigned int blk = (hdr >> 20) & (SCHAN_STATS_BLOCKS - 1);
+	bool err = status != 0;
+
+	st->ops++;
+	if (status == -ETIMEDOUT)
+		st->timeouts++;
+	if (ctrl & SCHAN_CTRL_TIMEOUT)
+		st->sbus_timeouts++;
+	if (ctrl & SCHAN_CTRL_NAK)
+		st->naks++;
+	if (status == 0 && data && data_words > 0 &&
+	    (data[0] & (SCHAN_RESP_ERR | SCHAN_RESP_NACK))) {
+		st->resp_errors++;
+		err = true;
+	}
+	st->op_count[op]++;
+	st->blk_count[blk]++;
+	st->blk_ns[blk] += ns;
+	if (err) {
+		st->op_errors[op]++;
+		st->blk_errors[blk]++;
+	}
+	st->lat_hist[schan_hist_bucket(ns)]++;
+}
+
+/* Set/clear one bit in CMIC_IRQ_MASK without touching the others. */
+static void cmic_irq_mask_update(void __iomem *bar0, u32 bit, bool enable)
+{
+	u32 mask = ioread32(bar0 + CMIC_IRQ_MASK);
+
+	iowrite32(enable ? (mask | bit) : (mask & ~bit), bar0 + CMIC_IRQ_MASK);
+}
+
+/*
+ * CMIC interrupt handler.  The line is shared, so only claim it when the
+ * SCHAN DONE source is both pending and unmasked.  DONE stays asserted until
+ * the waiter clears SCHAN_CTRL, so mask it here and let the waiter re-arm.
+ */
 static irqreturn_t nos_bde_irq(int irq, void *dev_id)
 {
+	struct nos_bde_priv *priv = dev_id;
+	u32 stat, mask;
+
 	(void)irq;
-	(void)dev_id;
-	/* TODO: read CMIC_CMCx_IRQ_STAT0, clear, wake S-Channel waiters */
-	return IRQ_NONE;
+	mask = ioread32(priv->bar0 + CMIC_IRQ_MASK);
+	if (!(mask & CMIC_IRQ_SCH_MSG_DONE))
+		return IRQ_NONE;
+	stat = ioread32(priv->bar0 + CMIC_IRQ_STAT);
+	if (!(stat & CMIC_IRQ_SCH_MSG_DONE))
+		return IRQ_NONE;
+	iowrite32(mask & ~CMIC_IRQ_SCH_MSG_DONE, priv->bar0 + CMIC_IRQ_MASK);
+	complete(&schan_done);
+	return IRQ_HANDLED;
 }
 
 /*
@@ -271,6 +404,12 @@ static int nos_bde_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	/* Full BCM56846 chip reset: CPS, soft-reset, ring maps, SCHAN clear */
 	bcm56846_chip_reset(priv->bar0);
 
+	/* SCHAN DONE is only unmasked while a waiter sleeps on it */
+	schan_irq_active = schan_intr;
+	pr_info("nos-kernel-bde: SCHAN completion via %s, spin <= %u us\n",
+		schan_irq_active ? "interrupt" : "polling", schan_spin_max_us);
+	nos_bde_debugfs_init();
+
 	return 0;
 
 err_dma:
@@ -292,7 +431,11 @@ static void nos_bde_remove(struct pci_dev *pdev)
 
 	if (!priv)
 		return;
+	nos_bde_debugfs_exit();
 	bde_priv = NULL;
+	if (schan_intr)
+		cmic_irq_mask_update(priv->bar0, CMIC_IRQ_SCH_MSG_DONE, false);
+	schan_irq_active = false;
 	free_irq(priv->irq, priv);
 	pci_set_drvdata(pdev, NULL);
 	dma_free_coherent(&pdev->dev, priv->dma_size, priv->dma_vbase, priv->dma_pbase);
@@ -324,18 +467,105 @@ void __iomem *nos_bde_get_bar0(void)
 }
 EXPORT_SYMBOL(nos_bde_get_bar0);
 
+resource_size_t nos_bde_get_bar0_phys(void)
+{
+	return bde_priv ? pci_resource_start(bde_priv->pdev, 0) : 0;
+}
+EXPORT_SYMBOL(nos_bde_get_bar0_phys);
+
 dma_addr_t nos_bde_get_dma_pbase(void)
 {
 	return bde_priv ? bde_priv->dma_pbase : 0;
 }
 EXPORT_SYMBOL(nos_bde_get_dma_pbase);
 
+void *nos_bde_get_dma_vbase(void)
+{
+	return bde_priv ? bde_priv->dma_vbase : NULL;
+}
+EXPORT_SYMBOL(nos_bde_get_dma_vbase);
+
 size_t nos_bde_get_dma_size(void)
 {
 	return bde_priv ? bde_priv->dma_size : 0;
 }
 EXPORT_SYMBOL(nos_bde_get_dma_size);
 
+static u32 schan_spin_budget_ns(void)
+{
+	u32 max_ns = schan_spin_max_us * 1000u;
+	u32 ns = schan_avg_ns * 2;
+
+	if (max_ns < SCHAN_SPIN_MIN_NS)
+		max_ns = SCHAN_SPIN_MIN_NS;
+	return clamp(ns, SCHAN_SPIN_MIN_NS, max_ns);
+}
+
+static void schan_latency_update(u64 ns)
+{
+	u32 sample = ns > 1000000 ? 1000000 : (u32)ns;
+
+	schan_avg_ns += ((s32)(sample - schan_avg_ns)) >> SCHAN_EWMA_SHIFT;
+}
+
+/*
+ * Wait for SCHAN DONE after START.  Spins for the adaptive budget, then
+ * sleeps until SCHAN_POLL_MS has elapsed.  Returns the last SCHAN_CTRL value;
+ * SCHAN_CTRL_DONE is clear on timeout.  Caller holds schan_mutex.
+ */
+static u32 schan_wait_done(void __iomem *bar0)
+{
+	u64 start = ktime_get_ns();
+	u64 spin_end = start + schan_spin_budget_ns();
+	unsigned long deadline;
+	u32 ctrl;
+
+	do {
+		ctrl = ioread32(bar0 + CMICE_SCHAN_CTRL);
+		if (ctrl & SCHAN_CTRL_DONE)
+			goto done;
+		cpu_relax();
+	} while (ktime_get_ns() < spin_end);
+
+	if (schan_irq_active) {
+		reinit_completion(&schan_done);
+		cmic_irq_mask_update(bar0, CMIC_IRQ_SCH_MSG_DONE, true);
+		/* DONE may have landed before the unmask */
+		ctrl = ioread32(bar0 + CMICE_SCHAN_CTRL);
+		if (!(ctrl & SCHAN_CTRL_DONE) &&
+		    wait_for_completion_timeout(&schan_done,
+						msecs_to_jiffies(SCHAN_POLL_MS))) {
+			ctrl = ioread32(bar0 + CMICE_SCHAN_CTRL);
+			goto done;
+		}
+		cmic_irq_mask_update(bar0, CMIC_IRQ_SCH_MSG_DONE, false);
+		ctrl = ioread32(bar0 + CMICE_SCHAN_CTRL);
+		if (!(ctrl & SCHAN_CTRL_DONE))
+			return ctrl;
+		/* Completed but no interrupt: count it, give up on IRQs if persistent */
+		schan_stats.irq_missed++;
+		if (++schan_irq_missed >= SCHAN_IRQ_MISS_MAX) {
+			schan_irq_active = false;
+			pr_warn("nos-bde: SCHAN DONE interrupt not delivered,"
+				" falling back to polling\n");
+		}
+		goto done;
+	}
+
+	deadline = jiffies + msecs_to_jiffies(SCHAN_POLL_MS);
+	while (time_before(jiffies, deadline)) {
+		usleep_range(10, 50);
+		ctrl = ioread32(bar0 + CMICE_SCHAN_CTRL);
+		if (ctrl & SCHAN_CTRL_DONE)
+			goto done;
+	}
+	return ctrl;
+
+done:
+	schan_latency_update(ktime_get_ns() - start);
+	return ctrl;
+}
+
 /*
  * S-Channel PIO op via CMICe interface on BCM56846 (Trident+).
  *
@@ -344,29 +574,29 @@ EXPORT_SYMBOL(nos_bde_get_dma_size);
  *   2. Write cmd[0..cmd_words-1] to SCHAN_D(0..cmd_words-1) at BAR0+0x0000.
  *   3. Write data[0..data_words-1] to SCHAN_D(cmd_words..) (for write ops).
  *   4. Write CMICE_SET_START (0x80) to SCHAN_CTRL to trigger the operation.
- *   5. Poll SCHAN_CTRL for DONE bit (bit 1), check TIMEOUT/NAK.
+ *   5. Wait for DONE bit (bit 1) via schan_wait_done(), check TIMEOUT/NAK.
  *   6. Read response from SCHAN_D(0..data_words-1).
  *
  * SCHAN_D registers at 0x0000 overlap CMIC config space (by design in CMICe).
  * SCHAN_CTRL at 0x0050 = SCHAN_D(20) — never overwritten by normal ops.
+ *
+ * Caller must hold schan_mutex (nos_bde_schan_lock()).
  */
-int nos_bde_schan_op(const u32 *cmd, int cmd_words, u32 *data, int data_words, int *status)
+int nos_bde_schan_op_locked(const u32 *cmd, int cmd_words, u32 *data, int data_words, int *status)
 {
 	struct nos_bde_priv *p = bde_priv;
 	void __iomem *bar0;
 	int i;
-	unsigned long deadline;
 	u32 ctrl, saved_misc;
+	u64 start;
 
 	if (!p || cmd_words <= 0 || cmd_words > SCHAN_MAX_MSG_WORDS ||
 	    data_words < 0 || data_words > SCHAN_MAX_MSG_WORDS)
 		return -EINVAL;
 
-	if (mutex_lock_interruptible(&schan_mutex))
-		return -EINTR;
-
 	bar0 = p->bar0;
 	*status = -1;
+	start = ktime_get_ns();
 
 	/*
 	 * Save MISC_CONTROL before SCHAN op.  SCHAN_D(7) at offset 0x1C
@@ -400,32 +630,30 @@ int nos_bde_schan_op(const u32 *cmd, int cmd_words, u32 *data, int data_words, i
 	/* Assert START via CMICe byte-write */
 	iowrite32(CMICE_SET_START, bar0 + CMICE_SCHAN_CTRL);
 
-	/* Poll for DONE (bit 1) */
-	deadline = jiffies + msecs_to_jiffies(SCHAN_POLL_MS);
-	while (time_before(jiffies, deadline)) {
-		ctrl = ioread32(bar0 + CMICE_SCHAN_CTRL);
-		if (ctrl & SCHAN_CTRL_DONE) {
-			if (ctrl & (SCHAN_CTRL_TIMEOUT | SCHAN_CTRL_NAK)) {
-				cmice_schan_abort(bar0);
-				/* Restore MISC_CONTROL after SCHAN response clobbered D regs */
-				iowrite32(saved_misc, bar0 + CMIC_MISC_CONTROL);
-				pr_warn_ratelimited(
-				    "nos-bde: SCHAN err ctrl=0x%08x cmd[0]=0x%08x addr=0x%08x\n",
-				    ctrl, cmd[0], cmd_words > 1 ? cmd[1] : 0);
-				*status = -EIO;
-			} else {
-				/* Read response from SCHAN_D before clearing state */
-				if (data && data_words > 0)
-					for (i = 0; i < data_words; i++)
-						data[i] = ioread32(bar0 + CMICE_SCHAN_D(i));
-				cmice_schan_abort(bar0);
-				/* Restore MISC_CONTROL after SCHAN response clobbered D regs */
-				iowrite32(saved_misc, bar0 + CMIC_MISC_CONTROL);
-				*status = 0;
-			}
-			goto out;
+	/* Wait for DONE (bit 1) */
+	ctrl = schan_wait_done(bar0);
+	if (ctrl & SCHAN_CTRL_DONE) {
+		if (ctrl & (SCHAN_CTRL_TIMEOUT | SCHAN_CTRL_NAK)) {
+			cmice_schan_abort(bar0);
+			/* Restore MISC_CONTROL after SCHAN response clobbered D regs */
+			iowrite32(saved_misc, bar0 + CMIC_MISC_CONTROL);
+			pr_warn_ratelimited(
+			    "nos-bde: SCHAN err ctrl=0x%08x cmd[0]=0x%08x addr=0x%08x\n",
+			    ctrl, cmd[0], cmd_words > 1 ? cmd[1] : 0);
+			*status = -EIO;
+		} else {
+			/* Read response from SCHAN_D before clearing state */
+			if (data && data_words > 0)
+				for (i = 0; i < data_words; i++)
+					data[i] = ioread32(bar0 + CMICE_SCHAN_D(i));
+			cmice_schan_abort(bar0);
+			/* Restore MISC_CONTROL after SCHAN response clobbered D regs */
+			iowrite32(saved_misc, bar0 + CMIC_MISC_CONTROL);
+			*status = 0;
 		}
-		usleep_range(10, 50);
+		schan_stats_record(cmd[0], ctrl, data, data_words, *status,
+				   ktime_get_ns() - start);
+		return 0;
 	}
 	cmice_schan_abort(bar0);
 	/* Restore MISC_CONTROL after timeout */
@@ -433,12 +661,156 @@ int nos_bde_schan_op(const u32 *cmd, int cmd_words, u32 *data, int data_words, i
 	pr_warn_ratelimited("nos-bde: SCHAN timeout cmd[0]=0x%08x addr=0x%08x ctrl=0x%08x\n",
 			    cmd[0], cmd_words > 1 ? cmd[1] : 0, ctrl);
 	*status = -ETIMEDOUT;
-out:
-	mutex_unlock(&schan_mutex);
+	schan_stats_record(cmd[0], ctrl, NULL, 0, *status, ktime_get_ns() - start);
+	return 0;
+}
+EXPORT_SYMBOL(nos_bde_schan_op_locked);
+
+/*
+ * Take/release the S-Channel mutex.  Batch users (nos_user_bde SCHAN_BATCH)
+ * hold it across many nos_bde_schan_op_locked() calls so a vector of ops
+ * costs one lock round-trip instead of one per op.
+ */
+int nos_bde_schan_lock(void)
+{
+	u64 t0 = ktime_get_ns();
+
+	if (mutex_lock_interruptible(&schan_mutex))
+		return -EINTR;
+	schan_stats.wait_hist[schan_hist_bucket(ktime_get_ns() - t0)]++;
 	return 0;
 }
+EXPORT_SYMBOL(nos_bde_schan_lock);
+
+void nos_bde_schan_unlock(void)
+{
+	mutex_unlock(&schan_mutex);
+}
+EXPORT_SYMBOL(nos_bde_schan_unlock);
+
+int nos_bde_schan_op(const u32 *cmd, int cmd_words, u32 *data, int data_words, int *status)
+{
+	int rc;
+
+	if (nos_bde_schan_lock())
+		return -EINTR;
+	rc = nos_bde_schan_op_locked(cmd, cmd_words, data, data_words, status);
+	nos_bde_schan_unlock();
+	return rc;
+}
 EXPORT_SYMBOL(nos_bde_schan_op);
 
+/*
+ * Clear the SCHAN telemetry; caller holds schan_mutex.  Shared by the ioctl
+ * and debugfs resets.  Control state (schan_irq_missed, the IRQ fallback,
+ * the latency average) is left alone.
+ */
+static void schan_stats_reset_locked(void)
+{
+	memset(&schan_stats, 0, sizeof(schan_stats));
+}
+
+/*
+ * Copy a snapshot of the SCHAN telemetry (struct nos_bde_schan_stats) into
+ * dst, truncated to len bytes; optionally reset the counters afterwards.
+ * Returns the number of bytes copied.
+ */
+int nos_bde_schan_stats_read(void *dst, size_t len, bool reset)
+{
+	if (nos_bde_schan_lock())
+		return -EINTR;
+	if (len > sizeof(schan_stats))
+		len = sizeof(schan_stats);
+	memcpy(dst, &schan_stats, len);
+	if (reset)
+		schan_stats_reset_locked();
+	nos_bde_schan_unlock();
+	return (int)len;
+}
+EXPORT_SYMBOL(nos_bde_schan_stats_read);
+
+static void schan_stats_show_hist(struct seq_file *m, const char *name,
+				  const u64 *hist)
+{
+	int b;
+
+	seq_printf(m, "%s (ns):\n", name);
+	for (b = 0; b < SCHAN_STATS_HIST; b++)
+		if (hist[b])
+			seq_printf(m, "  [%10llu, %10llu) %llu\n", 1ULL << b,
+				   2ULL << b, hist[b]);
+}
+
+static int schan_stats_show(struct seq_file *m, void *v)
+{
+	struct nos_bde_schan_stats *st;
+	int i;
+
+	(void)v;
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+	if (nos_bde_schan_stats_read(st, sizeof(*st), false) < 0) {
+		kfree(st);
+		return -EINTR;
+	}
+
+	seq_printf(m, "ops %llu timeouts %llu sbus_timeouts %llu naks %llu"
+		   " resp_errors %llu irq_missed %llu\n",
+		   st->ops, st->timeouts, st->sbus_timeouts, st->naks,
+		   st->resp_errors, st->irq_missed);
+	seq_puts(m, "opcode:\n");
+	for (i = 0; i < SCHAN_STATS_OPCODES; i++)
+		if (st->op_count[i])
+			seq_printf(m, "  0x%02x count %llu errors %llu\n", i,
+				   st->op_count[i], st->op_errors[i]);
+	seq_puts(m, "block:\n");
+	for (i = 0; i < SCHAN_STATS_BLOCKS; i++)
+		if (st->blk_count[i])
+			seq_printf(m, "  %2d count %llu errors %llu avg_ns %llu\n", i,
+				   st->blk_count[i], st->blk_errors[i],
+				   div64_u64(st->blk_ns[i], st->blk_count[i]));
+	schan_stats_show_hist(m, "latency", st->lat_hist);
+	schan_stats_show_hist(m, "mutex wait", st->wait_hist);
+	kfree(st);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(schan_stats);
+
+/* Any write to nos-bde/schan_stats_reset clears the counters. */
+static ssize_t schan_stats_reset_write(struct file *file, const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	(void)file;
+	(void)buf;
+	(void)ppos;
+	if (nos_bde_schan_lock())
+		return -EINTR;
+	schan_stats_reset_locked();
+	nos_bde_schan_unlock();
+	return count;
+}
+
+static const struct file_operations schan_stats_reset_fops = {
+	.owner = THIS_MODULE,
+	.write = schan_stats_reset_write,
+};
+
+static void nos_bde_debugfs_init(void)
+{
+	bde_debugfs_dir = debugfs_create_dir("nos-bde", NULL);
+	debugfs_create_file("schan_stats", 0444, bde_debugfs_dir, NULL,
+			    &schan_stats_fops);
+	debugfs_create_file("schan_stats_reset", 0200, bde_debugfs_dir, NULL,
+			    &schan_stats_reset_fops);
+}
+
+static void nos_bde_debugfs_exit(void)
+{
+	debugfs_remove_recursive(bde_debugfs_dir);
+	bde_debugfs_dir = NULL;
+}
+
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Kernel BDE for BCM56846 (open-nos-as5610)");
 MODULE_AUTHOR("open-nos-as5610");
@@ -1,7 +1,9 @@
 /*
  * nos-user-bde — Userspace BDE: /dev/nos-bde character device
- * ioctl: READ_REG, WRITE_REG, GET_DMA_INFO, SCHAN_OP
- * mmap: DMA pool (via remap_pfn_range)
+ * ioctl: READ_REG, WRITE_REG, GET_DMA_INFO, SCHAN_OP, SCHAN_BATCH, SCHAN_RING,
+ *        TDMA, SLAM, SCHAN_STATS, SQ_SETUP, SQ_DOORBELL
+ * mmap: DMA pool (via remap_pfn_range); CMIC register window of BAR0 at
+ *       NOS_BDE_MMAP_BAR0_OFFSET (via io_remap_pfn_range)
  * Depends on nos_kernel_bde (kernel BDE exports).
  */
 
@@ -13,12 +15,23 @@
 #include <linux/slab.h>
 #include <linux/io.h>
 #include <linux/device.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/eventfd.h>
+#include <linux/wait.h>
+#include <linux/jiffies.h>
 
 /* From nos_kernel_bde.ko */
 extern void __iomem *nos_bde_get_bar0(void);
+extern resource_size_t nos_bde_get_bar0_phys(void);
 extern dma_addr_t nos_bde_get_dma_pbase(void);
 extern size_t nos_bde_get_dma_size(void);
+extern void *nos_bde_get_dma_vbase(void);
 extern int nos_bde_schan_op(const __u32 *cmd, int cmd_words, __u32 *data, int data_words, int *status);
+extern int nos_bde_schan_op_locked(const __u32 *cmd, int cmd_words, __u32 *data, int data_words, int *status);
+extern int nos_bde_schan_lock(void);
+extern void nos_bde_schan_unlock(void);
+extern int nos_bde_schan_stats_read(void *dst, size_t len, bool reset);
 
 #define NOS_BDE_MAJOR	0
 #define NOS_BDE_MINOR	0
@@ -29,6 +42,45 @@ extern int nos_bde_schan_op(const __u32 *cmd, int cmd_words, __u32 *data, int da
 #define NOS_BDE_WRITE_REG	_IOR(NOS_BDE_MAGIC, 2, struct nos_bde_reg)
 #define NOS_BDE_GET_DMA_INFO	_IOR(NOS_BDE_MAGIC, 3, struct nos_bde_dma_info)
 #define NOS_BDE_SCHAN_OP		_IOWR(NOS_BDE_MAGIC, 4, struct nos_bde_schan)
+#define NOS_BDE_SCHAN_BATCH	_IOWR(NOS_BDE_MAGIC, 5, struct nos_bde_schan_batch)
+#define NOS_BDE_SCHAN_RING	_IOWR(NOS_BDE_MAGIC, 6, struct nos_bde_schan_ring)
+#define NOS_BDE_TDMA		_IOWR(NOS_BDE_MAGIC, 7, struct nos_bde_tdma)
+#define NOS_BDE_SLAM		_IOWR(NOS_BDE_MAGIC, 8, struct nos_bde_tdma)
+#define NOS_BDE_SCHAN_STATS	_IOWR(NOS_BDE_MAGIC, 9, struct nos_bde_stats_req)
+#define NOS_BDE_SQ_SETUP	_IOWR(NOS_BDE_MAGIC, 10, struct nos_bde_sq_setup)
+#define NOS_BDE_SQ_DOORBELL	_IO(NOS_BDE_MAGIC, 11)
+
+#define NOS_BDE_SCHAN_BATCH_MAX		256
+#define NOS_BDE_SCHAN_RING_MAX		4096
+#define NOS_BDE_BATCH_STOP_ON_ERR	0x1
+#define NOS_BDE_TDMA_MAX_WORDS		14	/* entry words per SCHAN message */
+#define NOS_BDE_TDMA_CHUNK		1024	/* entries per schan_mutex hold */
+
+/*
+ * mmap offset selecting the BAR0 CMIC register window instead of the DMA
+ * pool.  Only the first NOS_BDE_BAR0_MMAP_SIZE bytes (CMIC legacy registers:
+ * MIIM_PARAM 0x158, MIIM_ADDRESS 0x4a0, ...) can be mapped; the rest of
+ * BAR0 stays ioctl-only.  The SDK keeps the SCHAN, ring and IRQ registers
+ * inside the page on the ioctls too (see NOS_BDE_MMIO_DENY_* in
+ * sdk/include/bde_ioctl.h), since this driver serializes them; only
+ * reads of SCHAN_CTRL (MIIM done-poll) go through the mapping.
+ */
+#define NOS_BDE_MMAP_BAR0_OFFSET	0x10000000UL
+#define NOS_BDE_BAR0_MMAP_SIZE		0x1000UL
+
+#define NOS_BDE_STATS_RESET		0x1
+#define NOS_BDE_STATS_MAX_LEN		8192
+
+/* SCHAN response header bits (SCHAN_D(0)) checked after WRITE_MEM */
+#define NOS_BDE_SCHAN_RESP_ERR		(1u << 6)
+#define NOS_BDE_SCHAN_RESP_NACK		(1u << 0)
+
+/* SCHAN_RING engines (nos_bde_schan_ring.engine) */
+#define NOS_BDE_RING_ENGINE_PIO		0	/* kernel drains the ring via PIO */
+#define NOS_BDE_RING_ENGINE_HW		1	/* CMIC SCHAN DMA ring (not yet supported) */
+
+#define NOS_BDE_SQ_MAX			4096	/* SQ/CQ entries (power of two) */
+#define NOS_BDE_SQ_NEED_WAKEUP		0x1	/* ring flags: worker asleep, ring doorbell */
 
 struct nos_bde_reg {
 	__u32 offset;
@@ -47,6 +99,290 @@ struct nos_bde_schan {
 	__s32 status;
 };
 
+struct nos_bde_schan_batch_op {
+	__u32 cmd[16];
+	__u32 data[16];
+	__s32 cmd_words;
+	__s32 data_words;	/* response words to read back (0..16) */
+	__s32 status;
+	__u32 pad;
+};
+
+struct nos_bde_schan_batch {
+	__u64 ops;		/* user pointer to nos_bde_schan_batch_op[count] */
+	__u32 count;
+	__u32 flags;
+	__u32 done;		/* out: ops executed */
+	__u32 failed;		/* out: ops with status != 0 */
+};
+
+struct nos_bde_schan_ring {
+	__u32 offset;		/* byte offset of ops[0] in the DMA pool */
+	__u32 count;		/* nos_bde_schan_batch_op entries */
+	__u32 flags;
+	__u32 done;		/* out: ops executed */
+	__u32 failed;		/* out: ops with status != 0 */
+	__u32 engine;		/* out: NOS_BDE_RING_ENGINE_* */
+};
+
+struct nos_bde_tdma {
+	__u32 hdr;		/* SCHAN header for one entry (opcode, block, datalen) */
+	__u32 addr;		/* SBUS address of the first entry */
+	__u32 count;		/* entries */
+	__u32 entry_words;	/* 1..NOS_BDE_TDMA_MAX_WORDS */
+	__u32 offset;		/* byte offset of entry 0 in the DMA pool */
+	__u32 flags;
+	__u32 done;		/* out: entries transferred */
+	__s32 status;		/* out: status of the failing entry, 0 if none */
+};
+
+/* Layout of the buffer is owned by nos_kernel_bde (struct nos_bde_schan_stats) */
+struct nos_bde_stats_req {
+	__u64 buf;		/* user buffer */
+	__u32 len;		/* in: buffer size, out: bytes copied */
+	__u32 flags;		/* NOS_BDE_STATS_RESET: clear after reading */
+};
+
+/*
+ * Shared submission/completion queues.  Layout in the DMA pool at
+ * nos_bde_sq_setup.offset: struct nos_bde_sq_ring, then sqe[entries], then
+ * cqe[entries].  Indices are free-running; slot = index & (entries - 1).
+ * Userspace owns sq_tail and cq_head, the kernel sq_head and cq_tail.
+ */
+struct nos_bde_sq_setup {
+	__u32 offset;		/* byte offset of struct nos_bde_sq_ring in the pool */
+	__u32 entries;		/* power of two, 0 = tear down */
+	__s32 eventfd;		/* signalled with the number of new CQEs, -1 = none */
+	__u32 flags;
+};
+
+struct nos_bde_sq_ring {
+	__u32 sq_head;
+	__u32 sq_tail;
+	__u32 cq_head;
+	__u32 cq_tail;
+	__u32 entries;
+	__u32 flags;		/* NOS_BDE_SQ_NEED_WAKEUP */
+	__u32 pad[10];
+};
+
+struct nos_bde_sqe {
+	struct nos_bde_schan_batch_op op;
+	__u64 user_data;
+};
+
+struct nos_bde_cqe {
+	__u64 user_data;
+	__s32 status;
+	__u32 pad;
+	__u32 data[16];		/* response words (op.data_words of them) */
+};
+
+static unsigned int sq_idle_us = 1000;
+module_param(sq_idle_us, uint, 0644);
+MODULE_PARM_DESC(sq_idle_us, "SQ worker busy-poll time after the last SQE before sleeping (us)");
+
+static struct nos_bde_sq {
+	struct mutex lock;		/* setup / teardown */
+	struct task_struct *thread;
+	struct eventfd_ctx *ev;
+	struct file *owner;
+	struct nos_bde_sq_ring *ring;
+	struct nos_bde_sqe *sqes;
+	struct nos_bde_cqe *cqes;
+	__u32 mask;
+	__u32 sq_head;			/* private copies; the ring's are published */
+	__u32 cq_tail;
+	atomic_t kick;
+	wait_queue_head_t wq;
+} nos_bde_sq;
+
+/* An SQE is queued and there is CQ room for its completion. */
+static bool nos_bde_sq_ready(struct nos_bde_sq *sq)
+{
+	return smp_load_acquire(&sq->ring->sq_tail) != sq->sq_head &&
+	       sq->cq_tail - smp_load_acquire(&sq->ring->cq_head) <= sq->mask;
+}
+
+/*
+ * Run queued SQEs under one schan_mutex hold (at most
+ * NOS_BDE_SCHAN_BATCH_MAX, so other SCHAN users interleave), posting one CQE
+ * each.  Returns the number of CQEs posted.
+ */
+static int nos_bde_sq_drain(struct nos_bde_sq *sq)
+{
+	struct nos_bde_sq_ring *ring = sq->ring;
+	struct nos_bde_sqe sqe;
+	struct nos_bde_cqe *cqe;
+	int n = 0;
+
+	if (!nos_bde_sq_ready(sq) || nos_bde_schan_lock())
+		return 0;
+	while (n < NOS_BDE_SCHAN_BATCH_MAX && nos_bde_sq_ready(sq)) {
+		/* Snapshot the entry: userspace can still write the pool */
+		memcpy(&sqe, &sq->sqes[sq->sq_head & sq->mask], sizeof(sqe));
+		if (sqe.op.data_words < 0 || sqe.op.data_words > 16 ||
+		    nos_bde_schan_op_locked(sqe.op.cmd, sqe.op.cmd_words,
+					    sqe.op.data, sqe.op.data_words,
+					    &sqe.op.status) < 0)
+			sqe.op.status = -EINVAL;
+		cqe = &sq->cqes[sq->cq_tail & sq->mask];
+		cqe->user_data = sqe.user_data;
+		cqe->status = sqe.op.status;
+		memcpy(cqe->data, sqe.op.data, sizeof(cqe->data));
+		sq->sq_head++;
+		sq->cq_tail++;
+		smp_store_release(&ring->sq_head, sq->sq_head);
+		smp_store_release(&ring->cq_tail, sq->cq_tail);
+		n++;
+	}
+	nos_bde_schan_unlock();
+	return n;
+}
+
+/*
+ * SQ worker: drains the submission queue and signals the eventfd.  It keeps
+ * polling for sq_idle_us after the last SQE so a pipelining producer never
+ * needs a syscall; then it sets NOS_BDE_SQ_NEED_WAKEUP and sleeps until
+ * NOS_BDE_SQ_DOORBELL.
+ */
+static int nos_bde_sq_thread(void *arg)
+{
+	struct nos_bde_sq *sq = arg;
+	unsigned long idle_end = jiffies + usecs_to_jiffies(sq_idle_us);
+	int n;
+
+	while (!kthread_should_stop()) {
+		n = nos_bde_sq_drain(sq);
+		if (n > 0) {
+			if (sq->ev)
+				eventfd_signal(sq->ev, n);
+			idle_end = jiffies + usecs_to_jiffies(sq_idle_us);
+			cond_resched();
+			continue;
+		}
+		if (time_before(jiffies, idle_end)) {
+			cond_resched();
+			continue;
+		}
+		/* Pairs with the producer's barrier between sq_tail and flags */
+		WRITE_ONCE(sq->ring->flags, NOS_BDE_SQ_NEED_WAKEUP);
+		smp_mb();
+		wait_event_interruptible(sq->wq, atomic_xchg(&sq->kick, 0) ||
+					 nos_bde_sq_ready(sq) ||
+					 kthread_should_stop());
+		WRITE_ONCE(sq->ring->flags, 0);
+		idle_end = jiffies + usecs_to_jiffies(sq_idle_us);
+	}
+	return 0;
+}
+
+static void nos_bde_sq_teardown_locked(struct nos_bde_sq *sq)
+{
+	if (sq->thread) {
+		kthread_stop(sq->thread);
+		sq->thread = NULL;
+	}
+	if (sq->ev) {
+		eventfd_ctx_put(sq->ev);
+		sq->ev = NULL;
+	}
+	sq->ring = NULL;
+	sq->owner = NULL;
+}
+
+/*
+ * SQ_SETUP: register the SQ/CQ rings and start the worker (entries = 0
+ * tears them down).  One queue pair per device; it is torn down when the
+ * owning file is closed.
+ */
+static long nos_bde_sq_setup_ioctl(struct file *filp, unsigned long arg)
+{
+	struct nos_bde_sq *sq = &nos_bde_sq;
+	struct nos_bde_sq_setup s;
+	size_t pool = nos_bde_get_dma_size();
+	void *vbase = nos_bde_get_dma_vbase();
+	struct eventfd_ctx *ev = NULL;
+	size_t bytes;
+	long err = 0;
+
+	if (copy_from_user(&s, (void __user *)arg, sizeof(s)))
+		return -EFAULT;
+	mutex_lock(&sq->lock);
+	if (s.entries == 0) {
+		if (sq->owner == filp)
+			nos_bde_sq_teardown_locked(sq);
+		goto out;
+	}
+	if (sq->ring) {
+		err = -EBUSY;
+		goto out;
+	}
+	bytes = sizeof(struct nos_bde_sq_ring) + (size_t)s.entries *
+		(sizeof(struct nos_bde_sqe) + sizeof(struct nos_bde_cqe));
+	if (!vbase) {
+		err = -ENODEV;
+		goto out;
+	}
+	if (s.entries > NOS_BDE_SQ_MAX || (s.entries & (s.entries - 1)) ||
+	    (s.offset & 63) || s.offset >= pool || bytes > pool - s.offset) {
+		err = -EINVAL;
+		goto out;
+	}
+	if (s.eventfd >= 0) {
+		ev = eventfd_ctx_fdget(s.eventfd);
+		if (IS_ERR(ev)) {
+			err = PTR_ERR(ev);
+			goto out;
+		}
+	}
+
+	sq->ring = (struct nos_bde_sq_ring *)((char *)vbase + s.offset);
+	sq->sqes = (struct nos_bde_sqe *)(sq->ring + 1);
+	sq->cqes = (struct nos_bde_cqe *)(sq->sqes + s.entries);
+	sq->mask = s.entries - 1;
+	sq->sq_head = 0;
+	sq->cq_tail = 0;
+	memset(sq->ring, 0, sizeof(*sq->ring));
+	sq->ring->entries = s.entries;
+	atomic_set(&sq->kick, 0);
+	sq->ev = ev;
+	sq->owner = filp;
+	sq->thread = kthread_run(nos_bde_sq_thread, sq, "nos-bde-sq");
+	if (IS_ERR(sq->thread)) {
+		err = PTR_ERR(sq->thread);
+		sq->thread = NULL;
+		nos_bde_sq_teardown_locked(sq);
+	}
+out:
+	mutex_unlock(&sq->lock);
+	return err;
+}
+
+static int nos_bde_release(struct inode *inode, struct file *filp)
+{
+	(void)inode;
+	mutex_lock(&nos_bde_sq.lock);
+	if (nos_bde_sq.owner == filp)
+		nos_bde_sq_teardown_locked(&nos_bde_sq);
+	mutex_unlock(&nos_bde_sq.lock);
+	return 0;
+}
+
+/* Map the CMIC register window of BAR0 uncached for direct MMIO. */
+static int nos_bde_mmap_bar0(struct vm_area_struct *vma)
+{
+	resource_size_t phys = nos_bde_get_bar0_phys();
+
+	if (phys == 0)
+		return -ENODEV;
+	if (vma->vm_end - vma->vm_start > PAGE_ALIGN(NOS_BDE_BAR0_MMAP_SIZE))
+		return -EINVAL;
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+	return io_remap_pfn_range(vma, vma->vm_start, phys >> PAGE_SHIFT,
+				  vma->vm_end - vma->vm_start, vma->vm_page_prot);
+}
+
 static int nos_bde_mmap(struct file *filp, struct vm_area_struct *vma)
 {
 	size_t size = nos_bde_get_dma_size();
@@ -54,7 +390,13 @@ static int nos_bde_mmap(struct file *filp, struct vm_area_struct *vma)
 	void __iomem *bar0 = nos_bde_get_bar0();
 
 	(void)filp;
-	if (!bar0 || pbase == 0 || size == 0)
+	if (!bar0)
+		return -ENODEV;
+	if (vma->vm_pgoff == NOS_BDE_MMAP_BAR0_OFFSET >> PAGE_SHIFT)
+		return nos_bde_mmap_bar0(vma);
+	if (vma->vm_pgoff != 0)
+		return -EINVAL;
+	if (pbase == 0 || size == 0)
 		return -ENODEV;
 	if (vma->vm_end - vma->vm_start > size)
 		return -EINVAL;
@@ -63,6 +405,224 @@ static int nos_bde_mmap(struct file *filp, struct vm_area_struct *vma)
 			       vma->vm_end - vma->vm_start, vma->vm_page_prot);
 }
 
+/*
+ * SCHAN_BATCH: run a vector of S-Channel ops with one copy in, one copy out
+ * and a single schan_mutex hold.  Per-op status is returned in ops[i].status;
+ * with NOS_BDE_BATCH_STOP_ON_ERR the batch stops at the first failing op and
+ * 'done' tells userspace how far it got.
+ */
+static long nos_bde_schan_batch_ioctl(unsigned long arg)
+{
+	struct nos_bde_schan_batch b;
+	struct nos_bde_schan_batch_op *ops;
+	size_t bytes;
+	long err = 0;
+	__u32 i;
+
+	if (copy_from_user(&b, (void __user *)arg, sizeof(b)))
+		return -EFAULT;
+	if (b.count == 0 || b.count > NOS_BDE_SCHAN_BATCH_MAX)
+		return -EINVAL;
+	bytes = (size_t)b.count * sizeof(*ops);
+	ops = kvmalloc(bytes, GFP_KERNEL);
+	if (!ops)
+		return -ENOMEM;
+	if (copy_from_user(ops, u64_to_user_ptr(b.ops), bytes)) {
+		err = -EFAULT;
+		goto out;
+	}
+
+	b.done = 0;
+	b.failed = 0;
+	if (nos_bde_schan_lock()) {
+		err = -EINTR;
+		goto out;
+	}
+	for (i = 0; i < b.count; i++) {
+		struct nos_bde_schan_batch_op *op = &ops[i];
+
+		if (op->data_words < 0 || op->data_words > 16 ||
+		    nos_bde_schan_op_locked(op->cmd, op->cmd_words, op->data,
+					    op->data_words, &op->status) < 0)
+			op->status = -EINVAL;
+		b.done++;
+		if (op->status != 0) {
+			b.failed++;
+			if (b.flags & NOS_BDE_BATCH_STOP_ON_ERR)
+				break;
+		}
+	}
+	nos_bde_schan_unlock();
+
+	if (copy_to_user(u64_to_user_ptr(b.ops), ops, bytes) ||
+	    copy_to_user((void __user *)arg, &b, sizeof(b)))
+		err = -EFAULT;
+out:
+	kvfree(ops);
+	return err;
+}
+
+/*
+ * SCHAN_RING: run a ring of SCHAN messages that userspace queued in the
+ * mmapped DMA pool.  No message copy through the ioctl; status and response
+ * words are written back into the ring entries.
+ *
+ * The CMIC's own SCHAN DMA ring (CMIC_SCHAN_RING_CFG 0x10c) is not used yet:
+ * its descriptor format is not reverse-engineered, and once the CMIC is in
+ * ring mode PIO SCHAN stays dead until a cold power cycle (see
+ * bcm56846_regs.h).  Until then the ring is drained here through PIO under a
+ * single schan_mutex hold (NOS_BDE_RING_ENGINE_PIO), which keeps the
+ * userspace ring format and flow identical for a future hardware engine.
+ */
+static long nos_bde_schan_ring_ioctl(unsigned long arg)
+{
+	struct nos_bde_schan_ring r;
+	struct nos_bde_schan_batch_op op;
+	struct nos_bde_schan_batch_op *ring;
+	size_t pool = nos_bde_get_dma_size();
+	void *vbase = nos_bde_get_dma_vbase();
+	__u32 i;
+
+	if (copy_from_user(&r, (void __user *)arg, sizeof(r)))
+		return -EFAULT;
+	if (!vbase)
+		return -ENODEV;
+	if (r.count == 0 || r.count > NOS_BDE_SCHAN_RING_MAX ||
+	    (r.offset & 7) || r.offset >= pool ||
+	    (size_t)r.count * sizeof(op) > pool - r.offset)
+		return -EINVAL;
+	ring = (struct nos_bde_schan_batch_op *)((char *)vbase + r.offset);
+
+	r.done = 0;
+	r.failed = 0;
+	r.engine = NOS_BDE_RING_ENGINE_PIO;
+	if (nos_bde_schan_lock())
+		return -EINTR;
+	for (i = 0; i < r.count; i++) {
+		/* Snapshot the entry: userspace can still write the pool */
+		memcpy(&op, &ring[i], sizeof(op));
+		if (op.data_words < 0 || op.data_words > 16 ||
+		    nos_bde_schan_op_locked(op.cmd, op.cmd_words, op.data,
+					    op.data_words, &op.status) < 0)
+			op.status = -EINVAL;
+		memcpy(ring[i].data, op.data, sizeof(op.data));
+		ring[i].status = op.status;
+		r.done++;
+		if (op.status != 0) {
+			r.failed++;
+			if (r.flags & NOS_BDE_BATCH_STOP_ON_ERR)
+				break;
+		}
+	}
+	nos_bde_schan_unlock();
+
+	if (copy_to_user((void __user *)arg, &r, sizeof(r)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * TDMA / SLAM: move a table range between the ASIC and the DMA pool in one
+ * call.  Userspace supplies the READ_MEM (TDMA) or WRITE_MEM (SLAM) header
+ * for one entry; entry i is at SBUS address addr + i and at pool offset
+ * + i * entry_words * 4, where the SDK reads or packs it through its mmap.
+ *
+ * The CMICe table-DMA and SLAM engines are not reverse-engineered, so
+ * entries are moved by PIO, NOS_BDE_TDMA_CHUNK at a time per schan_mutex
+ * hold so a full-table transfer does not starve other SCHAN users.
+ */
+static long nos_bde_tdma_ioctl(unsigned long arg, bool write)
+{
+	struct nos_bde_tdma t;
+	size_t pool = nos_bde_get_dma_size();
+	void *vbase = nos_bde_get_dma_vbase();
+	__u32 cmd[2 + NOS_BDE_TDMA_MAX_WORDS], data[1 + NOS_BDE_TDMA_MAX_WORDS];
+	__u32 *buf, i = 0;
+	int status;
+
+	if (copy_from_user(&t, (void __user *)arg, sizeof(t)))
+		return -EFAULT;
+	if (!vbase)
+		return -ENODEV;
+	if (t.count == 0 || t.entry_words == 0 ||
+	    t.entry_words > NOS_BDE_TDMA_MAX_WORDS ||
+	    (t.offset & 3) || t.offset >= pool ||
+	    (size_t)t.count * t.entry_words * 4 > pool - t.offset)
+		return -EINVAL;
+	buf = (__u32 *)((char *)vbase + t.offset);
+
+	t.done = 0;
+	t.status = 0;
+	while (i < t.count && t.status == 0) {
+		__u32 end = min_t(__u32, t.count, i + NOS_BDE_TDMA_CHUNK);
+
+		if (nos_bde_schan_lock())
+			return -EINTR;
+		for (; i < end; i++) {
+			__u32 *entry = buf + (size_t)i * t.entry_words;
+
+			cmd[0] = t.hdr;
+			cmd[1] = t.addr + i;
+			if (write) {
+				memcpy(&cmd[2], entry, t.entry_words * sizeof(__u32));
+				if (nos_bde_schan_op_locked(cmd, 2 + t.entry_words,
+							    data, 1, &status) < 0)
+					status = -EINVAL;
+				else if (status == 0 &&
+					 (data[0] & (NOS_BDE_SCHAN_RESP_ERR |
+						     NOS_BDE_SCHAN_RESP_NACK)))
+					status = -EIO;
+			} else if (nos_bde_schan_op_locked(cmd, 2, data,
+							   1 + t.entry_words,
+							   &status) < 0) {
+				status = -EINVAL;
+			}
+			if (status != 0) {
+				t.status = status;
+				break;
+			}
+			if (!write)
+				memcpy(entry, &data[1], t.entry_words * sizeof(__u32));
+			t.done++;
+		}
+		nos_bde_schan_unlock();
+		cond_resched();
+	}
+
+	if (copy_to_user((void __user *)arg, &t, sizeof(t)))
+		return -EFAULT;
+	return 0;
+}
+
+/* SCHAN_STATS: snapshot (and optionally reset) the kernel SCHAN telemetry. */
+static long nos_bde_schan_stats_ioctl(unsigned long arg)
+{
+	struct nos_bde_stats_req req;
+	void *buf;
+	int n;
+	long err = 0;
+
+	if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+		return -EFAULT;
+	if (req.len == 0 || req.len > NOS_BDE_STATS_MAX_LEN)
+		return -EINVAL;
+	buf = kzalloc(req.len, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+	n = nos_bde_schan_stats_read(buf, req.len, req.flags & NOS_BDE_STATS_RESET);
+	if (n < 0) {
+		err = n;
+		goto out;
+	}
+	req.len = (__u32)n;
+	if (copy_to_user(u64_to_user_ptr(req.buf), buf, n) ||
+	    copy_to_user((void __user *)arg, &req, sizeof(req)))
+		err = -EFAULT;
+out:
+	kfree(buf);
+	return err;
+}
+
 static long nos_bde_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	void __iomem *bar0 = nos_bde_get_bar0();
@@ -71,7 +631,6 @@ static long nos_bde_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
 	struct nos_bde_schan schan;
 	long err = 0;
 
-	(void)filp;
 	if (!bar0)
 		return -ENODEV;
 
@@ -107,6 +666,22 @@ static long nos_bde_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
 		if (copy_to_user((void __user *)arg, &schan, sizeof(schan)))
 			return -EFAULT;
 		break;
+	case NOS_BDE_SCHAN_BATCH:
+		return nos_bde_schan_batch_ioctl(arg);
+	case NOS_BDE_SCHAN_RING:
+		return nos_bde_schan_ring_ioctl(arg);
+	case NOS_BDE_TDMA:
+		return nos_bde_tdma_ioctl(arg, false);
+	case NOS_BDE_SLAM:
+		return nos_bde_tdma_ioctl(arg, true);
+	case NOS_BDE_SCHAN_STATS:
+		return nos_bde_schan_stats_ioctl(arg);
+	case NOS_BDE_SQ_SETUP:
+		return nos_bde_sq_setup_ioctl(filp, arg);
+	case NOS_BDE_SQ_DOORBELL:
+		atomic_set(&nos_bde_sq.kick, 1);
+		wake_up_interruptible(&nos_bde_sq.wq);
+		break;
 	default:
 		return -ENOTTY;
 	}
@@ -116,6 +691,7 @@ static long nos_bde_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
 static const struct file_operations nos_bde_fops = {
 	.owner	 = THIS_MODULE,
 	.mmap	 = nos_bde_mmap,
+	.release = nos_bde_release,
 	.unlocked_ioctl = nos_bde_ioctl,
 };
 
@@ -126,6 +702,9 @@ static struct class *nos_bde_class;
 static int __init nos_user_bde_init(void)
 {
 	int rc;
+
+	mutex_init(&nos_bde_sq.lock);
+	init_waitqueue_head(&nos_bde_sq.wq);
 	nos_bde_class = class_create(THIS_MODULE, "nos_bde");
 	if (IS_ERR(nos_bde_class))
 		return PTR_ERR(nos_bde_class);
@@ -154,6 +733,9 @@ err_class:
 
 static void __exit nos_user_bde_exit(void)
 {
+	mutex_lock(&nos_bde_sq.lock);
+	nos_bde_sq_teardown_locked(&nos_bde_sq);
+	mutex_unlock(&nos_bde_sq.lock);
 	device_destroy(nos_bde_class, devt);
 	cdev_del(&cdev);
 	unregister_chrdev_region(devt, 1);
@@ -27,22 +27,116 @@ int bcm56846_serdes_link_get(int unit, int port, int *link_up);
 int bcm56846_l2_addr_add(int unit, const bcm56846_l2_addr_t *addr);
 int bcm56846_l2_addr_delete(int unit, const uint8_t mac[6], uint16_t vid);
 int bcm56846_l2_addr_get(int unit, const uint8_t mac[6], uint16_t vid, bcm56846_l2_addr_t *out);
-/* L2_USER_ENTRY (TCAM): guaranteed/BPDU entries; 512 entries, 20 bytes. */
-int bcm56846_l2_user_entry_add(int unit, const bcm56846_l2_user_addr_t *addr, int *index);
-int bcm56846_l2_user_entry_delete(int unit, int index);
+/* L2_ENTRY hash bucket (0..16383, 8 entries each) that (MAC, VID) maps to */
+int bcm56846_l2_bucket_get(int unit, const uint8_t mac[6], uint16_t vid);
+/*
+ * Hardware learning: l2_learn_enable turns on learning on every front-panel
+ * port and the L2_MOD_FIFO DMA.  l2_event_poll drains up to max learn/move/
+ * age records from the DMA ring (no SCHAN ops) and returns how many.
+ */
+int bcm56846_l2_learn_enable(int unit, int enable);
+int bcm56846_l2_event_poll(int unit, bcm56846_l2_event_t *events, int max);
+/*
+ * Learn limits and station-move detection (ports 1..66), enforced as
+ * l2_event_poll applies the learn records.  A port at learn_limit dynamic
+ * MACs, or with more than move_limit moves onto it in one second, gets the
+ * limit action for new (moving) MACs; learns past the limit are removed
+ * and not reported.  Learning resumes once the port is back under its
+ * limit, moves after a 10 s hold-down.  Defaults from config.bcm
+ * (l2_learn_limit, l2_move_limit, l2_limit_action, l2_limit_trap_pps).
+ */
+int bcm56846_l2_port_limit_set(int unit, int port, const bcm56846_l2_port_limit_t *limit);
+int bcm56846_l2_port_limit_get(int unit, int port, bcm56846_l2_port_limit_t *limit);
+int bcm56846_l2_port_learn_status_get(int unit, int port, bcm56846_l2_port_learn_status_t *st);
+/*
+ * Aging: dynamic entries idle for age..2*age seconds are removed by a
+ * hit-bit sweep (default l2_age_time in config.bcm, 0 = off).  l2_age_run
+ * advances the sweep when due, a chunk at a time with capped SCHAN writes,
+ * and returns the AGE events for the entries it removed (at most max).
+ */
+int bcm56846_l2_age_timer_set(int unit, int seconds);
+int bcm56846_l2_age_timer_get(int unit, int *seconds);
+int bcm56846_l2_age_run(int unit, bcm56846_l2_event_t *events, int max);
+/*
+ * Flush: remove every dynamic entry on port (a trunk with
+ * BCM56846_L2_FLUSH_TRUNK) and/or VLAN vid (negative = any) with the ASIC's
+ * bulk delete engine.  Returns the number removed; each is reported as a
+ * DELETE event by l2_event_poll while learning is enabled.
+ */
+int bcm56846_l2_flush(int unit, int port, int vid, int flags);
+/*
+ * Traverse: call cb for every entry matching filter (NULL = all), reading
+ * L2_ENTRY 4096 entries per TDMA and never holding the L2 lock across a
+ * callback.  Returns the number of entries passed to cb.
+ */
+int bcm56846_l2_traverse(int unit, const bcm56846_l2_filter_t *filter,
+			 bcm56846_l2_traverse_cb_t cb, void *cookie);
+/*
+ * Hit harvest: calls cb for each static entry the pipeline hit since the
+ * previous harvest and clears its hit bits (dynamic entries belong to the
+ * aging sweep).  Returns the number of entries passed to cb.
+ */
+int bcm56846_l2_hit_harvest(int unit, bcm56846_l2_traverse_cb_t cb, void *cookie);
+/*
+ * Hash: select_set switches the ASIC and the software model to another
+ * bucket hash and re-buckets the table (returns the entries that did not
+ * fit).  hash_stats_get reports bucket occupancy and insert failures for
+ * the hash in use (hash = -1) or for a candidate, without switching.
+ */
+int bcm56846_l2_hash_select_set(int unit, bcm56846_l2_hash_t hash);
+int bcm56846_l2_hash_select_get(int unit, bcm56846_l2_hash_t *hash);
+int bcm56846_l2_hash_stats_get(int unit, int hash, bcm56846_l2_hash_stats_t *st);
+/*
+ * L2_USER_ENTRY (TCAM): guaranteed/BPDU entries; 512 entries, 20 bytes.
+ * Higher addr->priority entries match first; add returns an entry id
+ * (stable while the SDK reorders the TCAM) that delete takes.
+ */
+int bcm56846_l2_user_entry_add(int unit, const bcm56846_l2_user_addr_t *addr, int *id);
+int bcm56846_l2_user_entry_delete(int unit, int id);
 
 /* L3 Interface (EGR_L3_INTF: SA_MAC + VLAN per interface) */
 int bcm56846_l3_intf_create(int unit, const uint8_t mac[6], uint16_t vid, int *intf_id);
 int bcm56846_l3_intf_destroy(int unit, int intf_id);
 
-/* L3 Egress */
+/*
+ * L3 Egress: creating an egress identical (port, MAC, intf, VLAN) to an
+ * existing one returns its id and takes a reference; destroy drops one
+ * and frees the next-hop entry with the last.
+ */
 int bcm56846_l3_egress_create(int unit, const bcm56846_l3_egress_t *egress, int *egress_id);
 int bcm56846_l3_egress_destroy(int unit, int egress_id);
 
-/* L3 Routes */
+/*
+ * L3 Routes: IPv4 and IPv6 up to /64 share the L3_DEFIP TCAM (IPv6 as
+ * double-wide entries), longer IPv6 prefixes go in L3_DEFIP_128.
+ */
 int bcm56846_l3_route_add(int unit, const bcm56846_l3_route_t *route);
 int bcm56846_l3_route_delete(int unit, const bcm56846_l3_route_t *route);
+/* Fill route->egress_id for an installed (vrf, prefix, prefix_len); -ENOENT if none. */
+int bcm56846_l3_route_get(int unit, bcm56846_l3_route_t *route);
+/*
+ * Hosts (addr[] in host byte order, IPv6 most significant word first) go
+ * in the L3_ENTRY hash table, not the DEFIP TCAM; IPv6 hosts take two
+ * adjacent entries.  add rewrites an existing (vrf, addr) in place and
+ * fails with -ENOSPC when its 8-entry bucket is full.
+ */
 int bcm56846_l3_host_add(int unit, const bcm56846_l3_host_t *host);
+int bcm56846_l3_host_delete(int unit, const bcm56846_l3_host_t *host);
+/*
+ * Host hit harvest: calls cb for each host entry the pipeline routed to
+ * since the previous harvest and clears its hit bit.  Like the
+ * other L3 calls it is not locked: call it from the thread that programs
+ * routes.  Returns the number of hosts passed to cb.
+ */
+int bcm56846_l3_host_hit_harvest(int unit, bcm56846_l3_host_cb_t cb, void *cookie);
+
+/*
+ * Pipelined L3 programming: with async set, intf/egress/route calls return
+ * once their table writes are queued to the kernel BDE.  l3_sync waits for
+ * all of them and returns the number that failed since the last sync.
+ */
+int bcm56846_l3_async_set(int unit, int enable);
+int bcm56846_l3_sync(int unit);
 
 /* ECMP */
 int bcm56846_l3_ecmp_create(int unit, const int *egress_ids, int count, int *ecmp_id);
@@ -50,9 +144,24 @@ int bcm56846_l3_ecmp_destroy(int unit, int ecmp_id);
 
 /* VLAN */
 int bcm56846_vlan_create(int unit, uint16_t vid);
+int bcm56846_vlan_create_range(int unit, uint16_t vid_lo, uint16_t vid_hi);
 int bcm56846_vlan_port_add(int unit, uint16_t vid, int port, int tagged);
 int bcm56846_vlan_destroy(int unit, uint16_t vid);
 
+/*
+ * Bulk table access (TDMA read / SLAM write).  mem is the CDK memory base
+ * address (e.g. 0x07120000 for L2_ENTRY).  table_read sets *entries to count
+ * entries of entry_words each inside the DMA pool; the buffer is shared, so
+ * on success the caller holds it until table_read_release (other reads,
+ * SDK-internal ones included, wait meanwhile).  table_write programs count
+ * packed entries from index on.
+ */
+int bcm56846_table_read(int unit, uint32_t mem, int index, int count,
+			int entry_words, const uint32_t **entries);
+void bcm56846_table_read_release(int unit);
+int bcm56846_table_write(int unit, uint32_t mem, int index, int count,
+			 int entry_words, const uint32_t *entries);
+
 /* Stats (XLMAC counters; RE: STATS_COUNTER_FORMAT.md) */
 int bcm56846_stat_get(int unit, int port, bcm56846_stat_t stat, uint64_t *value);
 
@@ -43,6 +43,27 @@
 #define CMICM_DMA_DESC0(ch)       CMIC_DMA_DESC(ch)
 #define CMICM_DMA_STAT            CMIC_DMA_STAT
 
+/*
+ * CMC2 FIFO read DMA, channel 0 — streams records popped from an SBUS FIFO
+ * memory (L2_MOD_FIFO) into a host ring in the DMA pool.  Hardware adds to
+ * NUM_VALID for every record it writes; software hands slots back by
+ * writing the number consumed to NUM_READ.  Offsets follow the CMICm
+ * CMC_FIFO_CHy_RD_DMA_* layout from the CMC2 base (tentative, not yet
+ * confirmed on hardware).
+ */
+#define CMIC_FIFO_RD_DMA_CFG            0x33150u
+#define CMIC_FIFO_RD_DMA_SBUS_START     0x33154u  /* SBUS address of the FIFO memory */
+#define CMIC_FIFO_RD_DMA_HOSTMEM_START  0x33158u  /* bus address of the host ring */
+#define CMIC_FIFO_RD_DMA_NUM_VALID      0x3315cu  /* RO: records written, not yet read */
+#define CMIC_FIFO_RD_DMA_NUM_READ       0x33160u  /* WO: records consumed */
+#define CMIC_FIFO_RD_DMA_STAT           0x331a0u
+#define CMIC_FIFO_RD_DMA_STAT_CLR       0x331b0u
+
+#define CMIC_FIFO_RD_DMA_CFG_ENABLE        (1u << 0)
+#define CMIC_FIFO_RD_DMA_CFG_WORDS_SHIFT   1       /* record words, bits 5:1 */
+#define CMIC_FIFO_RD_DMA_CFG_ENTRIES_SHIFT 6       /* ring = 64 << sel records, bits 9:6 */
+#define CMIC_FIFO_RD_DMA_STAT_OVERFLOW     (1u << 1) /* ring was full, records dropped */
+
 /*
  * CMIC diagnostic and boot-detection registers.
  *
@@ -13,6 +13,84 @@ typedef struct {
 	int       static_entry;
 } bcm56846_l2_addr_t;
 
+/* L2_MOD_FIFO record: what the pipeline did to L2_ENTRY on its own */
+typedef enum {
+	BCM56846_L2_EVENT_LEARN,   /* new source MAC installed */
+	BCM56846_L2_EVENT_MOVE,    /* known MAC seen on another port (addr = new) */
+	BCM56846_L2_EVENT_AGE,     /* entry aged out */
+	BCM56846_L2_EVENT_DELETE,  /* entry removed by the pipeline */
+} bcm56846_l2_event_type_t;
+
+typedef struct {
+	bcm56846_l2_event_type_t type;
+	bcm56846_l2_addr_t       addr;
+} bcm56846_l2_event_t;
+
+/* bcm56846_l2_flush() flags */
+enum {
+	BCM56846_L2_FLUSH_STATIC = 0x1,  /* static entries too */
+	BCM56846_L2_FLUSH_TRUNK  = 0x2,  /* port is a trunk group id */
+};
+
+/* L2_ENTRY bucket hash (HASH_CONTROL L2_AND_VLAN_MAC_HASH_SELECT) */
+typedef enum {
+	BCM56846_L2_HASH_CRC32_UPPER,  /* default */
+	BCM56846_L2_HASH_CRC32_LOWER,
+	BCM56846_L2_HASH_CRC16_UPPER,
+	BCM56846_L2_HASH_CRC16_LOWER,
+	BCM56846_L2_HASH_LSB,          /* MAC[13:0]: spreads sequential MACs */
+	BCM56846_L2_HASH_COUNT,
+} bcm56846_l2_hash_t;
+
+typedef struct {
+	bcm56846_l2_hash_t hash;
+	uint32_t entries;
+	uint32_t buckets_full;
+	uint32_t histogram[9];   /* buckets holding 0..8 valid entries */
+	uint32_t overflow;       /* candidate hash: entries that would not fit */
+	uint32_t insert_fail;    /* l2_addr_add -ENOSPC (bucket full) since start */
+	uint32_t rehash_drop;    /* entries dropped by hash changes since start */
+} bcm56846_l2_hash_stats_t;
+
+/* bcm56846_l2_traverse() filter; port/vid -1 = any, flags 0 = static and dynamic */
+enum {
+	BCM56846_L2_TRAVERSE_STATIC  = 0x1,
+	BCM56846_L2_TRAVERSE_DYNAMIC = 0x2,
+	BCM56846_L2_TRAVERSE_TRUNK   = 0x4,  /* port is a trunk group id */
+};
+
+typedef struct {
+	int port;
+	int vid;
+	int flags;
+} bcm56846_l2_filter_t;
+
+/* Return 0 to continue, nonzero to stop (a negative value is the traverse result). */
+typedef int (*bcm56846_l2_traverse_cb_t)(int unit, const bcm56846_l2_addr_t *addr, void *cookie);
+
+/* What a port does with new (or moving) source MACs once over its limit */
+typedef enum {
+	BCM56846_L2_LIMIT_NOLEARN,  /* forward, do not learn (default) */
+	BCM56846_L2_LIMIT_DROP,     /* discard the frame */
+	BCM56846_L2_LIMIT_TRAP,     /* discard, copy to the CPU at trap_pps */
+} bcm56846_l2_limit_action_t;
+
+typedef struct {
+	int learn_limit;   /* dynamic MACs on the port, 0 = no limit */
+	int move_limit;    /* station moves onto the port per second, 0 = no limit */
+	bcm56846_l2_limit_action_t action;
+	int trap_pps;      /* BCM56846_L2_LIMIT_TRAP: frames per second to the CPU */
+} bcm56846_l2_port_limit_t;
+
+typedef struct {
+	int      learned;        /* dynamic MACs on the port */
+	int      moves;          /* station moves onto the port in the current second */
+	int      learn_blocked;  /* 1 while new MACs get the limit action */
+	int      move_blocked;   /* 1 while moves get the limit action (move storm) */
+	uint32_t limit_drop;     /* learns removed for being over learn_limit */
+	uint32_t move_storm;     /* times move_limit was exceeded */
+} bcm56846_l2_port_learn_status_t;
+
 /* L2_USER_ENTRY (TCAM): guaranteed/BPDU entries; RE L2_ENTRY_FORMAT.md §2 */
 typedef struct {
 	uint8_t  mac[6];
@@ -22,6 +100,7 @@ typedef struct {
 	int      copy_to_cpu; /* 1= punt to CPU */
 	int      bpdu;        /* 1= BPDU flag */
 	uint64_t mask;        /* 61-bit: same layout as KEY; 1=match, 0=don't care. 0x1000ffffffffffff = BPDU (any VLAN) */
+	int      priority;    /* TCAM precedence: higher is matched first */
 } bcm56846_l2_user_addr_t;
 
 typedef struct {
@@ -32,19 +111,24 @@ typedef struct {
 } bcm56846_l3_egress_t;
 
 typedef struct {
-	uint32_t prefix;   /* IPv4 or low 32 bits */
-	uint32_t prefix6[4]; /* IPv6 full */
+	uint32_t prefix;   /* IPv4, network byte order */
+	uint32_t prefix6[4]; /* IPv6, network byte order (as struct in6_addr) */
 	int      prefix_len;
 	int      egress_id;
 	int      is_ipv6;
+	uint16_t vrf;      /* VRF_ID 0..1023 (0 = global table) */
 } bcm56846_l3_route_t;
 
 typedef struct {
-	uint32_t addr[4];  /* IPv4 or IPv6 */
+	uint32_t addr[4];  /* host byte order: IPv4 in addr[0]; IPv6 addr[0] = bits 127:96 */
 	int      is_ipv6;
 	int      egress_id;
+	uint16_t vrf;      /* VRF_ID 0..1023 (0 = global table) */
 } bcm56846_l3_host_t;
 
+/* Return 0 to continue, nonzero to stop (a negative value is the harvest result). */
+typedef int (*bcm56846_l3_host_cb_t)(int unit, const bcm56846_l3_host_t *host, void *cookie);
+
 typedef enum {
 	BCM56846_STAT_RPKT,
 	BCM56846_STAT_RBYT,
@@ -2,6 +2,7 @@
 #ifndef BDE_IOCTL_H
 #define BDE_IOCTL_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/ioctl.h>
 
@@ -12,6 +13,49 @@
 #define NOS_BDE_WRITE_REG    _IOR(NOS_BDE_MAGIC, 2, struct nos_bde_reg)
 #define NOS_BDE_GET_DMA_INFO _IOR(NOS_BDE_MAGIC, 3, struct nos_bde_dma_info)
 #define NOS_BDE_SCHAN_OP     _IOWR(NOS_BDE_MAGIC, 4, struct nos_bde_schan)
+#define NOS_BDE_SCHAN_BATCH  _IOWR(NOS_BDE_MAGIC, 5, struct nos_bde_schan_batch)
+#define NOS_BDE_SCHAN_RING   _IOWR(NOS_BDE_MAGIC, 6, struct nos_bde_schan_ring)
+#define NOS_BDE_TDMA         _IOWR(NOS_BDE_MAGIC, 7, struct nos_bde_tdma)
+#define NOS_BDE_SLAM         _IOWR(NOS_BDE_MAGIC, 8, struct nos_bde_tdma)
+#define NOS_BDE_SCHAN_STATS  _IOWR(NOS_BDE_MAGIC, 9, struct nos_bde_stats_req)
+#define NOS_BDE_SQ_SETUP     _IOWR(NOS_BDE_MAGIC, 10, struct nos_bde_sq_setup)
+#define NOS_BDE_SQ_DOORBELL  _IO(NOS_BDE_MAGIC, 11)
+
+#define NOS_BDE_SCHAN_BATCH_MAX    256   /* ops per SCHAN_BATCH ioctl */
+#define NOS_BDE_SCHAN_RING_MAX     4096  /* ops per SCHAN_RING ioctl */
+#define NOS_BDE_BATCH_STOP_ON_ERR  0x1u
+#define NOS_BDE_TDMA_MAX_WORDS     14    /* entry words per TDMA entry */
+#define NOS_BDE_STATS_RESET        0x1u  /* SCHAN_STATS: clear after reading */
+
+/* mmap offset of the BAR0 CMIC register window (first 4KB of BAR0) */
+#define NOS_BDE_MMAP_BAR0_OFFSET   0x10000000u
+#define NOS_BDE_BAR0_MMAP_SIZE     0x1000u
+/*
+ * Registers in that window that stay ioctl-only: the kernel BDE owns them
+ * under its schan_mutex and in the SCHAN done-IRQ wait, and a 4KB page
+ * cannot fence them off, so bde_read_reg/bde_write_reg never touch them
+ * through the mapping.  [LO, HI) byte ranges:
+ *   0x000-0x057  SCHAN_D(0..21) message words, SCHAN_CTRL 0x50 (also MIIM)
+ *   0x10c        CMIC_SCHAN_RING_CFG
+ *   0x144-0x14b  CMIC_IRQ_STAT, CMIC_IRQ_MASK
+ * The exception is a load of SCHAN_CTRL: it has no side effects, and the
+ * MIIM done-poll reads it, so only its writes take the ioctl.
+ */
+#define NOS_BDE_MMIO_SCHAN_CTRL    0x050u  /* MMIO reads allowed */
+#define NOS_BDE_MMIO_DENY_SCHAN_LO 0x000u
+#define NOS_BDE_MMIO_DENY_SCHAN_HI 0x058u
+#define NOS_BDE_MMIO_DENY_RING_LO  0x10cu
+#define NOS_BDE_MMIO_DENY_RING_HI  0x110u
+#define NOS_BDE_MMIO_DENY_IRQ_LO   0x144u
+#define NOS_BDE_MMIO_DENY_IRQ_HI   0x14cu
+
+/* SCHAN_RING engines (nos_bde_schan_ring.engine) */
+#define NOS_BDE_RING_ENGINE_PIO    0u    /* kernel drains the ring via PIO */
+#define NOS_BDE_RING_ENGINE_HW     1u    /* CMIC SCHAN DMA ring (not yet supported) */
+#define NOS_BDE_RING_ENGINE_SW     2u    /* userspace stand-in (no kernel support) */
+
+#define NOS_BDE_SQ_MAX             4096  /* SQ/CQ entries (power of two) */
+#define NOS_BDE_SQ_NEED_WAKEUP     0x1u  /* ring flags: worker asleep, ring doorbell */
 
 struct nos_bde_reg {
 	uint32_t offset;
@@ -30,6 +74,111 @@ struct nos_bde_schan {
 	int32_t  status;
 };
 
+/* One op of a SCHAN_BATCH vector; status is filled per op by the kernel. */
+struct nos_bde_schan_batch_op {
+	uint32_t cmd[16];
+	uint32_t data[16];
+	int32_t  cmd_words;
+	int32_t  data_words;  /* response words to read back (0..16) */
+	int32_t  status;
+	uint32_t pad;
+};
+
+struct nos_bde_schan_batch {
+	uint64_t ops;     /* pointer to nos_bde_schan_batch_op[count] */
+	uint32_t count;
+	uint32_t flags;   /* NOS_BDE_BATCH_* */
+	uint32_t done;    /* out: ops executed */
+	uint32_t failed;  /* out: ops with status != 0 */
+};
+
+/* SCHAN_RING: nos_bde_schan_batch_op[count] resident in the DMA pool */
+struct nos_bde_schan_ring {
+	uint32_t offset;  /* byte offset of ops[0] in the DMA pool */
+	uint32_t count;
+	uint32_t flags;   /* NOS_BDE_BATCH_* */
+	uint32_t done;    /* out: ops executed */
+	uint32_t failed;  /* out: ops with status != 0 */
+	uint32_t engine;  /* out: NOS_BDE_RING_ENGINE_* */
+};
+
+/* TDMA (read) / SLAM (write): table range <-> DMA pool */
+struct nos_bde_tdma {
+	uint32_t hdr;          /* SCHAN READ_MEM/WRITE_MEM header for one entry */
+	uint32_t addr;         /* SBUS address of the first entry */
+	uint32_t count;        /* entries */
+	uint32_t entry_words;  /* 1..NOS_BDE_TDMA_MAX_WORDS */
+	uint32_t offset;       /* byte offset of entry 0 in the DMA pool */
+	uint32_t flags;
+	uint32_t done;         /* out: entries transferred */
+	int32_t  status;       /* out: status of the failing entry, 0 if none */
+};
+
+struct nos_bde_stats_req {
+	uint64_t buf;    /* struct nos_bde_schan_stats */
+	uint32_t len;    /* in: buffer size, out: bytes copied */
+	uint32_t flags;  /* NOS_BDE_STATS_RESET */
+};
+
+/*
+ * Shared SCHAN submission/completion queues (SQ_SETUP).  In the DMA pool at
+ * offset: struct nos_bde_sq_ring, sqe[entries], cqe[entries].  Indices are
+ * free-running (slot = index & (entries - 1)); userspace owns sq_tail and
+ * cq_head, the kernel SQ worker sq_head and cq_tail.
+ */
+struct nos_bde_sq_setup {
+	uint32_t offset;   /* byte offset of struct nos_bde_sq_ring in the pool */
+	uint32_t entries;  /* power of two, 0 = tear down */
+	int32_t  eventfd;  /* signalled with the number of new CQEs, -1 = none */
+	uint32_t flags;
+};
+
+struct nos_bde_sq_ring {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint32_t entries;
+	uint32_t flags;    /* NOS_BDE_SQ_NEED_WAKEUP */
+	uint32_t pad[10];
+};
+
+struct nos_bde_sqe {
+	struct nos_bde_schan_batch_op op;
+	uint64_t user_data;
+};
+
+struct nos_bde_cqe {
+	uint64_t user_data;
+	int32_t  status;
+	uint32_t pad;
+	uint32_t data[16];  /* response words (op.data_words of them) */
+};
+
+/*
+ * SCHAN telemetry — must match struct nos_bde_schan_stats in
+ * bde/nos_kernel_bde.c.  Histogram bucket b counts [2^b, 2^(b+1)) ns.
+ */
+#define NOS_BDE_STATS_OPCODES  64
+#define NOS_BDE_STATS_BLOCKS   64
+#define NOS_BDE_STATS_HIST     32
+
+struct nos_bde_schan_stats {
+	uint64_t ops;
+	uint64_t timeouts;       /* no DONE within SCHAN_POLL_MS */
+	uint64_t sbus_timeouts;  /* SCHAN_CTRL bit 22 */
+	uint64_t naks;           /* SCHAN_CTRL bit 21 */
+	uint64_t resp_errors;    /* response header ERR/NACK */
+	uint64_t irq_missed;
+	uint64_t op_count[NOS_BDE_STATS_OPCODES];
+	uint64_t op_errors[NOS_BDE_STATS_OPCODES];
+	uint64_t blk_count[NOS_BDE_STATS_BLOCKS];
+	uint64_t blk_errors[NOS_BDE_STATS_BLOCKS];
+	uint64_t blk_ns[NOS_BDE_STATS_BLOCKS];
+	uint64_t lat_hist[NOS_BDE_STATS_HIST];
+	uint64_t wait_hist[NOS_BDE_STATS_HIST];
+};
+
 /* BDE layer API (implemented in bde_ioctl.c) */
 int bde_open(void);
 void bde_close(void);
@@ -37,6 +186,24 @@ int bde_read_reg(uint32_t offset, uint32_t *value);
 int bde_write_reg(uint32_t offset, uint32_t value);
 int bde_get_dma_info(uint64_t *pbase, uint32_t *size);
 void *bde_mmap_dma(void);
+void *bde_dma_alloc(size_t size, size_t align);
+uint64_t bde_dma_phys(const void *p);
+uint32_t bde_dma_offset(const void *p);
+int bde_dma_contains(const void *p, size_t len);
 int bde_schan_op(const uint32_t *cmd, int cmd_words, uint32_t *data, int data_len, int *status);
+int bde_schan_batch(struct nos_bde_schan_batch_op *ops, int count, uint32_t flags);
+int bde_schan_ring(struct nos_bde_schan_batch_op *ring, int count, uint32_t flags,
+		   uint32_t *engine);
+int bde_tdma_read(uint32_t hdr, uint32_t addr, int count, int entry_words,
+		  uint32_t *dst, int *status);
+int bde_schan_stats(struct nos_bde_schan_stats *st, int reset);
+int bde_slam_write(uint32_t hdr, uint32_t addr, int count, int entry_words,
+		   const uint32_t *src, int *status);
+int bde_sq_setup(int entries, uint32_t *engine);
+int bde_sq_space(void);
+int bde_sq_push(const struct nos_bde_schan_batch_op *op, uint64_t user_data);
+void bde_sq_kick(void);
+int bde_cq_pop(struct nos_bde_cqe *cqe);
+int bde_cq_wait(int timeout_ms);
 
 #endif
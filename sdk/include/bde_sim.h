@@ -0,0 +1,66 @@
+#ifndef BDE_SIM_H
+#define BDE_SIM_H
+
+#include <stdint.h>
+
+/*
+ * In-process BCM56846 simulator backend (bde_sim.c).  Linked instead of
+ * bde_ioctl.c (libbcm56846_sim), it implements the bde_ioctl.h API without
+ * /dev/nos-bde: BAR0 registers with the MIIM/Warpcore handshake, a heap DMA
+ * pool, and an SCHAN engine over modeled SBUS memories (L2_ENTRY,
+ * L2_USER_ENTRY, L3_DEFIP, EGR_L3_INTF, ING/EGR_L3_NEXT_HOP, L3_ECMP,
+ * L3_ECMP_GROUP, VLAN, EGR_VLAN) plus a sparse store for everything else
+ * (registers, XLMAC counters).  The hooks below let tests and benchmarks
+ * inspect the model; none of them issue SCHAN ops.
+ */
+
+/* Clear every table, register and counter (also done by bde_open()). */
+void bde_sim_reset(void);
+
+/* SCHAN ops executed since the last reset (batched ops count one each). */
+uint64_t bde_sim_op_count(void);
+
+/* Make every READ_REG/READ_MEM of SBUS address addr time out (0 = none). */
+void bde_sim_read_fail(uint32_t addr);
+
+/* Copy nwords of the SBUS memory/register at addr (addr = base + index). */
+int bde_sim_mem_get(uint32_t addr, uint32_t *words, int nwords);
+
+/* L2_ENTRY exact match on (MAC, VLAN).  0 and *port, or -ENOENT. */
+int bde_sim_l2_lookup(const uint8_t mac[6], uint16_t vid, int *port);
+
+/*
+ * A frame with source (mac, vid) arrives on port: a known entry gets HITSA
+ * set; with learning on for the port (PORT_TAB CML_FLAGS_NEW/MOVE) the
+ * pipeline installs the entry in its bucket or moves it, and queues a
+ * learn/move L2_MOD_FIFO record.  1 if learned or moved, 0 if not, -ENOSPC
+ * when the bucket is full.
+ */
+int bde_sim_l2_learn(const uint8_t mac[6], uint16_t vid, int port);
+
+/* Hardware age-out of a non-static entry (queues an age record).  0 or -ENOENT. */
+int bde_sim_l2_age(const uint8_t mac[6], uint16_t vid);
+
+/*
+ * IPv4 unicast lookup as the pipeline does it: an exact L3_ENTRY host
+ * match, else the first matching L3_DEFIP entry in index order (TCAM
+ * priority) with the ECMP member by address hash, then ING/EGR_L3_NEXT_HOP
+ * and EGR_L3_INTF; sets the matched entry's hit bit (HIT or HIT0).  ip
+ * is in host byte order.  Any of port, mac, vid may be NULL.  0, or -ENOENT
+ * if no route matches.
+ */
+int bde_sim_l3_lookup(uint32_t ip, int *port, uint8_t mac[6], uint16_t *vid);
+/*
+ * IPv6 the same way: L3_ENTRY host, else L3_DEFIP_128, else double-wide
+ * L3_DEFIP (first match each).  ip is host-order words, ip[0] most
+ * significant.
+ */
+int bde_sim_l3_lookup6(const uint32_t ip[4], int *port, uint8_t mac[6], uint16_t *vid);
+
+/* 1 if port is in vid's ingress and egress bitmaps (*untagged set), else 0. */
+int bde_sim_vlan_member(uint16_t vid, int port, int *untagged);
+
+/* Count traffic on port (1..52) in its XLMAC RPKT/RBYT (rx) or TPKT/TBYT. */
+int bde_sim_port_count(int port, int rx, uint64_t pkts, uint64_t bytes);
+
+#endif
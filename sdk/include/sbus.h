@@ -2,6 +2,7 @@
 #ifndef SBUS_H
 #define SBUS_H
 
+#include "bde_ioctl.h"
 #include <stdint.h>
 
 /* 32-bit register access */
@@ -9,6 +10,16 @@ int sbus_reg_write(uint32_t addr, uint32_t value);
 int sbus_reg_read(uint32_t addr, uint32_t *value);
 int sbus_reg_modify(uint32_t addr, uint32_t mask, uint32_t value);
 
+/*
+ * Register shadow cache (write-through).  sbus_reg_modify() uses it to skip
+ * the read; registers changed by hardware must be marked volatile.
+ */
+int sbus_reg_cache_get(uint32_t addr, uint32_t *value);
+void sbus_reg_cache_put(uint32_t addr, uint32_t value);
+void sbus_reg_cache_invalidate(uint32_t addr);
+void sbus_reg_cache_invalidate_all(void);
+void sbus_reg_cache_volatile(uint32_t addr);
+
 /* 64-bit register access */
 int sbus_reg_write64(uint32_t addr, const uint32_t *data);
 int sbus_reg_read64(uint32_t addr, uint32_t *data);
@@ -29,4 +40,99 @@ int sbus_mem_read_blk(uint32_t block, uint32_t addr, int index,
 /* Per-port address encoding (CDK block/port format) */
 uint32_t cdk_port_addr(uint32_t base, int port);
 
+/*
+ * Batched SCHAN submission.  Ops are queued in the batch and issued with a
+ * single NOS_BDE_SCHAN_BATCH ioctl by sbus_batch_submit(), or automatically
+ * when the queue fills.  Read results are copied to the caller's buffers at
+ * submit time.  After a submit, sbus_batch_status(b, i) gives the status of
+ * op i of that submission (0 = OK); b->errors counts failed ops since init.
+ */
+#define SBUS_BATCH_OPS  64
+
+typedef struct {
+	struct nos_bde_schan_batch_op ops[SBUS_BATCH_OPS];
+	uint32_t *rdst[SBUS_BATCH_OPS];  /* read destination, NULL for writes */
+	int       rwords[SBUS_BATCH_OPS];
+	int       count;      /* ops queued, not yet submitted */
+	int       submitted;  /* ops in the last submission */
+	int       errors;     /* failed ops since sbus_batch_init() */
+} sbus_batch_t;
+
+void sbus_batch_init(sbus_batch_t *b);
+int sbus_batch_reg_write(sbus_batch_t *b, uint32_t addr, uint32_t value);
+int sbus_batch_reg_write64(sbus_batch_t *b, uint32_t addr, const uint32_t *data);
+int sbus_batch_reg_read(sbus_batch_t *b, uint32_t addr, uint32_t *value);
+int sbus_batch_mem_write(sbus_batch_t *b, uint32_t addr, int index,
+			 const uint32_t *data, int nwords);
+int sbus_batch_mem_read(sbus_batch_t *b, uint32_t addr, int index,
+			uint32_t *data, int nwords);
+int sbus_batch_submit(sbus_batch_t *b);
+int sbus_batch_status(const sbus_batch_t *b, int i);
+
+/*
+ * Stage batches in a SCHAN message ring in the DMA pool (NOS_BDE_SCHAN_RING)
+ * instead of the SCHAN_BATCH ioctl.  Enabled by "schan_ring=1" in config.bcm.
+ */
+int sbus_ring_enable(int enable);
+
+/*
+ * Asynchronous SCHAN (io_uring-style SQ/CQ shared with the kernel BDE).
+ * sbus_submit() queues the ops of a batch as one tagged submission and
+ * returns at once; the kernel SQ worker runs them while the caller goes on.
+ * sbus_reap() returns finished submissions in order, with the status of the
+ * first failing op; read results land in the batch's read destinations.
+ * Without kernel support the queue is drained through SCHAN_BATCH at submit.
+ */
+#define SBUS_SQ_ENTRIES  512  /* SQ/CQ slots (ops in flight) */
+#define SBUS_SQ_SUBS     256  /* unreaped submissions */
+
+typedef struct {
+	uint64_t tag;
+	int      ops;
+	int      status;  /* 0, or status of the first failing op */
+} sbus_cqe_t;
+
+int sbus_submit(sbus_batch_t *b, uint64_t tag);
+int sbus_reap(sbus_cqe_t *cqe, int max, int timeout_ms);
+int sbus_inflight(void);
+
+/*
+ * Hashed table ops: the ASIC picks the bucket slot (TABLE_INSERT, which
+ * replaces an entry with the same key), removes (TABLE_DELETE) or finds
+ * (TABLE_LOOKUP) the entry matching the key fields, in one SCHAN op.
+ * addr is the table base; *index gets the slot.  Return 0, -ENOENT (no
+ * such key), -ENOSPC (bucket full), -ENOTSUP (op NACKed for this memory)
+ * or -EIO.
+ */
+int sbus_table_insert(uint32_t addr, const uint32_t *entry, int nwords, int *index);
+int sbus_table_delete(uint32_t addr, const uint32_t *key, int nwords, int *index);
+int sbus_table_lookup(uint32_t addr, const uint32_t *key, int nwords,
+		      uint32_t *entry, int *index);
+
+/*
+ * Bulk table read.  sbus_mem_read_range() streams count entries into data
+ * (one TDMA ioctl when data is in the DMA pool, batched READ_MEM otherwise).
+ * sbus_mem_view() reads into a shared DMA-pool buffer and returns a
+ * zero-copy view; the caller owns the buffer until it calls
+ * sbus_mem_view_release() (another view meanwhile blocks, so release
+ * before anything that may take a view, e.g. under another lock).
+ */
+#define SBUS_TDMA_BUF_BYTES  (2u * 1024u * 1024u)  /* full L2_ENTRY: 128K x 16B */
+
+int sbus_mem_read_range(uint32_t addr, int index, int count, uint32_t *data,
+			int nwords);
+const uint32_t *sbus_mem_view(uint32_t addr, int index, int count, int nwords);
+void sbus_mem_view_release(void);
+
+/*
+ * Bulk table write (SLAM).  sbus_mem_slam() writes count packed entries in
+ * one SLAM ioctl per SBUS_SLAM_BUF_BYTES (batched WRITE_MEM without BDE
+ * support).  Packing straight into sbus_slam_buf() avoids the staging copy.
+ */
+#define SBUS_SLAM_BUF_BYTES  (512u * 1024u)  /* full VLAN table: 4K x 40B */
+
+int sbus_mem_slam(uint32_t addr, int index, int count, const uint32_t *data,
+		  int nwords);
+uint32_t *sbus_slam_buf(int count, int nwords);
+
 #endif
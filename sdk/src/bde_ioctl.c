@@ -5,36 +5,118 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <endian.h>
 #include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 
 static int bde_fd = -1;
 static void *bde_dma_base = MAP_FAILED;
 static size_t bde_dma_size = 0;
+static uint64_t bde_dma_pbase;
+static size_t bde_dma_off;
+/* Pool mapping and bump pointer: pktio, fdb_sync and netlink threads allocate */
+static pthread_mutex_t bde_dma_lock = PTHREAD_MUTEX_INITIALIZER;
+static int bde_ring_ioctl_ok = 1;
+static volatile uint32_t *bde_bar0_mmio;  /* CMIC window, NULL = ioctl only */
+
+/* Shared SCHAN SQ/CQ (bde_sq_setup); bde_sq_kernel = 0 for the stand-in */
+static struct nos_bde_sq_ring *bde_sq;
+static struct nos_bde_sqe *bde_sqes;
+static struct nos_bde_cqe *bde_cqes;
+static uint32_t bde_sq_mask;
+static int bde_sq_kernel;
+static int bde_sq_heap;     /* no DMA pool: queues in the heap (stand-in only) */
+static int bde_sq_efd = -1;
+
+/*
+ * Map the BAR0 CMIC register window for syscall-free access.  Registers are
+ * little-endian on PCI; the host may be big-endian (PPC32), hence le32toh.
+ * A BDE without BAR0 mmap support leaves bde_bar0_mmio NULL (ioctl path).
+ */
+static void bde_map_bar0(void)
+{
+	void *p = mmap(NULL, NOS_BDE_BAR0_MMAP_SIZE, PROT_READ | PROT_WRITE,
+		       MAP_SHARED, bde_fd, (off_t)NOS_BDE_MMAP_BAR0_OFFSET);
+
+	if (p != MAP_FAILED)
+		bde_bar0_mmio = (volatile uint32_t *)p;
+}
 
 int bde_open(void)
 {
 	if (bde_fd >= 0)
 		return 0;
 	bde_fd = open(NOS_BDE_DEVICE, O_RDWR);
-	return bde_fd >= 0 ? 0 : -1;
+	if (bde_fd < 0)
+		return -1;
+	bde_map_bar0();
+	return 0;
 }
 
 void bde_close(void)
 {
+	if (bde_sq_efd >= 0) {
+		close(bde_sq_efd);
+		bde_sq_efd = -1;
+	}
+	if (bde_sq_heap)
+		free(bde_sq);
+	bde_sq = NULL;
+	bde_sq_heap = 0;
+	bde_sq_kernel = 0;
+	if (bde_bar0_mmio) {
+		munmap((void *)bde_bar0_mmio, NOS_BDE_BAR0_MMAP_SIZE);
+		bde_bar0_mmio = NULL;
+	}
+	pthread_mutex_lock(&bde_dma_lock);
 	if (bde_dma_base != MAP_FAILED && bde_dma_base != NULL) {
 		munmap(bde_dma_base, bde_dma_size);
 		bde_dma_base = MAP_FAILED;
 		bde_dma_size = 0;
+		bde_dma_off = 0;
 	}
+	pthread_mutex_unlock(&bde_dma_lock);
 	if (bde_fd >= 0) {
 		close(bde_fd);
 		bde_fd = -1;
 	}
 }
 
+/*
+ * CMIC register access.  Offsets inside the mmapped CMIC window are direct
+ * MMIO loads/stores (full barrier around each so polling loops observe
+ * ordering like the ioread32/iowrite32 ioctl path), except the SCHAN, ring
+ * and IRQ registers the kernel serializes (NOS_BDE_MMIO_DENY_*; SCHAN_CTRL
+ * only for writes); those and everything else go through the
+ * READ_REG/WRITE_REG ioctls.
+ */
+static int bde_reg_mmio_ok(uint32_t offset, int write)
+{
+	if (!bde_bar0_mmio || offset >= NOS_BDE_BAR0_MMAP_SIZE || (offset & 3))
+		return 0;
+	if (!write && offset == NOS_BDE_MMIO_SCHAN_CTRL)
+		return 1;
+	if (offset < NOS_BDE_MMIO_DENY_SCHAN_HI)
+		return 0;
+	if (offset >= NOS_BDE_MMIO_DENY_RING_LO && offset < NOS_BDE_MMIO_DENY_RING_HI)
+		return 0;
+	if (offset >= NOS_BDE_MMIO_DENY_IRQ_LO && offset < NOS_BDE_MMIO_DENY_IRQ_HI)
+		return 0;
+	return 1;
+}
+
 int bde_read_reg(uint32_t offset, uint32_t *value)
 {
 	struct nos_bde_reg r = { .offset = offset, .value = 0 };
+
+	if (bde_reg_mmio_ok(offset, 0)) {
+		__sync_synchronize();
+		*value = le32toh(bde_bar0_mmio[offset / 4]);
+		__sync_synchronize();
+		return 0;
+	}
 	if (bde_fd < 0 || ioctl(bde_fd, NOS_BDE_READ_REG, &r) < 0)
 		return -1;
 	*value = r.value;
@@ -44,6 +126,13 @@ int bde_read_reg(uint32_t offset, uint32_t *value)
 int bde_write_reg(uint32_t offset, uint32_t value)
 {
 	struct nos_bde_reg r = { .offset = offset, .value = value };
+
+	if (bde_reg_mmio_ok(offset, 1)) {
+		__sync_synchronize();
+		bde_bar0_mmio[offset / 4] = htole32(value);
+		__sync_synchronize();
+		return 0;
+	}
 	return (bde_fd >= 0 && ioctl(bde_fd, NOS_BDE_WRITE_REG, &r) == 0) ? 0 : -1;
 }
 
@@ -57,7 +146,8 @@ int bde_get_dma_info(uint64_t *pbase, uint32_t *size)
 	return 0;
 }
 
-void *bde_mmap_dma(void)
+/* Map the DMA pool on first use (bde_dma_lock held). */
+static void *bde_mmap_dma_locked(void)
 {
 	uint64_t pbase;
 	uint32_t size;
@@ -69,9 +159,73 @@ void *bde_mmap_dma(void)
 	if (bde_dma_base == MAP_FAILED)
 		return NULL;
 	bde_dma_size = size;
+	bde_dma_pbase = pbase;
 	return bde_dma_base;
 }
 
+void *bde_mmap_dma(void)
+{
+	void *base;
+
+	pthread_mutex_lock(&bde_dma_lock);
+	base = bde_mmap_dma_locked();
+	pthread_mutex_unlock(&bde_dma_lock);
+	return base;
+}
+
+/*
+ * Bump allocator over the mmapped DMA pool, shared by every SDK user of the
+ * pool (packet DCBs/buffers, SCHAN ring) so their regions never overlap.
+ * Nothing is freed; allocations live until bde_close().  align must be a
+ * power of two.  Callers on different threads hold different subsystem
+ * locks, so the allocator takes its own.
+ */
+void *bde_dma_alloc(size_t size, size_t align)
+{
+	uintptr_t p, a;
+
+	pthread_mutex_lock(&bde_dma_lock);
+	if (!bde_mmap_dma_locked()) {
+		pthread_mutex_unlock(&bde_dma_lock);
+		return NULL;
+	}
+	/* Leave space for any kernel/BDE scratch at start. */
+	if (bde_dma_off < 4096)
+		bde_dma_off = 4096;
+
+	p = (uintptr_t)bde_dma_base + bde_dma_off;
+	a = (p + (align - 1)) & ~(uintptr_t)(align - 1);
+	if (a + size > (uintptr_t)bde_dma_base + bde_dma_size) {
+		pthread_mutex_unlock(&bde_dma_lock);
+		return NULL;
+	}
+	bde_dma_off = (size_t)(a - (uintptr_t)bde_dma_base + size);
+	pthread_mutex_unlock(&bde_dma_lock);
+	return (void *)a;
+}
+
+/* Byte offset of p within the DMA pool (p must come from bde_dma_alloc). */
+uint32_t bde_dma_offset(const void *p)
+{
+	return (uint32_t)((uintptr_t)p - (uintptr_t)bde_dma_base);
+}
+
+/* Nonzero if [p, p + len) lies inside the mmapped DMA pool. */
+int bde_dma_contains(const void *p, size_t len)
+{
+	uintptr_t a = (uintptr_t)p, base = (uintptr_t)bde_dma_base;
+
+	if (bde_dma_base == MAP_FAILED || bde_dma_base == NULL || bde_dma_size == 0)
+		return 0;
+	return a >= base && len <= bde_dma_size && a - base <= bde_dma_size - len;
+}
+
+/* Bus address of p within the DMA pool, for descriptors the CMIC reads. */
+uint64_t bde_dma_phys(const void *p)
+{
+	return bde_dma_pbase + bde_dma_offset(p);
+}
+
 int bde_schan_op(const uint32_t *cmd, int cmd_words, uint32_t *data, int data_len, int *status)
 {
 	struct nos_bde_schan s = { .len = cmd_words, .status = -1 };
@@ -91,3 +245,339 @@ int bde_schan_op(const uint32_t *cmd, int cmd_words, uint32_t *data, int data_le
 		memcpy(data, s.data, sizeof(uint32_t) * (size_t)(data_len <= 16 ? data_len : 16));
 	return 0;
 }
+
+/*
+ * Run count SCHAN ops in one NOS_BDE_SCHAN_BATCH ioctl (one syscall, one
+ * kernel schan_mutex hold).  Per-op status lands in ops[i].status.
+ * Falls back to one SCHAN_OP per entry on a kernel BDE without the batch
+ * ioctl.  Returns the number of ops executed, or -1 on transport error.
+ */
+int bde_schan_batch(struct nos_bde_schan_batch_op *ops, int count, uint32_t flags)
+{
+	struct nos_bde_schan_batch b;
+	int done = 0;
+
+	if (bde_fd < 0 || !ops || count <= 0)
+		return -1;
+
+	while (done < count) {
+		int n = count - done;
+
+		if (n > NOS_BDE_SCHAN_BATCH_MAX)
+			n = NOS_BDE_SCHAN_BATCH_MAX;
+		memset(&b, 0, sizeof(b));
+		b.ops = (uint64_t)(uintptr_t)&ops[done];
+		b.count = (uint32_t)n;
+		b.flags = flags;
+		if (ioctl(bde_fd, NOS_BDE_SCHAN_BATCH, &b) < 0) {
+			if (errno != ENOTTY)
+				return -1;
+			break; /* old kernel BDE: per-op fallback below */
+		}
+		done += (int)b.done;
+		if (b.done < (uint32_t)n)
+			return done; /* stopped on error */
+	}
+
+	for (; done < count; done++) {
+		struct nos_bde_schan_batch_op *op = &ops[done];
+		struct nos_bde_schan s = { .len = op->cmd_words, .status = -1 };
+
+		if (op->cmd_words <= 0 || op->cmd_words > 16)
+			return -1;
+		memcpy(s.cmd, op->cmd, sizeof(s.cmd));
+		if (ioctl(bde_fd, NOS_BDE_SCHAN_OP, &s) < 0)
+			return -1;
+		op->status = s.status;
+		if (op->data_words > 0)
+			memcpy(op->data, s.data, sizeof(uint32_t) *
+			       (size_t)(op->data_words <= 16 ? op->data_words : 16));
+		if (op->status != 0 && (flags & NOS_BDE_BATCH_STOP_ON_ERR))
+			return done + 1;
+	}
+	return done;
+}
+
+/*
+ * Run count SCHAN ops queued in a DMA-pool ring (from bde_dma_alloc) with
+ * one NOS_BDE_SCHAN_RING ioctl.  The kernel writes status/response words
+ * back into the ring entries and reports the engine used in *engine.
+ *
+ * On a kernel BDE without the ring ioctl the ring is drained from
+ * userspace through bde_schan_batch() (NOS_BDE_RING_ENGINE_SW), so the same
+ * ring format is exercised either way.  Returns ops executed, or -1.
+ */
+int bde_schan_ring(struct nos_bde_schan_batch_op *ring, int count, uint32_t flags,
+		   uint32_t *engine)
+{
+	struct nos_bde_schan_ring r;
+	int done = 0;
+
+	if (bde_fd < 0 || !ring || count <= 0)
+		return -1;
+
+	while (bde_ring_ioctl_ok && done < count) {
+		int n = count - done;
+
+		if (n > NOS_BDE_SCHAN_RING_MAX)
+			n = NOS_BDE_SCHAN_RING_MAX;
+		memset(&r, 0, sizeof(r));
+		r.offset = bde_dma_offset(&ring[done]);
+		r.count = (uint32_t)n;
+		r.flags = flags;
+		if (ioctl(bde_fd, NOS_BDE_SCHAN_RING, &r) < 0) {
+			if (errno != ENOTTY)
+				return -1;
+			bde_ring_ioctl_ok = 0; /* old kernel BDE: stand-in below */
+			break;
+		}
+		if (engine)
+			*engine = r.engine;
+		done += (int)r.done;
+		if (r.done < (uint32_t)n)
+			return done; /* stopped on error */
+	}
+	if (done < count) {
+		int n = bde_schan_batch(&ring[done], count - done, flags);
+
+		if (n < 0)
+			return -1;
+		if (engine)
+			*engine = NOS_BDE_RING_ENGINE_SW;
+		done += n;
+	}
+	return done;
+}
+
+static int bde_tdma_xfer(unsigned long req, uint32_t hdr, uint32_t addr, int count,
+			 int entry_words, const uint32_t *buf, int *status)
+{
+	struct nos_bde_tdma t;
+
+	if (bde_fd < 0 || count <= 0 || entry_words <= 0 ||
+	    entry_words > NOS_BDE_TDMA_MAX_WORDS ||
+	    !bde_dma_contains(buf, sizeof(uint32_t) * (size_t)count * (size_t)entry_words)) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&t, 0, sizeof(t));
+	t.hdr = hdr;
+	t.addr = addr;
+	t.count = (uint32_t)count;
+	t.entry_words = (uint32_t)entry_words;
+	t.offset = bde_dma_offset(buf);
+	if (ioctl(bde_fd, req, &t) < 0)
+		return -1;
+	*status = t.status;
+	return (int)t.done;
+}
+
+/*
+ * Read count table entries starting at SBUS address addr into dst with one
+ * NOS_BDE_TDMA ioctl.  dst must lie in the DMA pool (bde_dma_alloc).
+ * hdr is the SCHAN READ_MEM header for one entry.  Returns entries read
+ * (fewer than count if *status != 0), or -1 with errno set; ENOTTY means the
+ * kernel BDE has no TDMA support.
+ */
+int bde_tdma_read(uint32_t hdr, uint32_t addr, int count, int entry_words,
+		  uint32_t *dst, int *status)
+{
+	return bde_tdma_xfer(NOS_BDE_TDMA, hdr, addr, count, entry_words, dst, status);
+}
+
+/*
+ * Write count packed table entries from src (in the DMA pool) starting at
+ * SBUS address addr with one NOS_BDE_SLAM ioctl.  hdr is the SCHAN
+ * WRITE_MEM header for one entry.  Same return convention as bde_tdma_read().
+ */
+int bde_slam_write(uint32_t hdr, uint32_t addr, int count, int entry_words,
+		   const uint32_t *src, int *status)
+{
+	return bde_tdma_xfer(NOS_BDE_SLAM, hdr, addr, count, entry_words, src, status);
+}
+
+/* Read the kernel SCHAN telemetry; reset != 0 clears it afterwards. */
+int bde_schan_stats(struct nos_bde_schan_stats *st, int reset)
+{
+	struct nos_bde_stats_req req;
+
+	if (bde_fd < 0 || !st)
+		return -1;
+	memset(st, 0, sizeof(*st));
+	memset(&req, 0, sizeof(req));
+	req.buf = (uint64_t)(uintptr_t)st;
+	req.len = (uint32_t)sizeof(*st);
+	req.flags = reset ? NOS_BDE_STATS_RESET : 0;
+	return ioctl(bde_fd, NOS_BDE_SCHAN_STATS, &req) < 0 ? -1 : 0;
+}
+
+/*
+ * ---- Shared SCHAN submission/completion queues ----
+ *
+ * bde_sq_setup() places an SQ/CQ pair of entries slots in the DMA pool and
+ * hands it to the kernel SQ worker (NOS_BDE_SQ_SETUP), which drains SQEs and
+ * posts CQEs without a syscall per op.  On a kernel BDE without the ioctl
+ * the queues live in the same layout and bde_sq_kick() drains them through
+ * bde_schan_batch() (NOS_BDE_RING_ENGINE_SW).  Single producer/consumer: the
+ * caller serializes bde_sq_* and bde_cq_* calls.
+ */
+int bde_sq_setup(int entries, uint32_t *engine)
+{
+	struct nos_bde_sq_setup s;
+	size_t bytes;
+
+	if (bde_fd < 0 || bde_sq || entries <= 0 || entries > NOS_BDE_SQ_MAX ||
+	    (entries & (entries - 1)))
+		return -1;
+	bytes = sizeof(*bde_sq) + (size_t)entries *
+		(sizeof(struct nos_bde_sqe) + sizeof(struct nos_bde_cqe));
+	bde_sq = bde_dma_alloc(bytes, 64);
+	if (bde_sq) {
+		bde_sq_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		memset(&s, 0, sizeof(s));
+		s.offset = bde_dma_offset(bde_sq);
+		s.entries = (uint32_t)entries;
+		s.eventfd = bde_sq_efd;
+		bde_sq_kernel = ioctl(bde_fd, NOS_BDE_SQ_SETUP, &s) == 0;
+		if (!bde_sq_kernel && errno != ENOTTY) {
+			if (bde_sq_efd >= 0)
+				close(bde_sq_efd);
+			bde_sq_efd = -1;
+			bde_sq = NULL; /* pool space is not reclaimed */
+			return -1;
+		}
+	} else {
+		bde_sq = calloc(1, bytes);
+		if (!bde_sq)
+			return -1;
+		bde_sq_heap = 1;
+		bde_sq_kernel = 0;
+	}
+	if (!bde_sq_kernel) {
+		if (bde_sq_efd >= 0)
+			close(bde_sq_efd);
+		bde_sq_efd = -1;
+		memset(bde_sq, 0, sizeof(*bde_sq));
+		bde_sq->entries = (uint32_t)entries;
+	}
+	bde_sqes = (struct nos_bde_sqe *)(bde_sq + 1);
+	bde_cqes = (struct nos_bde_cqe *)(bde_sqes + entries);
+	bde_sq_mask = (uint32_t)entries - 1;
+	if (engine)
+		*engine = bde_sq_kernel ? NOS_BDE_RING_ENGINE_PIO : NOS_BDE_RING_ENGINE_SW;
+	return 0;
+}
+
+/* Free SQE slots, counting ops whose CQE has not been popped yet. */
+int bde_sq_space(void)
+{
+	if (!bde_sq)
+		return 0;
+	return (int)(bde_sq_mask + 1) -
+	       (int)(bde_sq->sq_tail - __atomic_load_n(&bde_sq->cq_head, __ATOMIC_ACQUIRE));
+}
+
+/* Queue one op; it runs after the next bde_sq_kick().  -1 if full. */
+int bde_sq_push(const struct nos_bde_schan_batch_op *op, uint64_t user_data)
+{
+	struct nos_bde_sqe *sqe;
+	uint32_t tail;
+
+	if (bde_sq_space() <= 0)
+		return -1;
+	tail = bde_sq->sq_tail;
+	sqe = &bde_sqes[tail & bde_sq_mask];
+	memcpy(&sqe->op, op, sizeof(*op));
+	sqe->user_data = user_data;
+	__atomic_store_n(&bde_sq->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/* Stand-in engine: run every queued SQE through SCHAN_BATCH and post CQEs. */
+static void bde_sq_drain_sw(void)
+{
+	struct nos_bde_schan_batch_op ops[64];
+	uint64_t tags[64];
+	int i, n, done;
+
+	while (bde_sq->sq_head != bde_sq->sq_tail) {
+		for (n = 0; n < 64 && bde_sq->sq_head + (uint32_t)n != bde_sq->sq_tail; n++) {
+			struct nos_bde_sqe *sqe = &bde_sqes[(bde_sq->sq_head + (uint32_t)n) &
+							    bde_sq_mask];
+
+			ops[n] = sqe->op;
+			tags[n] = sqe->user_data;
+		}
+		done = bde_schan_batch(ops, n, 0);
+		for (i = 0; i < n; i++) {
+			struct nos_bde_cqe *cqe = &bde_cqes[bde_sq->cq_tail & bde_sq_mask];
+
+			cqe->user_data = tags[i];
+			cqe->status = i < done ? ops[i].status : -EIO;
+			memcpy(cqe->data, ops[i].data, sizeof(cqe->data));
+			bde_sq->cq_tail++;
+		}
+		bde_sq->sq_head += (uint32_t)n;
+	}
+}
+
+/*
+ * Make queued SQEs visible to the engine.  The kernel worker polls while
+ * busy, so this only costs a syscall once it has gone to sleep
+ * (NOS_BDE_SQ_NEED_WAKEUP); the stand-in drains synchronously here.
+ */
+void bde_sq_kick(void)
+{
+	if (!bde_sq)
+		return;
+	if (!bde_sq_kernel) {
+		bde_sq_drain_sw();
+		return;
+	}
+	/* Pairs with the worker's barrier between flags and sq_tail */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&bde_sq->flags, __ATOMIC_RELAXED) & NOS_BDE_SQ_NEED_WAKEUP)
+		(void)ioctl(bde_fd, NOS_BDE_SQ_DOORBELL);
+}
+
+/* Pop the next completion into *cqe.  Returns 1, or 0 if the CQ is empty. */
+int bde_cq_pop(struct nos_bde_cqe *cqe)
+{
+	uint32_t head;
+
+	if (!bde_sq)
+		return 0;
+	head = bde_sq->cq_head;
+	if (head == __atomic_load_n(&bde_sq->cq_tail, __ATOMIC_ACQUIRE))
+		return 0;
+	memcpy(cqe, &bde_cqes[head & bde_sq_mask], sizeof(*cqe));
+	__atomic_store_n(&bde_sq->cq_head, head + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/*
+ * Wait up to timeout_ms (-1 = forever) for the worker to post completions.
+ * Returns 1 if the CQ may have new entries, 0 on timeout.  Without an
+ * eventfd it naps and lets the caller re-poll.
+ */
+int bde_cq_wait(int timeout_ms)
+{
+	struct pollfd pfd;
+	uint64_t cnt;
+
+	if (!bde_sq || !bde_sq_kernel)
+		return 1;
+	if (bde_sq->cq_head != __atomic_load_n(&bde_sq->cq_tail, __ATOMIC_ACQUIRE))
+		return 1;
+	if (bde_sq_efd < 0) {
+		usleep(50);
+		return 1;
+	}
+	pfd.fd = bde_sq_efd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, timeout_ms) <= 0)
+		return 0;
+	(void)read(bde_sq_efd, &cnt, sizeof(cnt));
+	return 1;
+}
@@ -0,0 +1,1458 @@
+/*
+ * BDE simulator: the bde_ioctl.h API implemented in-process, for running the
+ * SDK and nos-switchd off-box (regression tests, benchmarks).  Links in place
+ * of bde_ioctl.c; see bde_sim.h for the model and the inspection hooks.
+ *
+ * - BAR0: a register file.  MIIM (CMIC_MIIM_*) completes immediately against
+ *   a per-PHY Warpcore register store with AER block/lane selection; the
+ *   firmware version and PLL lock read as loaded/locked so wc_phy_init()
+ *   skips the download.  Starting a DMA channel sets CMIC_DMA_STAT done.
+ * - DMA pool: 4MB from the heap with the same bump allocator.
+ * - SCHAN: READ/WRITE_REG and READ/WRITE_MEM against dense arrays for the
+ *   forwarding tables and a sparse store for everything else.  Batch, ring,
+ *   TDMA, SLAM and the SQ/CQ all run through the same engine synchronously.
+ *   Responses carry the ACK opcode; unknown opcodes answer with ERR set.
+ *   TABLE_INSERT/DELETE/LOOKUP hash L2_ENTRY keys into 8-entry buckets
+ *   (CRC32 upper, as HASH_CONTROL is programmed) and are NACKed for any
+ *   other memory.
+ * - Learning: bde_sim_l2_learn/age act as the ingress pipeline and push
+ *   L2_MOD_FIFO records through the FIFO read DMA channel into its ring.
+ */
+#include "bde_ioctl.h"
+#include "bde_sim.h"
+#include "bcm56846_regs.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_DMA_SIZE     (4u * 1024u * 1024u)
+#define SIM_DMA_PBASE    0x08000000ull  /* fake bus address for DCBs */
+#define SIM_BAR0_SIZE    0x40000u
+
+#define SIM_READ_MEM     0x07u
+#define SIM_WRITE_MEM    0x09u
+#define SIM_READ_REG     0x0Bu
+#define SIM_WRITE_REG    0x0Du
+#define SIM_TABLE_INSERT 0x24u
+#define SIM_TABLE_DELETE 0x26u
+#define SIM_TABLE_LOOKUP 0x28u
+#define SIM_RESP_ERR     0x40u          /* response header ERR (bit 6) */
+#define SIM_RESP_NACK    0x01u          /* response header NACK (bit 0) */
+
+/* Generic response word of the table ops: type << 20 | index */
+enum {
+	SIM_GEN_FOUND, SIM_GEN_NOT_FOUND, SIM_GEN_FULL,
+	SIM_GEN_INSERTED, SIM_GEN_REPLACED, SIM_GEN_DELETED
+};
+
+#define SIM_CELL_WORDS   14             /* NOS_BDE_TDMA_MAX_WORDS */
+#define SIM_KEY_SBUS     (1ull << 62)   /* | blk << 32 | addr */
+#define SIM_KEY_MDIO     (1ull << 61)   /* | bus << 40 | phy << 32 | lane << 16 | reg */
+
+/* Warpcore registers the SDK polls (serdes.c) and their simulated values */
+#define SIM_WC_AER_BLK       0x1f
+#define SIM_WC_AER_LANE      0x1e
+#define SIM_WC_AER_BROADCAST 0xffd0
+#define SIM_WC_XGXSSTATUS    0x8001     /* bit 11: PLL locked */
+#define SIM_WC_FW_VERSION    0x81f0
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sim_dma_lock = PTHREAD_MUTEX_INITIALIZER;  /* pool + bump pointer */
+static int sim_open;
+
+/* ---- Modeled SBUS memories (dense, index = addr - base) ---- */
+
+enum {
+	SIM_L2_ENTRY,
+	SIM_L2_USER_ENTRY,
+	SIM_L3_DEFIP,
+	SIM_L3_DEFIP_128,
+	SIM_L3_ENTRY,
+	SIM_EGR_L3_INTF,
+	SIM_ING_L3_NEXT_HOP,
+	SIM_EGR_L3_NEXT_HOP,
+	SIM_L3_ECMP,
+	SIM_L3_ECMP_GROUP,
+	SIM_VLAN,
+	SIM_EGR_VLAN,
+	SIM_NUM_MEMS
+};
+
+static struct sim_mem {
+	const char *name;
+	uint32_t base;
+	int entries;
+	int words;
+	uint32_t *data;
+} sim_mems[SIM_NUM_MEMS] = {
+	[SIM_L2_ENTRY]        = { "L2_ENTRY",        0x07120000u, 131072, 4 },
+	[SIM_L2_USER_ENTRY]   = { "L2_USER_ENTRY",   0x06168000u, 512,    5 },
+	[SIM_L3_DEFIP]        = { "L3_DEFIP",        0x0a170000u, 8192,   8 },
+	[SIM_L3_DEFIP_128]    = { "L3_DEFIP_128",    0x0a176000u, 256,    10 },
+	[SIM_L3_ENTRY]        = { "L3_ENTRY",        0x09000000u, 16384,  4 },
+	[SIM_EGR_L3_INTF]     = { "EGR_L3_INTF",     0x01264000u, 4096,   4 },
+	[SIM_ING_L3_NEXT_HOP] = { "ING_L3_NEXT_HOP", 0x0e17c000u, 16384,  2 },
+	[SIM_EGR_L3_NEXT_HOP] = { "EGR_L3_NEXT_HOP", 0x0c260000u, 16384,  4 },
+	[SIM_L3_ECMP]         = { "L3_ECMP",         0x0e176000u, 4096,   1 },
+	[SIM_L3_ECMP_GROUP]   = { "L3_ECMP_GROUP",   0x0e174000u, 1024,   7 },
+	[SIM_VLAN]            = { "VLAN",            0x12168000u, 4096,   10 },
+	[SIM_EGR_VLAN]        = { "EGR_VLAN",        0x0d260000u, 4096,   8 },
+};
+
+static uint32_t *sim_entry(int mem, int index)
+{
+	return sim_mems[mem].data + (size_t)index * (size_t)sim_mems[mem].words;
+}
+
+static struct sim_mem *sim_mem_find(uint32_t addr, int *index)
+{
+	int i;
+
+	for (i = 0; i < SIM_NUM_MEMS; i++) {
+		if (addr - sim_mems[i].base < (uint32_t)sim_mems[i].entries) {
+			*index = (int)(addr - sim_mems[i].base);
+			return &sim_mems[i];
+		}
+	}
+	return NULL;
+}
+
+/* Extract width (<= 64) bits starting at bit start of a packed entry. */
+static uint64_t sim_bits(const uint32_t *w, int start, int width)
+{
+	uint64_t v = 0;
+	int i;
+
+	for (i = 0; i < width; i++)
+		if ((w[(start + i) / 32] >> ((start + i) % 32)) & 1u)
+			v |= 1ull << i;
+	return v;
+}
+
+/*
+ * L2_ENTRY exact-match index: the table is addressed by whatever hash the
+ * SDK uses, so lookups go through a (key -> index) chain built from the
+ * entries as they are written.  Key = entry words 0..1 minus VALID
+ * (KEY_TYPE, VLAN, MAC).  Chain links are table indices.
+ */
+#define SIM_L2_BUCKETS 65536u
+
+static int32_t sim_l2_head[SIM_L2_BUCKETS];
+static int32_t *sim_l2_next;
+
+static uint64_t sim_l2_key(const uint32_t *w)
+{
+	return ((uint64_t)(w[0] & ~1u) << 32) | w[1];
+}
+
+static uint32_t sim_l2_bucket(uint64_t key)
+{
+	return (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 48) & (SIM_L2_BUCKETS - 1);
+}
+
+static void sim_l2_unlink(int index)
+{
+	const uint32_t *e = sim_entry(SIM_L2_ENTRY, index);
+	int32_t *p;
+
+	if (!(e[0] & 1u))
+		return;
+	for (p = &sim_l2_head[sim_l2_bucket(sim_l2_key(e))]; *p >= 0; p = &sim_l2_next[*p]) {
+		if (*p == index) {
+			*p = sim_l2_next[index];
+			return;
+		}
+	}
+}
+
+static void sim_l2_link(int index)
+{
+	const uint32_t *e = sim_entry(SIM_L2_ENTRY, index);
+	uint32_t b;
+
+	if (!(e[0] & 1u))
+		return;
+	b = sim_l2_bucket(sim_l2_key(e));
+	sim_l2_next[index] = sim_l2_head[b];
+	sim_l2_head[b] = index;
+}
+
+/* ---- Sparse store: registers, counters, unmodeled memories, MDIO ---- */
+
+struct sim_cell {
+	uint64_t key;  /* SIM_KEY_*; 0 = empty */
+	uint32_t w[SIM_CELL_WORDS];
+};
+
+static struct sim_cell *sim_cells;
+static size_t sim_cells_cap;  /* power of two */
+static size_t sim_cells_used;
+
+static size_t sim_cell_slot(uint64_t key)
+{
+	return (size_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & (sim_cells_cap - 1);
+}
+
+static int sim_cells_grow(void)
+{
+	struct sim_cell *old = sim_cells;
+	size_t old_cap = sim_cells_cap, i, s;
+
+	sim_cells_cap = old_cap ? old_cap * 2 : 4096;
+	sim_cells = calloc(sim_cells_cap, sizeof(*sim_cells));
+	if (!sim_cells) {
+		sim_cells = old;
+		sim_cells_cap = old_cap;
+		return -ENOMEM;
+	}
+	for (i = 0; i < old_cap; i++) {
+		if (!old[i].key)
+			continue;
+		for (s = sim_cell_slot(old[i].key); sim_cells[s].key; s = (s + 1) & (sim_cells_cap - 1))
+			;
+		sim_cells[s] = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+/* Cell for key; created (zeroed) if create, else NULL when absent. */
+static struct sim_cell *sim_cell(uint64_t key, int create)
+{
+	size_t s;
+
+	if (!sim_cells_cap) {
+		if (!create || sim_cells_grow() != 0)
+			return NULL;
+	}
+	for (s = sim_cell_slot(key); sim_cells[s].key; s = (s + 1) & (sim_cells_cap - 1))
+		if (sim_cells[s].key == key)
+			return &sim_cells[s];
+	if (!create)
+		return NULL;
+	if ((sim_cells_used + 1) * 4 > sim_cells_cap * 3) {
+		if (sim_cells_grow() != 0)
+			return NULL;
+		return sim_cell(key, 1);
+	}
+	sim_cells[s].key = key;
+	memset(sim_cells[s].w, 0, sizeof(sim_cells[s].w));
+	sim_cells_used++;
+	return &sim_cells[s];
+}
+
+static uint32_t sim_addr_block(uint32_t addr)
+{
+	return ((addr >> 20) & 0xfu) | ((addr >> 26) & 0x30u);
+}
+
+static uint64_t sim_sbus_key(uint32_t blk, uint32_t addr)
+{
+	return SIM_KEY_SBUS | ((uint64_t)blk << 32) | addr;
+}
+
+static void sim_load(uint32_t blk, uint32_t addr, uint32_t *words, int n)
+{
+	struct sim_mem *m;
+	struct sim_cell *c;
+	int index;
+
+	memset(words, 0, sizeof(uint32_t) * (size_t)n);
+	m = sim_mem_find(addr, &index);
+	if (m) {
+		memcpy(words, m->data + (size_t)index * (size_t)m->words,
+		       sizeof(uint32_t) * (size_t)(n < m->words ? n : m->words));
+		return;
+	}
+	c = sim_cell(sim_sbus_key(blk, addr), 0);
+	if (c)
+		memcpy(words, c->w, sizeof(uint32_t) * (size_t)n);
+}
+
+/* Entries are written whole: words past n read back as zero. */
+static void sim_store(uint32_t blk, uint32_t addr, const uint32_t *words, int n)
+{
+	struct sim_mem *m;
+	struct sim_cell *c;
+	uint32_t *e;
+	int index;
+
+	m = sim_mem_find(addr, &index);
+	if (m) {
+		int is_l2 = m == &sim_mems[SIM_L2_ENTRY];
+
+		if (n > m->words)
+			n = m->words;
+		if (is_l2)
+			sim_l2_unlink(index);
+		e = m->data + (size_t)index * (size_t)m->words;
+		memset(e, 0, sizeof(uint32_t) * (size_t)m->words);
+		memcpy(e, words, sizeof(uint32_t) * (size_t)n);
+		if (is_l2)
+			sim_l2_link(index);
+		return;
+	}
+	c = sim_cell(sim_sbus_key(blk, addr), 1);
+	if (!c)
+		return;
+	memset(c->w, 0, sizeof(c->w));
+	memcpy(c->w, words, sizeof(uint32_t) * (size_t)n);
+}
+
+/* ---- L2_ENTRY hashed table ops ---- */
+
+#define SIM_L2_BUCKET_SIZE 8
+#define SIM_L2_HASH_BITS   14
+
+/* Reflected CRC-32 (0xEDB88320, init 0) over nbits of key, LSB first. */
+static uint32_t sim_crc32(uint64_t key, int nbits)
+{
+	uint32_t crc = 0;
+
+	for (; nbits > 0; nbits--, key >>= 1)
+		crc = (crc >> 1) ^ (((crc ^ (uint32_t)key) & 1u) ? 0xedb88320u : 0);
+	return crc;
+}
+
+/* Reflected CRC-16 (0x8408, init 0) over nbits of key, LSB first. */
+static uint32_t sim_crc16(uint64_t key, int nbits)
+{
+	uint32_t crc = 0;
+
+	for (; nbits > 0; nbits--, key >>= 1)
+		crc = (crc >> 1) ^ (((crc ^ (uint32_t)key) & 1u) ? 0x8408u : 0);
+	return crc;
+}
+
+/*
+ * HASH_CONTROL.L2_AND_VLAN_MAC_HASH_SELECT (bits 2:0), same encoding as
+ * l2.c: 1/2 CRC16 upper/lower, 3 MAC LSBs, 5 CRC32 lower, otherwise
+ * CRC32 upper (4).
+ */
+#define SIM_HASH_CONTROL   0x05180640u
+
+/* First index of the bucket for entry words: key = MAC, VLAN_ID, KEY_TYPE. */
+static int sim_l2_bucket_of(const uint32_t *w)
+{
+	uint64_t mac48 = ((uint64_t)(w[0] >> 16) << 32) | w[1];
+	uint64_t key = (mac48 << 15) | ((w[0] >> 1) & 0x7fffu);
+	uint32_t ctl, b;
+
+	sim_load(sim_addr_block(SIM_HASH_CONTROL), SIM_HASH_CONTROL, &ctl, 1);
+	switch (ctl & 0x7u) {
+	case 1:
+		b = sim_crc16(key, 63) >> (16 - SIM_L2_HASH_BITS);
+		break;
+	case 2:
+		b = sim_crc16(key, 63);
+		break;
+	case 3:
+		b = (uint32_t)mac48;
+		break;
+	case 5:
+		b = sim_crc32(key, 63);
+		break;
+	default:
+		b = sim_crc32(key, 63) >> (32 - SIM_L2_HASH_BITS);
+		break;
+	}
+	return (int)(b & ((1u << SIM_L2_HASH_BITS) - 1)) * SIM_L2_BUCKET_SIZE;
+}
+
+/* Index of the valid entry with w's key in its bucket, or -1; *free_idx = first free slot. */
+static int sim_l2_find(const uint32_t *w, int *free_idx)
+{
+	int b = sim_l2_bucket_of(w), i;
+
+	*free_idx = -1;
+	for (i = b; i < b + SIM_L2_BUCKET_SIZE; i++) {
+		const uint32_t *e = sim_entry(SIM_L2_ENTRY, i);
+
+		if (!(e[0] & 1u)) {
+			if (*free_idx < 0)
+				*free_idx = i;
+			continue;
+		}
+		if ((e[0] & ~1u) == (w[0] & ~1u) && e[1] == w[1])
+			return i;
+	}
+	return -1;
+}
+
+/* TABLE_INSERT/DELETE/LOOKUP on L2_ENTRY; returns the response header flags. */
+static uint32_t sim_l2_table_op(uint32_t opcode, uint32_t blk, const uint32_t *key,
+				int n, uint32_t resp[16])
+{
+	const uint32_t zero[4] = { 0, 0, 0, 0 };
+	struct sim_mem *m = &sim_mems[SIM_L2_ENTRY];
+	uint32_t w[4] = { 0, 0, 0, 0 };
+	uint32_t type;
+	int i, hit, free_idx;
+
+	memcpy(w, key, sizeof(uint32_t) * (size_t)(n < 4 ? n : 4));
+	hit = sim_l2_find(w, &free_idx);
+	if (hit >= 0)
+		memcpy(resp + 2, sim_entry(SIM_L2_ENTRY, hit), sizeof(w));
+	switch (opcode) {
+	case SIM_TABLE_INSERT:
+		i = hit >= 0 ? hit : free_idx;
+		if (i < 0) {
+			resp[1] = (uint32_t)SIM_GEN_FULL << 20;
+			return SIM_RESP_ERR;
+		}
+		sim_store(blk, m->base + (uint32_t)i, w, 4);
+		type = hit >= 0 ? SIM_GEN_REPLACED : SIM_GEN_INSERTED;
+		break;
+	case SIM_TABLE_DELETE:
+		if (hit < 0) {
+			resp[1] = (uint32_t)SIM_GEN_NOT_FOUND << 20;
+			return SIM_RESP_ERR;
+		}
+		sim_store(blk, m->base + (uint32_t)hit, zero, 4);
+		i = hit;
+		type = SIM_GEN_DELETED;
+		break;
+	default:
+		if (hit < 0) {
+			resp[1] = (uint32_t)SIM_GEN_NOT_FOUND << 20;
+			return SIM_RESP_ERR;
+		}
+		i = hit;
+		type = SIM_GEN_FOUND;
+	}
+	resp[1] = (type << 20) | (uint32_t)i;
+	return 0;
+}
+
+/*
+ * L2 bulk engine: START in L2_BULK_CONTROL with ACTION=DELETE invalidates
+ * every valid L2_ENTRY matching L2_BULK_MATCH_DATA under
+ * L2_BULK_MATCH_MASK, then reports COMPLETE (same layout as l2.c).
+ */
+#define SIM_L2_BULK_CONTROL     0x07100100u
+#define SIM_L2_BULK_ACTION_MASK 0x3u
+#define SIM_L2_BULK_DELETE      1u
+#define SIM_L2_BULK_START       (1u << 3)
+#define SIM_L2_BULK_COMPLETE    (1u << 4)
+#define SIM_L2_BULK_MATCH_MASK  0x07160000u
+#define SIM_L2_BULK_MATCH_DATA  0x07164000u
+
+static void sim_l2_bulk(uint32_t blk, uint32_t ctl)
+{
+	const uint32_t zero[4] = { 0, 0, 0, 0 };
+	uint32_t mask[4], data[4];
+	struct sim_mem *m = &sim_mems[SIM_L2_ENTRY];
+	int i, k;
+
+	sim_load(sim_addr_block(SIM_L2_BULK_MATCH_MASK), SIM_L2_BULK_MATCH_MASK, mask, 4);
+	sim_load(sim_addr_block(SIM_L2_BULK_MATCH_DATA), SIM_L2_BULK_MATCH_DATA, data, 4);
+	for (i = 0; (ctl & SIM_L2_BULK_ACTION_MASK) == SIM_L2_BULK_DELETE && i < m->entries; i++) {
+		const uint32_t *e = sim_entry(SIM_L2_ENTRY, i);
+
+		if (!(e[0] & 1u))
+			continue;
+		for (k = 0; k < 4 && !((e[k] ^ data[k]) & mask[k]); k++)
+			;
+		if (k == 4)
+			sim_store(sim_addr_block(m->base), m->base + (uint32_t)i, zero, 4);
+	}
+	ctl = (ctl & ~SIM_L2_BULK_START) | SIM_L2_BULK_COMPLETE;
+	sim_store(blk, SIM_L2_BULK_CONTROL, &ctl, 1);
+}
+
+/* ---- SCHAN engine ---- */
+
+static uint64_t sim_ops;
+static struct nos_bde_schan_stats sim_stats;
+static uint32_t sim_read_fail;  /* reads of this address time out (0 = none) */
+
+/*
+ * Execute one SCHAN message; resp[0] gets the response header, resp[1..]
+ * the data of a read.  Returns the op status: 0 (errors are reported in
+ * the response header, as by the hardware), or -ETIMEDOUT for a read of
+ * sim_read_fail.
+ */
+static int sim_schan(const uint32_t *cmd, int cmd_words, uint32_t resp[16])
+{
+	uint32_t opcode = (cmd[0] >> 26) & 0x3fu;
+	uint32_t blk = (cmd[0] >> 20) & 0x3fu;
+	int n = (int)((cmd[0] >> 7) & 0x7fu) / 4;
+
+	memset(resp, 0, sizeof(uint32_t) * 16);
+	sim_ops++;
+	sim_stats.ops++;
+	sim_stats.op_count[opcode]++;
+	sim_stats.blk_count[blk]++;
+	if (n > SIM_CELL_WORDS)
+		n = SIM_CELL_WORDS;
+
+	switch (cmd_words >= 2 ? opcode : 0) {
+	case SIM_READ_MEM:
+	case SIM_READ_REG:
+		if (sim_read_fail && cmd[1] == sim_read_fail) {
+			sim_stats.timeouts++;
+			return -ETIMEDOUT;
+		}
+		if (n == 0)
+			n = 1;
+		sim_load(blk, cmd[1], resp + 1, n);
+		break;
+	case SIM_WRITE_MEM:
+	case SIM_WRITE_REG:
+		if (n == 0 || n > cmd_words - 2)
+			n = cmd_words - 2;
+		sim_store(blk, cmd[1], cmd + 2, n);
+		if (opcode == SIM_WRITE_REG && cmd[1] == SIM_L2_BULK_CONTROL &&
+		    (cmd[2] & SIM_L2_BULK_START))
+			sim_l2_bulk(blk, cmd[2]);
+		break;
+	case SIM_TABLE_INSERT:
+	case SIM_TABLE_DELETE:
+	case SIM_TABLE_LOOKUP:
+		if (n == 0 || n > cmd_words - 2)
+			n = cmd_words - 2;
+		resp[0] = ((opcode + 1u) << 26) | (blk << 20) | ((uint32_t)n * 4u << 7);
+		if (cmd[1] != sim_mems[SIM_L2_ENTRY].base || n <= 0)
+			resp[0] |= SIM_RESP_NACK;
+		else
+			resp[0] |= sim_l2_table_op(opcode, blk, cmd + 2, n, resp);
+		if (resp[0] & (SIM_RESP_ERR | SIM_RESP_NACK)) {
+			sim_stats.resp_errors++;
+			sim_stats.op_errors[opcode]++;
+			sim_stats.blk_errors[blk]++;
+		}
+		return 0;
+	default:
+		resp[0] = ((opcode + 1u) << 26) | (blk << 20) | SIM_RESP_ERR;
+		sim_stats.resp_errors++;
+		sim_stats.op_errors[opcode]++;
+		sim_stats.blk_errors[blk]++;
+		return 0;
+	}
+	resp[0] = ((opcode + 1u) << 26) | (blk << 20) | ((uint32_t)n * 4u << 7);
+	return 0;
+}
+
+/* ---- BAR0 and MIIM ---- */
+
+static uint32_t sim_bar0[SIM_BAR0_SIZE / 4];
+static uint32_t sim_fifo_wr;  /* FIFO read DMA: next ring slot */
+static uint16_t sim_mdio_blk[8][32];
+static uint8_t sim_mdio_lane[8][32];
+
+static uint64_t sim_mdio_key(int bus, int phy, uint32_t reg)
+{
+	uint32_t addr = reg;
+
+	if (reg >= 0x10)
+		addr = (sim_mdio_blk[bus][phy] & 0xfff0u) | (reg & 0xfu);
+	return SIM_KEY_MDIO | ((uint64_t)bus << 40) | ((uint64_t)phy << 32) |
+	       ((uint64_t)sim_mdio_lane[bus][phy] << 16) | addr;
+}
+
+/* Run the MIIM op latched in PARAM/ADDRESS; write != 0 for 0x91. */
+static void sim_miim(int write)
+{
+	uint32_t param = sim_bar0[CMIC_MIIM_PARAM / 4];
+	uint32_t reg = sim_bar0[CMIC_MIIM_ADDRESS / 4] & 0x1fu;
+	int bus = (int)((param >> 22) & 7u);
+	int phy = (int)((param >> 16) & 31u);
+	uint16_t data = (uint16_t)(param & 0xffffu);
+	struct sim_cell *c;
+
+	if (write) {
+		if (reg == SIM_WC_AER_BLK) {
+			sim_mdio_blk[bus][phy] = data;
+		} else if (reg == SIM_WC_AER_LANE &&
+			   sim_mdio_blk[bus][phy] == SIM_WC_AER_BROADCAST) {
+			sim_mdio_lane[bus][phy] = (uint8_t)(data & 3u);
+		} else {
+			c = sim_cell(sim_mdio_key(bus, phy, reg), 1);
+			if (c)
+				c->w[0] = data;
+		}
+	} else {
+		uint64_t key = sim_mdio_key(bus, phy, reg);
+		uint32_t val = 0;
+
+		c = sim_cell(key, 0);
+		if (c)
+			val = c->w[0];
+		else if ((uint16_t)key == SIM_WC_FW_VERSION)
+			val = 0x0101;
+		else if ((uint16_t)key == SIM_WC_XGXSSTATUS)
+			val = 1u << 11;
+		sim_bar0[CMIC_MIIM_READ_DATA / 4] = val;
+	}
+	sim_bar0[CMIC_MIIM_CTRL / 4] = CMIC_MIIM_CTRL_DONE;
+}
+
+static void sim_bar0_write(uint32_t offset, uint32_t value)
+{
+	switch (offset) {
+	case CMIC_MIIM_CTRL:
+		if (value == 0x90 || value == 0x91)
+			sim_miim(value == 0x91);
+		else
+			sim_bar0[offset / 4] = 0; /* reset/clear-done, SCHAN_CTRL byte writes */
+		return;
+	case CMIC_DMA_CTRL:
+		sim_bar0[offset / 4] = value;
+		if (value & 1u)
+			sim_bar0[CMIC_DMA_STAT / 4] |= 1u;
+		return;
+	case CMIC_FIFO_RD_DMA_CFG:
+		if ((value & CMIC_FIFO_RD_DMA_CFG_ENABLE) &&
+		    !(sim_bar0[offset / 4] & CMIC_FIFO_RD_DMA_CFG_ENABLE)) {
+			sim_fifo_wr = 0;
+			sim_bar0[CMIC_FIFO_RD_DMA_NUM_VALID / 4] = 0;
+		}
+		sim_bar0[offset / 4] = value;
+		return;
+	case CMIC_FIFO_RD_DMA_NUM_READ:
+		if (value > sim_bar0[CMIC_FIFO_RD_DMA_NUM_VALID / 4])
+			value = sim_bar0[CMIC_FIFO_RD_DMA_NUM_VALID / 4];
+		sim_bar0[CMIC_FIFO_RD_DMA_NUM_VALID / 4] -= value;
+		return;
+	case CMIC_FIFO_RD_DMA_NUM_VALID:
+		return;
+	case CMIC_FIFO_RD_DMA_STAT_CLR:
+		sim_bar0[CMIC_FIFO_RD_DMA_STAT / 4] &= ~value;
+		return;
+	default:
+		sim_bar0[offset / 4] = value;
+	}
+}
+
+/* ---- Simulator state ---- */
+
+static int sim_alloc(void)
+{
+	int i;
+
+	for (i = 0; i < SIM_NUM_MEMS; i++) {
+		if (sim_mems[i].data)
+			continue;
+		sim_mems[i].data = calloc((size_t)sim_mems[i].entries,
+					  sizeof(uint32_t) * (size_t)sim_mems[i].words);
+		if (!sim_mems[i].data)
+			return -ENOMEM;
+	}
+	if (!sim_l2_next) {
+		sim_l2_next = calloc((size_t)sim_mems[SIM_L2_ENTRY].entries, sizeof(int32_t));
+		if (!sim_l2_next)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static void sim_free(void)
+{
+	int i;
+
+	for (i = 0; i < SIM_NUM_MEMS; i++) {
+		free(sim_mems[i].data);
+		sim_mems[i].data = NULL;
+	}
+	free(sim_l2_next);
+	sim_l2_next = NULL;
+	free(sim_cells);
+	sim_cells = NULL;
+	sim_cells_cap = 0;
+	sim_cells_used = 0;
+}
+
+static void sim_reset_locked(void)
+{
+	int i;
+
+	for (i = 0; i < SIM_NUM_MEMS; i++)
+		if (sim_mems[i].data)
+			memset(sim_mems[i].data, 0, sizeof(uint32_t) *
+			       (size_t)sim_mems[i].entries * (size_t)sim_mems[i].words);
+	memset(sim_l2_head, 0xff, sizeof(sim_l2_head));
+	if (sim_cells)
+		memset(sim_cells, 0, sizeof(*sim_cells) * sim_cells_cap);
+	sim_cells_used = 0;
+	memset(sim_bar0, 0, sizeof(sim_bar0));
+	sim_read_fail = 0;
+	sim_fifo_wr = 0;
+	memset(sim_mdio_blk, 0, sizeof(sim_mdio_blk));
+	memset(sim_mdio_lane, 0, sizeof(sim_mdio_lane));
+	memset(&sim_stats, 0, sizeof(sim_stats));
+	sim_ops = 0;
+}
+
+/* ---- bde_ioctl.h API ---- */
+
+static void *bde_dma_base;
+static size_t bde_dma_off;
+
+/* Shared SCHAN SQ/CQ; the simulator is the worker, run at bde_sq_kick() */
+static struct nos_bde_sq_ring *bde_sq;
+static struct nos_bde_sqe *bde_sqes;
+static struct nos_bde_cqe *bde_cqes;
+static uint32_t bde_sq_mask;
+static int bde_sq_heap;
+
+int bde_open(void)
+{
+	if (sim_open)
+		return 0;
+	pthread_mutex_lock(&sim_lock);
+	if (sim_alloc() != 0) {
+		sim_free();
+		pthread_mutex_unlock(&sim_lock);
+		return -1;
+	}
+	sim_reset_locked();
+	sim_open = 1;
+	pthread_mutex_unlock(&sim_lock);
+	return 0;
+}
+
+void bde_close(void)
+{
+	if (bde_sq_heap)
+		free(bde_sq);
+	bde_sq = NULL;
+	bde_sq_heap = 0;
+	pthread_mutex_lock(&sim_dma_lock);
+	free(bde_dma_base);
+	bde_dma_base = NULL;
+	bde_dma_off = 0;
+	pthread_mutex_unlock(&sim_dma_lock);
+	pthread_mutex_lock(&sim_lock);
+	sim_free();
+	sim_open = 0;
+	pthread_mutex_unlock(&sim_lock);
+}
+
+int bde_read_reg(uint32_t offset, uint32_t *value)
+{
+	if (!sim_open || offset >= SIM_BAR0_SIZE || (offset & 3))
+		return -1;
+	pthread_mutex_lock(&sim_lock);
+	*value = sim_bar0[offset / 4];
+	pthread_mutex_unlock(&sim_lock);
+	return 0;
+}
+
+int bde_write_reg(uint32_t offset, uint32_t value)
+{
+	if (!sim_open || offset >= SIM_BAR0_SIZE || (offset & 3))
+		return -1;
+	pthread_mutex_lock(&sim_lock);
+	sim_bar0_write(offset, value);
+	pthread_mutex_unlock(&sim_lock);
+	return 0;
+}
+
+int bde_get_dma_info(uint64_t *pbase, uint32_t *size)
+{
+	if (!sim_open)
+		return -1;
+	*pbase = SIM_DMA_PBASE;
+	*size = SIM_DMA_SIZE;
+	return 0;
+}
+
+static void *bde_mmap_dma_locked(void)
+{
+	if (bde_dma_base)
+		return bde_dma_base;
+	if (!sim_open || posix_memalign(&bde_dma_base, 4096, SIM_DMA_SIZE) != 0) {
+		bde_dma_base = NULL;
+		return NULL;
+	}
+	memset(bde_dma_base, 0, SIM_DMA_SIZE);
+	return bde_dma_base;
+}
+
+void *bde_mmap_dma(void)
+{
+	void *base;
+
+	pthread_mutex_lock(&sim_dma_lock);
+	base = bde_mmap_dma_locked();
+	pthread_mutex_unlock(&sim_dma_lock);
+	return base;
+}
+
+/* Same locked bump allocator as bde_ioctl.c, first 4KB reserved. */
+void *bde_dma_alloc(size_t size, size_t align)
+{
+	uintptr_t p, a = 0;
+
+	pthread_mutex_lock(&sim_dma_lock);
+	if (bde_mmap_dma_locked()) {
+		if (bde_dma_off < 4096)
+			bde_dma_off = 4096;
+		p = (uintptr_t)bde_dma_base + bde_dma_off;
+		a = (p + (align - 1)) & ~(uintptr_t)(align - 1);
+		if (a + size > (uintptr_t)bde_dma_base + SIM_DMA_SIZE)
+			a = 0;
+		else
+			bde_dma_off = (size_t)(a - (uintptr_t)bde_dma_base + size);
+	}
+	pthread_mutex_unlock(&sim_dma_lock);
+	return (void *)a;
+}
+
+uint32_t bde_dma_offset(const void *p)
+{
+	return (uint32_t)((uintptr_t)p - (uintptr_t)bde_dma_base);
+}
+
+int bde_dma_contains(const void *p, size_t len)
+{
+	uintptr_t a = (uintptr_t)p, base = (uintptr_t)bde_dma_base;
+
+	if (!bde_dma_base)
+		return 0;
+	return a >= base && len <= SIM_DMA_SIZE && a - base <= SIM_DMA_SIZE - len;
+}
+
+uint64_t bde_dma_phys(const void *p)
+{
+	return SIM_DMA_PBASE + bde_dma_offset(p);
+}
+
+int bde_schan_op(const uint32_t *cmd, int cmd_words, uint32_t *data, int data_len, int *status)
+{
+	uint32_t resp[16];
+
+	if (!sim_open || cmd_words <= 0 || cmd_words > 16)
+		return -1;
+	pthread_mutex_lock(&sim_lock);
+	*status = sim_schan(cmd, cmd_words, resp);
+	pthread_mutex_unlock(&sim_lock);
+	if (data && data_len > 0)
+		memcpy(data, resp, sizeof(uint32_t) * (size_t)(data_len <= 16 ? data_len : 16));
+	return 0;
+}
+
+static int sim_batch_locked(struct nos_bde_schan_batch_op *ops, int count, uint32_t flags)
+{
+	uint32_t resp[16];
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct nos_bde_schan_batch_op *op = &ops[i];
+
+		if (op->cmd_words <= 0 || op->cmd_words > 16)
+			return -1;
+		op->status = sim_schan(op->cmd, op->cmd_words, resp);
+		if (op->data_words > 0)
+			memcpy(op->data, resp, sizeof(uint32_t) *
+			       (size_t)(op->data_words <= 16 ? op->data_words : 16));
+		if (op->status != 0 && (flags & NOS_BDE_BATCH_STOP_ON_ERR))
+			return i + 1;
+	}
+	return count;
+}
+
+int bde_schan_batch(struct nos_bde_schan_batch_op *ops, int count, uint32_t flags)
+{
+	int done;
+
+	if (!sim_open || !ops || count <= 0)
+		return -1;
+	pthread_mutex_lock(&sim_lock);
+	done = sim_batch_locked(ops, count, flags);
+	pthread_mutex_unlock(&sim_lock);
+	return done;
+}
+
+int bde_schan_ring(struct nos_bde_schan_batch_op *ring, int count, uint32_t flags,
+		   uint32_t *engine)
+{
+	if (!bde_dma_contains(ring, sizeof(*ring) * (size_t)(count > 0 ? count : 0))) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (engine)
+		*engine = NOS_BDE_RING_ENGINE_PIO;
+	return bde_schan_batch(ring, count, flags);
+}
+
+/* TDMA/SLAM: entry i is one op at addr + i; buf must be in the DMA pool. */
+static int sim_tdma_xfer(int write, uint32_t hdr, uint32_t addr, int count,
+			 int entry_words, uint32_t *buf, int *status)
+{
+	uint32_t cmd[16], resp[16];
+	int i;
+
+	if (!sim_open || count <= 0 || entry_words <= 0 ||
+	    entry_words > NOS_BDE_TDMA_MAX_WORDS ||
+	    !bde_dma_contains(buf, sizeof(uint32_t) * (size_t)count * (size_t)entry_words)) {
+		errno = EINVAL;
+		return -1;
+	}
+	cmd[0] = hdr;
+	*status = 0;
+	pthread_mutex_lock(&sim_lock);
+	for (i = 0; i < count; i++) {
+		uint32_t *e = buf + (size_t)i * (size_t)entry_words;
+
+		cmd[1] = addr + (uint32_t)i;
+		if (write)
+			memcpy(cmd + 2, e, sizeof(uint32_t) * (size_t)entry_words);
+		sim_schan(cmd, write ? 2 + entry_words : 2, resp);
+		if (resp[0] & 0x41u) {
+			*status = -EIO;
+			break;
+		}
+		if (!write)
+			memcpy(e, resp + 1, sizeof(uint32_t) * (size_t)entry_words);
+	}
+	pthread_mutex_unlock(&sim_lock);
+	return i;
+}
+
+int bde_tdma_read(uint32_t hdr, uint32_t addr, int count, int entry_words,
+		  uint32_t *dst, int *status)
+{
+	return sim_tdma_xfer(0, hdr, addr, count, entry_words, dst, status);
+}
+
+int bde_slam_write(uint32_t hdr, uint32_t addr, int count, int entry_words,
+		   const uint32_t *src, int *status)
+{
+	return sim_tdma_xfer(1, hdr, addr, count, entry_words, (uint32_t *)src, status);
+}
+
+int bde_schan_stats(struct nos_bde_schan_stats *st, int reset)
+{
+	if (!sim_open || !st)
+		return -1;
+	pthread_mutex_lock(&sim_lock);
+	memcpy(st, &sim_stats, sizeof(*st));
+	if (reset)
+		memset(&sim_stats, 0, sizeof(sim_stats));
+	pthread_mutex_unlock(&sim_lock);
+	return 0;
+}
+
+int bde_sq_setup(int entries, uint32_t *engine)
+{
+	size_t bytes;
+
+	if (!sim_open || bde_sq || entries <= 0 || entries > NOS_BDE_SQ_MAX ||
+	    (entries & (entries - 1)))
+		return -1;
+	bytes = sizeof(*bde_sq) + (size_t)entries *
+		(sizeof(struct nos_bde_sqe) + sizeof(struct nos_bde_cqe));
+	bde_sq = bde_dma_alloc(bytes, 64);
+	if (!bde_sq) {
+		bde_sq = malloc(bytes);
+		if (!bde_sq)
+			return -1;
+		bde_sq_heap = 1;
+	}
+	memset(bde_sq, 0, sizeof(*bde_sq));
+	bde_sq->entries = (uint32_t)entries;
+	bde_sqes = (struct nos_bde_sqe *)(bde_sq + 1);
+	bde_cqes = (struct nos_bde_cqe *)(bde_sqes + entries);
+	bde_sq_mask = (uint32_t)entries - 1;
+	if (engine)
+		*engine = NOS_BDE_RING_ENGINE_PIO;
+	return 0;
+}
+
+int bde_sq_space(void)
+{
+	if (!bde_sq)
+		return 0;
+	return (int)(bde_sq_mask + 1) - (int)(bde_sq->sq_tail - bde_sq->cq_head);
+}
+
+int bde_sq_push(const struct nos_bde_schan_batch_op *op, uint64_t user_data)
+{
+	struct nos_bde_sqe *sqe;
+
+	if (bde_sq_space() <= 0)
+		return -1;
+	sqe = &bde_sqes[bde_sq->sq_tail & bde_sq_mask];
+	memcpy(&sqe->op, op, sizeof(*op));
+	sqe->user_data = user_data;
+	bde_sq->sq_tail++;
+	return 0;
+}
+
+/* The simulated worker: run every queued SQE and post its CQE. */
+void bde_sq_kick(void)
+{
+	uint32_t resp[16];
+
+	if (!bde_sq)
+		return;
+	pthread_mutex_lock(&sim_lock);
+	while (bde_sq->sq_head != bde_sq->sq_tail) {
+		struct nos_bde_sqe *sqe = &bde_sqes[bde_sq->sq_head & bde_sq_mask];
+		struct nos_bde_cqe *cqe = &bde_cqes[bde_sq->cq_tail & bde_sq_mask];
+
+		cqe->user_data = sqe->user_data;
+		cqe->status = -EIO;
+		memset(cqe->data, 0, sizeof(cqe->data));
+		if (sqe->op.cmd_words > 0 && sqe->op.cmd_words <= 16) {
+			cqe->status = sim_schan(sqe->op.cmd, sqe->op.cmd_words, resp);
+			memcpy(cqe->data, resp, sizeof(cqe->data));
+		}
+		bde_sq->sq_head++;
+		bde_sq->cq_tail++;
+	}
+	pthread_mutex_unlock(&sim_lock);
+}
+
+int bde_cq_pop(struct nos_bde_cqe *cqe)
+{
+	if (!bde_sq || bde_sq->cq_head == bde_sq->cq_tail)
+		return 0;
+	memcpy(cqe, &bde_cqes[bde_sq->cq_head & bde_sq_mask], sizeof(*cqe));
+	bde_sq->cq_head++;
+	return 1;
+}
+
+int bde_cq_wait(int timeout_ms)
+{
+	(void)timeout_ms;
+	return 1;
+}
+
+/* ---- Inspection hooks (bde_sim.h) ---- */
+
+void bde_sim_reset(void)
+{
+	pthread_mutex_lock(&sim_lock);
+	sim_reset_locked();
+	pthread_mutex_unlock(&sim_lock);
+}
+
+void bde_sim_read_fail(uint32_t addr)
+{
+	pthread_mutex_lock(&sim_lock);
+	sim_read_fail = addr;
+	pthread_mutex_unlock(&sim_lock);
+}
+
+uint64_t bde_sim_op_count(void)
+{
+	uint64_t n;
+
+	pthread_mutex_lock(&sim_lock);
+	n = sim_ops;
+	pthread_mutex_unlock(&sim_lock);
+	return n;
+}
+
+int bde_sim_mem_get(uint32_t addr, uint32_t *words, int nwords)
+{
+	if (!sim_open || !words || nwords <= 0 || nwords > SIM_CELL_WORDS)
+		return -EINVAL;
+	pthread_mutex_lock(&sim_lock);
+	sim_load(sim_addr_block(addr), addr, words, nwords);
+	pthread_mutex_unlock(&sim_lock);
+	return 0;
+}
+
+/* L2_ENTRY key words 0..1 (VALID clear) for (MAC, VLAN). */
+static void sim_l2_key_words(const uint8_t mac[6], uint16_t vid, uint32_t *w)
+{
+	w[0] = ((uint32_t)(vid & 0xfff) << 4) |
+	       ((uint32_t)((mac[0] << 8) | mac[1]) << 16);
+	w[1] = (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 |
+	       (uint32_t)mac[4] << 8 | mac[5];
+}
+
+int bde_sim_l2_lookup(const uint8_t mac[6], uint16_t vid, int *port)
+{
+	uint32_t key_words[2];
+	uint64_t key;
+	int32_t i;
+
+	if (!sim_open || !mac)
+		return -EINVAL;
+	sim_l2_key_words(mac, vid, key_words);
+	key = sim_l2_key(key_words);
+	pthread_mutex_lock(&sim_lock);
+	for (i = sim_l2_head[sim_l2_bucket(key)]; i >= 0; i = sim_l2_next[i]) {
+		const uint32_t *e = sim_entry(SIM_L2_ENTRY, i);
+
+		if (sim_l2_key(e) != key)
+			continue;
+		if (port)
+			*port = (int)(e[2] & 0x7f);
+		pthread_mutex_unlock(&sim_lock);
+		return 0;
+	}
+	pthread_mutex_unlock(&sim_lock);
+	return -ENOENT;
+}
+
+/*
+ * Pipeline learning: every frame sets the entry's HITSA; PORT_TAB
+ * CML_FLAGS_NEW/MOVE (word 2 bits 23:20 / 27:24) with the LEARN bit
+ * install or move the entry in its hash bucket, and
+ * AUX_ARB_CONTROL L2_MOD_FIFO_ENABLE_LEARN/AGE let the record reach
+ * L2_MOD_FIFO and the FIFO read DMA ring (same layout as l2.c).
+ */
+#define SIM_PORT_TAB         0x01160000u
+#define SIM_AUX_ARB_CONTROL  0x00180700u
+#define SIM_AUX_MOD_LEARN    (1u << 4)
+#define SIM_AUX_MOD_AGE      (1u << 5)
+#define SIM_CML_LEARN        0x8u
+#define SIM_L2_STATIC        (1u << 29)  /* entry word 2 */
+#define SIM_L2_HITSA         (1u << 31)  /* entry word 2 */
+#define SIM_L2_MOD_WORDS     5
+
+enum { SIM_MOD_DELETE, SIM_MOD_LEARN, SIM_MOD_MOVE, SIM_MOD_AGE };
+
+static void sim_l2_mod_push(const uint32_t *e, int index, uint32_t op)
+{
+	uint32_t cfg = sim_bar0[CMIC_FIFO_RD_DMA_CFG / 4];
+	uint32_t words = (cfg >> CMIC_FIFO_RD_DMA_CFG_WORDS_SHIFT) & 0x1fu;
+	uint32_t entries = 64u << ((cfg >> CMIC_FIFO_RD_DMA_CFG_ENTRIES_SHIFT) & 0xfu);
+	uint32_t host = sim_bar0[CMIC_FIFO_RD_DMA_HOSTMEM_START / 4];
+	uint32_t *rec;
+	uint64_t off;
+
+	if (!(cfg & CMIC_FIFO_RD_DMA_CFG_ENABLE) || words < SIM_L2_MOD_WORDS || !bde_dma_base)
+		return;
+	if (sim_bar0[CMIC_FIFO_RD_DMA_NUM_VALID / 4] >= entries) {
+		sim_bar0[CMIC_FIFO_RD_DMA_STAT / 4] |= CMIC_FIFO_RD_DMA_STAT_OVERFLOW;
+		return;
+	}
+	off = (uint64_t)host - SIM_DMA_PBASE + (uint64_t)(sim_fifo_wr % entries) * words * 4u;
+	if (host < SIM_DMA_PBASE || off + words * 4u > SIM_DMA_SIZE)
+		return;
+	rec = (uint32_t *)((char *)bde_dma_base + off);
+	memset(rec, 0, words * 4u);
+	memcpy(rec, e, 4 * sizeof(uint32_t));
+	rec[4] = (uint32_t)index | (op << 17);
+	sim_fifo_wr++;
+	sim_bar0[CMIC_FIFO_RD_DMA_NUM_VALID / 4]++;
+}
+
+int bde_sim_l2_learn(const uint8_t mac[6], uint16_t vid, int port)
+{
+	uint32_t w[4] = { 0, 0, 0, 0 }, pt[3], aux, cml_new, cml_move;
+	int index, free_idx, rc = 0;
+
+	if (!sim_open || !mac || port <= 0 || port > 127)
+		return -EINVAL;
+	sim_l2_key_words(mac, vid, w);
+	w[0] |= 1u;
+	w[2] = (uint32_t)port | SIM_L2_HITSA;
+	pthread_mutex_lock(&sim_lock);
+	sim_load(sim_addr_block(SIM_PORT_TAB), SIM_PORT_TAB + (uint32_t)port, pt, 3);
+	sim_load(sim_addr_block(SIM_AUX_ARB_CONTROL), SIM_AUX_ARB_CONTROL, &aux, 1);
+	cml_new = (pt[2] >> 20) & 0xfu;
+	cml_move = (pt[2] >> 24) & 0xfu;
+	index = sim_l2_find(w, &free_idx);
+	if (index >= 0) {
+		const uint32_t *e = sim_entry(SIM_L2_ENTRY, index);
+		int move = (e[2] & 0x7fu) != (uint32_t)port && !(e[2] & SIM_L2_STATIC) &&
+			   (cml_move & SIM_CML_LEARN);
+
+		memcpy(w, e, sizeof(w));
+		w[2] |= SIM_L2_HITSA;
+		if (move)
+			w[2] = (w[2] & ~0x7fu) | (uint32_t)port;
+		sim_store(sim_addr_block(sim_mems[SIM_L2_ENTRY].base),
+			  sim_mems[SIM_L2_ENTRY].base + (uint32_t)index, w, 4);
+		if (move) {
+			if (aux & SIM_AUX_MOD_LEARN)
+				sim_l2_mod_push(w, index, SIM_MOD_MOVE);
+			rc = 1;
+		}
+	} else if (cml_new & SIM_CML_LEARN) {
+		if (free_idx < 0) {
+			rc = -ENOSPC;
+		} else {
+			sim_store(sim_addr_block(sim_mems[SIM_L2_ENTRY].base),
+				  sim_mems[SIM_L2_ENTRY].base + (uint32_t)free_idx, w, 4);
+			if (aux & SIM_AUX_MOD_LEARN)
+				sim_l2_mod_push(w, free_idx, SIM_MOD_LEARN);
+			rc = 1;
+		}
+	}
+	pthread_mutex_unlock(&sim_lock);
+	return rc;
+}
+
+int bde_sim_l2_age(const uint8_t mac[6], uint16_t vid)
+{
+	const uint32_t zero[4] = { 0, 0, 0, 0 };
+	uint32_t w[4] = { 0, 0, 0, 0 }, aux;
+	int index, free_idx;
+
+	if (!sim_open || !mac)
+		return -EINVAL;
+	sim_l2_key_words(mac, vid, w);
+	pthread_mutex_lock(&sim_lock);
+	index = sim_l2_find(w, &free_idx);
+	if (index < 0 || (sim_entry(SIM_L2_ENTRY, index)[2] & SIM_L2_STATIC)) {
+		pthread_mutex_unlock(&sim_lock);
+		return -ENOENT;
+	}
+	memcpy(w, sim_entry(SIM_L2_ENTRY, index), sizeof(w));
+	sim_store(sim_addr_block(sim_mems[SIM_L2_ENTRY].base),
+		  sim_mems[SIM_L2_ENTRY].base + (uint32_t)index, zero, 4);
+	sim_load(sim_addr_block(SIM_AUX_ARB_CONTROL), SIM_AUX_ARB_CONTROL, &aux, 1);
+	if (aux & SIM_AUX_MOD_AGE)
+		sim_l2_mod_push(w, index, SIM_MOD_AGE);
+	pthread_mutex_unlock(&sim_lock);
+	return 0;
+}
+
+/*
+ * L3_DEFIP half 0 only (IPv4, VRF 0); matching half 1 is not modeled.  The
+ * matched entry gets HIT0 set, as a routed packet would.
+ */
+#define SIM_DEFIP_HIT0       238
+
+/*
+ * L3_ENTRY IPV4_UNICAST (VRF 0), searched before L3_DEFIP: the key
+ * (KEY_TYPE, VRF_ID, IP_ADDR; entry bits 45:1) hashes by CRC32 upper to a
+ * bucket of 8.  A match sets HIT (word 2 bit 31).  Same layout as l3.c.
+ */
+#define SIM_L3_BUCKET_SIZE   8
+#define SIM_L3_HASH_BITS     11
+#define SIM_L3_HIT           (1u << 31)
+
+static uint32_t *sim_l3_host_find(uint32_t ip)
+{
+	uint64_t key = (uint64_t)ip << 13;  /* KEY_TYPE 0, VRF_ID 0 */
+	int b = (int)(sim_crc32(key, 45) >> (32 - SIM_L3_HASH_BITS)) * SIM_L3_BUCKET_SIZE;
+	int i;
+
+	for (i = b; i < b + SIM_L3_BUCKET_SIZE; i++) {
+		uint32_t *e = sim_entry(SIM_L3_ENTRY, i);
+
+		if ((e[0] & 1u) && (e[0] & 0x3ffeu) == 0 && e[1] == ip)
+			return e;
+	}
+	return NULL;
+}
+
+/* Next hop nhi's port, MAC and VLAN, as the egress pipeline sees them (sim_lock held). */
+static void sim_l3_nhop(uint32_t nhi, int *port, uint8_t mac[6], uint16_t *vid)
+{
+	const uint32_t *ing = sim_entry(SIM_ING_L3_NEXT_HOP, (int)nhi);
+	const uint32_t *egr = sim_entry(SIM_EGR_L3_NEXT_HOP, (int)nhi);
+	uint32_t intf = (uint32_t)sim_bits(egr, 3, 12);
+	uint64_t mac48 = sim_bits(egr, 15, 48);
+	int i;
+
+	if (port)
+		*port = (int)sim_bits(ing, 16, 7);
+	if (mac)
+		for (i = 0; i < 6; i++)
+			mac[i] = (uint8_t)(mac48 >> (40 - 8 * i));
+	if (vid)
+		*vid = (uint16_t)sim_bits(sim_entry(SIM_EGR_L3_INTF, (int)intf), 13, 12);
+}
+
+int bde_sim_l3_lookup(uint32_t ip, int *port, uint8_t mac[6], uint16_t *vid)
+{
+	uint64_t search = (uint64_t)ip << 1;
+	uint32_t nhi = 0, *host;
+	int found = 0, i;
+
+	if (!sim_open)
+		return -EINVAL;
+	pthread_mutex_lock(&sim_lock);
+	host = sim_l3_host_find(ip);
+	if (host) {
+		host[2] |= SIM_L3_HIT;
+		nhi = host[2] & 0x3fff;
+		found = 1;
+	}
+	for (i = 0; !found && i < sim_mems[SIM_L3_DEFIP].entries; i++) {
+		uint32_t *e = sim_entry(SIM_L3_DEFIP, i);
+
+		if (!(e[0] & 1u))
+			continue;
+		if ((sim_bits(e, 2, 44) ^ search) & sim_bits(e, 90, 44))
+			continue;
+		e[SIM_DEFIP_HIT0 / 32] |= 1u << (SIM_DEFIP_HIT0 % 32);
+		nhi = (uint32_t)sim_bits(e, 207, 14);
+		if (sim_bits(e, 206, 1)) {
+			const uint32_t *g = sim_entry(SIM_L3_ECMP_GROUP, (int)(nhi & 0x3ff));
+			uint32_t base = (uint32_t)sim_bits(g, 10, 12);
+			uint32_t count = (uint32_t)sim_bits(g, 0, 10);
+			uint32_t h = ip ^ (ip >> 16);
+
+			if (count == 0 || base + count > (uint32_t)sim_mems[SIM_L3_ECMP].entries)
+				break;
+			nhi = sim_entry(SIM_L3_ECMP, (int)(base + (h ^ (h >> 8)) % count))[0] & 0x3fff;
+		}
+		found = 1;
+		break;
+	}
+	if (found)
+		sim_l3_nhop(nhi, port, mac, vid);
+	pthread_mutex_unlock(&sim_lock);
+	return found ? 0 : -ENOENT;
+}
+
+/*
+ * IPv6 (VRF 0, no ECMP): an L3_ENTRY IPV6_UNICAST pair (KEY_TYPE 2; half 0
+ * carries address bits 63:0, half 1 bits 127:64 and the result), then the
+ * first L3_DEFIP_128 match, then the first double-wide L3_DEFIP match
+ * (MODE0 = MODE1 = 1, halves 0/1 on address bits 127:96 / 95:64).  Same
+ * layouts as l3.c.
+ */
+#define SIM_L3_KEY_IPV6UC    2
+
+static uint32_t *sim_l3_host6_find(const uint32_t ip[4])
+{
+	uint64_t key = ((uint64_t)ip[3] << 13) | SIM_L3_KEY_IPV6UC;  /* VRF_ID 0 */
+	uint32_t crc = sim_crc32(key, 45);
+	int b, i;
+
+	for (i = 2; i >= 0; i--) {
+		uint32_t v = ip[i];
+		int n;
+
+		for (n = 0; n < 32; n++, v >>= 1)
+			crc = (crc >> 1) ^ (((crc ^ v) & 1u) ? 0xedb88320u : 0);
+	}
+	b = (int)(crc >> (32 - SIM_L3_HASH_BITS)) * SIM_L3_BUCKET_SIZE;
+	for (i = b; i < b + SIM_L3_BUCKET_SIZE; i += 2) {
+		uint32_t *h0 = sim_entry(SIM_L3_ENTRY, i), *h1 = sim_entry(SIM_L3_ENTRY, i + 1);
+
+		if ((h0[0] & 0x3fffu) == (1u | (SIM_L3_KEY_IPV6UC << 1)) &&
+		    (h1[0] & 0xfu) == (1u | (SIM_L3_KEY_IPV6UC << 1)) &&
+		    h0[1] == ip[3] && h0[2] == ip[2] && h1[1] == ip[1] && h1[2] == ip[0])
+			return h1;
+	}
+	return NULL;
+}
+
+int bde_sim_l3_lookup6(const uint32_t ip[4], int *port, uint8_t mac[6], uint16_t *vid)
+{
+	uint64_t s0 = ((uint64_t)ip[0] << 1) | 1u, s1 = ((uint64_t)ip[1] << 1) | 1u;
+	uint32_t nhi = 0, *host;
+	int found = 0, i, j;
+
+	if (!sim_open || !ip)
+		return -EINVAL;
+	pthread_mutex_lock(&sim_lock);
+	host = sim_l3_host6_find(ip);
+	if (host) {
+		host[3] |= SIM_L3_HIT;
+		nhi = host[3] & 0x3fff;
+		found = 1;
+	}
+	for (i = 0; !found && i < sim_mems[SIM_L3_DEFIP_128].entries; i++) {
+		const uint32_t *e = sim_entry(SIM_L3_DEFIP_128, i);
+
+		if (!(e[0] & 1u) || sim_bits(e, 129, 10) & sim_bits(e, 267, 10))
+			continue;
+		for (j = 0; j < 4; j++)
+			if ((sim_bits(e, 1 + 32 * (3 - j), 32) ^ ip[j]) & sim_bits(e, 139 + 32 * (3 - j), 32))
+				break;
+		if (j < 4)
+			continue;
+		nhi = (uint32_t)sim_bits(e, 278, 14);
+		found = 1;
+	}
+	for (i = 0; !found && i < sim_mems[SIM_L3_DEFIP].entries; i++) {
+		uint32_t *e = sim_entry(SIM_L3_DEFIP, i);
+
+		if ((e[0] & 3u) != 3u || !sim_bits(e, 2, 1) || !sim_bits(e, 46, 1))
+			continue;
+		if (((sim_bits(e, 2, 44) ^ s0) & sim_bits(e, 90, 44)) ||
+		    ((sim_bits(e, 46, 44) ^ s1) & sim_bits(e, 134, 44)))
+			continue;
+		e[SIM_DEFIP_HIT0 / 32] |= 1u << (SIM_DEFIP_HIT0 % 32);
+		nhi = (uint32_t)sim_bits(e, 207, 14);
+		found = 1;
+	}
+	if (found)
+		sim_l3_nhop(nhi, port, mac, vid);
+	pthread_mutex_unlock(&sim_lock);
+	return found ? 0 : -ENOENT;
+}
+
+int bde_sim_vlan_member(uint16_t vid, int port, int *untagged)
+{
+	const uint32_t *ing, *egr;
+	int member;
+
+	if (!sim_open || vid > 4095 || port < 0 || port > 65)
+		return 0;
+	pthread_mutex_lock(&sim_lock);
+	ing = sim_entry(SIM_VLAN, vid);
+	egr = sim_entry(SIM_EGR_VLAN, vid);
+	/* VLAN: VALID@205, PORT_BITMAP@0; EGR_VLAN: VALID@0, UT@96, PORT_BITMAP@162 */
+	member = sim_bits(ing, 205, 1) && sim_bits(ing, port, 1) &&
+		 sim_bits(egr, 0, 1) && sim_bits(egr, 162 + port, 1);
+	if (member && untagged)
+		*untagged = (int)sim_bits(egr, 96 + port, 1);
+	pthread_mutex_unlock(&sim_lock);
+	return member;
+}
+
+/* XLMAC block/lane per xe port, as stats.c addresses them. */
+static const struct {
+	uint32_t block_id;
+	int base_xe;
+	int lane[4];
+} sim_stat_blocks[] = {
+	{ 0x40a,  0, { 0, 1, 2, 3 } },
+	{ 0x40b,  4, { 0, 1, 2, 3 } },
+	{ 0x00b,  8, { 0, 1, 2, 3 } },
+	{ 0x00c, 12, { 0, 1, 2, 3 } },
+	{ 0x00d, 16, { 0, 1, 2, 3 } },
+	{ 0x00e, 20, { 1, 0, 3, 2 } },
+	{ 0x00f, 24, { 1, 0, 3, 2 } },
+	{ 0x400, 28, { 0, 1, 2, 3 } },
+	{ 0x401, 32, { 0, 1, 2, 3 } },
+	{ 0x402, 36, { 0, 1, 2, 3 } },
+	{ 0x403, 40, { 0, 1, 2, 3 } },
+	{ 0x404, 44, { 0, 1, 2, 3 } },
+	{ 0x406, 48, { 0, 0, 0, 0 } },
+	{ 0x405, 49, { 0, 0, 0, 0 } },
+	{ 0x409, 50, { 0, 0, 0, 0 } },
+	{ 0x408, 51, { 0, 0, 0, 0 } },
+};
+
+static void sim_counter_add(uint32_t addr, uint64_t delta)
+{
+	struct sim_cell *c = sim_cell(sim_sbus_key(sim_addr_block(addr), addr), 1);
+	uint64_t v;
+
+	if (!c)
+		return;
+	/* 64-bit register: word 0 = high half (stats.c) */
+	v = (((uint64_t)c->w[0] << 32) | c->w[1]) + delta;
+	c->w[0] = (uint32_t)(v >> 32);
+	c->w[1] = (uint32_t)v;
+}
+
+int bde_sim_port_count(int port, int rx, uint64_t pkts, uint64_t bytes)
+{
+	int xe = port - 1, i;
+
+	if (!sim_open || port <= 0 || port > 52)
+		return -EINVAL;
+	for (i = 0; i < (int)(sizeof(sim_stat_blocks) / sizeof(sim_stat_blocks[0])); i++) {
+		int base = sim_stat_blocks[i].base_xe;
+		uint32_t addr;
+
+		if (xe < base || xe >= base + (base >= 48 ? 1 : 4))
+			continue;
+		addr = (sim_stat_blocks[i].block_id << 20) |
+		       ((uint32_t)sim_stat_blocks[i].lane[xe - base] << 12);
+		pthread_mutex_lock(&sim_lock);
+		sim_counter_add(addr | (rx ? 0x0bu : 0x45u), pkts);   /* RPKT / TPKT */
+		sim_counter_add(addr | (rx ? 0x34u : 0x64u), bytes);  /* RBYT / TBYT */
+		pthread_mutex_unlock(&sim_lock);
+		return 0;
+	}
+	return -EINVAL;
+}
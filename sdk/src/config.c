@@ -1,4 +1,5 @@
 /* Load config.bcm (key=value). Portmap and other params for ASIC init. */
+#include "bcm56846_types.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +15,25 @@ typedef struct {
 
 static portmap_entry_t portmap[MAX_PORTMAP];
 static int portmap_count;
+static int schan_ring;
+static int l2_hw_hash = 1;
+static int l2_age_time = 300;
+static int l2_hash_select = BCM56846_L2_HASH_CRC32_UPPER;
+static bcm56846_l2_port_limit_t l2_limit = { 0, 0, BCM56846_L2_LIMIT_NOLEARN, 100 };
+
+static const char *const l2_hash_names[BCM56846_L2_HASH_COUNT] = {
+	[BCM56846_L2_HASH_CRC32_UPPER] = "crc32_upper",
+	[BCM56846_L2_HASH_CRC32_LOWER] = "crc32_lower",
+	[BCM56846_L2_HASH_CRC16_UPPER] = "crc16_upper",
+	[BCM56846_L2_HASH_CRC16_LOWER] = "crc16_lower",
+	[BCM56846_L2_HASH_LSB]         = "lsb",
+};
+
+static const char *const l2_limit_action_names[] = {
+	[BCM56846_L2_LIMIT_NOLEARN] = "nolearn",
+	[BCM56846_L2_LIMIT_DROP]    = "drop",
+	[BCM56846_L2_LIMIT_TRAP]    = "trap",
+};
 
 /* Call after load_config; used by init/port code */
 int bcm56846_config_get_portmap(int port_id, int *lane, int *speed)
@@ -30,6 +50,66 @@ int bcm56846_config_get_port_count(void)
 	return portmap_count;
 }
 
+/* "schan_ring=1": issue SCHAN batches through the DMA-pool message ring */
+int bcm56846_config_get_schan_ring(void)
+{
+	return schan_ring;
+}
+
+/* "l2_hw_hash=0": place L2 entries in software instead of TABLE_INSERT/DELETE */
+int bcm56846_config_get_l2_hw_hash(void)
+{
+	return l2_hw_hash;
+}
+
+/* "l2_age_time=N": seconds before an idle dynamic L2 entry is removed (0 = never) */
+int bcm56846_config_get_l2_age_time(void)
+{
+	return l2_age_time;
+}
+
+/* "l2_hash_select=crc32_upper|crc32_lower|crc16_upper|crc16_lower|lsb": L2_ENTRY bucket hash */
+int bcm56846_config_get_l2_hash_select(void)
+{
+	return l2_hash_select;
+}
+
+/*
+ * Per-port defaults for every port: "l2_learn_limit=N" dynamic MACs and
+ * "l2_move_limit=N" station moves per second (0 = none),
+ * "l2_limit_action=nolearn|drop|trap", "l2_limit_trap_pps=N"
+ */
+void bcm56846_config_get_l2_port_limit(bcm56846_l2_port_limit_t *limit)
+{
+	*limit = l2_limit;
+}
+
+static void parse_l2_limit_action(const char *name)
+{
+	int i;
+
+	for (i = 0; i < (int)(sizeof(l2_limit_action_names) / sizeof(l2_limit_action_names[0])); i++) {
+		if (strcmp(name, l2_limit_action_names[i]) == 0) {
+			l2_limit.action = (bcm56846_l2_limit_action_t)i;
+			return;
+		}
+	}
+	fprintf(stderr, "config: unknown l2_limit_action '%s', using nolearn\n", name);
+}
+
+static void parse_l2_hash_select(const char *name)
+{
+	int i;
+
+	for (i = 0; i < BCM56846_L2_HASH_COUNT; i++) {
+		if (strcmp(name, l2_hash_names[i]) == 0) {
+			l2_hash_select = i;
+			return;
+		}
+	}
+	fprintf(stderr, "config: unknown l2_hash_select '%s', using crc32_upper\n", name);
+}
+
 /* Parse "portmap_N.0=65:10" or "portmap_N=65:10" */
 static int parse_portmap_line(const char *line)
 {
@@ -61,10 +141,19 @@ int bcm56846_config_load(const char *path)
 {
 	FILE *f;
 	char line[256];
+	char name[32];
 	char filepath[CONFIG_PATH_MAX];
 
 	portmap_count = 0;
 	memset(portmap, 0, sizeof(portmap));
+	schan_ring = 0;
+	l2_hw_hash = 1;
+	l2_age_time = 300;
+	l2_hash_select = BCM56846_L2_HASH_CRC32_UPPER;
+	l2_limit.learn_limit = 0;
+	l2_limit.move_limit = 0;
+	l2_limit.action = BCM56846_L2_LIMIT_NOLEARN;
+	l2_limit.trap_pps = 100;
 
 	if (!path)
 		return -1;
@@ -80,7 +169,25 @@ int bcm56846_config_load(const char *path)
 		trim(line);
 		if (!line[0] || line[0] == '#')
 			continue;
-		parse_portmap_line(line);
+		if (parse_portmap_line(line) == 0)
+			continue;
+		if (sscanf(line, "schan_ring=%d", &schan_ring) == 1)
+			continue;
+		if (sscanf(line, "l2_hw_hash=%d", &l2_hw_hash) == 1)
+			continue;
+		if (sscanf(line, "l2_hash_select=%31s", name) == 1) {
+			parse_l2_hash_select(name);
+			continue;
+		}
+		if (sscanf(line, "l2_learn_limit=%d", &l2_limit.learn_limit) == 1 ||
+		    sscanf(line, "l2_move_limit=%d", &l2_limit.move_limit) == 1 ||
+		    sscanf(line, "l2_limit_trap_pps=%d", &l2_limit.trap_pps) == 1)
+			continue;
+		if (sscanf(line, "l2_limit_action=%31s", name) == 1) {
+			parse_l2_limit_action(name);
+			continue;
+		}
+		sscanf(line, "l2_age_time=%d", &l2_age_time);
 	}
 	fclose(f);
 	return 0;
@@ -36,10 +36,11 @@ static void set_bits_u64(uint32_t *words, int num_words, int start_bit, int widt
 	}
 }
 
-static int l3_ecmp_write(int unit, int index, uint32_t word)
+/* Write count consecutive L3_ECMP member entries in one SLAM. */
+static int l3_ecmp_write_range(int unit, int index, const uint32_t *words, int count)
 {
 	(void)unit;
-	return sbus_mem_write(L3_ECMP_BASE, index, &word, L3_ECMP_WORDS);
+	return sbus_mem_slam(L3_ECMP_BASE, index, count, words, L3_ECMP_WORDS);
 }
 
 static int l3_ecmp_group_write(int unit, int group_id, const uint32_t *words)
@@ -125,10 +126,13 @@ int bcm56846_l3_ecmp_create(int unit, const int *egress_ids, int count, int *ecm
 		return -ENOSPC;
 	}
 
-	/* Write member table entries */
-	for (int i = 0; i < count; i++) {
-		uint32_t w = (uint32_t)(egress_ids[i] & 0x3fff);
-		if (l3_ecmp_write(unit, base_ptr + i, w) != 0) {
+	/* Write member table entries (one SLAM for the whole member block) */
+	{
+		uint32_t members[1023];
+
+		for (int i = 0; i < count; i++)
+			members[i] = (uint32_t)(egress_ids[i] & 0x3fff);
+		if (l3_ecmp_write_range(unit, base_ptr, members, count) != 0) {
 			free_ecmp_slots(base_ptr, count);
 			free_group_id(group);
 			return -EIO;
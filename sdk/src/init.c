@@ -183,6 +183,8 @@ int bcm56846_chip_init(int unit)
 
 	(void)unit;
 	fprintf(stderr, "[init] bcm56846_chip_init: begin\n");
+	/* Shadowed register values do not survive a (re)init */
+	sbus_reg_cache_invalidate_all();
 
 	/*
 	 * Step 1: Log diagnostic registers (read-only, no gating).
@@ -302,6 +304,10 @@ int bcm56846_chip_init(int unit)
 	 */
 	{
 		extern int bcm56846_datapath_init(void);
+		extern int bcm56846_config_get_schan_ring(void);
+
+		if (bcm56846_config_get_schan_ring())
+			sbus_ring_enable(1);
 		if (bcm56846_datapath_init() < 0)
 			fprintf(stderr,
 				"[init] WARNING: datapath init failed\n");
@@ -176,6 +176,7 @@
 #define USE_TCP_UDP_PORTS_BIT        22
 #define L3_HASH_SELECT_SHIFT         18
 #define L3_HASH_SELECT_MASK          (0x7u << 18)
+#define L2_HASH_SELECT_MASK          0x7u   /* L2_AND_VLAN_MAC_HASH_SELECT */
 #define NON_UC_TRUNK_HASH_USE_RTAG7_BIT 24
 
 /* CPU_CONTROL_1r */
@@ -267,37 +268,70 @@ static uint32_t xlport_reg_addr(int xe, int reg_offset)
 #define XMAC_TX_CTRL_OFF  0x604
 #define XMAC_RX_CTRL_OFF  0x606
 
+/*
+ * Shared SCHAN batch for the bulk write loops below.  Each helper queues its
+ * writes and submits before returning, so ordering against the unbatched
+ * sbus_* calls in between is preserved.
+ */
+static sbus_batch_t dp_batch;
+
 /* ===== Helper: write per-port register to all ports ===== */
 static int reg_write_allports(uint32_t base, uint32_t value)
 {
-	int p, rc = 0;
-	for (p = PORT_MIN; p <= PORT_MAX; p++) {
-		if (sbus_reg_write(cdk_port_addr(base, p), value) < 0)
-			rc = -1;
-	}
-	return rc;
+	int p;
+
+	sbus_batch_init(&dp_batch);
+	for (p = PORT_MIN; p <= PORT_MAX; p++)
+		sbus_batch_reg_write(&dp_batch, cdk_port_addr(base, p), value);
+	sbus_batch_submit(&dp_batch);
+	return dp_batch.errors ? -1 : 0;
 }
 
-/* Helper: modify per-port register for all ports */
+/*
+ * Helper: modify per-port register for all ports.  Ports missing from the
+ * register shadow cache are read in one batch, then all writes go in a
+ * second batch.  The read statuses are taken before any write is queued:
+ * the writes reuse the batch slots.  A port whose read failed is skipped.
+ */
 static int reg_modify_allports(uint32_t base, uint32_t mask, uint32_t value)
 {
+	uint32_t cur[PORT_MAX + 1];
+	int slot[PORT_MAX + 1], bad[PORT_MAX + 1];
 	int p, rc = 0;
+
+	sbus_batch_init(&dp_batch);
+	for (p = PORT_MIN; p <= PORT_MAX; p++) {
+		slot[p] = -1;
+		if (sbus_reg_cache_get(cdk_port_addr(base, p), &cur[p]) < 0) {
+			slot[p] = dp_batch.count;
+			sbus_batch_reg_read(&dp_batch, cdk_port_addr(base, p), &cur[p]);
+		}
+	}
+	sbus_batch_submit(&dp_batch);
+	for (p = PORT_MIN; p <= PORT_MAX; p++)
+		bad[p] = slot[p] >= 0 && sbus_batch_status(&dp_batch, slot[p]) != 0;
 	for (p = PORT_MIN; p <= PORT_MAX; p++) {
-		if (sbus_reg_modify(cdk_port_addr(base, p), mask, value) < 0)
+		if (bad[p]) {
 			rc = -1;
+			continue;
+		}
+		sbus_batch_reg_write(&dp_batch, cdk_port_addr(base, p),
+				     (cur[p] & ~mask) | (value & mask));
 	}
-	return rc;
+	sbus_batch_submit(&dp_batch);
+	return (rc || dp_batch.errors) ? -1 : 0;
 }
 
 /* Helper: write 64-bit per-port register to all ports */
 static int reg_write64_allports(uint32_t base, const uint32_t *data)
 {
-	int p, rc = 0;
-	for (p = PORT_MIN; p <= PORT_MAX; p++) {
-		if (sbus_reg_write64(cdk_port_addr(base, p), data) < 0)
-			rc = -1;
-	}
-	return rc;
+	int p;
+
+	sbus_batch_init(&dp_batch);
+	for (p = PORT_MIN; p <= PORT_MAX; p++)
+		sbus_batch_reg_write64(&dp_batch, cdk_port_addr(base, p), data);
+	sbus_batch_submit(&dp_batch);
+	return dp_batch.errors ? -1 : 0;
 }
 
 /*
@@ -341,13 +375,17 @@ static int init_ingress_buffers(void)
 	reg_write_allports(PORT_MIN_CELLr, 0);
 
 	/* pg_min_cell = 0, pg_hdrm_limit_cell = 0 (defaults for all PGs, all ports) */
+	sbus_batch_init(&dp_batch);
 	for (p = PORT_MIN; p <= PORT_MAX; p++) {
 		int pg;
 		for (pg = 0; pg < 8; pg++) {
-			sbus_reg_write(cdk_port_addr(PG_MIN_CELLr + pg, p), 0);
-			sbus_reg_write(cdk_port_addr(PG_HDRM_LIMIT_CELLr + pg, p), 0);
+			sbus_batch_reg_write(&dp_batch,
+					     cdk_port_addr(PG_MIN_CELLr + pg, p), 0);
+			sbus_batch_reg_write(&dp_batch,
+					     cdk_port_addr(PG_HDRM_LIMIT_CELLr + pg, p), 0);
 		}
 	}
+	sbus_batch_submit(&dp_batch);
 
 	/*
 	 * PG0 min cell limits:
@@ -419,12 +457,14 @@ static int init_priority_mapping(void)
 
 	/* write ing_untagged_phb 0 64: all entries = 0 (pri=0, cng=0) */
 	memset(data, 0, sizeof(data));
+	sbus_batch_init(&dp_batch);
 	for (i = 0; i < 64; i++)
-		sbus_mem_write(ING_UNTAGGED_PHBm, i, data, 1);
+		sbus_batch_mem_write(&dp_batch, ING_UNTAGGED_PHBm, i, data, 1);
 
 	/* write ing_pri_cng_map 0 1024: all entries = 0 */
 	for (i = 0; i < 1024; i++)
-		sbus_mem_write(ING_PRI_CNG_MAPm, i, data, 1);
+		sbus_batch_mem_write(&dp_batch, ING_PRI_CNG_MAPm, i, data, 1);
+	sbus_batch_submit(&dp_batch);
 
 	/*
 	 * modify ing_pri_cng_map: set PRI field for indices 0-15
@@ -535,16 +575,22 @@ static int init_forwarding(void)
 	 *   use_tcp_udp_ports = 1 (bit 22)
 	 *   l3_hash_select = 4 (bits 20:18)
 	 *   non_uc_trunk_hash_use_rtag7 = 1 (bit 24)
+	 *   l2_and_vlan_mac_hash_select (bits 2:0) = l2_hash_select from
+	 *     config.bcm (4, CRC32 upper, by default): the bucket hash l2.c's
+	 *     L2_ENTRY shadow computes
 	 */
 	{
+		extern uint32_t bcm56846_l2_hash_hw_select(void);
 		uint32_t mask = (1u << ECMP_HASH_USE_RTAG7_BIT) |
 				(1u << USE_TCP_UDP_PORTS_BIT) |
 				L3_HASH_SELECT_MASK |
-				(1u << NON_UC_TRUNK_HASH_USE_RTAG7_BIT);
+				(1u << NON_UC_TRUNK_HASH_USE_RTAG7_BIT) |
+				L2_HASH_SELECT_MASK;
 		uint32_t val  = (1u << ECMP_HASH_USE_RTAG7_BIT) |
 				(1u << USE_TCP_UDP_PORTS_BIT) |
 				(4u << L3_HASH_SELECT_SHIFT) |
-				(1u << NON_UC_TRUNK_HASH_USE_RTAG7_BIT);
+				(1u << NON_UC_TRUNK_HASH_USE_RTAG7_BIT) |
+				bcm56846_l2_hash_hw_select();
 		sbus_reg_modify(HASH_CONTROLr, mask, val);
 	}
 
@@ -795,15 +841,24 @@ static int init_egress_config(void)
  * ===================================================================
  */
 
-/* Helper: zero a memory table range */
+/* Helper: zero entries 0..count-1 of a memory table (SLAMs of up to 296x6 words) */
 static void thdo_zero_table(uint32_t addr, int count, int nwords)
 {
-	uint32_t data[6] = {0};
-	int i;
-
-	if (nwords > 6) nwords = 6;
-	for (i = 0; i < count; i++)
-		sbus_mem_write(addr, i, data, nwords);
+	static const uint32_t zero[296 * 6];
+	int per = nwords > 0 ? (int)(sizeof(zero) / sizeof(zero[0])) / nwords : 0;
+	int i, n;
+
+	if (per == 0) {
+		fprintf(stderr, "[datapath] zero 0x%08x: %d-word entries not supported\n",
+			addr, nwords);
+		return;
+	}
+	for (i = 0; i < count; i += n) {
+		n = count - i < per ? count - i : per;
+		if (sbus_mem_slam(addr, i, n, zero, nwords) != 0)
+			fprintf(stderr, "[datapath] zero 0x%08x[%d..%d] failed\n",
+				addr, i, i + n - 1);
+	}
 }
 
 /*
@@ -7,13 +7,49 @@
 #include "bcm56846_regs.h"
 #include "sbus.h"
 #include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #define L2_ENTRY_BASE     0x07120000u
 #define L2_ENTRY_ENTRIES  131072
 #define L2_ENTRY_WORDS    4
 #define KEY_TYPE_L2       0
 
+/*
+ * The ASIC hashes the key to a bucket of 8 consecutive entries (16K
+ * buckets) and searches only that bucket.  HASH_CONTROL selects the hash
+ * (CRC32 upper unless l2_hash_select in config.bcm says otherwise,
+ * init_datapath.c); l2_bucket() computes the same thing.
+ */
+#define L2_BUCKET_SIZE    8
+#define L2_HASH_BITS      14  /* log2(L2_ENTRY_ENTRIES / L2_BUCKET_SIZE) */
+#define L2_KEY_BITS       63  /* KEY_TYPE, VLAN_ID, MAC_ADDR: entry bits 63:1 */
+
+/* word[2] flags; hit bits are set by the pipeline on a DA/SA match (tentative) */
+#define L2_T              (1u << 15)  /* entry bit 79: PORT_NUM holds a TGID */
+#define L2_STATIC         (1u << 29)  /* entry bit 93 */
+#define L2_HITDA          (1u << 30)  /* entry bit 94 */
+#define L2_HITSA          (1u << 31)  /* entry bit 95 */
+
+/*
+ * Software shadow of L2_ENTRY (raw entry words), loaded from the hardware
+ * with one TDMA on first use and then kept write-through, so lookups cost
+ * no SCHAN op and adds/deletes touch exactly one index.  l2_lock
+ * serializes every L2_ENTRY update.
+ */
+static pthread_mutex_t l2_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t l2_shadow[L2_ENTRY_ENTRIES][L2_ENTRY_WORDS];
+static int l2_shadow_loaded;
+static uint32_t l2_insert_fail;  /* adds refused: bucket full */
+
+/* Dynamic (non-static, non-trunk) entries in the shadow per port, for learn limits */
+#define L2_PORTS          128  /* PORT_NUM is 7 bits */
+static int l2_port_learned[L2_PORTS];
+
 /* Hash key: (MAC<<16)|(VLAN<<4)|(KEY_TYPE<<1)|0. VALID=0 in key. */
 static uint64_t l2_hash_key(const uint8_t mac[6], uint16_t vid)
 {
@@ -23,6 +59,119 @@ static uint64_t l2_hash_key(const uint8_t mac[6], uint16_t vid)
 	return (mac48 << 16) | ((uint64_t)(vid & 0xfff) << 4) | (KEY_TYPE_L2 << 1);
 }
 
+static uint32_t l2_crc_table[256];
+static pthread_once_t l2_crc_once = PTHREAD_ONCE_INIT;
+
+static void l2_crc_init(void)
+{
+	int i, b;
+
+	for (i = 0; i < 256; i++) {
+		uint32_t c = (uint32_t)i;
+
+		for (b = 0; b < 8; b++)
+			c = (c >> 1) ^ ((c & 1u) ? 0xedb88320u : 0);
+		l2_crc_table[i] = c;
+	}
+}
+
+/*
+ * Reflected CRC-32 (0xEDB88320) over nbits of key, LSB first, continuing
+ * from crc (0 to start).  The ASIC's L2_ENTRY and L3_ENTRY bucket hashes;
+ * l3.c uses it too.
+ */
+uint32_t bcm56846_hash_crc32(uint32_t crc, uint64_t key, int nbits)
+{
+	pthread_once(&l2_crc_once, l2_crc_init);
+	for (; nbits >= 8; nbits -= 8, key >>= 8)
+		crc = (crc >> 8) ^ l2_crc_table[(crc ^ (uint32_t)key) & 0xffu];
+	for (; nbits > 0; nbits--, key >>= 1)
+		crc = (crc >> 1) ^ (((crc ^ (uint32_t)key) & 1u) ? 0xedb88320u : 0);
+	return crc;
+}
+
+/* Reflected CRC-16 (0x8408, init 0) over nbits of key, LSB first. */
+static uint32_t l2_crc16(uint64_t key, int nbits)
+{
+	uint32_t crc = 0;
+
+	for (; nbits > 0; nbits--, key >>= 1)
+		crc = (crc >> 1) ^ (((crc ^ (uint32_t)key) & 1u) ? 0x8408u : 0);
+	return crc;
+}
+
+/*
+ * HASH_CONTROL.L2_AND_VLAN_MAC_HASH_SELECT encoding per bcm56846_l2_hash_t.
+ * CRC32 upper (4) is what the switch runs with; the others are tentative
+ * (XGS family order, not yet confirmed on the AS5610).
+ */
+#define HASH_CONTROLr             0x05180640u
+#define L2_HASH_SELECT_MASK       0x7u
+
+static const uint32_t l2_hash_hw[BCM56846_L2_HASH_COUNT] = {
+	[BCM56846_L2_HASH_CRC32_UPPER] = 4,
+	[BCM56846_L2_HASH_CRC32_LOWER] = 5,
+	[BCM56846_L2_HASH_CRC16_UPPER] = 1,
+	[BCM56846_L2_HASH_CRC16_LOWER] = 2,
+	[BCM56846_L2_HASH_LSB]         = 3,
+};
+
+static int l2_hash_sel = -1;  /* -1: l2_hash_select from config.bcm */
+
+static int l2_hash_current(void)
+{
+	extern int bcm56846_config_get_l2_hash_select(void);
+
+	if (l2_hash_sel < 0)
+		l2_hash_sel = bcm56846_config_get_l2_hash_select();
+	return l2_hash_sel;
+}
+
+/* HASH_CONTROL encoding of the configured L2 hash, for init_datapath.c. */
+uint32_t bcm56846_l2_hash_hw_select(void)
+{
+	return l2_hash_hw[l2_hash_current()];
+}
+
+/* First L2_ENTRY index of the bucket (MAC, VID) hashes to under hash. */
+static int l2_bucket_hash(const uint8_t mac[6], uint16_t vid, int hash)
+{
+	uint64_t key = l2_hash_key(mac, vid) >> 1;
+	uint32_t b;
+
+	switch (hash) {
+	case BCM56846_L2_HASH_CRC32_LOWER:
+		b = bcm56846_hash_crc32(0, key, L2_KEY_BITS);
+		break;
+	case BCM56846_L2_HASH_CRC16_UPPER:
+		b = l2_crc16(key, L2_KEY_BITS) >> (16 - L2_HASH_BITS);
+		break;
+	case BCM56846_L2_HASH_CRC16_LOWER:
+		b = l2_crc16(key, L2_KEY_BITS);
+		break;
+	case BCM56846_L2_HASH_LSB:
+		b = (uint32_t)(key >> 15);  /* MAC[13:0] */
+		break;
+	default:
+		b = bcm56846_hash_crc32(0, key, L2_KEY_BITS) >> (32 - L2_HASH_BITS);
+		break;
+	}
+	return (int)(b & ((1u << L2_HASH_BITS) - 1)) * L2_BUCKET_SIZE;
+}
+
+static int l2_bucket(const uint8_t mac[6], uint16_t vid)
+{
+	return l2_bucket_hash(mac, vid, l2_hash_current());
+}
+
+int bcm56846_l2_bucket_get(int unit, const uint8_t mac[6], uint16_t vid)
+{
+	(void)unit;
+	if (!mac)
+		return -EINVAL;
+	return l2_bucket(mac, vid) / L2_BUCKET_SIZE;
+}
+
 /* Pack L2_ENTRY 4 words. Entry bits: VALID@0, KEY_TYPE@3:1, VLAN@15:4, MAC@63:16, PORT@70:64, MODULE@78:71, T@79, STATIC@93. */
 static void l2_pack_entry(const bcm56846_l2_addr_t *addr, uint32_t *words)
 {
@@ -39,7 +188,7 @@ static void l2_pack_entry(const bcm56846_l2_addr_t *addr, uint32_t *words)
 	w1 = (uint32_t)addr->mac[2] << 24 | (uint32_t)addr->mac[3] << 16 |
 	     (uint32_t)addr->mac[4] << 8 | addr->mac[5];
 	/* word[2]: PORT_NUM[6:0], MODULE_ID[14:7], T=0, STATIC_BIT[29] */
-	w2 = (uint32_t)port | ((uint32_t)(mod & 0xff) << 7) | ((uint32_t)static_bit << 29);
+	w2 = (uint32_t)port | ((uint32_t)(mod & 0xff) << 7) | (static_bit ? L2_STATIC : 0);
 
 	words[0] = w0;
 	words[1] = w1;
@@ -54,13 +203,6 @@ static int l2_table_write(int unit, int index, const uint32_t *words)
 	return sbus_mem_write(L2_ENTRY_BASE, index, words, L2_ENTRY_WORDS);
 }
 
-/* Read L2_ENTRY at index via SCHAN READ_MEMORY. */
-static int l2_table_read(int unit, int index, uint32_t *words)
-{
-	(void)unit;
-	return sbus_mem_read(L2_ENTRY_BASE, index, words, L2_ENTRY_WORDS);
-}
-
 /* Delete: write all-zero (VALID=0) at index. */
 static int l2_table_delete_at(int unit, int index)
 {
@@ -82,80 +224,1244 @@ static void l2_unpack_entry(const uint32_t *words, bcm56846_l2_addr_t *addr)
 	addr->static_entry = ((words[2] >> 29) & 1u) ? 1 : 0;
 }
 
+/* Port a shadow entry counts against in l2_port_learned, or -1. */
+static int l2_count_port(const uint32_t *e)
+{
+	if (!(e[0] & 1u) || (e[2] & (L2_STATIC | L2_T)))
+		return -1;
+	return (int)(e[2] & 0x7f);
+}
+
+static void l2_port_recount(void)
+{
+	int i, p;
+
+	memset(l2_port_learned, 0, sizeof(l2_port_learned));
+	for (i = 0; i < L2_ENTRY_ENTRIES; i++)
+		if ((p = l2_count_port(l2_shadow[i])) >= 0)
+			l2_port_learned[p]++;
+}
+
+/* Every single-entry shadow update goes through here (words NULL = clear). */
+static void l2_shadow_put(int index, const uint32_t *words)
+{
+	uint32_t *e = l2_shadow[index];
+	int p;
+
+	if ((p = l2_count_port(e)) >= 0)
+		l2_port_learned[p]--;
+	if (words)
+		memcpy(e, words, sizeof(l2_shadow[0]));
+	else
+		memset(e, 0, sizeof(l2_shadow[0]));
+	if ((p = l2_count_port(e)) >= 0)
+		l2_port_learned[p]++;
+}
+
+/* Seed the shadow from the hardware table (entries left by a previous run). */
+static void l2_shadow_load(void)
+{
+	const uint32_t *view;
+
+	if (l2_shadow_loaded)
+		return;
+	view = sbus_mem_view(L2_ENTRY_BASE, 0, L2_ENTRY_ENTRIES, L2_ENTRY_WORDS);
+	if (view) {
+		memcpy(l2_shadow, view, sizeof(l2_shadow));
+		sbus_mem_view_release();
+	} else {
+		fprintf(stderr, "[l2] L2_ENTRY read failed, shadow starts empty\n");
+	}
+	l2_port_recount();
+	l2_shadow_loaded = 1;
+}
+
+/*
+ * Index of the valid shadow entry with the key of words (packed entry) in
+ * the bucket starting at bucket, or -1.  *free_idx gets the first free
+ * slot of the bucket (-1 if full) when non-NULL.
+ */
+static int l2_shadow_find(int bucket, const uint32_t *words, int *free_idx)
+{
+	int i;
+
+	if (free_idx)
+		*free_idx = -1;
+	for (i = bucket; i < bucket + L2_BUCKET_SIZE; i++) {
+		const uint32_t *e = l2_shadow[i];
+
+		if (!(e[0] & 1u)) {
+			if (free_idx && *free_idx < 0)
+				*free_idx = i;
+			continue;
+		}
+		if (e[0] == words[0] && e[1] == words[1])
+			return i;
+	}
+	return -1;
+}
+
+/* Key-only entry image for l2_shadow_find(). */
+static void l2_key_words(const uint8_t mac[6], uint16_t vid, uint32_t *words)
+{
+	bcm56846_l2_addr_t key;
+
+	memset(&key, 0, sizeof(key));
+	memcpy(key.mac, mac, 6);
+	key.vid = vid;
+	l2_pack_entry(&key, words);
+}
+
+/*
+ * Hardware-hashed path: TABLE_INSERT/DELETE/LOOKUP let the ASIC pick the
+ * slot, so a colliding valid entry can never be overwritten.  On by
+ * default ("l2_hw_hash=0" in config.bcm turns it off); dropped for the
+ * rest of the run the first time the ASIC NACKs a table op.
+ */
+static int l2_hw_nack;
+
+static int l2_hw_hash(void)
+{
+	extern int bcm56846_config_get_l2_hw_hash(void);
+
+	return !l2_hw_nack && bcm56846_config_get_l2_hw_hash();
+}
+
+static void l2_hw_hash_failed(void)
+{
+	l2_hw_nack = 1;
+	fprintf(stderr, "[l2] TABLE_INSERT/DELETE not accepted, placing L2 entries in software\n");
+}
+
+/* Record words at index, dropping a stale copy of the key elsewhere in the bucket. */
+static void l2_shadow_set(int bucket, int index, const uint32_t *words)
+{
+	int old = l2_shadow_find(bucket, words, NULL);
+
+	if (old >= 0 && old != index)
+		l2_shadow_put(old, NULL);
+	l2_shadow_put(index, words);
+}
+
+/*
+ * Add or replace (MAC, VID): an existing entry is rewritten in place,
+ * otherwise the first free slot of its bucket is used.  -ENOSPC when the
+ * bucket is full.
+ */
 int bcm56846_l2_addr_add(int unit, const bcm56846_l2_addr_t *addr)
 {
 	uint32_t words[L2_ENTRY_WORDS];
-	uint64_t key;
-	int index;
-	int probe;
+	int bucket, index, free_idx, rc = 0;
 
 	if (!addr)
 		return -EINVAL;
 	l2_pack_entry(addr, words);
-	key = l2_hash_key(addr->mac, addr->vid);
-	index = (int)(key % L2_ENTRY_ENTRIES);
+	pthread_mutex_lock(&l2_lock);
+	l2_shadow_load();
+	bucket = l2_bucket(addr->mac, addr->vid);
+	if (l2_hw_hash()) {
+		rc = sbus_table_insert(L2_ENTRY_BASE, words, L2_ENTRY_WORDS, &index);
+		if (rc == 0 && (index < 0 || index >= L2_ENTRY_ENTRIES))
+			rc = -EIO;
+		if (rc == 0)
+			l2_shadow_set(bucket, index, words);
+		if (rc == -ENOSPC)
+			l2_insert_fail++;
+		if (rc != -ENOTSUP) {
+			pthread_mutex_unlock(&l2_lock);
+			return rc;
+		}
+		l2_hw_hash_failed();
+		rc = 0;
+	}
+	index = l2_shadow_find(bucket, words, &free_idx);
 	if (index < 0)
-		index += L2_ENTRY_ENTRIES;
-	/* Linear probe 0..5 for collision (per L2_WRITE_PATH: retry 0..5) */
-	for (probe = 0; probe < 6; probe++) {
-		int idx = (index + probe) % L2_ENTRY_ENTRIES;
-		if (l2_table_write(unit, idx, words) == 0)
-			return 0;
+		index = free_idx;
+	if (index < 0) {
+		rc = -ENOSPC;
+		l2_insert_fail++;
+	} else if (l2_table_write(unit, index, words) != 0) {
+		rc = -EIO;
+	} else {
+		l2_shadow_put(index, words);
 	}
-	return -ENOSPC;
+	pthread_mutex_unlock(&l2_lock);
+	return rc;
 }
 
 int bcm56846_l2_addr_delete(int unit, const uint8_t mac[6], uint16_t vid)
 {
-	uint64_t key;
-	int index;
-	int probe;
+	uint32_t words[L2_ENTRY_WORDS];
+	int bucket, index, rc = 0;
 
 	if (!mac)
 		return -EINVAL;
-	key = l2_hash_key(mac, vid);
-	index = (int)(key % L2_ENTRY_ENTRIES);
-	if (index < 0)
-		index += L2_ENTRY_ENTRIES;
-	for (probe = 0; probe < 6; probe++) {
-		int idx = (index + probe) % L2_ENTRY_ENTRIES;
-		if (l2_table_delete_at(unit, idx) == 0)
-			return 0;
+	l2_key_words(mac, vid, words);
+	pthread_mutex_lock(&l2_lock);
+	l2_shadow_load();
+	bucket = l2_bucket(mac, vid);
+	if (l2_hw_hash()) {
+		rc = sbus_table_delete(L2_ENTRY_BASE, words, L2_ENTRY_WORDS, &index);
+		if (rc == 0 || rc == -ENOENT) {
+			index = l2_shadow_find(bucket, words, NULL);
+			if (index >= 0)
+				l2_shadow_put(index, NULL);
+			pthread_mutex_unlock(&l2_lock);
+			return 0; /* not present is not an error */
+		}
+		if (rc != -ENOTSUP) {
+			pthread_mutex_unlock(&l2_lock);
+			return rc;
+		}
+		l2_hw_hash_failed();
+		rc = 0;
+	}
+	index = l2_shadow_find(bucket, words, NULL);
+	if (index >= 0) {
+		if (l2_table_delete_at(unit, index) != 0)
+			rc = -EIO;
+		else
+			l2_shadow_put(index, NULL);
 	}
-	return 0; /* best-effort: may not have been present */
+	pthread_mutex_unlock(&l2_lock);
+	return rc; /* not present is not an error */
 }
 
+/*
+ * Served from the shadow (no SCHAN op).  On a miss with the hardware path,
+ * one TABLE_LOOKUP picks up entries the SDK did not install.
+ */
 int bcm56846_l2_addr_get(int unit, const uint8_t mac[6], uint16_t vid, bcm56846_l2_addr_t *out)
 {
-	uint32_t words[L2_ENTRY_WORDS];
-	uint64_t key;
-	int index;
-	int probe;
+	uint32_t words[L2_ENTRY_WORDS], found[L2_ENTRY_WORDS];
+	int bucket, index, hw_index;
 
+	(void)unit;
 	if (!mac || !out)
 		return -EINVAL;
-	key = l2_hash_key(mac, vid);
-	index = (int)(key % L2_ENTRY_ENTRIES);
-	if (index < 0)
-		index += L2_ENTRY_ENTRIES;
-	for (probe = 0; probe < 6; probe++) {
-		int idx = (index + probe) % L2_ENTRY_ENTRIES;
-		if (l2_table_read(unit, idx, words) != 0)
+	l2_key_words(mac, vid, words);
+	pthread_mutex_lock(&l2_lock);
+	l2_shadow_load();
+	bucket = l2_bucket(mac, vid);
+	index = l2_shadow_find(bucket, words, NULL);
+	if (index < 0 && l2_hw_hash() &&
+	    sbus_table_lookup(L2_ENTRY_BASE, words, L2_ENTRY_WORDS, found, &hw_index) == 0 &&
+	    hw_index >= 0 && hw_index < L2_ENTRY_ENTRIES && (found[0] & 1u)) {
+		l2_shadow_set(bucket, hw_index, found);
+		index = hw_index;
+	}
+	if (index >= 0)
+		l2_unpack_entry(l2_shadow[index], out);
+	pthread_mutex_unlock(&l2_lock);
+	return index >= 0 ? 0 : -ENOENT;
+}
+
+/*
+ * --- Hardware learning: L2_MOD_FIFO ---
+ * With CML_FLAGS_NEW/MOVE = LEARN in PORT_TAB the ingress pipeline installs
+ * unknown source MACs in L2_ENTRY itself and pushes a record per learn,
+ * station move or age-out to L2_MOD_FIFO.  FIFO read DMA channel 0 streams
+ * the records into a ring in the DMA pool, so a burst of any size costs one
+ * NUM_VALID read and one NUM_READ write.  The records carry the L2_ENTRY
+ * index, which keeps the shadow exact without a lookup per MAC.
+ *
+ * Tentative (XGS family layout, not yet confirmed on the AS5610): the FIFO
+ * address, the record format, PORT_TAB CML field offsets and the
+ * AUX_ARB_CONTROL enable bits.
+ */
+#define L2_MOD_FIFO_BASE        0x07180000u
+#define L2_MOD_FIFO_WORDS       5    /* L2_ENTRY words 0-3, word 4: INDEX[16:0], OPERATION[19:17] */
+#define L2_MOD_INDEX_MASK       0x1ffffu
+#define L2_MOD_OP_SHIFT         17
+#define L2_MOD_OP_MASK          0x7u
+#define L2_MOD_OP_DELETE        0u
+#define L2_MOD_OP_LEARN         1u
+#define L2_MOD_OP_MOVE          2u
+#define L2_MOD_OP_AGE           3u
+#define L2_MOD_RING_SEL         6    /* 64 << 6 = 4096 records */
+#define L2_MOD_RING_ENTRIES     (64 << L2_MOD_RING_SEL)
+
+#define AUX_ARB_CONTROLr                 0x00180700u
+#define L2_MOD_FIFO_ENABLE_LEARN_BIT     4
+#define L2_MOD_FIFO_ENABLE_AGE_BIT       5
+
+#define PORT_TABm               0x01160000u
+#define PORT_TAB_WORDS          6    /* leading words, as init_datapath.c */
+#define PORT_TAB_LEARN_MAX      66   /* front-panel + internal ports 1..66 */
+#define CML_FLAGS_NEW_SHIFT     20   /* word[2] bits 23:20 (entry bits 87:84) */
+#define CML_FLAGS_MOVE_SHIFT    24   /* word[2] bits 27:24 (entry bits 91:88) */
+#define CML_FLAGS_MASK          0xfu
+#define CML_LEARN               0x8u /* install in L2_ENTRY and forward */
+
+extern void *bde_dma_alloc(size_t size, size_t align);
+extern uint64_t bde_dma_phys(const void *p);
+extern int bde_read_reg(uint32_t offset, uint32_t *value);
+extern int bde_write_reg(uint32_t offset, uint32_t value);
+
+static uint32_t *l2_mod_ring;
+static uint32_t l2_mod_rd;
+
+/*
+ * --- Learn limits and station-move detection ---
+ * The dynamic MACs per port are counted from the shadow (l2_port_learned)
+ * and the limits are enforced as the learn records are applied.  The ASIC
+ * has already installed a MAC when its record arrives, so one past
+ * learn_limit is deleted again and not reported, and the port's
+ * CML_FLAGS_NEW switches to the limit action so the pipeline stops
+ * learning there.  Moves onto a port are counted per one-second window;
+ * past move_limit, CML_FLAGS_MOVE gets the action for L2_MOVE_HOLD_MS.
+ * l2_limit_check() lifts both from l2_event_poll().  TRAP frames are
+ * policed in the RX thread by bcm56846_l2_trap_admit() (per-port token
+ * bucket).  CML_DROP/CML_CPU follow the XGS encoding (tentative).
+ */
+#define CML_DROP                0x1u /* do not forward */
+#define CML_CPU                 0x2u /* copy to the CPU */
+#define L2_MOVE_WINDOW_MS       1000
+#define L2_MOVE_HOLD_MS         10000
+
+struct l2_port_limit {
+	bcm56846_l2_port_limit_t cfg;
+	int learn_blocked;      /* CML_FLAGS_NEW holds the limit action */
+	int move_blocked;       /* CML_FLAGS_MOVE holds the limit action */
+	int moves;              /* onto the port in the current window */
+	int64_t move_until_ms;  /* end of the move hold-down */
+	uint32_t limit_drop;
+	uint32_t move_storm;
+};
+
+static struct l2_port_limit l2_limit[PORT_TAB_LEARN_MAX + 1];
+static int l2_limit_loaded;       /* cfg seeded from config.bcm */
+static int l2_learning;           /* learn_enable(1) in effect */
+static int64_t l2_move_window_ms; /* start of the current move window */
+static volatile int l2_trap_on[PORT_TAB_LEARN_MAX + 1];
+
+static int64_t l2_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void l2_limit_load(void)
+{
+	extern void bcm56846_config_get_l2_port_limit(bcm56846_l2_port_limit_t *limit);
+	bcm56846_l2_port_limit_t def;
+	int port;
+
+	if (l2_limit_loaded)
+		return;
+	bcm56846_config_get_l2_port_limit(&def);
+	for (port = 1; port <= PORT_TAB_LEARN_MAX; port++)
+		l2_limit[port].cfg = def;
+	l2_limit_loaded = 1;
+}
+
+static uint32_t l2_limit_cml(const struct l2_port_limit *l)
+{
+	switch (l->cfg.action) {
+	case BCM56846_L2_LIMIT_DROP:
+		return CML_DROP;
+	case BCM56846_L2_LIMIT_TRAP:
+		return CML_DROP | CML_CPU;
+	default:
+		return 0;
+	}
+}
+
+/* PORT_TAB CML_FLAGS_NEW/MOVE from the learning and limit state (l2_lock held). */
+static int l2_port_cml_write(int port)
+{
+	struct l2_port_limit *l = &l2_limit[port];
+	uint32_t entry[PORT_TAB_WORDS], cml_new = 0, cml_move = 0;
+
+	if (l2_learning) {
+		cml_new = l->learn_blocked ? l2_limit_cml(l) : CML_LEARN;
+		cml_move = l->move_blocked ? l2_limit_cml(l) : CML_LEARN;
+	}
+	l2_trap_on[port] = l2_learning && (l->learn_blocked || l->move_blocked) &&
+			   l->cfg.action == BCM56846_L2_LIMIT_TRAP;
+	if (sbus_mem_read(PORT_TABm, port, entry, PORT_TAB_WORDS) != 0)
+		return -EIO;
+	entry[2] &= ~((CML_FLAGS_MASK << CML_FLAGS_NEW_SHIFT) |
+		      (CML_FLAGS_MASK << CML_FLAGS_MOVE_SHIFT));
+	entry[2] |= (cml_new << CML_FLAGS_NEW_SHIFT) | (cml_move << CML_FLAGS_MOVE_SHIFT);
+	return sbus_mem_write(PORT_TABm, port, entry, PORT_TAB_WORDS) != 0 ? -EIO : 0;
+}
+
+static void l2_limit_block(int port, int move, int64_t now)
+{
+	static const char *const act[] = { "not learning", "dropping", "trapping" };
+	struct l2_port_limit *l = &l2_limit[port];
+
+	if (move) {
+		l->move_storm++;
+		l->move_until_ms = now + L2_MOVE_HOLD_MS;
+		if (l->move_blocked)
+			return;
+		l->move_blocked = 1;
+		fprintf(stderr, "[l2] port %d: over %d station moves/s, %s moving MACs for %d s\n",
+			port, l->cfg.move_limit, act[l->cfg.action], L2_MOVE_HOLD_MS / 1000);
+	} else {
+		if (l->learn_blocked)
+			return;
+		l->learn_blocked = 1;
+		fprintf(stderr, "[l2] port %d: learn limit %d reached, %s new MACs\n",
+			port, l->cfg.learn_limit, act[l->cfg.action]);
+	}
+	if (l2_port_cml_write(port) != 0)
+		fprintf(stderr, "[l2] port %d: PORT_TAB learn flags update failed\n", port);
+}
+
+/*
+ * Count and police the entry a LEARN/MOVE record just put at index.
+ * Returns 0 if it was over learn_limit and has been removed again.
+ */
+static int l2_limit_apply(int index, int move, int64_t now)
+{
+	struct l2_port_limit *l;
+	int port = l2_count_port(l2_shadow[index]);
+
+	if (port <= 0 || port > PORT_TAB_LEARN_MAX)
+		return 1;
+	l = &l2_limit[port];
+	if (move && ++l->moves > l->cfg.move_limit && l->cfg.move_limit > 0)
+		l2_limit_block(port, 1, now);
+	if (l->cfg.learn_limit <= 0 || l2_port_learned[port] < l->cfg.learn_limit)
+		return 1;
+	l2_limit_block(port, 0, now);
+	if (l2_port_learned[port] == l->cfg.learn_limit || l2_table_delete_at(0, index) != 0)
+		return 1;
+	l2_shadow_put(index, NULL);
+	l->limit_drop++;
+	return 0;
+}
+
+/* Lift blocks whose cause has gone and roll the move window (l2_lock held). */
+static void l2_limit_check(int64_t now)
+{
+	int port, window = now - l2_move_window_ms >= L2_MOVE_WINDOW_MS;
+
+	if (window)
+		l2_move_window_ms = now;
+	for (port = 1; port <= PORT_TAB_LEARN_MAX; port++) {
+		struct l2_port_limit *l = &l2_limit[port];
+		int changed = 0;
+
+		if (window)
+			l->moves = 0;
+		if (l->learn_blocked && (l->cfg.learn_limit <= 0 ||
+					 l2_port_learned[port] < l->cfg.learn_limit)) {
+			l->learn_blocked = 0;
+			changed = 1;
+		}
+		if (l->move_blocked && now >= l->move_until_ms) {
+			l->move_blocked = 0;
+			changed = 1;
+		}
+		if (changed && l2_port_cml_write(port) != 0)
+			fprintf(stderr, "[l2] port %d: PORT_TAB learn flags update failed\n", port);
+	}
+}
+
+/*
+ * RX policer for BCM56846_L2_LIMIT_TRAP: 1 to hand the frame from port to
+ * the application, 0 to drop it.  Only the RX thread calls it; ports that
+ * are not trapping always pass.
+ */
+int bcm56846_l2_trap_admit(int port)
+{
+	static int64_t last_ms[PORT_TAB_LEARN_MAX + 1];
+	static int tokens[PORT_TAB_LEARN_MAX + 1];
+	int64_t now, add;
+	int pps;
+
+	if (port <= 0 || port > PORT_TAB_LEARN_MAX || !l2_trap_on[port])
+		return 1;
+	pps = l2_limit[port].cfg.trap_pps;
+	now = l2_now_ms();
+	add = (now - last_ms[port]) * pps / 1000;
+	if (add > 0) {
+		tokens[port] = add >= pps - tokens[port] ? pps : tokens[port] + (int)add;
+		last_ms[port] = now;
+	}
+	if (tokens[port] <= 0)
+		return 0;
+	tokens[port]--;
+	return 1;
+}
+
+int bcm56846_l2_port_limit_set(int unit, int port, const bcm56846_l2_port_limit_t *limit)
+{
+	struct l2_port_limit *l;
+	int rc = 0;
+
+	(void)unit;
+	if (port <= 0 || port > PORT_TAB_LEARN_MAX || !limit || limit->learn_limit < 0 ||
+	    limit->move_limit < 0 || limit->trap_pps < 0 ||
+	    (int)limit->action < 0 || limit->action > BCM56846_L2_LIMIT_TRAP)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	l2_limit_load();
+	l2_shadow_load();
+	l = &l2_limit[port];
+	l->cfg = *limit;
+	/* Entries already over a lowered limit stay until they age or are flushed */
+	l->learn_blocked = limit->learn_limit > 0 && l2_port_learned[port] >= limit->learn_limit;
+	if (limit->move_limit == 0)
+		l->move_blocked = 0;
+	if (l2_learning)
+		rc = l2_port_cml_write(port);
+	pthread_mutex_unlock(&l2_lock);
+	return rc;
+}
+
+int bcm56846_l2_port_limit_get(int unit, int port, bcm56846_l2_port_limit_t *limit)
+{
+	(void)unit;
+	if (port <= 0 || port > PORT_TAB_LEARN_MAX || !limit)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	l2_limit_load();
+	*limit = l2_limit[port].cfg;
+	pthread_mutex_unlock(&l2_lock);
+	return 0;
+}
+
+int bcm56846_l2_port_learn_status_get(int unit, int port, bcm56846_l2_port_learn_status_t *st)
+{
+	const struct l2_port_limit *l;
+
+	(void)unit;
+	if (port <= 0 || port > PORT_TAB_LEARN_MAX || !st)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	l2_shadow_load();
+	l = &l2_limit[port];
+	st->learned = l2_port_learned[port];
+	st->moves = l->moves;
+	st->learn_blocked = l->learn_blocked;
+	st->move_blocked = l->move_blocked;
+	st->limit_drop = l->limit_drop;
+	st->move_storm = l->move_storm;
+	pthread_mutex_unlock(&l2_lock);
+	return 0;
+}
+
+int bcm56846_l2_learn_enable(int unit, int enable)
+{
+	uint32_t aux = (1u << L2_MOD_FIFO_ENABLE_LEARN_BIT) | (1u << L2_MOD_FIFO_ENABLE_AGE_BIT);
+	uint32_t cfg;
+	int port, rc = 0;
+
+	(void)unit;
+	if (enable && !l2_mod_ring) {
+		l2_mod_ring = bde_dma_alloc(sizeof(uint32_t) * L2_MOD_FIFO_WORDS * L2_MOD_RING_ENTRIES, 64);
+		if (!l2_mod_ring)
+			return -ENOMEM;
+	}
+	pthread_mutex_lock(&l2_lock);
+	if (enable) {
+		/* DMA first, so no record is dropped once the pipeline learns */
+		cfg = CMIC_FIFO_RD_DMA_CFG_ENABLE |
+		      ((uint32_t)L2_MOD_FIFO_WORDS << CMIC_FIFO_RD_DMA_CFG_WORDS_SHIFT) |
+		      ((uint32_t)L2_MOD_RING_SEL << CMIC_FIFO_RD_DMA_CFG_ENTRIES_SHIFT);
+		memset(l2_mod_ring, 0, sizeof(uint32_t) * L2_MOD_FIFO_WORDS * L2_MOD_RING_ENTRIES);
+		l2_mod_rd = 0;
+		if (bde_write_reg(CMIC_FIFO_RD_DMA_CFG, 0) != 0 ||
+		    bde_write_reg(CMIC_FIFO_RD_DMA_SBUS_START, L2_MOD_FIFO_BASE) != 0 ||
+		    bde_write_reg(CMIC_FIFO_RD_DMA_HOSTMEM_START, (uint32_t)bde_dma_phys(l2_mod_ring)) != 0 ||
+		    bde_write_reg(CMIC_FIFO_RD_DMA_STAT_CLR, CMIC_FIFO_RD_DMA_STAT_OVERFLOW) != 0 ||
+		    bde_write_reg(CMIC_FIFO_RD_DMA_CFG, cfg) != 0 ||
+		    sbus_reg_modify(AUX_ARB_CONTROLr, aux, aux) != 0)
+			rc = -EIO;
+	}
+	l2_learning = enable ? 1 : 0;
+	if (enable) {
+		l2_limit_load();
+		l2_shadow_load();
+	}
+	for (port = 1; rc == 0 && port <= PORT_TAB_LEARN_MAX; port++) {
+		struct l2_port_limit *l = &l2_limit[port];
+
+		l->learn_blocked = l->cfg.learn_limit > 0 && l2_port_learned[port] >= l->cfg.learn_limit;
+		rc = l2_port_cml_write(port);
+	}
+	if (!enable && rc == 0) {
+		/* Records already queued stay readable until the next enable */
+		if (sbus_reg_modify(AUX_ARB_CONTROLr, aux, 0) != 0)
+			rc = -EIO;
+	}
+	pthread_mutex_unlock(&l2_lock);
+	if (rc != 0)
+		fprintf(stderr, "[l2] learning %s failed\n", enable ? "enable" : "disable");
+	return rc;
+}
+
+/*
+ * Apply one L2_MOD_FIFO record to the shadow and decode it into ev.
+ * Returns 0 when the record yields no event (a learn over the limit).
+ */
+static int l2_mod_apply(const uint32_t *rec, bcm56846_l2_event_t *ev, int64_t now)
+{
+	uint32_t op = (rec[4] >> L2_MOD_OP_SHIFT) & L2_MOD_OP_MASK;
+	int index = (int)(rec[4] & L2_MOD_INDEX_MASK);
+	uint32_t *e = l2_shadow[index];
+
+	l2_unpack_entry(rec, &ev->addr);
+	switch (op) {
+	case L2_MOD_OP_LEARN:
+	case L2_MOD_OP_MOVE:
+		ev->type = op == L2_MOD_OP_LEARN ? BCM56846_L2_EVENT_LEARN : BCM56846_L2_EVENT_MOVE;
+		l2_shadow_set(l2_bucket(ev->addr.mac, ev->addr.vid), index, rec);
+		if (l2_limit_apply(index, op == L2_MOD_OP_MOVE, now))
+			return 1;
+		/* Removed: a moved MAC has left its old port as well */
+		ev->type = BCM56846_L2_EVENT_DELETE;
+		return op == L2_MOD_OP_MOVE;
+	default:
+		ev->type = op == L2_MOD_OP_AGE ? BCM56846_L2_EVENT_AGE : BCM56846_L2_EVENT_DELETE;
+		if ((e[0] & 1u) && e[0] == rec[0] && e[1] == rec[1])
+			l2_shadow_put(index, NULL);
+		return 1;
+	}
+}
+
+/*
+ * Events the SDK generates itself (DELETEs from l2_flush()), handed out by
+ * l2_event_poll() ahead of the ring.  Only queued while the ring exists,
+ * i.e. while something polls.
+ */
+#define L2_MOD_DRAIN            256
+
+static bcm56846_l2_event_t *l2_pend;
+static int l2_pend_head, l2_pend_count, l2_pend_size;
+
+/* Room for n more pending events at l2_pend + l2_pend_count, or NULL. */
+static bcm56846_l2_event_t *l2_pend_reserve(int n)
+{
+	bcm56846_l2_event_t *p;
+	int size;
+
+	if (l2_pend_head > 0) {
+		memmove(l2_pend, l2_pend + l2_pend_head, sizeof(*l2_pend) * (size_t)l2_pend_count);
+		l2_pend_head = 0;
+	}
+	if (l2_pend_count + n <= l2_pend_size)
+		return l2_pend + l2_pend_count;
+	for (size = l2_pend_size ? l2_pend_size : 256; size < l2_pend_count + n; size *= 2)
+		;
+	p = realloc(l2_pend, sizeof(*p) * (size_t)size);
+	if (!p)
+		return NULL;
+	l2_pend = p;
+	l2_pend_size = size;
+	return l2_pend + l2_pend_count;
+}
+
+/* Apply up to max ring records to the shadow and decode them (l2_lock held). */
+static int l2_mod_drain(bcm56846_l2_event_t *events, int max)
+{
+	uint32_t valid = 0, stat = 0, i;
+	int64_t now = l2_now_ms();
+	int n;
+
+	if (bde_read_reg(CMIC_FIFO_RD_DMA_NUM_VALID, &valid) != 0)
+		return -EIO;
+	__sync_synchronize();  /* records are in memory before NUM_VALID counts them */
+	l2_shadow_load();
+	for (i = 0, n = 0; n < max && i < valid; i++) {
+		const uint32_t *rec = l2_mod_ring +
+			(size_t)((l2_mod_rd + i) & (L2_MOD_RING_ENTRIES - 1)) * L2_MOD_FIFO_WORDS;
+
+		n += l2_mod_apply(rec, &events[n], now);
+	}
+	if (i > 0) {
+		l2_mod_rd += i;
+		bde_write_reg(CMIC_FIFO_RD_DMA_NUM_READ, i);
+	}
+	/* Dropped records: the shadow no longer matches, re-read it on next use */
+	if (bde_read_reg(CMIC_FIFO_RD_DMA_STAT, &stat) == 0 &&
+	    (stat & CMIC_FIFO_RD_DMA_STAT_OVERFLOW)) {
+		bde_write_reg(CMIC_FIFO_RD_DMA_STAT_CLR, CMIC_FIFO_RD_DMA_STAT_OVERFLOW);
+		l2_shadow_loaded = 0;
+		fprintf(stderr, "[l2] L2_MOD_FIFO ring overflow, records lost\n");
+	}
+	return n;
+}
+
+/*
+ * Apply every queued ring record before a bulk change, so the shadow is
+ * current; their events wait in the pending queue (l2_lock held).
+ */
+static void l2_mod_drain_pending(void)
+{
+	bcm56846_l2_event_t *ev;
+	int got;
+
+	l2_shadow_load();
+	while (l2_mod_ring && (ev = l2_pend_reserve(L2_MOD_DRAIN)) != NULL) {
+		got = l2_mod_drain(ev, L2_MOD_DRAIN);
+		if (got > 0)
+			l2_pend_count += got;
+		if (got < L2_MOD_DRAIN)
+			break;
+	}
+	l2_shadow_load();  /* again, if an overflow dropped it */
+}
+
+int bcm56846_l2_event_poll(int unit, bcm56846_l2_event_t *events, int max)
+{
+	int n, got;
+
+	(void)unit;
+	if (!events || max <= 0)
+		return -EINVAL;
+	if (!l2_mod_ring)
+		return 0;
+	pthread_mutex_lock(&l2_lock);
+	n = l2_pend_count < max ? l2_pend_count : max;
+	if (n > 0) {
+		memcpy(events, l2_pend + l2_pend_head, sizeof(*events) * (size_t)n);
+		l2_pend_head += n;
+		l2_pend_count -= n;
+		if (l2_pend_count == 0)
+			l2_pend_head = 0;
+	}
+	got = n < max ? l2_mod_drain(events + n, max - n) : 0;
+	l2_limit_check(l2_now_ms());
+	pthread_mutex_unlock(&l2_lock);
+	if (got < 0)
+		return n > 0 ? n : got;
+	return n + got;
+}
+
+/*
+ * --- Aging: software sweep of the hit bits ---
+ * One pass over L2_ENTRY per age interval, one chunk (4096 entries, one
+ * TDMA into a private pool buffer) per due l2_age_run() call.  A dynamic
+ * entry with HITSA/HITDA set has its hit bits cleared; one still clear a
+ * pass later has been idle for a full interval and is deleted, so entries
+ * go after age..2*age seconds of silence.  The sweep also refreshes the
+ * shadow from the chunk it read.  SCHAN writes per call are capped; a
+ * chunk with more work is finished by the next calls, which resume at
+ * the first entry not yet handled (the hit bits just cleared before it
+ * must not read as idle in the same pass).
+ */
+#define L2_CHUNK            4096  /* entries per TDMA for the sweep and traverse */
+#define L2_AGE_CHUNKS       (L2_ENTRY_ENTRIES / L2_CHUNK)
+#define L2_AGE_OPS_MAX      256   /* SCHAN writes per l2_age_run() */
+
+static int l2_age_seconds = -1;   /* -1: l2_age_time from config.bcm */
+static int l2_age_cursor;         /* next chunk */
+static int l2_age_offset;         /* first entry of that chunk not yet swept */
+static int64_t l2_age_due_ms;     /* when that chunk is due */
+static uint32_t *l2_chunk_buf;
+
+/* TDMA L2_CHUNK entries from base into l2_chunk_buf (l2_lock held). */
+static int l2_chunk_read(int base)
+{
+	if (!l2_chunk_buf) {
+		l2_chunk_buf = bde_dma_alloc(sizeof(uint32_t) * L2_ENTRY_WORDS * L2_CHUNK, 64);
+		if (!l2_chunk_buf)
+			return -ENOMEM;
+	}
+	if (sbus_mem_read_range(L2_ENTRY_BASE, base, L2_CHUNK, l2_chunk_buf, L2_ENTRY_WORDS) != 0)
+		return -EIO;
+	return 0;
+}
+
+static int l2_age_interval(void)
+{
+	extern int bcm56846_config_get_l2_age_time(void);
+
+	if (l2_age_seconds < 0)
+		l2_age_seconds = bcm56846_config_get_l2_age_time();
+	return l2_age_seconds;
+}
+
+int bcm56846_l2_age_timer_set(int unit, int seconds)
+{
+	(void)unit;
+	if (seconds < 0)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	l2_age_seconds = seconds;
+	l2_age_cursor = 0;
+	l2_age_offset = 0;
+	l2_age_due_ms = l2_now_ms() + (int64_t)seconds * 1000 / L2_AGE_CHUNKS;
+	pthread_mutex_unlock(&l2_lock);
+	return 0;
+}
+
+int bcm56846_l2_age_timer_get(int unit, int *seconds)
+{
+	(void)unit;
+	if (!seconds)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	*seconds = l2_age_interval();
+	pthread_mutex_unlock(&l2_lock);
+	return 0;
+}
+
+/*
+ * Sweep the chunk at l2_age_cursor from l2_age_offset on; *aged gets the
+ * number of events written.  0 when the chunk is done, -EAGAIN when the
+ * op cap (or max) stopped it early; l2_age_offset then marks where the
+ * next call goes on.
+ */
+static int l2_age_chunk(bcm56846_l2_event_t *events, int max, int *aged)
+{
+	static const uint32_t zero[L2_ENTRY_WORDS];
+	sbus_batch_t batch;
+	int base = l2_age_cursor * L2_CHUNK, i, ops = 0, rc;
+
+	*aged = 0;
+	rc = l2_chunk_read(base);
+	if (rc != 0)
+		return rc;
+	sbus_batch_init(&batch);
+	for (i = l2_age_offset; i < L2_CHUNK; i++) {
+		uint32_t *hw = l2_chunk_buf + (size_t)i * L2_ENTRY_WORDS;
+
+		if (!(hw[0] & 1u) || (hw[2] & L2_STATIC)) {
+			l2_shadow_put(base + i, hw);
+			continue;
+		}
+		if (ops >= L2_AGE_OPS_MAX || *aged >= max)
+			break;
+		if (hw[2] & (L2_HITSA | L2_HITDA)) {
+			hw[2] &= ~(L2_HITSA | L2_HITDA);
+			sbus_batch_mem_write(&batch, L2_ENTRY_BASE, base + i, hw, L2_ENTRY_WORDS);
+		} else {
+			events[*aged].type = BCM56846_L2_EVENT_AGE;
+			l2_unpack_entry(hw, &events[*aged].addr);
+			(*aged)++;
+			memset(hw, 0, sizeof(uint32_t) * L2_ENTRY_WORDS);
+			sbus_batch_mem_write(&batch, L2_ENTRY_BASE, base + i, zero, L2_ENTRY_WORDS);
+		}
+		l2_shadow_put(base + i, hw);
+		ops++;
+	}
+	if (batch.count > 0)
+		sbus_batch_submit(&batch);
+	if (batch.errors > 0)
+		fprintf(stderr, "[l2] aging: %d L2_ENTRY writes failed\n", batch.errors);
+	l2_age_offset = i < L2_CHUNK ? i : 0;
+	return i < L2_CHUNK ? -EAGAIN : 0;
+}
+
+/*
+ * Run the aging sweep if a chunk is due: removes idle dynamic entries and
+ * returns their AGE events (at most max).  Meant to be called every few
+ * milliseconds from one thread; the interval sets the pace, not the caller.
+ */
+int bcm56846_l2_age_run(int unit, bcm56846_l2_event_t *events, int max)
+{
+	int64_t now, step;
+	int rc, aged = 0;
+
+	(void)unit;
+	if (!events || max <= 0)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	if (l2_age_interval() == 0) {
+		pthread_mutex_unlock(&l2_lock);
+		return 0;
+	}
+	now = l2_now_ms();
+	step = (int64_t)l2_age_seconds * 1000 / L2_AGE_CHUNKS;
+	if (l2_age_due_ms == 0)
+		l2_age_due_ms = now + step;
+	if (now < l2_age_due_ms) {
+		pthread_mutex_unlock(&l2_lock);
+		return 0;
+	}
+	l2_shadow_load();
+	rc = l2_age_chunk(events, max, &aged);
+	if (rc == 0) {
+		l2_age_cursor = (l2_age_cursor + 1) % L2_AGE_CHUNKS;
+		/* Catch up after a stall, but never by more than one pass */
+		l2_age_due_ms = l2_age_due_ms + step < now - step * L2_AGE_CHUNKS ?
+				now - step * L2_AGE_CHUNKS : l2_age_due_ms + step;
+	}
+	pthread_mutex_unlock(&l2_lock);
+	return rc == 0 || rc == -EAGAIN ? aged : rc;
+}
+
+/*
+ * --- Flush: L2 bulk delete engine ---
+ * L2_BULK_MATCH_MASK/DATA (one L2_ENTRY-format entry each) select entries
+ * by any field; START with ACTION=DELETE in L2_BULK_CONTROL makes the ASIC
+ * walk the whole table, invalidate every match and set COMPLETE.  A flush
+ * is a handful of SCHAN ops however many MACs it removes.  The same
+ * mask/data applied to the shadow gives the removed entries, which become
+ * DELETE events.  If the engine does not complete, the matches are deleted
+ * with batched writes instead (and the engine is not tried again).
+ *
+ * Tentative (XGS family layout, not yet confirmed on the AS5610): the
+ * L2_BULK addresses and the CONTROL field positions.
+ */
+#define L2_BULK_CONTROLr         0x07100100u
+#define L2_BULK_ACTION_DELETE    1u          /* L2_BULK_ACTION[1:0] */
+#define L2_BULK_START            (1u << 3)
+#define L2_BULK_COMPLETE         (1u << 4)
+#define L2_BULK_MATCH_MASKm      0x07160000u
+#define L2_BULK_MATCH_DATAm      0x07164000u
+#define L2_BULK_POLL_MAX         200         /* x 100 us; a full walk is ~1 ms */
+
+static int l2_bulk_failed;
+
+/* Mask/data selecting valid entries on port (TGID if trunk) and VLAN vid; negative = any. */
+static void l2_match_words(int port, int vid, int trunk, uint32_t *mask, uint32_t *data)
+{
+	memset(mask, 0, sizeof(uint32_t) * L2_ENTRY_WORDS);
+	memset(data, 0, sizeof(uint32_t) * L2_ENTRY_WORDS);
+	mask[0] = data[0] = 1u;
+	if (vid >= 0) {
+		mask[0] |= 0xfffu << 4;
+		data[0] |= (uint32_t)vid << 4;
+	}
+	if (port >= 0) {
+		mask[2] |= 0x7fu | L2_T;
+		data[2] |= (uint32_t)port | (trunk ? L2_T : 0);
+	}
+}
+
+static int l2_entry_match(const uint32_t *e, const uint32_t *mask, const uint32_t *data)
+{
+	int k;
+
+	for (k = 0; k < L2_ENTRY_WORDS; k++)
+		if ((e[k] ^ data[k]) & mask[k])
+			return 0;
+	return 1;
+}
+
+/* Run one bulk delete; 0 once the ASIC reports COMPLETE. */
+static int l2_bulk_delete(const uint32_t *mask, const uint32_t *data)
+{
+	uint32_t ctl = 0;
+	int i;
+
+	sbus_reg_cache_volatile(L2_BULK_CONTROLr);
+	if (sbus_mem_write(L2_BULK_MATCH_MASKm, 0, mask, L2_ENTRY_WORDS) != 0 ||
+	    sbus_mem_write(L2_BULK_MATCH_DATAm, 0, data, L2_ENTRY_WORDS) != 0 ||
+	    sbus_reg_write(L2_BULK_CONTROLr, L2_BULK_ACTION_DELETE | L2_BULK_START) != 0)
+		return -EIO;
+	for (i = 0; i < L2_BULK_POLL_MAX; i++) {
+		if (sbus_reg_read(L2_BULK_CONTROLr, &ctl) != 0 || (ctl & L2_BULK_COMPLETE))
+			break;
+		usleep(100);
+	}
+	sbus_reg_write(L2_BULK_CONTROLr, 0);
+	return (ctl & L2_BULK_COMPLETE) ? 0 : -ETIMEDOUT;
+}
+
+/*
+ * Remove the entries learned on port (or trunk port with
+ * BCM56846_L2_FLUSH_TRUNK) in VLAN vid; a negative port or vid matches
+ * any.  Static entries stay unless BCM56846_L2_FLUSH_STATIC.  Returns the
+ * number of entries removed; their DELETE events come from l2_event_poll().
+ */
+int bcm56846_l2_flush(int unit, int port, int vid, int flags)
+{
+	static const uint32_t zero[L2_ENTRY_WORDS];
+	uint32_t mask[L2_ENTRY_WORDS], data[L2_ENTRY_WORDS];
+	bcm56846_l2_event_t *ev;
+	sbus_batch_t batch;
+	int i, n = 0, rc = 0;
+
+	(void)unit;
+	if (port > 0x7f || vid > 0xfff)
+		return -EINVAL;
+	l2_match_words(port, vid, flags & BCM56846_L2_FLUSH_TRUNK, mask, data);
+	if (!(flags & BCM56846_L2_FLUSH_STATIC))
+		mask[2] |= L2_STATIC;
+
+	pthread_mutex_lock(&l2_lock);
+	l2_mod_drain_pending();
+	l2_shadow_load();
+	for (i = 0; i < L2_ENTRY_ENTRIES; i++)
+		n += l2_entry_match(l2_shadow[i], mask, data);
+	if (n == 0) {
+		pthread_mutex_unlock(&l2_lock);
+		return 0;
+	}
+	if (!l2_bulk_failed && l2_bulk_delete(mask, data) != 0) {
+		l2_bulk_failed = 1;
+		fprintf(stderr, "[l2] L2 bulk delete did not complete, flushing entry by entry\n");
+	}
+	ev = l2_mod_ring ? l2_pend_reserve(n) : NULL;
+	sbus_batch_init(&batch);
+	for (i = 0; i < L2_ENTRY_ENTRIES; i++) {
+		uint32_t *e = l2_shadow[i];
+
+		if (!l2_entry_match(e, mask, data))
 			continue;
-		if ((words[0] & 1u) == 0)
+		if (l2_bulk_failed)
+			sbus_batch_mem_write(&batch, L2_ENTRY_BASE, i, zero, L2_ENTRY_WORDS);
+		if (ev) {
+			ev->type = BCM56846_L2_EVENT_DELETE;
+			l2_unpack_entry(e, &ev->addr);
+			ev++;
+			l2_pend_count++;
+		}
+		l2_shadow_put(i, NULL);
+	}
+	if (batch.count > 0)
+		sbus_batch_submit(&batch);
+	if (batch.errors > 0) {
+		fprintf(stderr, "[l2] flush: %d L2_ENTRY writes failed\n", batch.errors);
+		l2_shadow_loaded = 0;
+		rc = -EIO;
+	}
+	pthread_mutex_unlock(&l2_lock);
+	return rc ? rc : n;
+}
+
+/*
+ * --- Traverse ---
+ * Walks L2_ENTRY one chunk (L2_CHUNK entries, one TDMA) at a time.  l2_lock
+ * is held only while a chunk is read and filtered, and the callback runs
+ * without it, so a full dump holds up other L2 updates (and the SCHAN
+ * channel) for one chunk at most and the callback may call back into the
+ * SDK.  Each chunk read also refreshes the shadow.
+ */
+int bcm56846_l2_traverse(int unit, const bcm56846_l2_filter_t *filter,
+			 bcm56846_l2_traverse_cb_t cb, void *cookie)
+{
+	uint32_t mask[L2_ENTRY_WORDS], data[L2_ENTRY_WORDS];
+	bcm56846_l2_addr_t *match;
+	int flags = filter ? filter->flags : 0;
+	int base, i, n, total = 0, rc = 0;
+
+	if (!cb)
+		return -EINVAL;
+	l2_match_words(filter ? filter->port : -1, filter ? filter->vid : -1,
+		       flags & BCM56846_L2_TRAVERSE_TRUNK, mask, data);
+	if ((flags & BCM56846_L2_TRAVERSE_STATIC) && !(flags & BCM56846_L2_TRAVERSE_DYNAMIC)) {
+		mask[2] |= L2_STATIC;
+		data[2] |= L2_STATIC;
+	} else if ((flags & BCM56846_L2_TRAVERSE_DYNAMIC) && !(flags & BCM56846_L2_TRAVERSE_STATIC)) {
+		mask[2] |= L2_STATIC;
+	}
+	match = malloc(sizeof(*match) * L2_CHUNK);
+	if (!match)
+		return -ENOMEM;
+	for (base = 0; base < L2_ENTRY_ENTRIES && rc == 0; base += L2_CHUNK) {
+		pthread_mutex_lock(&l2_lock);
+		l2_shadow_load();
+		rc = l2_chunk_read(base);
+		for (i = 0, n = 0; rc == 0 && i < L2_CHUNK; i++) {
+			const uint32_t *e = l2_chunk_buf + (size_t)i * L2_ENTRY_WORDS;
+
+			l2_shadow_put(base + i, e);
+			if (l2_entry_match(e, mask, data))
+				l2_unpack_entry(e, &match[n++]);
+		}
+		pthread_mutex_unlock(&l2_lock);
+		for (i = 0; rc == 0 && i < n; i++, total++)
+			rc = cb(unit, &match[i], cookie);
+	}
+	free(match);
+	if (rc < 0)
+		return rc;
+	return total;
+}
+
+/*
+ * --- Hit harvest ---
+ * Static entries are never aged, so nothing else reads or clears their hit
+ * bits: each harvest reports the static entries the pipeline has hit (DA
+ * or SA) since the previous harvest and clears those bits.  Dynamic
+ * entries are left to the aging sweep, which owns their hit bits.  Chunks
+ * the shadow shows without a static entry are not read, so a table of
+ * learned hosts and a few hundred neighbors costs a few TDMAs per harvest.
+ * Locking and callbacks as in traverse.
+ */
+static int l2_chunk_has_static(int base)
+{
+	int i;
+
+	for (i = base; i < base + L2_CHUNK; i++)
+		if ((l2_shadow[i][0] & 1u) && (l2_shadow[i][2] & L2_STATIC))
+			return 1;
+	return 0;
+}
+
+int bcm56846_l2_hit_harvest(int unit, bcm56846_l2_traverse_cb_t cb, void *cookie)
+{
+	bcm56846_l2_addr_t *hit;
+	sbus_batch_t batch;
+	int base, i, n, total = 0, rc = 0;
+
+	if (!cb)
+		return -EINVAL;
+	hit = malloc(sizeof(*hit) * L2_CHUNK);
+	if (!hit)
+		return -ENOMEM;
+	for (base = 0; base < L2_ENTRY_ENTRIES && rc == 0; base += L2_CHUNK) {
+		pthread_mutex_lock(&l2_lock);
+		l2_shadow_load();
+		if (!l2_chunk_has_static(base)) {
+			pthread_mutex_unlock(&l2_lock);
 			continue;
-		/* Compare MAC and VID (same layout as pack). */
-		if (((words[0] >> 4) & 0xfff) != (vid & 0xfff))
+		}
+		rc = l2_chunk_read(base);
+		sbus_batch_init(&batch);
+		for (i = 0, n = 0; rc == 0 && i < L2_CHUNK; i++) {
+			uint32_t *e = l2_chunk_buf + (size_t)i * L2_ENTRY_WORDS;
+
+			if ((e[0] & 1u) && (e[2] & L2_STATIC) && (e[2] & (L2_HITSA | L2_HITDA))) {
+				l2_unpack_entry(e, &hit[n++]);
+				e[2] &= ~(L2_HITSA | L2_HITDA);
+				sbus_batch_mem_write(&batch, L2_ENTRY_BASE, base + i, e, L2_ENTRY_WORDS);
+			}
+			l2_shadow_put(base + i, e);
+		}
+		if (batch.count > 0)
+			sbus_batch_submit(&batch);
+		if (batch.errors > 0)
+			fprintf(stderr, "[l2] harvest: %d L2_ENTRY writes failed\n", batch.errors);
+		pthread_mutex_unlock(&l2_lock);
+		for (i = 0; rc == 0 && i < n; i++, total++)
+			rc = cb(unit, &hit[i], cookie);
+	}
+	free(hit);
+	if (rc < 0)
+		return rc;
+	return total;
+}
+
+/*
+ * --- Hash selection and bucket statistics ---
+ * A new hash puts most entries in another bucket: the new layout is built
+ * from the shadow and written with SLAM (a few ioctls for the whole table)
+ * right after HASH_CONTROL changes.  Entries whose new bucket is full are
+ * dropped and reported as DELETE events (dynamic ones are relearned).
+ * Lookups miss while the table is rewritten, so switch hashes at startup
+ * or in a maintenance window.  Bucket statistics come from the shadow and
+ * can be computed for a candidate hash before switching to it.
+ */
+static uint32_t l2_rehash_drop;
+
+int bcm56846_l2_hash_select_set(int unit, bcm56846_l2_hash_t hash)
+{
+	uint32_t (*table)[L2_ENTRY_WORDS];
+	bcm56846_l2_event_t *ev;
+	bcm56846_l2_addr_t a;
+	int i, j, b, dropped = 0, rc = 0;
+
+	(void)unit;
+	if ((int)hash < 0 || hash >= BCM56846_L2_HASH_COUNT)
+		return -EINVAL;
+	table = calloc(L2_ENTRY_ENTRIES, sizeof(*table));
+	if (!table)
+		return -ENOMEM;
+	pthread_mutex_lock(&l2_lock);
+	l2_mod_drain_pending();
+	if ((int)hash == l2_hash_current()) {
+		pthread_mutex_unlock(&l2_lock);
+		free(table);
+		return 0;
+	}
+	for (i = 0; i < L2_ENTRY_ENTRIES; i++) {
+		const uint32_t *e = l2_shadow[i];
+
+		if (!(e[0] & 1u))
 			continue;
-		if ((uint8_t)(words[0] >> 24) != mac[0] || (uint8_t)(words[0] >> 16) != mac[1])
+		l2_unpack_entry(e, &a);
+		b = l2_bucket_hash(a.mac, a.vid, hash);
+		for (j = b; j < b + L2_BUCKET_SIZE && (table[j][0] & 1u); j++)
+			;
+		if (j < b + L2_BUCKET_SIZE) {
+			memcpy(table[j], e, sizeof(table[j]));
 			continue;
-		if ((uint8_t)(words[1] >> 24) != mac[2] || (uint8_t)(words[1] >> 16) != mac[3] ||
-		    (uint8_t)(words[1] >> 8) != mac[4] || (uint8_t)words[1] != mac[5])
+		}
+		dropped++;
+		if (l2_mod_ring && (ev = l2_pend_reserve(1)) != NULL) {
+			ev->type = BCM56846_L2_EVENT_DELETE;
+			ev->addr = a;
+			l2_pend_count++;
+		}
+	}
+	if (sbus_reg_modify(HASH_CONTROLr, L2_HASH_SELECT_MASK, l2_hash_hw[hash]) != 0) {
+		rc = -EIO;
+	} else {
+		l2_hash_sel = (int)hash;
+		l2_rehash_drop += (uint32_t)dropped;
+		if (sbus_mem_slam(L2_ENTRY_BASE, 0, L2_ENTRY_ENTRIES, table[0], L2_ENTRY_WORDS) != 0) {
+			fprintf(stderr, "[l2] L2_ENTRY rewrite after hash change failed\n");
+			l2_shadow_loaded = 0;
+			rc = -EIO;
+		} else {
+			memcpy(l2_shadow, table, sizeof(l2_shadow));
+			l2_port_recount();
+		}
+	}
+	pthread_mutex_unlock(&l2_lock);
+	free(table);
+	if (dropped > 0)
+		fprintf(stderr, "[l2] hash change: %d entries did not fit their new bucket\n", dropped);
+	return rc ? rc : dropped;
+}
+
+int bcm56846_l2_hash_select_get(int unit, bcm56846_l2_hash_t *hash)
+{
+	(void)unit;
+	if (!hash)
+		return -EINVAL;
+	pthread_mutex_lock(&l2_lock);
+	*hash = (bcm56846_l2_hash_t)l2_hash_current();
+	pthread_mutex_unlock(&l2_lock);
+	return 0;
+}
+
+/*
+ * Bucket occupancy for hash (-1 = the one in use).  For the current hash
+ * it is the table as laid out; for another, what re-bucketing the present
+ * entries would give, with the ones that would not fit in overflow.
+ */
+int bcm56846_l2_hash_stats_get(int unit, int hash, bcm56846_l2_hash_stats_t *st)
+{
+	static uint16_t fill[L2_ENTRY_ENTRIES / L2_BUCKET_SIZE];
+	bcm56846_l2_addr_t a;
+	int i, n;
+
+	(void)unit;
+	if (!st || hash >= BCM56846_L2_HASH_COUNT)
+		return -EINVAL;
+	memset(st, 0, sizeof(*st));
+	pthread_mutex_lock(&l2_lock);
+	l2_shadow_load();
+	if (hash < 0)
+		hash = l2_hash_current();
+	memset(fill, 0, sizeof(fill));
+	for (i = 0; i < L2_ENTRY_ENTRIES; i++) {
+		if (!(l2_shadow[i][0] & 1u))
 			continue;
-		l2_unpack_entry(words, out);
-		return 0;
+		if (hash == l2_hash_current()) {
+			fill[i / L2_BUCKET_SIZE]++;
+		} else {
+			l2_unpack_entry(l2_shadow[i], &a);
+			fill[l2_bucket_hash(a.mac, a.vid, hash) / L2_BUCKET_SIZE]++;
+		}
 	}
-	return -ENOENT;
+	for (i = 0; i < L2_ENTRY_ENTRIES / L2_BUCKET_SIZE; i++) {
+		n = fill[i] < L2_BUCKET_SIZE ? fill[i] : L2_BUCKET_SIZE;
+		st->histogram[n]++;
+		st->entries += (uint32_t)n;
+		st->overflow += (uint32_t)(fill[i] - n);
+		if (n == L2_BUCKET_SIZE)
+			st->buckets_full++;
+	}
+	st->hash = (bcm56846_l2_hash_t)hash;
+	st->insert_fail = l2_insert_fail;
+	st->rehash_drop = l2_rehash_drop;
+	pthread_mutex_unlock(&l2_lock);
+	return 0;
 }
 
 /* --- L2_USER_ENTRY (TCAM): 0x06168000, 512 entries × 20 bytes (5 words). RE: L2_ENTRY_FORMAT.md §2 --- */
@@ -163,16 +1469,90 @@ int bcm56846_l2_addr_get(int unit, const uint8_t mac[6], uint16_t vid, bcm56846_
 #define L2_USER_ENTRY_COUNT   512
 #define L2_USER_ENTRY_WORDS   5
 
-static int l2_user_table_write(int unit, int index, const uint32_t *words)
+/*
+ * The TCAM hits on the lowest matching index, so entries are kept in
+ * descending priority order (equal priorities in insertion order).  Slot
+ * contents, priorities and the occupancy bitmap live in software, loaded
+ * with one TDMA on first use: add and delete issue no reads.  A new entry
+ * goes right after the last one of its priority or above; only when that
+ * spot is taken do the entries up to the nearest free slot shift by one,
+ * each written to its new slot before its old one is reused, so a lookup
+ * always finds a copy.  Callers hold entry ids, which stay stable across
+ * moves.  l2_lock serializes L2_USER_ENTRY updates too.
+ */
+#define L2_USER_MAP_WORDS     (L2_USER_ENTRY_COUNT / 32)
+
+static uint32_t l2_user_used[L2_USER_MAP_WORDS];   /* slot holds an entry */
+static uint32_t l2_user_ids[L2_USER_MAP_WORDS];    /* id allocated */
+static uint32_t l2_user_words[L2_USER_ENTRY_COUNT][L2_USER_ENTRY_WORDS];
+static int l2_user_prio[L2_USER_ENTRY_COUNT];      /* by slot */
+static int16_t l2_user_slot_id[L2_USER_ENTRY_COUNT];
+static int16_t l2_user_id_slot[L2_USER_ENTRY_COUNT];
+static int l2_user_loaded;
+
+static int l2_user_bit(const uint32_t *map, int i)
 {
-	(void)unit;
-	return sbus_mem_write(L2_USER_ENTRY_BASE, index, words, L2_USER_ENTRY_WORDS);
+	return (map[i / 32] >> (i % 32)) & 1u;
 }
 
-static int l2_user_table_read(int unit, int index, uint32_t *words)
+static void l2_user_bit_set(uint32_t *map, int i, int on)
 {
-	(void)unit;
-	return sbus_mem_read(L2_USER_ENTRY_BASE, index, words, L2_USER_ENTRY_WORDS);
+	if (on)
+		map[i / 32] |= 1u << (i % 32);
+	else
+		map[i / 32] &= ~(1u << (i % 32));
+}
+
+/* First clear bit of map, or -1. */
+static int l2_user_ffz(const uint32_t *map)
+{
+	int w;
+
+	for (w = 0; w < L2_USER_MAP_WORDS; w++)
+		if (map[w] != 0xffffffffu)
+			return w * 32 + __builtin_ctz(~map[w]);
+	return -1;
+}
+
+/* Entries left by a previous run keep their slots, as priority 0. */
+static void l2_user_load(void)
+{
+	const uint32_t *view;
+	int i;
+
+	if (l2_user_loaded)
+		return;
+	memset(l2_user_used, 0, sizeof(l2_user_used));
+	memset(l2_user_ids, 0, sizeof(l2_user_ids));
+	memset(l2_user_words, 0, sizeof(l2_user_words));
+	view = sbus_mem_view(L2_USER_ENTRY_BASE, 0, L2_USER_ENTRY_COUNT, L2_USER_ENTRY_WORDS);
+	if (!view)
+		fprintf(stderr, "[l2] L2_USER_ENTRY read failed, TCAM assumed empty\n");
+	for (i = 0; view && i < L2_USER_ENTRY_COUNT; i++) {
+		const uint32_t *e = view + (size_t)i * L2_USER_ENTRY_WORDS;
+
+		if (!(e[0] & 1u))
+			continue;
+		memcpy(l2_user_words[i], e, sizeof(l2_user_words[i]));
+		l2_user_bit_set(l2_user_used, i, 1);
+		l2_user_bit_set(l2_user_ids, i, 1);
+		l2_user_prio[i] = 0;
+		l2_user_slot_id[i] = (int16_t)i;
+		l2_user_id_slot[i] = (int16_t)i;
+	}
+	if (view)
+		sbus_mem_view_release();
+	l2_user_loaded = 1;
+}
+
+/* Queue the entry at slot from into slot to (software state follows). */
+static void l2_user_move(sbus_batch_t *batch, int from, int to)
+{
+	memcpy(l2_user_words[to], l2_user_words[from], sizeof(l2_user_words[to]));
+	l2_user_prio[to] = l2_user_prio[from];
+	l2_user_slot_id[to] = l2_user_slot_id[from];
+	l2_user_id_slot[l2_user_slot_id[to]] = (int16_t)to;
+	sbus_batch_mem_write(batch, L2_USER_ENTRY_BASE, to, l2_user_words[to], L2_USER_ENTRY_WORDS);
 }
 
 /* Pack 5 words: KEY (VALID, MAC, VLAN, KEY_TYPE), MASK (61 bits), DATA (PRI, CPU, PORT_NUM, BPDU). */
@@ -202,34 +1582,96 @@ static void l2_user_pack(const bcm56846_l2_user_addr_t *addr, uint32_t *words)
 		   ((uint32_t)(addr->bpdu & 1) << 26);
 }
 
-int bcm56846_l2_user_entry_add(int unit, const bcm56846_l2_user_addr_t *addr, int *index_out)
+/*
+ * Install addr ahead of every entry of lower priority; *id_out gets the
+ * entry id for l2_user_entry_delete().  -ENOSPC when the TCAM is full.
+ */
+int bcm56846_l2_user_entry_add(int unit, const bcm56846_l2_user_addr_t *addr, int *id_out)
 {
-	uint32_t words[L2_USER_ENTRY_WORDS];
-	int i;
+	sbus_batch_t batch;
+	int lo = 0, hi = L2_USER_ENTRY_COUNT, slot, free_lo, free_hi, id, i, rc = 0;
 
+	(void)unit;
 	if (!addr)
 		return -EINVAL;
-	l2_user_pack(addr, words);
-	/* Find first free slot (VALID=0). */
+	pthread_mutex_lock(&l2_lock);
+	l2_user_load();
+	id = l2_user_ffz(l2_user_ids);
+	if (id < 0) {
+		pthread_mutex_unlock(&l2_lock);
+		return -ENOSPC;
+	}
+	/* Free slots in [lo, hi) sit between priority >= and < addr->priority */
 	for (i = 0; i < L2_USER_ENTRY_COUNT; i++) {
-		uint32_t read_back[L2_USER_ENTRY_WORDS];
-		if (l2_user_table_read(unit, i, read_back) != 0)
+		if (!l2_user_bit(l2_user_used, i))
 			continue;
-		if ((read_back[0] & 1u) == 0) {
-			if (l2_user_table_write(unit, i, words) != 0)
-				return -EIO;
-			if (index_out)
-				*index_out = i;
-			return 0;
+		if (l2_user_prio[i] < addr->priority) {
+			hi = i;
+			break;
 		}
+		lo = i + 1;
 	}
-	return -ENOSPC;
+	sbus_batch_init(&batch);
+	slot = lo;
+	if (lo == hi) {
+		for (free_lo = lo - 1; free_lo >= 0 && l2_user_bit(l2_user_used, free_lo); free_lo--)
+			;
+		for (free_hi = hi; free_hi < L2_USER_ENTRY_COUNT && l2_user_bit(l2_user_used, free_hi); free_hi++)
+			;
+		if (free_hi < L2_USER_ENTRY_COUNT && (free_lo < 0 || free_hi - hi <= lo - free_lo)) {
+			for (i = free_hi; i > hi; i--)
+				l2_user_move(&batch, i - 1, i);
+			l2_user_bit_set(l2_user_used, free_hi, 1);
+			slot = hi;
+		} else {
+			for (i = free_lo; i < lo - 1; i++)
+				l2_user_move(&batch, i + 1, i);
+			l2_user_bit_set(l2_user_used, free_lo, 1);
+			slot = lo - 1;
+		}
+	}
+	l2_user_pack(addr, l2_user_words[slot]);
+	l2_user_prio[slot] = addr->priority;
+	l2_user_slot_id[slot] = (int16_t)id;
+	l2_user_id_slot[id] = (int16_t)slot;
+	l2_user_bit_set(l2_user_used, slot, 1);
+	l2_user_bit_set(l2_user_ids, id, 1);
+	sbus_batch_mem_write(&batch, L2_USER_ENTRY_BASE, slot, l2_user_words[slot], L2_USER_ENTRY_WORDS);
+	sbus_batch_submit(&batch);
+	if (batch.errors > 0) {
+		/* Some slots may hold stale copies: re-read the TCAM on next use */
+		fprintf(stderr, "[l2] L2_USER_ENTRY: %d writes failed\n", batch.errors);
+		l2_user_loaded = 0;
+		rc = -EIO;
+	} else if (id_out) {
+		*id_out = id;
+	}
+	pthread_mutex_unlock(&l2_lock);
+	return rc;
 }
 
-int bcm56846_l2_user_entry_delete(int unit, int index)
+int bcm56846_l2_user_entry_delete(int unit, int id)
 {
-	uint32_t words[L2_USER_ENTRY_WORDS] = { 0, 0, 0, 0, 0 };
-	if (index < 0 || index >= L2_USER_ENTRY_COUNT)
+	static const uint32_t zero[L2_USER_ENTRY_WORDS];
+	int slot, rc = 0;
+
+	(void)unit;
+	if (id < 0 || id >= L2_USER_ENTRY_COUNT)
 		return -EINVAL;
-	return l2_user_table_write(unit, index, words);
+	pthread_mutex_lock(&l2_lock);
+	l2_user_load();
+	if (!l2_user_bit(l2_user_ids, id)) {
+		pthread_mutex_unlock(&l2_lock);
+		return -ENOENT;
+	}
+	slot = l2_user_id_slot[id];
+	if (sbus_mem_write(L2_USER_ENTRY_BASE, slot, zero, L2_USER_ENTRY_WORDS) != 0) {
+		rc = -EIO;
+	} else {
+		memset(l2_user_words[slot], 0, sizeof(l2_user_words[slot]));
+		l2_user_bit_set(l2_user_used, slot, 0);
+		l2_user_bit_set(l2_user_ids, id, 0);
+	}
+	pthread_mutex_unlock(&l2_lock);
+	return rc;
 }
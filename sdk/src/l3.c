@@ -3,6 +3,8 @@
 #include "sbus.h"
 #include <arpa/inet.h>
 #include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define EGR_L3_INTF_BASE        0x01264000u
@@ -18,15 +20,29 @@
 #define L3_DEFIP_BASE           0x0a170000u
 #define L3_DEFIP_WORDS          8
 
+/* L3_DEFIP_128: IPv6 prefixes longer than /64, one per entry (39 bytes) */
+#define L3_DEFIP_128_BASE       0x0a176000u
+#define L3_DEFIP_128_WORDS      10
+
 #define MAX_L3_INTF             4096
 #define MAX_L3_NHOP             16384
 #define MAX_L3_DEFIP            8192
+#define MAX_L3_DEFIP_128        256
+#define MAX_L3_VRF              1024  /* VRF_ID is 10 bits of the DEFIP key */
+
+/*
+ * Pipelined mode (bcm56846_l3_async_set): table writes are queued on the
+ * shared SCHAN SQ (sbus_submit) and the API call returns once queued, so
+ * the caller can parse the next update while the kernel programs this one.
+ * Write failures are counted and reported by bcm56846_l3_sync().  The SQ
+ * is FIFO, so a route never reaches the hardware before its next hop.
+ */
+static int l3_async;
+static int l3_async_errors;
+static sbus_batch_t l3_batch;
 
 static int intf_used[MAX_L3_INTF];
 static int nhop_used[MAX_L3_NHOP];
-static int defip_used[MAX_L3_DEFIP];
-static uint32_t defip_prefix[MAX_L3_DEFIP];
-static int defip_plen[MAX_L3_DEFIP];
 
 static int alloc_id(int *used, int max, int start)
 {
@@ -65,6 +81,16 @@ static void set_bits_u64(uint32_t *words, int num_words, int start_bit, int widt
 	}
 }
 
+static uint64_t get_bits_u64(const uint32_t *words, int start_bit, int width)
+{
+	uint64_t v = 0;
+
+	for (int i = 0; i < width; i++)
+		if ((words[(start_bit + i) / 32] >> ((start_bit + i) % 32)) & 1u)
+			v |= 1ull << i;
+	return v;
+}
+
 static uint64_t mac48_to_u64(const uint8_t mac[6])
 {
 	return ((uint64_t)mac[0] << 40) | ((uint64_t)mac[1] << 32) |
@@ -72,28 +98,74 @@ static uint64_t mac48_to_u64(const uint8_t mac[6])
 	       ((uint64_t)mac[4] << 8) | (uint64_t)mac[5];
 }
 
+/* Reap every queued L3 write; returns the number of failed writes since last call. */
+static int l3_reap_all(void)
+{
+	sbus_cqe_t c[16];
+	int i, n, failed;
+
+	while (sbus_inflight() > 0) {
+		n = sbus_reap(c, 16, -1);
+		for (i = 0; i < n; i++)
+			if (c[i].status != 0)
+				l3_async_errors++;
+	}
+	failed = l3_async_errors;
+	l3_async_errors = 0;
+	return failed;
+}
+
+/* One table entry write: queued in pipelined mode, synchronous otherwise. */
+static int l3_mem_write(uint32_t mem, int index, const uint32_t *words, int nwords)
+{
+	uint64_t tag = ((uint64_t)mem << 32) | (uint32_t)index;
+
+	if (l3_async) {
+		sbus_batch_mem_write(&l3_batch, mem, index, words, nwords);
+		if (sbus_submit(&l3_batch, tag) == 0)
+			return 0;
+		/* Too many unreaped submissions: drain, then retry once */
+		l3_async_errors += l3_reap_all();
+		if (sbus_submit(&l3_batch, tag) == 0)
+			return 0;
+		l3_batch.count = 0; /* no SQ: nothing in flight, write synchronously */
+	}
+	return sbus_mem_write(mem, index, words, nwords);
+}
+
 static int egr_l3_intf_write(int unit, int intf_id, const uint32_t *words)
 {
 	(void)unit;
-	return sbus_mem_write(EGR_L3_INTF_BASE, intf_id, words, EGR_L3_INTF_WORDS);
+	return l3_mem_write(EGR_L3_INTF_BASE, intf_id, words, EGR_L3_INTF_WORDS);
 }
 
 static int ing_l3_nhop_write(int unit, int nhop_id, const uint32_t *words)
 {
 	(void)unit;
-	return sbus_mem_write(ING_L3_NEXT_HOP_BASE, nhop_id, words, ING_L3_NEXT_HOP_WORDS);
+	return l3_mem_write(ING_L3_NEXT_HOP_BASE, nhop_id, words, ING_L3_NEXT_HOP_WORDS);
 }
 
 static int egr_l3_nhop_write(int unit, int nhop_id, const uint32_t *words)
 {
 	(void)unit;
-	return sbus_mem_write(EGR_L3_NEXT_HOP_BASE, nhop_id, words, EGR_L3_NEXT_HOP_WORDS);
+	return l3_mem_write(EGR_L3_NEXT_HOP_BASE, nhop_id, words, EGR_L3_NEXT_HOP_WORDS);
+}
+
+int bcm56846_l3_async_set(int unit, int enable)
+{
+	(void)unit;
+	if (!enable && l3_async)
+		l3_async_errors += l3_reap_all();
+	if (enable && !l3_async)
+		sbus_batch_init(&l3_batch);
+	l3_async = enable ? 1 : 0;
+	return 0;
 }
 
-static int l3_defip_write(int unit, int index, const uint32_t *words)
+int bcm56846_l3_sync(int unit)
 {
 	(void)unit;
-	return sbus_mem_write(L3_DEFIP_BASE, index, words, L3_DEFIP_WORDS);
+	return l3_reap_all();
 }
 
 int bcm56846_l3_intf_create(int unit, const uint8_t mac[6], uint16_t vid, int *intf_id)
@@ -131,6 +203,80 @@ int bcm56846_l3_intf_destroy(int unit, int intf_id)
 	return 0;
 }
 
+/*
+ * Next hops are shared: egress_create returns the existing index for an
+ * identical (port, MAC, intf, VLAN) and takes a reference on it, and
+ * egress_destroy drops one, clearing the hardware entries with the last.
+ * nhop_ent chains each index into nhop_hash on that key; index 0 is
+ * never allocated, so 0 ends a chain.
+ */
+#define NHOP_HASH_SIZE 4096  /* chain heads, power of 2 */
+
+struct nhop_entry {
+	uint8_t mac[6];
+	uint16_t vid;
+	int port;
+	int intf_id;
+	int refs;
+	int next;  /* next index on the same hash chain, 0 = end */
+};
+
+static struct nhop_entry nhop_ent[MAX_L3_NHOP];
+static int nhop_hash[NHOP_HASH_SIZE];
+
+static unsigned int nhop_hash_key(const bcm56846_l3_egress_t *egress)
+{
+	uint32_t h = (uint32_t)(mac48_to_u64(egress->mac) ^ (mac48_to_u64(egress->mac) >> 24));
+
+	h ^= ((uint32_t)egress->port << 24) ^ ((uint32_t)egress->intf_id << 12) ^ egress->vid;
+	return (h * 0x9e3779b1u >> 16) & (NHOP_HASH_SIZE - 1);
+}
+
+static int nhop_find(const bcm56846_l3_egress_t *egress)
+{
+	int i;
+
+	for (i = nhop_hash[nhop_hash_key(egress)]; i != 0; i = nhop_ent[i].next) {
+		const struct nhop_entry *e = &nhop_ent[i];
+
+		if (e->port == egress->port && e->intf_id == egress->intf_id &&
+		    e->vid == egress->vid && memcmp(e->mac, egress->mac, 6) == 0)
+			return i;
+	}
+	return 0;
+}
+
+static void nhop_link(int id, const bcm56846_l3_egress_t *egress)
+{
+	struct nhop_entry *e = &nhop_ent[id];
+	unsigned int h = nhop_hash_key(egress);
+
+	memcpy(e->mac, egress->mac, 6);
+	e->vid = egress->vid;
+	e->port = egress->port;
+	e->intf_id = egress->intf_id;
+	e->refs = 1;
+	e->next = nhop_hash[h];
+	nhop_hash[h] = id;
+}
+
+static void nhop_unlink(int id)
+{
+	struct nhop_entry *e = &nhop_ent[id];
+	bcm56846_l3_egress_t key;
+	int *pp;
+
+	memcpy(key.mac, e->mac, 6);
+	key.vid = e->vid;
+	key.port = e->port;
+	key.intf_id = e->intf_id;
+	for (pp = &nhop_hash[nhop_hash_key(&key)]; *pp != 0 && *pp != id; pp = &nhop_ent[*pp].next)
+		;
+	if (*pp == id)
+		*pp = e->next;
+	memset(e, 0, sizeof(*e));
+}
+
 int bcm56846_l3_egress_create(int unit, const bcm56846_l3_egress_t *egress, int *egress_id)
 {
 	uint32_t ingw[ING_L3_NEXT_HOP_WORDS];
@@ -144,6 +290,12 @@ int bcm56846_l3_egress_create(int unit, const bcm56846_l3_egress_t *egress, int
 	if (egress->intf_id <= 0 || egress->intf_id >= MAX_L3_INTF)
 		return -EINVAL;
 
+	id = nhop_find(egress);
+	if (id > 0) {
+		nhop_ent[id].refs++;
+		*egress_id = id;
+		return 0;
+	}
 	id = alloc_id(nhop_used, MAX_L3_NHOP, 1);
 	if (id < 0)
 		return -ENOSPC;
@@ -164,6 +316,7 @@ int bcm56846_l3_egress_create(int unit, const bcm56846_l3_egress_t *egress, int
 		return -EIO;
 	}
 
+	nhop_link(id, egress);
 	*egress_id = id;
 	return 0;
 }
@@ -174,26 +327,323 @@ int bcm56846_l3_egress_destroy(int unit, int egress_id)
 	uint32_t egrw[EGR_L3_NEXT_HOP_WORDS] = { 0, 0, 0, 0 };
 	if (egress_id <= 0 || egress_id >= MAX_L3_NHOP)
 		return -EINVAL;
+	if (nhop_ent[egress_id].refs > 1) {
+		nhop_ent[egress_id].refs--;
+		return 0;
+	}
+	if (nhop_ent[egress_id].refs == 1)
+		nhop_unlink(egress_id);
 	(void) ing_l3_nhop_write(unit, egress_id, ingw);
 	(void) egr_l3_nhop_write(unit, egress_id, egrw);
 	free_id(nhop_used, MAX_L3_NHOP, egress_id);
 	return 0;
 }
 
-static int defip_find(uint32_t prefix, int plen)
+/*
+ * L3_DEFIP is a TCAM: the lowest matching index wins, so longest-prefix
+ * match needs longer prefixes at lower indices.  The table is split into
+ * one partition per prefix length, longest first; partition p is the
+ * contiguous run [start[p], start[p] + count[p]) followed by its free
+ * space.  An add goes at the end of its partition.  With no room there,
+ * the nearest partition with free space (above or below) lends a slot:
+ * each non-empty partition in between moves one entry across itself
+ * (first to end going down, last to front going up), so an add costs at
+ * most one move per partition it crosses.  Every move writes the copy
+ * before the original slot is reused, so each route stays in the TCAM
+ * throughout (make-before-break); a delete fills its hole with the
+ * partition's last entry the same way.  shadow holds the words written at
+ * each index.
+ *
+ * IPv4 (/32../0, partitions 0..32) and IPv6 up to /64 (33..97) share
+ * L3_DEFIP, an IPv6 route taking both halves of an entry (double-wide,
+ * MODE0 = MODE1 = 1); the modes keep the families from matching each
+ * other, so their partitions only need ordering within a family.  The
+ * lender is looked for within the add's own family first, the free space
+ * between IPv4 /0 and IPv6 /64 counting for both, so an add moves at most
+ * 32 (IPv4) or 64 (IPv6) entries.  Only a family out of room borrows
+ * across the other one, up to DEFIP_PARTS - 1 moves.  Longer IPv6
+ * prefixes go to the L3_DEFIP_128 TCAM, managed the same way.
+ *
+ * ent records the route at each index and chains it into hash, keyed by
+ * (VRF, prefix, length), so add and delete find a route in O(1) rather
+ * than scanning the table.
+ */
+#define DEFIP_V4_PARTS    33  /* IPv4 /32../0 */
+#define DEFIP_V6_PARTS    65  /* IPv6 /64../0, double-wide */
+#define DEFIP_PARTS       (DEFIP_V4_PARTS + DEFIP_V6_PARTS)
+#define DEFIP128_PARTS    64  /* IPv6 /128../65 */
+#define DEFIP_HASH_SIZE   4096  /* chain heads per table, power of 2 */
+
+struct defip_entry {
+	uint32_t prefix[4];  /* host order, most significant first, masked to plen */
+	uint16_t vrf;
+	uint8_t plen;
+	uint8_t is_ipv6;
+	uint8_t used;
+	int16_t next;        /* next index on the same hash chain, -1 = end */
+};
+
+struct defip_table {
+	uint32_t mem;
+	int size;
+	int words;
+	int parts;
+	int split;           /* first partition of the second family (= parts: one) */
+	int nhi_bit;         /* NEXT_HOP_INDEX(0), for route_get */
+	int *start;          /* [parts] = size */
+	int *count;
+	struct defip_entry *ent;
+	int16_t *hash;
+	uint32_t *shadow;    /* size x words */
+	int ready;
+};
+
+static int defip_start[DEFIP_PARTS + 1];
+static int defip_count[DEFIP_PARTS];
+static struct defip_entry defip_ent[MAX_L3_DEFIP];
+static int16_t defip_hash[DEFIP_HASH_SIZE];
+static uint32_t defip_shadow[MAX_L3_DEFIP * L3_DEFIP_WORDS];
+
+static int defip128_start[DEFIP128_PARTS + 1];
+static int defip128_count[DEFIP128_PARTS];
+static struct defip_entry defip128_ent[MAX_L3_DEFIP_128];
+static int16_t defip128_hash[DEFIP_HASH_SIZE];
+static uint32_t defip128_shadow[MAX_L3_DEFIP_128 * L3_DEFIP_128_WORDS];
+
+static struct defip_table defip = {
+	L3_DEFIP_BASE, MAX_L3_DEFIP, L3_DEFIP_WORDS, DEFIP_PARTS, DEFIP_V4_PARTS, 207,
+	defip_start, defip_count, defip_ent, defip_hash, defip_shadow, 0
+};
+static struct defip_table defip128 = {
+	L3_DEFIP_128_BASE, MAX_L3_DEFIP_128, L3_DEFIP_128_WORDS, DEFIP128_PARTS, DEFIP128_PARTS, 278,
+	defip128_start, defip128_count, defip128_ent, defip128_hash, defip128_shadow, 0
+};
+
+/* Table and partition a route key belongs in. */
+static struct defip_table *defip_table_of(const struct defip_entry *k, int *part)
 {
-	for (int i = 0; i < MAX_L3_DEFIP; i++) {
-		if (defip_used[i] && defip_prefix[i] == prefix && defip_plen[i] == plen)
-			return i;
+	if (!k->is_ipv6) {
+		*part = 32 - k->plen;
+		return &defip;
+	}
+	if (k->plen <= 64) {
+		*part = DEFIP_V4_PARTS + 64 - k->plen;
+		return &defip;
 	}
+	*part = 128 - k->plen;
+	return &defip128;
+}
+
+/* Free space evenly between the partitions to start with. */
+static void defip_init(struct defip_table *t)
+{
+	int p;
+
+	if (t->ready)
+		return;
+	for (p = 0; p <= t->parts; p++)
+		t->start[p] = (int)((long)p * t->size / t->parts);
+	memset(t->count, 0, sizeof(int) * (size_t)t->parts);
+	memset(t->ent, 0, sizeof(*t->ent) * (size_t)t->size);
+	memset(t->hash, 0xff, sizeof(int16_t) * DEFIP_HASH_SIZE);  /* all -1 */
+	t->ready = 1;
+}
+
+static unsigned int defip_hash_key(const struct defip_entry *k)
+{
+	uint32_t h = k->prefix[0] ^ (k->prefix[1] * 0x85ebca6bu) ^ (k->prefix[2] * 0xc2b2ae35u) ^
+		     k->prefix[3] ^ ((uint32_t)k->vrf << 20) ^ (uint32_t)k->plen;
+
+	return ((h * 0x9e3779b1u) >> 16) & (DEFIP_HASH_SIZE - 1);
+}
+
+static int defip_key_eq(const struct defip_entry *a, const struct defip_entry *b)
+{
+	return a->plen == b->plen && a->vrf == b->vrf && a->is_ipv6 == b->is_ipv6 &&
+	       memcmp(a->prefix, b->prefix, sizeof(a->prefix)) == 0;
+}
+
+static int defip_find(const struct defip_table *t, const struct defip_entry *k)
+{
+	int i;
+
+	if (!t->ready)
+		return -1;
+	for (i = t->hash[defip_hash_key(k)]; i >= 0; i = t->ent[i].next)
+		if (defip_key_eq(&t->ent[i], k))
+			return i;
 	return -1;
 }
 
-static void defip_pack_v4_ucast(uint32_t *w, uint32_t prefix_host, int plen, int nhop_index)
+/* Drop idx from its hash chain and mark it free. */
+static void defip_unlink(struct defip_table *t, int idx)
+{
+	struct defip_entry *e = &t->ent[idx];
+	int16_t *pp;
+
+	if (!e->used)
+		return;
+	pp = &t->hash[defip_hash_key(e)];
+	while (*pp >= 0 && *pp != idx)
+		pp = &t->ent[*pp].next;
+	if (*pp == idx)
+		*pp = e->next;
+	e->used = 0;
+	e->next = -1;
+}
+
+/* Free slots after partition p (p = -1: before partition 0). */
+static int defip_gap(const struct defip_table *t, int p)
+{
+	if (p < 0)
+		return t->start[0];
+	return t->start[p + 1] - (t->start[p] + t->count[p]);
+}
+
+/* Write words (NULL = invalidate) at idx and record them as route key. */
+static int defip_set(int unit, struct defip_table *t, int idx, const uint32_t *words,
+		     const struct defip_entry *key)
+{
+	static const uint32_t zero[L3_DEFIP_128_WORDS];
+	uint32_t *sh = t->shadow + (size_t)idx * (size_t)t->words;
+	struct defip_entry k;
+	unsigned int h;
+
+	(void)unit;
+	if (words)
+		k = *key;  /* key may point at another slot's entry */
+	else
+		memset(&k, 0, sizeof(k));
+	if (l3_mem_write(t->mem, idx, words ? words : zero, t->words) != 0)
+		return -EIO;
+	memcpy(sh, words ? words : zero, sizeof(uint32_t) * (size_t)t->words);
+	defip_unlink(t, idx);
+	if (!words)
+		return 0;
+	h = defip_hash_key(&k);
+	k.used = 1;
+	k.next = t->hash[h];
+	t->ent[idx] = k;
+	t->hash[h] = (int16_t)idx;
+	return 0;
+}
+
+/*
+ * Copy the route at from into the free slot to.  from keeps its (now
+ * duplicate) entry in hardware until the caller reuses it.
+ */
+static int defip_move(int unit, struct defip_table *t, int from, int to)
 {
-	uint32_t ip_mask = (plen <= 0) ? 0 : (uint32_t)(0xffffffffu << (32 - plen));
-	uint64_t key = ((uint64_t)0u << 33) | ((uint64_t)prefix_host << 1) | 0u;
-	uint64_t mask = ((uint64_t)0x3ffu << 33) | ((uint64_t)ip_mask << 1) | 1u;
+	if (defip_set(unit, t, to, t->shadow + (size_t)from * (size_t)t->words, &t->ent[from]) != 0)
+		return -EIO;
+	defip_unlink(t, from);
+	return 0;
+}
+
+/*
+ * Nearest partitions with free space after them among lo..hi-1, at or
+ * below k (*down) and above it (*up, lo - 1 = the space before lo).
+ * -1 when there is none.
+ */
+static int defip_gap_near(const struct defip_table *t, int k, int lo, int hi,
+			  int *up, int *down)
+{
+	for (*down = k; *down < hi && defip_gap(t, *down) == 0; (*down)++)
+		;
+	for (*up = k - 1; *up >= lo - 1 && defip_gap(t, *up) == 0; (*up)--)
+		;
+	return (*down < hi || *up >= lo - 1) ? 0 : -1;
+}
+
+/*
+ * Make the slot after partition k free, borrowing from the nearest
+ * partition with room in k's family, else in the whole table.  Returns
+ * the slot (already counted in partition k), -ENOSPC or -EIO.
+ */
+static int defip_slot_alloc(int unit, struct defip_table *t, int k)
+{
+	int lo = k < t->split ? 0 : t->split;
+	int hi = k < t->split ? t->split : t->parts;
+	int up, down, m, free_idx, rc = 0;
+
+	if (defip_gap_near(t, k, lo, hi, &up, &down) != 0) {
+		lo = 0;
+		hi = t->parts;
+		if (defip_gap_near(t, k, lo, hi, &up, &down) != 0)
+			return -ENOSPC;
+	}
+	if (down < hi && (up < lo - 1 || down - k <= k - 1 - up)) {
+		/* Going down: partition m's first entry moves to its end */
+		free_idx = t->start[down] + t->count[down];
+		for (m = down; m > k && rc == 0; m--) {
+			if (t->count[m] > 0 && (rc = defip_move(unit, t, t->start[m], free_idx)) != 0)
+				break;
+			free_idx = t->start[m]++;
+		}
+		if (rc == 0)
+			free_idx = t->start[k] + t->count[k];
+	} else {
+		/* Going up: partition m's last entry moves in front of it */
+		free_idx = t->start[up + 1] - 1;
+		for (m = up + 1; m < k && rc == 0; m++) {
+			int last = t->start[m] + t->count[m] - 1;
+
+			if (t->count[m] > 0 && (rc = defip_move(unit, t, last, free_idx)) != 0)
+				break;
+			t->start[m]--;
+			free_idx = t->start[m + 1] - 1;
+		}
+		if (rc == 0)
+			free_idx = --t->start[k];
+	}
+	if (rc != 0) {
+		/* Stopped halfway: drop the stale duplicate left in the free slot */
+		(void) defip_set(unit, t, free_idx, NULL, NULL);
+		return rc;
+	}
+	t->count[k]++;
+	return free_idx;
+}
+
+static uint32_t defip_ip_mask(int plen)
+{
+	if (plen <= 0)
+		return 0;
+	return plen >= 32 ? 0xffffffffu : (uint32_t)(0xffffffffu << (32 - plen));
+}
+
+/* Key of route: prefix in host order and masked to its length. */
+static int defip_route_key(const bcm56846_l3_route_t *route, struct defip_entry *k)
+{
+	int i;
+
+	if (route->prefix_len < 0 || route->prefix_len > (route->is_ipv6 ? 128 : 32) ||
+	    route->vrf >= MAX_L3_VRF)
+		return -EINVAL;
+	memset(k, 0, sizeof(*k));
+	if (route->is_ipv6) {
+		for (i = 0; i < 4; i++)
+			k->prefix[i] = ntohl(route->prefix6[i]) & defip_ip_mask(route->prefix_len - 32 * i);
+	} else {
+		k->prefix[0] = ntohl(route->prefix) & defip_ip_mask(route->prefix_len);
+	}
+	k->vrf = route->vrf;
+	k->plen = (uint8_t)route->prefix_len;
+	k->is_ipv6 = route->is_ipv6 ? 1 : 0;
+	return 0;
+}
+
+/* KEY = VRF_ID[42:33] | IP_ADDR[32:1] | MODE[0]; MASK likewise. */
+static uint64_t defip_half_key(uint16_t vrf, uint32_t ip, int mode)
+{
+	return ((uint64_t)vrf << 33) | ((uint64_t)ip << 1) | (uint64_t)mode;
+}
+
+static void defip_pack_v4_ucast(uint32_t *w, uint16_t vrf, uint32_t prefix_host, int plen,
+				int nhop_index)
+{
+	uint64_t key = defip_half_key(vrf, prefix_host, 0);
+	uint64_t mask = defip_half_key(0x3ff, defip_ip_mask(plen), 1);
 
 	memset(w, 0, sizeof(uint32_t) * L3_DEFIP_WORDS);
 	/* VALID0 */
@@ -206,72 +656,362 @@ static void defip_pack_v4_ucast(uint32_t *w, uint32_t prefix_host, int plen, int
 	set_bits_u64(w, L3_DEFIP_WORDS, 207, 14, (uint64_t)(nhop_index & 0x3fff));
 }
 
+/*
+ * IPv6 /0../64, double-wide: half 0 holds address bits 127:96, half 1
+ * bits 95:64, both with MODE = 1; the result comes from half 0.
+ * Tentative (L3_DEFIP_128 likewise): half-1 field offsets, mirroring half 0.
+ */
+static void defip_pack_v6_64(uint32_t *w, const struct defip_entry *k, int nhop_index)
+{
+	memset(w, 0, sizeof(uint32_t) * L3_DEFIP_WORDS);
+	/* VALID0, VALID1 */
+	set_bit(w, L3_DEFIP_WORDS, 0, 1);
+	set_bit(w, L3_DEFIP_WORDS, 1, 1);
+	/* KEY0[45:2], KEY1[89:46], MASK0[133:90], MASK1[177:134] */
+	set_bits_u64(w, L3_DEFIP_WORDS, 2, 44, defip_half_key(k->vrf, k->prefix[0], 1));
+	set_bits_u64(w, L3_DEFIP_WORDS, 46, 44, defip_half_key(k->vrf, k->prefix[1], 1));
+	set_bits_u64(w, L3_DEFIP_WORDS, 90, 44, defip_half_key(0x3ff, defip_ip_mask(k->plen), 1));
+	set_bits_u64(w, L3_DEFIP_WORDS, 134, 44,
+		     defip_half_key(0x3ff, defip_ip_mask(k->plen - 32), 1));
+	set_bits_u64(w, L3_DEFIP_WORDS, 207, 14, (uint64_t)(nhop_index & 0x3fff));
+}
+
+/*
+ * L3_DEFIP_128: VALID[0], IP_ADDR[128:1] (bits 31:0 first), VRF_ID[138:129],
+ * IP_ADDR_MASK[266:139], VRF_ID_MASK[276:267], ECMP[277],
+ * NEXT_HOP_INDEX[291:278].
+ */
+static void defip_pack_v6_128(uint32_t *w, const struct defip_entry *k, int nhop_index)
+{
+	int i;
+
+	memset(w, 0, sizeof(uint32_t) * L3_DEFIP_128_WORDS);
+	set_bit(w, L3_DEFIP_128_WORDS, 0, 1);
+	for (i = 0; i < 4; i++) {
+		set_bits_u64(w, L3_DEFIP_128_WORDS, 1 + 32 * (3 - i), 32, k->prefix[i]);
+		set_bits_u64(w, L3_DEFIP_128_WORDS, 139 + 32 * (3 - i), 32,
+			     defip_ip_mask(k->plen - 32 * i));
+	}
+	set_bits_u64(w, L3_DEFIP_128_WORDS, 129, 10, k->vrf);
+	set_bits_u64(w, L3_DEFIP_128_WORDS, 267, 10, 0x3ff);
+	set_bits_u64(w, L3_DEFIP_128_WORDS, 278, 14, (uint64_t)(nhop_index & 0x3fff));
+}
+
 int bcm56846_l3_route_add(int unit, const bcm56846_l3_route_t *route)
 {
-	uint32_t w[L3_DEFIP_WORDS];
-	uint32_t prefix_host;
-	int idx;
+	uint32_t w[L3_DEFIP_128_WORDS];
+	struct defip_entry key;
+	struct defip_table *t;
+	int idx, part, fresh = 0;
 
 	if (!route)
 		return -EINVAL;
-	if (route->is_ipv6)
-		return -ENOTSUP;
-	if (route->prefix_len < 0 || route->prefix_len > 32)
+	if (defip_route_key(route, &key) != 0)
 		return -EINVAL;
 	if (route->egress_id <= 0 || route->egress_id >= MAX_L3_NHOP)
 		return -EINVAL;
 
-	prefix_host = ntohl(route->prefix);
-	idx = defip_find(prefix_host, route->prefix_len);
+	t = defip_table_of(&key, &part);
+	defip_init(t);
+	idx = defip_find(t, &key);
 	if (idx < 0) {
-		idx = alloc_id(defip_used, MAX_L3_DEFIP, 0);
+		idx = defip_slot_alloc(unit, t, part);
 		if (idx < 0)
-			return -ENOSPC;
-		defip_prefix[idx] = prefix_host;
-		defip_plen[idx] = route->prefix_len;
+			return idx;
+		fresh = 1;
 	}
 
-	defip_pack_v4_ucast(w, prefix_host, route->prefix_len, route->egress_id);
-	if (l3_defip_write(unit, idx, w) != 0)
+	if (!key.is_ipv6)
+		defip_pack_v4_ucast(w, key.vrf, key.prefix[0], key.plen, route->egress_id);
+	else if (t == &defip)
+		defip_pack_v6_64(w, &key, route->egress_id);
+	else
+		defip_pack_v6_128(w, &key, route->egress_id);
+	if (defip_set(unit, t, idx, w, &key) != 0) {
+		if (fresh) {
+			/* Give the slot back: it may still hold a moved route's duplicate */
+			(void) defip_set(unit, t, idx, NULL, NULL);
+			if (idx == t->start[part])
+				t->start[part]++;
+			t->count[part]--;
+		}
 		return -EIO;
+	}
 	return 0;
 }
 
 int bcm56846_l3_route_delete(int unit, const bcm56846_l3_route_t *route)
 {
-	uint32_t w[L3_DEFIP_WORDS] = { 0 };
-	uint32_t prefix_host;
-	int idx;
+	struct defip_entry key;
+	struct defip_table *t;
+	int idx, k, last;
 
 	if (!route)
 		return -EINVAL;
-	if (route->is_ipv6)
-		return -ENOTSUP;
-	if (route->prefix_len < 0 || route->prefix_len > 32)
+	if (defip_route_key(route, &key) != 0)
 		return -EINVAL;
-	prefix_host = ntohl(route->prefix);
-	idx = defip_find(prefix_host, route->prefix_len);
+	t = defip_table_of(&key, &k);
+	idx = defip_find(t, &key);
 	if (idx < 0)
 		return 0;
-	(void) l3_defip_write(unit, idx, w);
-	defip_used[idx] = 0;
-	defip_prefix[idx] = 0;
-	defip_plen[idx] = 0;
+	/* The partition's last entry takes the hole, then its old slot is cleared */
+	last = t->start[k] + t->count[k] - 1;
+	if (idx != last && defip_move(unit, t, last, idx) != 0)
+		return -EIO;
+	if (defip_set(unit, t, last, NULL, NULL) != 0)
+		return -EIO;  /* last still valid in hardware: keep it counted */
+	t->count[k]--;
+	return 0;
+}
+
+int bcm56846_l3_route_get(int unit, bcm56846_l3_route_t *route)
+{
+	struct defip_entry key;
+	struct defip_table *t;
+	int idx, part;
+
+	(void)unit;
+	if (!route)
+		return -EINVAL;
+	if (defip_route_key(route, &key) != 0)
+		return -EINVAL;
+	t = defip_table_of(&key, &part);
+	idx = defip_find(t, &key);
+	if (idx < 0)
+		return -ENOENT;
+	route->egress_id = (int)get_bits_u64(t->shadow + (size_t)idx * (size_t)t->words,
+					      t->nhi_bit, 14);
+	return 0;
+}
+
+/*
+ * Hosts live in the L3_ENTRY hash table, not the DEFIP TCAM.  As with
+ * L2_ENTRY the key (KEY_TYPE, VRF_ID, IP_ADDR) hashes to a bucket of 8
+ * consecutive entries that the ASIC searches; the SDK places each host in
+ * its bucket from a write-through shadow, rewriting an existing key in
+ * place and failing with -ENOSPC when the bucket is full.  An IPv6 host
+ * is double-wide: an even/odd pair of entries in its bucket.
+ *
+ * Tentative (XGS family layout, not yet confirmed on the AS5610): the
+ * table address, the IPV4/IPV6_UNICAST views below and CRC32-upper as the
+ * L3 hash.
+ */
+#define L3_ENTRY_BASE           0x09000000u
+#define L3_ENTRY_ENTRIES        16384
+#define L3_ENTRY_WORDS          4
+#define L3_ENTRY_BUCKET_SIZE    8
+#define L3_ENTRY_HASH_BITS      11  /* log2(L3_ENTRY_ENTRIES / L3_ENTRY_BUCKET_SIZE) */
+#define L3_ENTRY_KEY_BITS       45  /* KEY_TYPE, VRF_ID, IP_ADDR: entry bits 45:1 */
+#define L3_KEY_TYPE_IPV4UC      0
+#define L3_KEY_TYPE_IPV6UC      2
+#define L3_ENTRY_KEY_MASK       0x3fffu  /* word[0]: VALID, KEY_TYPE, VRF_ID */
+
+/*
+ * IPV4_UNICAST: word[0]: VALID@0, KEY_TYPE@3:1, VRF_ID@13:4; word[1]:
+ * IP_ADDR; word[2]: NEXT_HOP_INDEX@13:0, HIT@31.
+ * IPV6_UNICAST: half 0 word[0] as IPv4, words[1..2] address bits 31:0,
+ * 63:32; half 1 word[0] VALID + KEY_TYPE, words[1..2] bits 95:64, 127:96,
+ * word[3] NEXT_HOP_INDEX@13:0, HIT@31.
+ */
+#define L3_ENTRY_HIT            (1u << 31)
+
+static uint32_t l3x_shadow[L3_ENTRY_ENTRIES][L3_ENTRY_WORDS];
+static int l3x_count;  /* valid entries in the shadow */
+
+/* First L3_ENTRY index of the bucket for a packed host's key (1 or 2 entries). */
+static int l3x_bucket(const uint32_t *words, int wide)
+{
+	extern uint32_t bcm56846_hash_crc32(uint32_t crc, uint64_t key, int nbits);
+	uint64_t key = ((uint64_t)words[1] << 13) | ((words[0] >> 1) & 0x1fffu);
+	uint32_t crc = bcm56846_hash_crc32(0, key, L3_ENTRY_KEY_BITS);
+
+	if (wide) {
+		crc = bcm56846_hash_crc32(crc, words[2], 32);
+		crc = bcm56846_hash_crc32(crc, words[L3_ENTRY_WORDS + 1], 32);
+		crc = bcm56846_hash_crc32(crc, words[L3_ENTRY_WORDS + 2], 32);
+	}
+	return (int)(crc >> (32 - L3_ENTRY_HASH_BITS)) * L3_ENTRY_BUCKET_SIZE;
+}
+
+/* Pack host into words (2 entries for IPv6); returns the width in entries. */
+static int l3x_pack(uint32_t *words, const bcm56846_l3_host_t *host, int nhop_index)
+{
+	uint32_t hdr = 1u | ((uint32_t)(host->vrf & 0x3ff) << 4);
+
+	memset(words, 0, sizeof(uint32_t) * 2 * L3_ENTRY_WORDS);
+	if (!host->is_ipv6) {
+		words[0] = hdr | (L3_KEY_TYPE_IPV4UC << 1);
+		words[1] = host->addr[0];
+		words[2] = (uint32_t)(nhop_index & 0x3fff);
+		return 1;
+	}
+	words[0] = hdr | (L3_KEY_TYPE_IPV6UC << 1);
+	words[1] = host->addr[3];
+	words[2] = host->addr[2];
+	words[L3_ENTRY_WORDS] = 1u | (L3_KEY_TYPE_IPV6UC << 1);
+	words[L3_ENTRY_WORDS + 1] = host->addr[1];
+	words[L3_ENTRY_WORDS + 2] = host->addr[0];
+	words[L3_ENTRY_WORDS + 3] = (uint32_t)(nhop_index & 0x3fff);
+	return 2;
+}
+
+static int l3x_key_eq(const uint32_t *e, const uint32_t *words)
+{
+	return ((e[0] ^ words[0]) & L3_ENTRY_KEY_MASK) == 0 && e[1] == words[1] &&
+	       (((words[0] >> 1) & 7u) != L3_KEY_TYPE_IPV6UC || e[2] == words[2]);
+}
+
+/*
+ * Index of the valid shadow host with words' key in bucket, or -1;
+ * *free_idx gets the bucket's first free slot (an even, free pair when
+ * wide), -1 if full.
+ */
+static int l3x_find(int bucket, const uint32_t *words, int width, int *free_idx)
+{
+	int wide = width == 2, i;
+
+	*free_idx = -1;
+	for (i = bucket; i < bucket + L3_ENTRY_BUCKET_SIZE; i += width) {
+		const uint32_t *e = l3x_shadow[i];
+
+		if (!(e[0] & 1u) && (!wide || !(l3x_shadow[i + 1][0] & 1u))) {
+			if (*free_idx < 0)
+				*free_idx = i;
+			continue;
+		}
+		if (!l3x_key_eq(e, words))
+			continue;
+		if (!wide || (l3x_shadow[i + 1][1] == words[L3_ENTRY_WORDS + 1] &&
+			      l3x_shadow[i + 1][2] == words[L3_ENTRY_WORDS + 2]))
+			return i;
+	}
+	return -1;
+}
+
+static int l3x_write(int unit, int index, const uint32_t *words)
+{
+	(void)unit;
+	if (l3_mem_write(L3_ENTRY_BASE, index, words, L3_ENTRY_WORDS) != 0)
+		return -EIO;
+	if ((words[0] & 1u) != (l3x_shadow[index][0] & 1u))
+		l3x_count += (words[0] & 1u) ? 1 : -1;
+	memcpy(l3x_shadow[index], words, sizeof(l3x_shadow[index]));
+	return 0;
+}
+
+static int l3x_host_check(const bcm56846_l3_host_t *host)
+{
+	if (!host || host->vrf >= MAX_L3_VRF)
+		return -EINVAL;
 	return 0;
 }
 
+/* A wide host's half 1 (result) is written before half 0 validates the pair. */
 int bcm56846_l3_host_add(int unit, const bcm56846_l3_host_t *host)
 {
-	bcm56846_l3_route_t r;
+	uint32_t words[2 * L3_ENTRY_WORDS];
+	int width, idx, free_idx;
+
+	if (l3x_host_check(host) != 0)
+		return -EINVAL;
+	if (host->egress_id <= 0 || host->egress_id >= MAX_L3_NHOP)
+		return -EINVAL;
+	width = l3x_pack(words, host, host->egress_id);
+	idx = l3x_find(l3x_bucket(words, width == 2), words, width, &free_idx);
+	if (idx < 0)
+		idx = free_idx;
+	if (idx < 0)
+		return -ENOSPC;
+	if (width == 2 && l3x_write(unit, idx + 1, words + L3_ENTRY_WORDS) != 0)
+		return -EIO;
+	return l3x_write(unit, idx, words);
+}
+
+int bcm56846_l3_host_delete(int unit, const bcm56846_l3_host_t *host)
+{
+	static const uint32_t zero[L3_ENTRY_WORDS];
+	uint32_t words[2 * L3_ENTRY_WORDS];
+	int width, idx, free_idx;
 
-	if (!host)
+	if (l3x_host_check(host) != 0)
 		return -EINVAL;
-	if (host->is_ipv6)
-		return -ENOTSUP;
-	memset(&r, 0, sizeof(r));
-	r.prefix = htonl(host->addr[0]);
-	r.prefix_len = 32;
-	r.egress_id = host->egress_id;
-	r.is_ipv6 = 0;
-	return bcm56846_l3_route_add(unit, &r);
+	width = l3x_pack(words, host, 0);
+	idx = l3x_find(l3x_bucket(words, width == 2), words, width, &free_idx);
+	if (idx < 0)
+		return 0; /* not present is not an error */
+	if (l3x_write(unit, idx, zero) != 0)
+		return -EIO;
+	return width == 2 ? l3x_write(unit, idx + 1, zero) : 0;
+}
+
+/*
+ * Host hit harvest: L3_ENTRY is read with one TDMA and each host entry
+ * with HIT set is written back with it clear.  Queued writes are reaped
+ * first so the view is not older than the shadow; only HIT is taken from
+ * the view, the rest of the write-back comes from the shadow.  The write
+ * goes through l3_mem_write, so in pipelined mode it is ordered with the
+ * route updates after it; the hosts are reported after the scan.
+ */
+int bcm56846_l3_host_hit_harvest(int unit, bcm56846_l3_host_cb_t cb, void *cookie)
+{
+	const uint32_t *view;
+	bcm56846_l3_host_t *hit;
+	uint32_t w[L3_ENTRY_WORDS];
+	int i, n = 0, failed = 0, rc = 0;
+
+	if (!cb)
+		return -EINVAL;
+	if (l3x_count == 0)
+		return 0;
+	hit = calloc((size_t)l3x_count, sizeof(*hit));
+	if (!hit)
+		return -ENOMEM;
+	l3_async_errors += l3_reap_all();  /* counted again by the next sync */
+	view = sbus_mem_view(L3_ENTRY_BASE, 0, L3_ENTRY_ENTRIES, L3_ENTRY_WORDS);
+	if (!view) {
+		free(hit);
+		return -EIO;
+	}
+	for (i = 0; i < L3_ENTRY_ENTRIES; i++) {
+		const uint32_t *v = view + (size_t)i * L3_ENTRY_WORDS;
+
+		if (!(l3x_shadow[i][0] & 1u))
+			continue;
+		memcpy(w, l3x_shadow[i], sizeof(w));
+		if (((w[0] >> 1) & 7u) == L3_KEY_TYPE_IPV6UC) {
+			/* Wide host: the result and HIT are in half 1 (odd index) */
+			const uint32_t *h0;
+
+			if (!(i & 1) || !(v[3] & L3_ENTRY_HIT))
+				continue;
+			h0 = l3x_shadow[i - 1];
+			w[3] &= ~L3_ENTRY_HIT;
+			hit[n].is_ipv6 = 1;
+			hit[n].addr[0] = w[2];
+			hit[n].addr[1] = w[1];
+			hit[n].addr[2] = h0[2];
+			hit[n].addr[3] = h0[1];
+			hit[n].vrf = (uint16_t)((h0[0] >> 4) & 0x3ff);
+			hit[n].egress_id = (int)(w[3] & 0x3fff);
+		} else {
+			if (!(v[2] & L3_ENTRY_HIT))
+				continue;
+			w[2] &= ~L3_ENTRY_HIT;
+			hit[n].addr[0] = w[1];
+			hit[n].vrf = (uint16_t)((w[0] >> 4) & 0x3ff);
+			hit[n].egress_id = (int)(w[2] & 0x3fff);
+		}
+		if (l3_mem_write(L3_ENTRY_BASE, i, w, L3_ENTRY_WORDS) != 0)
+			failed++;
+		n++;
+	}
+	sbus_mem_view_release();
+	if (failed > 0)
+		fprintf(stderr, "[l3] harvest: %d L3_ENTRY writes failed\n", failed);
+	for (i = 0; rc == 0 && i < n; i++)
+		rc = cb(unit, &hit[i], cookie);
+	free(hit);
+	if (rc < 0)
+		return rc;
+	return i;
 }
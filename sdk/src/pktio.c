@@ -8,8 +8,8 @@
 #include <string.h>
 #include <unistd.h>
 
-extern int bde_get_dma_info(uint64_t *pbase, uint32_t *size);
-extern void *bde_mmap_dma(void);
+extern void *bde_dma_alloc(size_t size, size_t align);
+extern uint64_t bde_dma_phys(const void *p);
 extern int bde_read_reg(uint32_t offset, uint32_t *value);
 extern int bde_write_reg(uint32_t offset, uint32_t value);
 
@@ -18,11 +18,6 @@ extern int bde_write_reg(uint32_t offset, uint32_t value);
 #define RX_DCBS 64
 #define RX_BUF_SIZE 2048
 
-static void *dma_vbase;
-static uint64_t dma_pbase;
-static uint32_t dma_size;
-static size_t dma_off;
-
 static bcm56846_rx_cb_t rx_cb;
 static void *rx_cookie;
 static pthread_t rx_th;
@@ -34,33 +29,9 @@ static uint8_t *tx_buf;
 static uint32_t *rx_ring;
 static uint8_t *rx_bufs[RX_DCBS];
 
-static void *dma_alloc(size_t size, size_t align)
-{
-	uintptr_t p;
-	uintptr_t a;
-
-	if (!dma_vbase) {
-		dma_vbase = bde_mmap_dma();
-		if (!dma_vbase)
-			return NULL;
-		if (bde_get_dma_info(&dma_pbase, &dma_size) != 0 || dma_size == 0)
-			return NULL;
-		/* Leave space for any kernel/BDE scratch at start. */
-		if (dma_off < 4096)
-			dma_off = 4096;
-	}
-
-	p = (uintptr_t)dma_vbase + dma_off;
-	a = (p + (align - 1)) & ~(align - 1);
-	if (a + size > (uintptr_t)dma_vbase + dma_size)
-		return NULL;
-	dma_off = (size_t)(a - (uintptr_t)dma_vbase + size);
-	return (void *)a;
-}
-
 static uint32_t dma_virt_to_phys32(const void *p)
 {
-	return (uint32_t)(dma_pbase + (uint64_t)((const uint8_t *)p - (const uint8_t *)dma_vbase));
+	return (uint32_t)bde_dma_phys(p);
 }
 
 static int cmic_dma_start(int ch, uint32_t desc0_phys)
@@ -74,6 +45,7 @@ static int cmic_dma_start(int ch, uint32_t desc0_phys)
 
 static void *rx_thread_main(void *arg)
 {
+	extern int bcm56846_l2_trap_admit(int port);
 	int unit = *(int *)arg;
 	(void)unit;
 
@@ -84,7 +56,8 @@ static void *rx_thread_main(void *arg)
 			if (st & 0x80000000u) {
 				int len = (int)(st & 0x7fffu);
 				int port = (int)(dcb[4] & 0xffu); /* best-effort (matches TX LOCAL_DEST_PORT field position) */
-				if (len > 0 && len <= RX_BUF_SIZE && rx_cb)
+				/* Learn-limit TRAP ports are policed before the application */
+				if (len > 0 && len <= RX_BUF_SIZE && rx_cb && bcm56846_l2_trap_admit(port))
 					rx_cb(0, port, rx_bufs[i], len, rx_cookie);
 				/* Re-arm */
 				dcb[15] = 0;
@@ -107,8 +80,8 @@ int bcm56846_tx(int unit, int port, const void *pkt, int len)
 		return -EINVAL;
 
 	if (!tx_dcb) {
-		tx_dcb = (uint32_t *)dma_alloc(DCB_WORDS * sizeof(uint32_t), 64);
-		tx_buf = (uint8_t *)dma_alloc(TX_BUF_MAX, 16);
+		tx_dcb = (uint32_t *)bde_dma_alloc(DCB_WORDS * sizeof(uint32_t), 64);
+		tx_buf = (uint8_t *)bde_dma_alloc(TX_BUF_MAX, 16);
 		if (!tx_dcb || !tx_buf)
 			return -ENOMEM;
 	}
@@ -153,13 +126,13 @@ int bcm56846_rx_start(int unit)
 
 	/* Allocate RX ring and buffers */
 	if (!rx_ring) {
-		rx_ring = (uint32_t *)dma_alloc((RX_DCBS + 1) * DCB_WORDS * sizeof(uint32_t), 64);
+		rx_ring = (uint32_t *)bde_dma_alloc((RX_DCBS + 1) * DCB_WORDS * sizeof(uint32_t), 64);
 		if (!rx_ring)
 			return -ENOMEM;
 		memset(rx_ring, 0, (RX_DCBS + 1) * DCB_WORDS * sizeof(uint32_t));
 		for (int i = 0; i < RX_DCBS; i++) {
 			uint32_t *dcb = rx_ring + i * DCB_WORDS;
-			rx_bufs[i] = (uint8_t *)dma_alloc(RX_BUF_SIZE, 16);
+			rx_bufs[i] = (uint8_t *)bde_dma_alloc(RX_BUF_SIZE, 16);
 			if (!rx_bufs[i])
 				return -ENOMEM;
 			memset(rx_bufs[i], 0, RX_BUF_SIZE);
@@ -11,8 +11,13 @@
  *
  * Per-port registers: addr = (block << 20) | (port << 12) | (offset & ~0xF00000)
  */
+#include "bcm56846.h"
 #include "bde_ioctl.h"
+#include "sbus.h"
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* SCHAN opcodes (XGS) */
@@ -20,6 +25,19 @@
 #define SCHAN_WRITE_REG_CMD  0x0Du
 #define SCHAN_READ_MEM_CMD   0x07u
 #define SCHAN_WRITE_MEM_CMD  0x09u
+#define SCHAN_TABLE_INSERT_CMD  0x24u
+#define SCHAN_TABLE_DELETE_CMD  0x26u
+#define SCHAN_TABLE_LOOKUP_CMD  0x28u
+
+/* Generic response word (resp[1]) of the hashed table ops */
+#define SCHAN_GEN_RESP_INDEX(w)  ((int)((w) & 0xfffffu))
+#define SCHAN_GEN_RESP_TYPE(w)   (((w) >> 20) & 0xfu)
+#define SCHAN_GEN_RESP_FOUND      0u
+#define SCHAN_GEN_RESP_NOT_FOUND  1u
+#define SCHAN_GEN_RESP_FULL       2u
+#define SCHAN_GEN_RESP_INSERTED   3u
+#define SCHAN_GEN_RESP_REPLACED   4u
+#define SCHAN_GEN_RESP_DELETED    5u
 
 /* Build SCHAN header word.
  * dwords: number of 32-bit data words.
@@ -54,6 +72,138 @@ uint32_t cdk_port_addr(uint32_t base, int port)
 	return (base & ~0xF00000u) | (block << 20) | ((uint32_t)port << 12);
 }
 
+/*
+ * ---- Register shadow cache ----
+ *
+ * Write-through cache of SOC register values so that sbus_reg_modify()
+ * costs one WRITE_REG instead of READ_REG + WRITE_REG.  Entries are filled
+ * by successful register writes (single or batched) and by the read half of
+ * an uncached modify; sbus_reg_read() always goes to the hardware and only
+ * refreshes an existing entry.  Registers the hardware changes on its own
+ * (status, counters, self-clearing bits) must be marked volatile, or
+ * invalidated after anything that resets them behind the SDK's back.
+ * Open addressing over addr; entries are never removed, only invalidated.
+ */
+#define SBUS_REG_CACHE_SLOTS  4096u  /* power of two */
+
+enum { RC_EMPTY, RC_VALID, RC_INVALID, RC_VOLATILE };
+
+static struct {
+	uint32_t addr;
+	uint32_t value;
+	uint8_t  state;
+} sbus_reg_cache[SBUS_REG_CACHE_SLOTS];
+static pthread_mutex_t sbus_reg_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Slot holding addr, else the empty slot to claim for it; -1 when full. */
+static int sbus_reg_cache_slot(uint32_t addr)
+{
+	uint32_t h = (addr * 2654435761u) & (SBUS_REG_CACHE_SLOTS - 1);
+	uint32_t i;
+
+	for (i = 0; i < SBUS_REG_CACHE_SLOTS; i++) {
+		uint32_t k = (h + i) & (SBUS_REG_CACHE_SLOTS - 1);
+
+		if (sbus_reg_cache[k].state == RC_EMPTY ||
+		    sbus_reg_cache[k].addr == addr)
+			return (int)k;
+	}
+	return -1;
+}
+
+/* Cached value of addr: 0 on hit, -1 on miss or volatile. */
+int sbus_reg_cache_get(uint32_t addr, uint32_t *value)
+{
+	int k, rc = -1;
+
+	pthread_mutex_lock(&sbus_reg_cache_lock);
+	k = sbus_reg_cache_slot(addr);
+	if (k >= 0 && sbus_reg_cache[k].state == RC_VALID &&
+	    sbus_reg_cache[k].addr == addr) {
+		*value = sbus_reg_cache[k].value;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&sbus_reg_cache_lock);
+	return rc;
+}
+
+/* Record a value known to be in the hardware (no-op for volatile registers). */
+void sbus_reg_cache_put(uint32_t addr, uint32_t value)
+{
+	int k;
+
+	pthread_mutex_lock(&sbus_reg_cache_lock);
+	k = sbus_reg_cache_slot(addr);
+	if (k >= 0 && sbus_reg_cache[k].state != RC_VOLATILE) {
+		sbus_reg_cache[k].addr = addr;
+		sbus_reg_cache[k].value = value;
+		sbus_reg_cache[k].state = RC_VALID;
+	}
+	pthread_mutex_unlock(&sbus_reg_cache_lock);
+}
+
+/* A hardware read of addr: update the entry if addr is already cached. */
+static void sbus_reg_cache_refresh(uint32_t addr, uint32_t value)
+{
+	int k;
+
+	pthread_mutex_lock(&sbus_reg_cache_lock);
+	k = sbus_reg_cache_slot(addr);
+	if (k >= 0 && sbus_reg_cache[k].addr == addr &&
+	    (sbus_reg_cache[k].state == RC_VALID || sbus_reg_cache[k].state == RC_INVALID)) {
+		sbus_reg_cache[k].value = value;
+		sbus_reg_cache[k].state = RC_VALID;
+	}
+	pthread_mutex_unlock(&sbus_reg_cache_lock);
+}
+
+static void sbus_reg_cache_set_state(uint32_t addr, uint8_t state)
+{
+	int k;
+
+	pthread_mutex_lock(&sbus_reg_cache_lock);
+	k = sbus_reg_cache_slot(addr);
+	if (k >= 0 && (state == RC_VOLATILE || sbus_reg_cache[k].state == RC_VALID)) {
+		sbus_reg_cache[k].addr = addr;
+		sbus_reg_cache[k].state = state;
+	}
+	pthread_mutex_unlock(&sbus_reg_cache_lock);
+}
+
+void sbus_reg_cache_invalidate(uint32_t addr)
+{
+	sbus_reg_cache_set_state(addr, RC_INVALID);
+}
+
+/* Never cache addr: every modify reads it from the hardware. */
+void sbus_reg_cache_volatile(uint32_t addr)
+{
+	sbus_reg_cache_set_state(addr, RC_VOLATILE);
+}
+
+/* Drop every cached value (e.g. after a block reset); volatile marks stay. */
+void sbus_reg_cache_invalidate_all(void)
+{
+	uint32_t k;
+
+	pthread_mutex_lock(&sbus_reg_cache_lock);
+	for (k = 0; k < SBUS_REG_CACHE_SLOTS; k++)
+		if (sbus_reg_cache[k].state == RC_VALID)
+			sbus_reg_cache[k].state = RC_INVALID;
+	pthread_mutex_unlock(&sbus_reg_cache_lock);
+}
+
+/* Keep the cache in step with a 32-bit WRITE_REG issued as a batch/SQ op. */
+static void sbus_reg_cache_op(const struct nos_bde_schan_batch_op *op, int ok)
+{
+	if ((op->cmd[0] >> 26) != SCHAN_WRITE_REG_CMD || op->cmd_words != 3)
+		return;
+	if (ok)
+		sbus_reg_cache_put(op->cmd[1], op->cmd[2]);
+	else
+		sbus_reg_cache_invalidate(op->cmd[1]);
+}
+
 /*
  * sbus_reg_write: Write a 32-bit SOC register via SCHAN WRITE_REGISTER.
  *   addr: CDK register address (e.g. 0x0238010a for BUFFER_CELL_LIMIT_SPr)
@@ -71,8 +221,10 @@ int sbus_reg_write(uint32_t addr, uint32_t value)
 	if (bde_schan_op(cmd, 3, NULL, 0, &status) < 0 || status != 0) {
 		fprintf(stderr, "[sbus] reg_write FAIL addr=0x%08x val=0x%08x status=%d\n",
 			addr, value, status);
+		sbus_reg_cache_invalidate(addr);
 		return -1;
 	}
+	sbus_reg_cache_put(addr, value);
 	return 0;
 }
 
@@ -95,6 +247,7 @@ int sbus_reg_read(uint32_t addr, uint32_t *value)
 	}
 	/* Response: resp[0] = response header, resp[1] = data */
 	*value = resp[1];
+	sbus_reg_cache_refresh(addr, resp[1]);
 	return 0;
 }
 
@@ -103,12 +256,16 @@ int sbus_reg_read(uint32_t addr, uint32_t *value)
  *   addr: CDK register address
  *   mask: bit mask for field (pre-shifted)
  *   value: new field value (pre-shifted)
+ * The read is skipped when the register is in the shadow cache.
  */
 int sbus_reg_modify(uint32_t addr, uint32_t mask, uint32_t value)
 {
 	uint32_t cur = 0;
-	if (sbus_reg_read(addr, &cur) < 0)
-		return -1;
+
+	if (sbus_reg_cache_get(addr, &cur) < 0) {
+		if (sbus_reg_read(addr, &cur) < 0)
+			return -1;
+	}
 	cur = (cur & ~mask) | (value & mask);
 	return sbus_reg_write(addr, cur);
 }
@@ -259,6 +416,8 @@ int sbus_reg_write_blk(uint32_t block, uint32_t addr, uint32_t value)
 	cmd[1] = addr;
 	cmd[2] = value;
 
+	/* Cache is keyed by addr alone; the block override makes it ambiguous */
+	sbus_reg_cache_invalidate(addr);
 	if (bde_schan_op(cmd, 3, NULL, 0, &status) < 0 || status != 0) {
 		fprintf(stderr, "[sbus] reg_write_blk FAIL blk=%u addr=0x%08x "
 			"val=0x%08x status=%d\n", block, addr, value, status);
@@ -309,3 +468,659 @@ int sbus_reg_read64(uint32_t addr, uint32_t *data)
 	data[1] = resp[2];
 	return 0;
 }
+
+/*
+ * ---- Hashed table ops (TABLE_INSERT / TABLE_DELETE / TABLE_LOOKUP) ----
+ *
+ * The ASIC hashes the key fields of entry, searches the bucket and places,
+ * removes or returns the entry in one message.  addr is the table base
+ * (index 0).  The response carries the generic response word (type and
+ * index) followed by the found, replaced or deleted entry.
+ */
+static int sbus_table_op(uint32_t opcode, uint32_t addr, const uint32_t *entry,
+			 int nwords, uint32_t *out, int *index)
+{
+	uint32_t cmd[16];
+	uint32_t resp[16] = {0};
+	uint32_t type;
+	int status = -1;
+
+	if (!entry || nwords <= 0 || nwords > 14)
+		return -EINVAL;
+	cmd[0] = schan_header(opcode, cdk_addr_to_block(addr), (uint32_t)nwords);
+	cmd[1] = addr;
+	memcpy(cmd + 2, entry, sizeof(uint32_t) * (size_t)nwords);
+
+	if (bde_schan_op(cmd, 2 + nwords, resp, 2 + nwords, &status) < 0 || status != 0) {
+		fprintf(stderr, "[sbus] table op 0x%02x FAIL addr=0x%08x status=%d\n",
+			opcode, addr, status);
+		return -EIO;
+	}
+	if (resp[0] & 0x0001u)
+		return -ENOTSUP; /* NACK: opcode not accepted for this memory */
+	type = SCHAN_GEN_RESP_TYPE(resp[1]);
+	switch (type) {
+	case SCHAN_GEN_RESP_FOUND:
+	case SCHAN_GEN_RESP_INSERTED:
+	case SCHAN_GEN_RESP_REPLACED:
+	case SCHAN_GEN_RESP_DELETED:
+		if (resp[0] & 0x0040u)
+			break;
+		if (index)
+			*index = SCHAN_GEN_RESP_INDEX(resp[1]);
+		if (out)
+			memcpy(out, resp + 2, sizeof(uint32_t) * (size_t)nwords);
+		return 0;
+	case SCHAN_GEN_RESP_NOT_FOUND:
+		return -ENOENT;
+	case SCHAN_GEN_RESP_FULL:
+		return -ENOSPC;
+	}
+	fprintf(stderr, "[sbus] table op 0x%02x RESP_ERR addr=0x%08x resp=0x%08x/0x%08x\n",
+		opcode, addr, resp[0], resp[1]);
+	return -EIO;
+}
+
+int sbus_table_insert(uint32_t addr, const uint32_t *entry, int nwords, int *index)
+{
+	return sbus_table_op(SCHAN_TABLE_INSERT_CMD, addr, entry, nwords, NULL, index);
+}
+
+int sbus_table_delete(uint32_t addr, const uint32_t *key, int nwords, int *index)
+{
+	return sbus_table_op(SCHAN_TABLE_DELETE_CMD, addr, key, nwords, NULL, index);
+}
+
+int sbus_table_lookup(uint32_t addr, const uint32_t *key, int nwords,
+		      uint32_t *entry, int *index)
+{
+	return sbus_table_op(SCHAN_TABLE_LOOKUP_CMD, addr, key, nwords, entry, index);
+}
+
+/*
+ * ---- Batched SCHAN ----
+ *
+ * Ops use the same message layout as the single-op helpers above; only the
+ * transport differs (one SCHAN_BATCH ioctl per SBUS_BATCH_OPS ops).
+ */
+/*
+ * Optional SCHAN ring: batches are staged in a DMA-pool ring and issued with
+ * NOS_BDE_SCHAN_RING instead of SCHAN_BATCH.  One ring is shared by all
+ * batches, so submissions through it are serialized by sbus_ring_lock.
+ */
+static struct nos_bde_schan_batch_op *sbus_ring;
+static int sbus_ring_on;
+static uint32_t sbus_ring_engine = NOS_BDE_RING_ENGINE_PIO;
+static pthread_mutex_t sbus_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const sbus_ring_engine_name[] = {
+	[NOS_BDE_RING_ENGINE_PIO] = "kernel PIO",
+	[NOS_BDE_RING_ENGINE_HW]  = "CMIC DMA",
+	[NOS_BDE_RING_ENGINE_SW]  = "userspace stand-in",
+};
+
+/*
+ * sbus_ring_enable: route sbus_batch_submit() through the SCHAN ring.
+ * Returns -1 (ring stays off, batches use SCHAN_BATCH) if the DMA pool is
+ * not available.
+ */
+int sbus_ring_enable(int enable)
+{
+	pthread_mutex_lock(&sbus_ring_lock);
+	if (enable && !sbus_ring) {
+		sbus_ring = bde_dma_alloc(sizeof(*sbus_ring) * SBUS_BATCH_OPS, 64);
+		if (!sbus_ring) {
+			pthread_mutex_unlock(&sbus_ring_lock);
+			fprintf(stderr, "[sbus] SCHAN ring: no DMA pool, using batch ioctl\n");
+			return -1;
+		}
+	}
+	sbus_ring_on = enable ? 1 : 0;
+	pthread_mutex_unlock(&sbus_ring_lock);
+	return 0;
+}
+
+/* Issue n queued ops through the ring; same contract as bde_schan_batch(). */
+static int sbus_ring_submit(struct nos_bde_schan_batch_op *ops, int n)
+{
+	uint32_t engine = sbus_ring_engine;
+	int done;
+
+	pthread_mutex_lock(&sbus_ring_lock);
+	memcpy(sbus_ring, ops, sizeof(*ops) * (size_t)n);
+	done = bde_schan_ring(sbus_ring, n, 0, &engine);
+	if (done > 0)
+		memcpy(ops, sbus_ring, sizeof(*ops) * (size_t)done);
+	if (engine != sbus_ring_engine && engine <= NOS_BDE_RING_ENGINE_SW) {
+		fprintf(stderr, "[sbus] SCHAN ring engine: %s\n",
+			sbus_ring_engine_name[engine]);
+		sbus_ring_engine = engine;
+	}
+	pthread_mutex_unlock(&sbus_ring_lock);
+	return done;
+}
+
+void sbus_batch_init(sbus_batch_t *b)
+{
+	b->count = 0;
+	b->submitted = 0;
+	b->errors = 0;
+}
+
+/*
+ * Reserve the next op slot, flushing a full queue first.  Failures in the
+ * flushed ops are logged and accumulated in b->errors.
+ */
+static struct nos_bde_schan_batch_op *sbus_batch_slot(sbus_batch_t *b)
+{
+	struct nos_bde_schan_batch_op *op;
+
+	if (b->count >= SBUS_BATCH_OPS)
+		(void)sbus_batch_submit(b);
+	op = &b->ops[b->count];
+	memset(op, 0, sizeof(*op));
+	b->rdst[b->count] = NULL;
+	b->rwords[b->count] = 0;
+	b->count++;
+	return op;
+}
+
+int sbus_batch_reg_write(sbus_batch_t *b, uint32_t addr, uint32_t value)
+{
+	struct nos_bde_schan_batch_op *op = sbus_batch_slot(b);
+
+	op->cmd[0] = schan_header(SCHAN_WRITE_REG_CMD, cdk_addr_to_block(addr), 1);
+	op->cmd[1] = addr;
+	op->cmd[2] = value;
+	op->cmd_words = 3;
+	return 0;
+}
+
+int sbus_batch_reg_write64(sbus_batch_t *b, uint32_t addr, const uint32_t *data)
+{
+	struct nos_bde_schan_batch_op *op = sbus_batch_slot(b);
+
+	op->cmd[0] = schan_header(SCHAN_WRITE_REG_CMD, cdk_addr_to_block(addr), 2);
+	op->cmd[1] = addr;
+	op->cmd[2] = data[0];
+	op->cmd[3] = data[1];
+	op->cmd_words = 4;
+	return 0;
+}
+
+int sbus_batch_reg_read(sbus_batch_t *b, uint32_t addr, uint32_t *value)
+{
+	struct nos_bde_schan_batch_op *op = sbus_batch_slot(b);
+
+	op->cmd[0] = schan_header(SCHAN_READ_REG_CMD, cdk_addr_to_block(addr), 1);
+	op->cmd[1] = addr;
+	op->cmd_words = 2;
+	op->data_words = 2;
+	b->rdst[b->count - 1] = value;
+	b->rwords[b->count - 1] = 1;
+	return 0;
+}
+
+int sbus_batch_mem_write(sbus_batch_t *b, uint32_t addr, int index,
+			 const uint32_t *data, int nwords)
+{
+	struct nos_bde_schan_batch_op *op = sbus_batch_slot(b);
+	int i;
+
+	if (nwords > 14)
+		nwords = 14;
+	op->cmd[0] = schan_header(SCHAN_WRITE_MEM_CMD, cdk_addr_to_block(addr),
+				  (uint32_t)nwords);
+	op->cmd[1] = addr + (uint32_t)index;
+	for (i = 0; i < nwords; i++)
+		op->cmd[2 + i] = data[i];
+	op->cmd_words = 2 + nwords;
+	op->data_words = 1; /* response header for ERR/NACK check */
+	return 0;
+}
+
+int sbus_batch_mem_read(sbus_batch_t *b, uint32_t addr, int index,
+			uint32_t *data, int nwords)
+{
+	struct nos_bde_schan_batch_op *op = sbus_batch_slot(b);
+
+	if (nwords > 14)
+		nwords = 14;
+	op->cmd[0] = schan_header(SCHAN_READ_MEM_CMD, cdk_addr_to_block(addr),
+				  (uint32_t)nwords);
+	op->cmd[1] = addr + (uint32_t)index;
+	op->cmd_words = 2;
+	op->data_words = 1 + nwords;
+	b->rdst[b->count - 1] = data;
+	b->rwords[b->count - 1] = nwords;
+	return 0;
+}
+
+/*
+ * sbus_batch_submit: issue all queued ops.  Returns 0 if every op succeeded,
+ * -1 if any op failed or the transport failed (ops not executed are marked
+ * -EIO).  Read data is copied out for successful read ops.
+ */
+int sbus_batch_submit(sbus_batch_t *b)
+{
+	int i, done, failed = 0;
+
+	if (b->count == 0)
+		return 0;
+	if (sbus_ring_on)
+		done = sbus_ring_submit(b->ops, b->count);
+	else
+		done = bde_schan_batch(b->ops, b->count, 0);
+	for (i = 0; i < b->count; i++) {
+		struct nos_bde_schan_batch_op *op = &b->ops[i];
+
+		if (i >= done)
+			op->status = -EIO;
+		else if (op->status == 0 && !b->rdst[i] && op->data_words > 0 &&
+			 (op->data[0] & 0x0041u))
+			op->status = -EIO; /* write RESP_ERR / NACK */
+		sbus_reg_cache_op(op, op->status == 0);
+		if (op->status != 0) {
+			fprintf(stderr, "[sbus] batch op FAIL hdr=0x%08x addr=0x%08x "
+				"status=%d\n", op->cmd[0], op->cmd[1], op->status);
+			failed++;
+			continue;
+		}
+		if (b->rdst[i])
+			memcpy(b->rdst[i], &op->data[1],
+			       sizeof(uint32_t) * (size_t)b->rwords[i]);
+	}
+	b->submitted = b->count;
+	b->count = 0;
+	b->errors += failed;
+	return failed ? -1 : 0;
+}
+
+int sbus_batch_status(const sbus_batch_t *b, int i)
+{
+	if (i < 0 || i >= b->submitted)
+		return -EINVAL;
+	return b->ops[i].status;
+}
+
+/*
+ * ---- Asynchronous submission (shared SQ/CQ) ----
+ *
+ * Each sbus_submit() is one submission record in sbus_subs[]: the ops of a
+ * batch share it, and it completes when all of them have a CQE.  SQE
+ * user_data = (record << 32) | SQ slot, so each CQE finds its record and
+ * the read destination the batch gave for that op.  The kernel worker is
+ * FIFO, so records complete (and are reaped) in submission order.
+ */
+struct sbus_sub {
+	uint64_t tag;
+	int      ops;
+	int      pending;  /* ops without a CQE yet */
+	int      status;   /* first failing op */
+};
+
+static struct sbus_sub sbus_subs[SBUS_SQ_SUBS];
+static uint32_t sbus_sub_head, sbus_sub_tail;  /* reap / submit */
+static uint32_t *sbus_sq_rdst[SBUS_SQ_ENTRIES];
+static int sbus_sq_rwords[SBUS_SQ_ENTRIES];
+static uint32_t sbus_sq_seq;
+static int sbus_sq_state;  /* 0 = not set up, 1 = ready, -1 = unavailable */
+static pthread_mutex_t sbus_sq_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int sbus_sq_init_locked(void)
+{
+	uint32_t engine = NOS_BDE_RING_ENGINE_PIO;
+
+	if (sbus_sq_state == 0) {
+		sbus_sq_state = bde_sq_setup(SBUS_SQ_ENTRIES, &engine) == 0 ? 1 : -1;
+		if (sbus_sq_state > 0 && engine <= NOS_BDE_RING_ENGINE_SW)
+			fprintf(stderr, "[sbus] SCHAN SQ engine: %s\n",
+				sbus_ring_engine_name[engine]);
+	}
+	return sbus_sq_state > 0 ? 0 : -1;
+}
+
+/* Fold one CQE into its submission record. */
+static void sbus_cqe_apply(const struct nos_bde_cqe *cqe)
+{
+	struct sbus_sub *sub = &sbus_subs[(cqe->user_data >> 32) % SBUS_SQ_SUBS];
+	uint32_t slot = (uint32_t)cqe->user_data % SBUS_SQ_ENTRIES;
+	uint32_t *rdst = sbus_sq_rdst[slot];
+	int status = cqe->status;
+
+	if (status == 0 && !rdst && (cqe->data[0] & 0x0041u) &&
+	    sbus_sq_rwords[slot] < 0)
+		status = -EIO; /* write RESP_ERR / NACK */
+	if (status != 0) {
+		fprintf(stderr, "[sbus] async op FAIL tag=%llu status=%d\n",
+			(unsigned long long)sub->tag, status);
+		if (sub->status == 0)
+			sub->status = status;
+	} else if (rdst) {
+		memcpy(rdst, &cqe->data[1], sizeof(uint32_t) * (size_t)sbus_sq_rwords[slot]);
+	}
+	sub->pending--;
+}
+
+/* Pop every posted CQE; returns the number popped. */
+static int sbus_cq_drain_locked(void)
+{
+	struct nos_bde_cqe cqe;
+	int n = 0;
+
+	while (bde_cq_pop(&cqe)) {
+		sbus_cqe_apply(&cqe);
+		n++;
+	}
+	return n;
+}
+
+/*
+ * sbus_submit: hand the ops queued in b to the kernel SQ worker as one
+ * submission tagged tag, and return without waiting (b is left empty).
+ * Read destinations must stay valid until the submission is reaped.  Blocks
+ * only while the SQ is full.  Returns 0, or -1 (nothing submitted) if there
+ * is no SQ or SBUS_SQ_SUBS submissions are unreaped.
+ */
+int sbus_submit(sbus_batch_t *b, uint64_t tag)
+{
+	struct sbus_sub *sub;
+	uint32_t idx;
+	int i;
+
+	if (b->count == 0)
+		return 0;
+	pthread_mutex_lock(&sbus_sq_lock);
+	if (sbus_sq_init_locked() < 0 || sbus_sub_tail - sbus_sub_head >= SBUS_SQ_SUBS) {
+		pthread_mutex_unlock(&sbus_sq_lock);
+		return -1;
+	}
+	idx = sbus_sub_tail++;
+	sub = &sbus_subs[idx % SBUS_SQ_SUBS];
+	sub->tag = tag;
+	sub->ops = b->count;
+	sub->pending = b->count;
+	sub->status = 0;
+	for (i = 0; i < b->count; i++) {
+		uint32_t slot = sbus_sq_seq % SBUS_SQ_ENTRIES;
+
+		while (bde_sq_space() <= 0) {
+			bde_sq_kick();
+			if (sbus_cq_drain_locked() == 0)
+				bde_cq_wait(10);
+		}
+		/* rwords < 0 marks a write whose response header is checked */
+		sbus_sq_rdst[slot] = b->rdst[i];
+		sbus_sq_rwords[slot] = b->rdst[i] ? b->rwords[i] :
+				       (b->ops[i].data_words > 0 ? -1 : 0);
+		sbus_reg_cache_op(&b->ops[i], 0); /* outcome unknown until reaped */
+		bde_sq_push(&b->ops[i], ((uint64_t)(idx % SBUS_SQ_SUBS) << 32) | slot);
+		sbus_sq_seq++;
+	}
+	bde_sq_kick();
+	b->submitted = b->count;
+	b->count = 0;
+	pthread_mutex_unlock(&sbus_sq_lock);
+	return 0;
+}
+
+/*
+ * sbus_reap: collect up to max finished submissions into cqe[], oldest
+ * first.  If none is finished, waits up to timeout_ms for one (0 = poll,
+ * -1 = until one completes).  Returns the number collected.
+ */
+int sbus_reap(sbus_cqe_t *cqe, int max, int timeout_ms)
+{
+	int n = 0;
+
+	pthread_mutex_lock(&sbus_sq_lock);
+	for (;;) {
+		sbus_cq_drain_locked();
+		while (n < max && sbus_sub_head != sbus_sub_tail &&
+		       sbus_subs[sbus_sub_head % SBUS_SQ_SUBS].pending == 0) {
+			struct sbus_sub *sub = &sbus_subs[sbus_sub_head++ % SBUS_SQ_SUBS];
+
+			cqe[n].tag = sub->tag;
+			cqe[n].ops = sub->ops;
+			cqe[n].status = sub->status;
+			n++;
+		}
+		if (n > 0 || timeout_ms == 0 || sbus_sub_head == sbus_sub_tail)
+			break;
+		if (bde_cq_wait(timeout_ms) == 0)
+			break;
+	}
+	pthread_mutex_unlock(&sbus_sq_lock);
+	return n;
+}
+
+/* Submissions not yet reaped (in flight or finished). */
+int sbus_inflight(void)
+{
+	int n;
+
+	pthread_mutex_lock(&sbus_sq_lock);
+	n = (int)(sbus_sub_tail - sbus_sub_head);
+	pthread_mutex_unlock(&sbus_sq_lock);
+	return n;
+}
+
+/*
+ * ---- Bulk table read (TDMA) ----
+ */
+static uint32_t *tdma_buf;
+static int tdma_ioctl_ok = 1;
+static pthread_mutex_t tdma_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * sbus_mem_read_range: read count entries of nwords each, starting at index,
+ * into data[count * nwords].  If data lies in the DMA pool the whole range
+ * is one NOS_BDE_TDMA ioctl; otherwise (or on a BDE without TDMA) it falls
+ * back to batched READ_MEM.  Returns 0, or -1 if any entry failed.
+ */
+int sbus_mem_read_range(uint32_t addr, int index, int count, uint32_t *data,
+			int nwords)
+{
+	sbus_batch_t *b;
+	int i, status = 0;
+
+	if (count <= 0 || nwords <= 0 || nwords > NOS_BDE_TDMA_MAX_WORDS)
+		return -1;
+
+	if (tdma_ioctl_ok &&
+	    bde_dma_contains(data, sizeof(uint32_t) * (size_t)count * (size_t)nwords)) {
+		int done = bde_tdma_read(schan_header(SCHAN_READ_MEM_CMD,
+						      cdk_addr_to_block(addr),
+						      (uint32_t)nwords),
+					 addr + (uint32_t)index, count, nwords,
+					 data, &status);
+		if (done == count)
+			return 0;
+		if (done >= 0) {
+			fprintf(stderr, "[sbus] tdma FAIL addr=0x%08x index=%d status=%d\n",
+				addr, index + done, status);
+			return -1;
+		}
+		if (errno != ENOTTY)
+			return -1;
+		tdma_ioctl_ok = 0; /* old kernel BDE: batched reads below */
+	}
+
+	b = malloc(sizeof(*b));
+	if (!b)
+		return -1;
+	sbus_batch_init(b);
+	for (i = 0; i < count; i++)
+		sbus_batch_mem_read(b, addr, index + i, data + (size_t)i * (size_t)nwords,
+				    nwords);
+	sbus_batch_submit(b);
+	status = b->errors;
+	free(b);
+	return status ? -1 : 0;
+}
+
+/*
+ * sbus_mem_view: read a table range into the shared table-DMA buffer and
+ * return a zero-copy pointer to entry 0 (entry i at view + i * nwords).
+ * A non-NULL view holds the buffer (tdma_lock) until the caller's
+ * sbus_mem_view_release(), so other threads' views wait instead of
+ * overwriting it.  The buffer is SBUS_TDMA_BUF_BYTES in the DMA pool (heap
+ * if the pool is unavailable).  Returns NULL, holding nothing, on error or
+ * if the range does not fit.
+ */
+const uint32_t *sbus_mem_view(uint32_t addr, int index, int count, int nwords)
+{
+	const uint32_t *view = NULL;
+
+	if (count <= 0 || nwords <= 0 ||
+	    (size_t)count * (size_t)nwords * sizeof(uint32_t) > SBUS_TDMA_BUF_BYTES)
+		return NULL;
+
+	pthread_mutex_lock(&tdma_lock);
+	if (!tdma_buf) {
+		tdma_buf = bde_dma_alloc(SBUS_TDMA_BUF_BYTES, 64);
+		if (!tdma_buf)
+			tdma_buf = malloc(SBUS_TDMA_BUF_BYTES);
+	}
+	if (tdma_buf && sbus_mem_read_range(addr, index, count, tdma_buf, nwords) == 0)
+		view = tdma_buf;
+	if (!view)
+		pthread_mutex_unlock(&tdma_lock);
+	return view;
+}
+
+/* Done with the view from the last successful sbus_mem_view(). */
+void sbus_mem_view_release(void)
+{
+	pthread_mutex_unlock(&tdma_lock);
+}
+
+/*
+ * ---- Bulk table write (SLAM) ----
+ */
+static uint32_t *slam_buf;
+static int slam_ioctl_ok = 1;
+static pthread_mutex_t slam_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Fallback: one batched WRITE_MEM per entry. */
+static int slam_batched(uint32_t addr, int index, int count, const uint32_t *data,
+			int nwords)
+{
+	sbus_batch_t *b = malloc(sizeof(*b));
+	int i, errors;
+
+	if (!b)
+		return -1;
+	sbus_batch_init(b);
+	for (i = 0; i < count; i++)
+		sbus_batch_mem_write(b, addr, index + i,
+				     data + (size_t)i * (size_t)nwords, nwords);
+	sbus_batch_submit(b);
+	errors = b->errors;
+	free(b);
+	return errors ? -1 : 0;
+}
+
+/* One SLAM ioctl for entries already in the DMA pool; -2 = not supported. */
+static int slam_pool(uint32_t addr, int index, int count, const uint32_t *data,
+		     int nwords)
+{
+	int status = 0;
+	int done = bde_slam_write(schan_header(SCHAN_WRITE_MEM_CMD,
+					       cdk_addr_to_block(addr),
+					       (uint32_t)nwords),
+				  addr + (uint32_t)index, count, nwords, data, &status);
+
+	if (done == count)
+		return 0;
+	if (done >= 0) {
+		fprintf(stderr, "[sbus] slam FAIL addr=0x%08x index=%d status=%d\n",
+			addr, index + done, status);
+		return -1;
+	}
+	if (errno != ENOTTY)
+		return -1;
+	slam_ioctl_ok = 0;
+	return -2;
+}
+
+/*
+ * sbus_mem_slam: write count packed entries of nwords each (data[count *
+ * nwords]) starting at index.  Entries in the DMA pool (sbus_slam_buf())
+ * go down in one NOS_BDE_SLAM ioctl; other buffers are staged through the
+ * shared SLAM buffer in SBUS_SLAM_BUF_BYTES chunks.  Falls back to batched
+ * WRITE_MEM when the pool or the ioctl is unavailable.  Returns 0 or -1.
+ */
+int sbus_mem_slam(uint32_t addr, int index, int count, const uint32_t *data,
+		  int nwords)
+{
+	size_t bytes, chunk;
+	int rc = -2, done = 0;
+
+	if (count <= 0 || nwords <= 0 || nwords > NOS_BDE_TDMA_MAX_WORDS)
+		return -1;
+	bytes = sizeof(uint32_t) * (size_t)count * (size_t)nwords;
+
+	if (slam_ioctl_ok && bde_dma_contains(data, bytes))
+		rc = slam_pool(addr, index, count, data, nwords);
+	else if (slam_ioctl_ok) {
+		chunk = SBUS_SLAM_BUF_BYTES / (sizeof(uint32_t) * (size_t)nwords);
+		pthread_mutex_lock(&slam_lock);
+		if (sbus_slam_buf(0, nwords)) {
+			for (rc = 0; done < count && rc == 0; done += (int)chunk) {
+				int n = count - done < (int)chunk ? count - done : (int)chunk;
+
+				memcpy(slam_buf, data + (size_t)done * (size_t)nwords,
+				       sizeof(uint32_t) * (size_t)n * (size_t)nwords);
+				rc = slam_pool(addr, index + done, n, slam_buf, nwords);
+			}
+			if (rc == -2)
+				done -= (int)chunk; /* this chunk was not written */
+		}
+		pthread_mutex_unlock(&slam_lock);
+	}
+	if (rc != -2)
+		return rc;
+	return slam_batched(addr, index + done, count - done,
+			    data + (size_t)done * (size_t)nwords, nwords);
+}
+
+/*
+ * sbus_slam_buf: the shared SLAM staging buffer in the DMA pool, for callers
+ * that pack entries in place to skip the copy in sbus_mem_slam().  Returns
+ * NULL if count entries of nwords do not fit or the pool is unavailable.
+ * Not thread-safe against other users of the buffer.
+ */
+uint32_t *sbus_slam_buf(int count, int nwords)
+{
+	if ((size_t)count * (size_t)nwords * sizeof(uint32_t) > SBUS_SLAM_BUF_BYTES)
+		return NULL;
+	if (!slam_buf)
+		slam_buf = bde_dma_alloc(SBUS_SLAM_BUF_BYTES, 64);
+	return slam_buf;
+}
+
+int bcm56846_table_write(int unit, uint32_t mem, int index, int count,
+			 int entry_words, const uint32_t *entries)
+{
+	(void)unit;
+	if (!entries)
+		return -1;
+	return sbus_mem_slam(mem, index, count, entries, entry_words);
+}
+
+int bcm56846_table_read(int unit, uint32_t mem, int index, int count,
+			int entry_words, const uint32_t **entries)
+{
+	(void)unit;
+	if (!entries)
+		return -1;
+	*entries = sbus_mem_view(mem, index, count, entry_words);
+	return *entries ? 0 : -1;
+}
+
+void bcm56846_table_read_release(int unit)
+{
+	(void)unit;
+	sbus_mem_view_release();
+}
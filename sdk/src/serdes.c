@@ -44,6 +44,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 extern int bde_read_reg(uint32_t offset, uint32_t *value);
@@ -142,14 +143,40 @@ static uint32_t port_to_xlport_base(int port)
 }
 
 /* Max poll iterations for MIIM done */
-#define MIIM_POLL_MAX 2000
+/*
+ * MIIM done-wait bound.  Time-based rather than a poll count: a poll costs
+ * an MMIO load or an ioctl depending on the register and on whether the
+ * BAR0 CMIC window is mapped, so a fixed count would not bound the time.
+ */
+#define MIIM_TIMEOUT_US 10000
 
 /*--- MIIM read/write using correct CMIC registers ---*/
 
+static uint64_t miim_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+/* Poll MIIM_CTRL until DONE; returns 0 when done, -1 on timeout. */
+static int miim_wait_done(void)
+{
+	uint64_t deadline = miim_now_us() + MIIM_TIMEOUT_US;
+	uint32_t ctrl;
+
+	do {
+		if (bde_read_reg(CMIC_MIIM_CTRL, &ctrl) == 0 &&
+		    (ctrl & CMIC_MIIM_CTRL_DONE))
+			return 0;
+	} while (miim_now_us() < deadline);
+	return -1;
+}
+
 static int miim_write(int phy_addr, int bus_id, uint32_t reg, uint16_t data)
 {
-	uint32_t param, ctrl;
-	int i;
+	uint32_t param;
 
 	/* Reset write state, clear done */
 	bde_write_reg(CMIC_MIIM_CTRL, 17);
@@ -167,12 +194,9 @@ static int miim_write(int phy_addr, int bus_id, uint32_t reg, uint16_t data)
 	bde_write_reg(CMIC_MIIM_CTRL, 0x91);
 
 	/* Poll for done */
-	for (i = 0; i < MIIM_POLL_MAX; i++) {
-		bde_read_reg(CMIC_MIIM_CTRL, &ctrl);
-		if (ctrl & CMIC_MIIM_CTRL_DONE) {
-			bde_write_reg(CMIC_MIIM_CTRL, 18);
-			return 0;
-		}
+	if (miim_wait_done() == 0) {
+		bde_write_reg(CMIC_MIIM_CTRL, 18);
+		return 0;
 	}
 
 	bde_write_reg(CMIC_MIIM_CTRL, 17);
@@ -181,8 +205,7 @@ static int miim_write(int phy_addr, int bus_id, uint32_t reg, uint16_t data)
 
 static int miim_read(int phy_addr, int bus_id, uint32_t reg, uint16_t *data)
 {
-	uint32_t param, ctrl, val;
-	int i;
+	uint32_t param, val;
 
 	/* Reset read state, clear done */
 	bde_write_reg(CMIC_MIIM_CTRL, 16);
@@ -200,15 +223,12 @@ static int miim_read(int phy_addr, int bus_id, uint32_t reg, uint16_t *data)
 	bde_write_reg(CMIC_MIIM_CTRL, 0x90);
 
 	/* Poll for done */
-	for (i = 0; i < MIIM_POLL_MAX; i++) {
-		bde_read_reg(CMIC_MIIM_CTRL, &ctrl);
-		if (ctrl & CMIC_MIIM_CTRL_DONE) {
-			bde_read_reg(CMIC_MIIM_READ_DATA, &val);
-			bde_write_reg(CMIC_MIIM_CTRL, 18);
-			if (data)
-				*data = (uint16_t)(val & 0xffffu);
-			return 0;
-		}
+	if (miim_wait_done() == 0) {
+		bde_read_reg(CMIC_MIIM_READ_DATA, &val);
+		bde_write_reg(CMIC_MIIM_CTRL, 18);
+		if (data)
+			*data = (uint16_t)(val & 0xffffu);
+		return 0;
 	}
 
 	bde_write_reg(CMIC_MIIM_CTRL, 16);
@@ -217,6 +237,104 @@ static int miim_read(int phy_addr, int bus_id, uint32_t reg, uint16_t *data)
 
 /*--- WARPcore register access via AER ---*/
 
+/*
+ * Write-through shadow of WARPcore configuration registers, keyed by
+ * (bus, phy, lane, addr), so wc_modify() skips the MDIO read.  Only the
+ * static PCS/PMA configuration blocks (0x8300-0x84ff) are cached; status
+ * registers in that range, the uC/firmware blocks and everything the 8051
+ * or the PLL sequencer rewrites are always read from the PHY.  wc_read() and
+ * wc_write() keep entries current; wc_cache_flush_phy() drops a whole PHY.
+ */
+#define WC_CACHE_SLOTS 2048u  /* power of two; 52 lanes x ~20 registers */
+
+static struct {
+	uint32_t key;  /* 0 = empty */
+	uint16_t val;
+	uint8_t  valid;
+} wc_cache[WC_CACHE_SLOTS];
+
+static int wc_cacheable(uint16_t addr)
+{
+	if (addr < 0x8300u || addr > 0x84ffu)
+		return 0;
+	/* CL49 status / LSM state */
+	return addr != 0x8367u && addr != 0x8368u;
+}
+
+static uint32_t wc_cache_key(int phy, int lane, int bus, uint16_t addr)
+{
+	return 0x80000000u | ((uint32_t)(bus & 3) << 23) | ((uint32_t)(phy & 31) << 18) |
+	       ((uint32_t)(lane & 3) << 16) | addr;
+}
+
+/* Slot for key (existing or empty to claim), -1 if the table is full. */
+static int wc_cache_slot(uint32_t key)
+{
+	uint32_t h = (key * 2654435761u) & (WC_CACHE_SLOTS - 1);
+	uint32_t i;
+
+	for (i = 0; i < WC_CACHE_SLOTS; i++) {
+		uint32_t k = (h + i) & (WC_CACHE_SLOTS - 1);
+
+		if (wc_cache[k].key == key || wc_cache[k].key == 0)
+			return (int)k;
+	}
+	return -1;
+}
+
+static int wc_cache_get(int phy, int lane, int bus, uint16_t addr, uint16_t *val)
+{
+	uint32_t key = wc_cache_key(phy, lane, bus, addr);
+	int k;
+
+	if (!wc_cacheable(addr))
+		return -1;
+	k = wc_cache_slot(key);
+	if (k < 0 || wc_cache[k].key != key || !wc_cache[k].valid)
+		return -1;
+	*val = wc_cache[k].val;
+	return 0;
+}
+
+static void wc_cache_put(int phy, int lane, int bus, uint16_t addr, uint16_t val)
+{
+	uint32_t key = wc_cache_key(phy, lane, bus, addr);
+	int k;
+
+	if (!wc_cacheable(addr))
+		return;
+	k = wc_cache_slot(key);
+	if (k < 0)
+		return;
+	wc_cache[k].key = key;
+	wc_cache[k].val = val;
+	wc_cache[k].valid = 1;
+}
+
+/* Forget addr before a write whose outcome is not yet known. */
+static void wc_cache_drop(int phy, int lane, int bus, uint16_t addr)
+{
+	uint32_t key = wc_cache_key(phy, lane, bus, addr);
+	int k;
+
+	if (!wc_cacheable(addr))
+		return;
+	k = wc_cache_slot(key);
+	if (k >= 0 && wc_cache[k].key == key)
+		wc_cache[k].valid = 0;
+}
+
+/* Drop every cached register of one PHY (all lanes), e.g. around a reset. */
+static void wc_cache_flush_phy(int phy, int bus)
+{
+	uint32_t k;
+
+	for (k = 0; k < WC_CACHE_SLOTS; k++)
+		if (wc_cache[k].key &&
+		    ((wc_cache[k].key >> 18) & 0x7fu) == (((uint32_t)(bus & 3) << 5) | (uint32_t)(phy & 31)))
+			wc_cache[k].valid = 0;
+}
+
 /*
  * Read a WARPcore register with lane selection.
  * addr: full 16-bit register address (e.g. 0x8308 for MISC1).
@@ -234,7 +352,10 @@ static int wc_read(int phy, int lane, int bus, uint16_t addr, uint16_t *val)
 		return -EIO;
 	if (miim_write(phy, bus, WC_REG_AER_BLK, block) != 0)
 		return -EIO;
-	return miim_read(phy, bus, 0x10 + offset, val);
+	if (miim_read(phy, bus, 0x10 + offset, val) != 0)
+		return -EIO;
+	wc_cache_put(phy, lane, bus, addr, *val);
+	return 0;
 }
 
 /*
@@ -246,13 +367,33 @@ static int wc_write(int phy, int lane, int bus, uint16_t addr, uint16_t val)
 	uint16_t block = addr & 0xFFF0u;
 	int offset = addr & 0xFu;
 
+	wc_cache_drop(phy, lane, bus, addr);
 	if (miim_write(phy, bus, WC_REG_AER_BLK, WC_AER_BROADCAST) != 0)
 		return -EIO;
 	if (miim_write(phy, bus, WC_REG_AER_LANE, lane & 0x3) != 0)
 		return -EIO;
 	if (miim_write(phy, bus, WC_REG_AER_BLK, block) != 0)
 		return -EIO;
-	return miim_write(phy, bus, 0x10 + offset, val);
+	if (miim_write(phy, bus, 0x10 + offset, val) != 0)
+		return -EIO;
+	wc_cache_put(phy, lane, bus, addr, val);
+	return 0;
+}
+
+/*
+ * Read-modify-write a WARPcore register: bits in mask take value.  Cached
+ * registers skip the MDIO read, so the update costs one register write.
+ */
+static int wc_modify(int phy, int lane, int bus, uint16_t addr, uint16_t mask,
+		     uint16_t value)
+{
+	uint16_t cur;
+
+	if (wc_cache_get(phy, lane, bus, addr, &cur) < 0 &&
+	    wc_read(phy, lane, bus, addr, &cur) != 0)
+		return -EIO;
+	return wc_write(phy, lane, bus, addr,
+			(uint16_t)((cur & ~mask) | (value & mask)));
 }
 
 /*
@@ -799,12 +940,10 @@ static int wc_firmware_download(int phy, int bus)
  */
 static void wc_init_stage2(int phy, int bus)
 {
-	uint16_t val;
-
 	/* Rx clock compensation for 1-lane ports (10G SFI).
 	 * CC_EN (bit 13) = 1, CC_DATA_SEL (bit 14) = 1 */
-	wc_read(phy, 0, bus, WC_RX66_CTRL, &val);
-	wc_write(phy, 0, bus, WC_RX66_CTRL, val | (1u << 13) | (1u << 14));
+	wc_modify(phy, 0, bus, WC_RX66_CTRL, (1u << 13) | (1u << 14),
+		  (1u << 13) | (1u << 14));
 
 	/* Configure 64/66 sync words and masks.
 	 * These define the block sync patterns that CL49 PCS uses to
@@ -819,26 +958,23 @@ static void wc_init_stage2(int phy, int bus)
 	wc_write(phy, 0, bus, WC_RX66_SCW3_MASK, 0xf0f0);
 
 	/* Auto PCS type selection: MISC4 bit 15 = 1 */
-	wc_read(phy, 0, bus, WC_MISC4, &val);
-	wc_write(phy, 0, bus, WC_MISC4, val | (1u << 15));
+	wc_modify(phy, 0, bus, WC_MISC4, 1u << 15, 1u << 15);
 
 	/* Disable PMA/PMD forced speed encoding: MISC2 bit 5 = 0 */
-	wc_read(phy, 0, bus, WC_MISC2, &val);
-	wc_write(phy, 0, bus, WC_MISC2, val & ~(1u << 5));
+	wc_modify(phy, 0, bus, WC_MISC2, 1u << 5, 0);
 
 	/* Disable PLL powerdown + disable SGMII/fiber auto-detect:
 	 * CONTROL1000X1: DISABLE_PLL_PWRDWN (bit 6) = 1, AUTODET_EN (bit 4) = 0 */
-	wc_read(phy, 0, bus, WC_CONTROL1000X1, &val);
-	val |= (1u << 6);   /* disable PLL powerdown */
-	val &= ~(1u << 4);  /* disable auto-detect */
-	wc_write(phy, 0, bus, WC_CONTROL1000X1, val);
+	wc_modify(phy, 0, bus, WC_CONTROL1000X1,
+		  (1u << 6) | (1u << 4),  /* disable PLL powerdown, auto-detect */
+		  1u << 6);
 
 	/* FIFO elasticity 13.5k + disable Tx CRS:
 	 * CONTROL1000X3: FIFO_ELASICITY_TX[2:1] = 2, DISABLE_TX_CRS (bit 13) = 1 */
-	wc_read(phy, 0, bus, WC_CONTROL1000X3, &val);
-	val = (val & ~(0x3u << 1)) | (2u << 1);  /* FIFO elasticity = 2 */
-	val |= (1u << 13);                        /* disable TX CRS */
-	wc_write(phy, 0, bus, WC_CONTROL1000X3, val);
+	wc_modify(phy, 0, bus, WC_CONTROL1000X3,
+		  (0x3u << 1) | (1u << 13),
+		  (2u << 1) |             /* FIFO elasticity = 2 */
+		  (1u << 13));            /* disable TX CRS */
 
 	fprintf(stderr, "[serdes] PHY %d bus %d: init_stage2 complete "
 		"(64/66 sync words + clock comp configured)\n", phy, bus);
@@ -857,6 +993,7 @@ static int wc_phy_init(int phy, int bus, int port)
 	int cnt, locked = 0;
 
 	fprintf(stderr, "[serdes] PHY %d bus %d: init\n", phy, bus);
+	wc_cache_flush_phy(phy, bus);
 
 	/* Read SERDESID0 to identify WARPcore variant */
 	wc_read(phy, 0, bus, WC_SERDESID0, &val);
@@ -876,10 +1013,8 @@ static int wc_phy_init(int phy, int bus, int port)
 	 * MISC1[11:8] = PLL_MODE_AFE = 2 (66x divider)
 	 * MISC1[12]   = PLL_MODE_AFE_SEL = 1 (use explicit PLL mode)
 	 * Must be set BEFORE starting PLL sequencer (OpenMDK init_stage0). */
-	wc_read(phy, 0, bus, WC_MISC1, &val);
-	val &= ~0x1F00u;  /* clear PLL_MODE_AFE[11:8] and PLL_MODE_AFE_SEL[12] */
-	val |= (2u << 8) | (1u << 12);  /* AFE=2, SEL=1 */
-	wc_write(phy, 0, bus, WC_MISC1, val);
+	wc_modify(phy, 0, bus, WC_MISC1, 0x1F00u,  /* PLL_MODE_AFE[11:8], _SEL[12] */
+		  (2u << 8) | (1u << 12));        /* AFE=2, SEL=1 */
 
 	/* Check if firmware is already loaded (warm boot).
 	 * If version 0x0101 is already running, skip download. */
@@ -970,7 +1105,6 @@ static uint32_t phy_inited[3];
 int bcm56846_serdes_init_10g(int unit, int port)
 {
 	int phy, bus, lane;
-	uint16_t val;
 
 	(void)unit;
 
@@ -1004,49 +1138,34 @@ int bcm56846_serdes_init_10g(int unit, int port)
 	 */
 
 	/* 1. Hold Tx/Rx ASIC reset: MISC6 bits 15,14 = 1 */
-	wc_read(phy, lane, bus, WC_MISC6, &val);
-	wc_write(phy, lane, bus, WC_MISC6, val | 0xC000u);
+	wc_modify(phy, lane, bus, WC_MISC6, 0xC000u, 0xC000u);
 
 	/* 2. Set FIRMWARE_MODE for this lane = SFP_DAC (2) */
-	wc_read(phy, 0, bus, WC_FW_MODE, &val);
-	val &= (uint16_t)~(0xFu << (4 * lane));
-	val |= (uint16_t)(2u << (4 * lane));
-	wc_write(phy, 0, bus, WC_FW_MODE, val);
+	wc_modify(phy, 0, bus, WC_FW_MODE, (uint16_t)(0xFu << (4 * lane)),
+		  (uint16_t)(2u << (4 * lane)));
 
 	/* 3. Disable FX100 mode (required by OpenMDK for all speed changes):
 	 *    FX100_CONTROL1r (0x8400): ENABLE=bit0→0, AUTO_DETECT_FX_MODE=bit2→0
 	 *    FX100_CONTROL3r (0x8402): CORRELATOR_DISABLE=bit7→1 */
-	if (wc_read(phy, lane, bus, 0x8400u, &val) == 0)
-		wc_write(phy, lane, bus, 0x8400u, val & ~0x0005u);
-	if (wc_read(phy, lane, bus, 0x8402u, &val) == 0)
-		wc_write(phy, lane, bus, 0x8402u, val | (1u << 7));
+	wc_modify(phy, lane, bus, 0x8400u, 0x0005u, 0);
+	wc_modify(phy, lane, bus, 0x8402u, 1u << 7, 1u << 7);
 
 	/* 3b. Clear CL49 HiGig2 bits for standard 10GBASE-R:
 	 * CL49_CONTROL1r defaults to 0x0078 (HiGig2 mode), which uses
 	 * different encoding than standard 10G. MUST clear for BLOCK_LOCK. */
-	if (wc_read(phy, lane, bus, WC_CL49_CTRL1, &val) == 0) {
-		if (val & WC_CL49_HG2_MASK)
-			wc_write(phy, lane, bus, WC_CL49_CTRL1,
-				 val & ~WC_CL49_HG2_MASK);
-	}
+	wc_modify(phy, lane, bus, WC_CL49_CTRL1, WC_CL49_HG2_MASK, 0);
 
 	/* 4a. Set forced speed: FV_fdr_10G_SFI = 0x29
 	 *     MISC1[4:0] = 0x09, MISC3.FORCE_SPEED_B5 = 1 */
-	if (wc_read(phy, lane, bus, WC_MISC1, &val) == 0)
-		wc_write(phy, lane, bus, WC_MISC1,
-			 (val & ~0x001Fu) | 0x09u);
+	wc_modify(phy, lane, bus, WC_MISC1, 0x001Fu, 0x09u);
 
 	/* 4b. MISC3: FORCE_SPEED_B5=1 (bit7), IND_40BITIF=1 (bit15),
 	 *     clear LANEDISABLE (bit6) */
-	if (wc_read(phy, lane, bus, WC_MISC3, &val) == 0) {
-		val |= (1u << 7) | (1u << 15);
-		val &= ~(1u << 6);
-		wc_write(phy, lane, bus, WC_MISC3, val);
-	}
+	wc_modify(phy, lane, bus, WC_MISC3, (1u << 7) | (1u << 15) | (1u << 6),
+		  (1u << 7) | (1u << 15));
 
 	/* 5. Release Tx/Rx ASIC reset: MISC6 bits 15,14 = 0 */
-	wc_read(phy, lane, bus, WC_MISC6, &val);
-	wc_write(phy, lane, bus, WC_MISC6, val & ~0xC000u);
+	wc_modify(phy, lane, bus, WC_MISC6, 0xC000u, 0);
 
 	/*
 	 * init_stage_2 per-lane: 64B/66B and PCS configuration.
@@ -1054,9 +1173,8 @@ int bcm56846_serdes_init_10g(int unit, int port)
 	 */
 
 	/* Rx clock compensation: CC_EN (bit 13), CC_DATA_SEL (bit 14) */
-	if (wc_read(phy, lane, bus, WC_RX66_CTRL, &val) == 0)
-		wc_write(phy, lane, bus, WC_RX66_CTRL,
-			 val | (1u << 13) | (1u << 14));
+	wc_modify(phy, lane, bus, WC_RX66_CTRL, (1u << 13) | (1u << 14),
+		  (1u << 13) | (1u << 14));
 
 	/* 64/66 sync words for CL49 block boundary detection */
 	wc_write(phy, lane, bus, WC_RX66_SCW0, 0xe070);
@@ -1069,23 +1187,14 @@ int bcm56846_serdes_init_10g(int unit, int port)
 	wc_write(phy, lane, bus, WC_RX66_SCW3_MASK, 0xf0f0);
 
 	/* FIBER_MODE (bit 0) = 1, PMA_PMD_FORCED_SPEED_ENC_EN (bit 5) = 0 */
-	if (wc_read(phy, lane, bus, WC_MISC2, &val) == 0)
-		wc_write(phy, lane, bus, WC_MISC2,
-			 (val | 0x0001u) & ~(1u << 5));
+	wc_modify(phy, lane, bus, WC_MISC2, 0x0001u | (1u << 5), 0x0001u);
 
 	/* Disable PLL powerdown, disable SGMII auto-detect */
-	if (wc_read(phy, lane, bus, WC_CONTROL1000X1, &val) == 0) {
-		val |= (1u << 6);
-		val &= ~(1u << 4);
-		wc_write(phy, lane, bus, WC_CONTROL1000X1, val);
-	}
+	wc_modify(phy, lane, bus, WC_CONTROL1000X1, (1u << 6) | (1u << 4), 1u << 6);
 
 	/* FIFO elasticity + disable Tx CRS */
-	if (wc_read(phy, lane, bus, WC_CONTROL1000X3, &val) == 0) {
-		val = (val & ~(0x3u << 1)) | (2u << 1);
-		val |= (1u << 13);
-		wc_write(phy, lane, bus, WC_CONTROL1000X3, val);
-	}
+	wc_modify(phy, lane, bus, WC_CONTROL1000X3, (0x3u << 1) | (1u << 13),
+		  (2u << 1) | (1u << 13));
 
 	/* Unmute retimer so external 10G signal reaches the WARPcore PHY.
 	 * DS100DF410 defaults to OUTPUT MUTED after cold boot. */
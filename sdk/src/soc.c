@@ -51,6 +51,22 @@ static inline int soc_read_reg(uint32_t addr, uint32_t *value)
 	return sbus_reg_read(addr, value);
 }
 
+/*
+ * Read-modify-write.  A script may name any register, status and
+ * self-clearing ones included, so the read always goes to the hardware
+ * rather than the shadow cache.  *result gets the value written.
+ */
+static int soc_modify_reg(uint32_t addr, uint32_t mask, uint32_t value,
+			  uint32_t *result)
+{
+	uint32_t cur = 0u;
+
+	if (soc_read_reg(addr, &cur) < 0)
+		return -1;
+	*result = (cur & ~mask) | (value & mask);
+	return soc_write_reg(addr, *result);
+}
+
 /* Named register lookup table for BCM56846 (Trident+).
  * Addresses from BCM SDK RE and Broadcom documentation.
  * Only registers actually referenced in Cumulus rc.soc / rc.forwarding are included.
@@ -260,10 +276,9 @@ static int soc_run_internal(const char *script_path)
 			/* Read-modify-write */
 			{
 				uint32_t cur = 0u;
-				soc_read_reg(reg_addr, &cur);
-				cur = (cur & ~(fe->mask << fe->shift)) |
-				      ((uint32_t)(field_val & fe->mask) << fe->shift);
-				soc_write_reg(reg_addr, cur);
+				soc_modify_reg(reg_addr, fe->mask << fe->shift,
+					       (uint32_t)(field_val & fe->mask) << fe->shift,
+					       &cur);
 				fprintf(stderr,
 					"[soc] m %s.%s=%lu -> 0x%08x\n",
 					arg1, field_name, field_val, cur);
@@ -90,10 +90,9 @@ static int vlan_write_egr(int unit, uint16_t vid)
 	return sbus_mem_write(EGR_VLAN_BASE, (int)vid, vlan_egr[vid], EGR_VLAN_WORDS);
 }
 
-int bcm56846_vlan_create(int unit, uint16_t vid)
+/* Reset the shadow entries for vid to VALID=1, STG=2, no members. */
+static void vlan_shadow_init(uint16_t vid)
 {
-	if (vid > 4095)
-		return -EINVAL;
 	memset(vlan_ing[vid], 0, sizeof(vlan_ing[vid]));
 	memset(vlan_egr[vid], 0, sizeof(vlan_egr[vid]));
 	vlan_ing_pbm[vid] = 0;
@@ -110,11 +109,38 @@ int bcm56846_vlan_create(int unit, uint16_t vid)
 	egr_vlan_set_port_bitmap(vlan_egr[vid], vlan_egr_pbm[vid]);
 
 	vlan_valid[vid] = 1;
+}
+
+int bcm56846_vlan_create(int unit, uint16_t vid)
+{
+	if (vid > 4095)
+		return -EINVAL;
+	vlan_shadow_init(vid);
 	if (vlan_write_ing(unit, vid) != 0 || vlan_write_egr(unit, vid) != 0)
 		return -EIO;
 	return 0;
 }
 
+/*
+ * Create vid_lo..vid_hi (inclusive) with no members.  The shadow rows are
+ * contiguous, so each table is programmed with a single SLAM.
+ */
+int bcm56846_vlan_create_range(int unit, uint16_t vid_lo, uint16_t vid_hi)
+{
+	int vid, n;
+
+	(void)unit;
+	if (vid_lo > vid_hi || vid_hi > 4095)
+		return -EINVAL;
+	for (vid = vid_lo; vid <= vid_hi; vid++)
+		vlan_shadow_init((uint16_t)vid);
+	n = vid_hi - vid_lo + 1;
+	if (sbus_mem_slam(VLAN_BASE, vid_lo, n, vlan_ing[vid_lo], VLAN_WORDS) != 0 ||
+	    sbus_mem_slam(EGR_VLAN_BASE, vid_lo, n, vlan_egr[vid_lo], EGR_VLAN_WORDS) != 0)
+		return -EIO;
+	return 0;
+}
+
 int bcm56846_vlan_port_add(int unit, uint16_t vid, int port, int tagged)
 {
 	int bit;
@@ -0,0 +1,204 @@
+/*
+ * FDB sync thread — replay the dynamic L2 entries already in the table at
+ * startup, then drain hardware L2 learn/move/age events (L2_MOD_FIFO) and
+ * the software aging sweep every 10 ms, and mirror them into the Linux
+ * bridge FDB as externally learned entries, one netlink send per batch.
+ */
+#include "bcm56846.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/neighbour.h>
+
+extern void nl_add_rtattr(struct nlmsghdr *nlh, int type, const void *data, int len);
+
+#define POLL_MS 10
+#define FDB_BATCH 256
+#define FDB_MSG_SPACE (NLMSG_SPACE(sizeof(struct ndmsg)) + RTA_SPACE(6) + RTA_SPACE(2))
+#define MAX_PORTS 56
+
+#ifndef NTF_EXT_LEARNED
+#define NTF_EXT_LEARNED 0x10
+#endif
+
+static volatile int fdb_sync_running = 1;
+
+/* port (1-based) -> ifindex of swpN, resolved on first use */
+static int port_ifindex[MAX_PORTS + 1];
+
+static int fdb_port_ifindex(int port)
+{
+	char name[IF_NAMESIZE];
+
+	if (port <= 0 || port > MAX_PORTS)
+		return 0;
+	if (!port_ifindex[port]) {
+		snprintf(name, sizeof(name), "swp%d", port);
+		port_ifindex[port] = (int)if_nametoindex(name);
+	}
+	return port_ifindex[port];
+}
+
+/* Build the RTM_NEWNEIGH/RTM_DELNEIGH for ev at buf; returns bytes used (0 = skip). */
+static int fdb_msg(char *buf, const bcm56846_l2_event_t *ev, uint32_t seq)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct ndmsg *ndm;
+	int ifindex = fdb_port_ifindex(ev->addr.port);
+
+	if (!ifindex)
+		return 0;
+	memset(buf, 0, FDB_MSG_SPACE);
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*ndm));
+	nlh->nlmsg_seq = seq;
+	if (ev->type == BCM56846_L2_EVENT_LEARN || ev->type == BCM56846_L2_EVENT_MOVE) {
+		nlh->nlmsg_type = RTM_NEWNEIGH;
+		nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_REPLACE;
+	} else {
+		nlh->nlmsg_type = RTM_DELNEIGH;
+		nlh->nlmsg_flags = NLM_F_REQUEST;
+	}
+	ndm = NLMSG_DATA(nlh);
+	ndm->ndm_family = AF_BRIDGE;
+	ndm->ndm_ifindex = ifindex;
+	ndm->ndm_state = NUD_REACHABLE;
+	ndm->ndm_flags = NTF_MASTER | NTF_EXT_LEARNED;
+	nl_add_rtattr(nlh, NDA_LLADDR, ev->addr.mac, 6);
+	if (ev->addr.vid)
+		nl_add_rtattr(nlh, NDA_VLAN, &ev->addr.vid, 2);
+	return (int)NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+/* Count (and drop) the NLMSG_ERROR replies for failed FDB updates. */
+static int fdb_drain_errors(int fd, char *buf, int size)
+{
+	struct nlmsghdr *nlh;
+	int len, errors = 0;
+
+	while ((len = (int)recv(fd, buf, (size_t)size, MSG_DONTWAIT)) > 0) {
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_ERROR &&
+			    ((struct nlmsgerr *)NLMSG_DATA(nlh))->error != 0)
+				errors++;
+		}
+	}
+	return errors;
+}
+
+/* One send() for n events; returns the rejected updates reported since the last call. */
+static int fdb_send(int fd, const bcm56846_l2_event_t *ev, int n, char *buf, uint32_t *seq)
+{
+	int i, len;
+
+	for (i = 0, len = 0; i < n; i++)
+		len += fdb_msg(buf + len, &ev[i], ++*seq);
+	if (len > 0 && send(fd, buf, (size_t)len, 0) < 0)
+		fprintf(stderr, "fdb_sync: send failed: %d\n", errno);
+	return fdb_drain_errors(fd, buf, FDB_BATCH * FDB_MSG_SPACE);
+}
+
+/* Startup replay: entries already in L2_ENTRY become LEARN events. */
+struct fdb_replay {
+	int fd;
+	bcm56846_l2_event_t *ev;
+	char *buf;
+	uint32_t *seq;
+	int n;
+	int errors;
+};
+
+static int fdb_replay_cb(int unit, const bcm56846_l2_addr_t *addr, void *cookie)
+{
+	struct fdb_replay *r = cookie;
+
+	(void)unit;
+	r->ev[r->n].type = BCM56846_L2_EVENT_LEARN;
+	r->ev[r->n].addr = *addr;
+	if (++r->n == FDB_BATCH) {
+		r->errors += fdb_send(r->fd, r->ev, r->n, r->buf, r->seq);
+		r->n = 0;
+	}
+	return fdb_sync_running ? 0 : 1;
+}
+
+void *fdb_sync_thread(void *arg)
+{
+	int unit = *(int *)arg;
+	bcm56846_l2_event_t *ev;
+	char *buf;
+	bcm56846_l2_filter_t dynamic = { -1, -1, BCM56846_L2_TRAVERSE_DYNAMIC };
+	struct fdb_replay replay;
+	uint32_t seq = 0;
+	int fd, n, errors = 0;
+
+	ev = calloc(FDB_BATCH, sizeof(*ev));
+	buf = malloc(FDB_BATCH * FDB_MSG_SPACE);
+	if (!ev || !buf) {
+		free(ev);
+		free(buf);
+		return NULL;
+	}
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0) {
+		fprintf(stderr, "fdb_sync: socket failed: %d\n", errno);
+		free(ev);
+		free(buf);
+		return NULL;
+	}
+	if (bcm56846_l2_learn_enable(unit, 1) != 0) {
+		fprintf(stderr, "fdb_sync: hardware learning not available\n");
+		close(fd);
+		free(ev);
+		free(buf);
+		return NULL;
+	}
+	/* Learned before this thread (or a previous run) started */
+	memset(&replay, 0, sizeof(replay));
+	replay.fd = fd;
+	replay.ev = ev;
+	replay.buf = buf;
+	replay.seq = &seq;
+	if (bcm56846_l2_traverse(unit, &dynamic, fdb_replay_cb, &replay) < 0)
+		fprintf(stderr, "fdb_sync: L2 table replay failed\n");
+	if (replay.n > 0)
+		replay.errors += fdb_send(fd, ev, replay.n, buf, &seq);
+	errors = replay.errors;
+
+	while (fdb_sync_running) {
+		int pass;
+
+		/* pass 0: learn/move/age records, pass 1: software aging sweep */
+		for (pass = 0, n = 0; pass < 2; pass++) {
+			int got = pass == 0 ? bcm56846_l2_event_poll(unit, ev, FDB_BATCH) :
+					      bcm56846_l2_age_run(unit, ev, FDB_BATCH);
+
+			if (got <= 0)
+				continue;
+			n += got;
+			errors += fdb_send(fd, ev, got, buf, &seq);
+		}
+		if (errors >= 1000) {
+			fprintf(stderr, "fdb_sync: %d bridge FDB updates rejected\n", errors);
+			errors = 0;
+		}
+		if (n < FDB_BATCH)
+			usleep(POLL_MS * 1000);
+	}
+
+	bcm56846_l2_learn_enable(unit, 0);
+	close(fd);
+	free(ev);
+	free(buf);
+	return NULL;
+}
+
+void fdb_sync_stop(void)
+{
+	fdb_sync_running = 0;
+}
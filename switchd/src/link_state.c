@@ -1,6 +1,7 @@
 /*
  * Link-state poll thread — poll ASIC port link every 200 ms,
  * reflect to TUN admin state (SIOCSIFFLAGS) so kernel/FRR see link up/down.
+ * On link down the port's learned MACs are flushed from L2_ENTRY at once.
  */
 #include "bcm56846.h"
 #include <stdio.h>
@@ -35,6 +36,9 @@ void *link_state_thread(void *arg)
 			if (bcm56846_port_link_status_get(unit, i + 1, &link_up) != 0)
 				continue;
 			changed = (last_up[i] != link_up);
+			/* One bulk delete; fdb_sync reports the removed MACs to the bridge */
+			if (last_up[i] == 1 && !link_up && bcm56846_l2_flush(unit, i + 1, -1, 0) < 0)
+				fprintf(stderr, "link_state: L2 flush of port %d failed\n", i + 1);
 			last_up[i] = link_up;
 			if (changed) {
 				const char *name = port_config_get_name(i);
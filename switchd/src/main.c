@@ -27,6 +27,8 @@ extern void *netlink_thread(void *unit_ptr);
 extern void netlink_stop(void);
 extern void *link_state_thread(void *unit_ptr);
 extern void link_state_stop(void);
+extern void *fdb_sync_thread(void *unit_ptr);
+extern void fdb_sync_stop(void);
 extern void *tx_thread(void *arg);
 extern void tx_stop(void);
 extern int rx_start(int unit, int *tun_fds, int num_ports, void *cookie);
@@ -100,9 +102,9 @@ int main(int argc, char **argv)
 			fprintf(stderr, "rx_start failed\n");
 	}
 
-	/* Threads: netlink, link-state poll, TX */
+	/* Threads: netlink, link-state poll, TX, FDB sync */
 	{
-		pthread_t th_netlink, th_link, th_tx;
+		pthread_t th_netlink, th_link, th_tx, th_fdb;
 		static struct { int unit; int *tun_fds; int num_ports; } tx_arg;
 
 		tx_arg.unit = unit;
@@ -112,7 +114,8 @@ int main(int argc, char **argv)
 		pthread_create(&th_netlink, NULL, netlink_thread, &unit);
 		pthread_create(&th_link, NULL, link_state_thread, &unit);
 		pthread_create(&th_tx, NULL, tx_thread, &tx_arg);
-		fprintf(stderr, "netlink, link-state, TX threads started\n");
+		pthread_create(&th_fdb, NULL, fdb_sync_thread, &unit);
+		fprintf(stderr, "netlink, link-state, TX, FDB sync threads started\n");
 
 		while (running)
 			sleep(1);
@@ -120,9 +123,11 @@ int main(int argc, char **argv)
 		netlink_stop();
 		link_state_stop();
 		tx_stop();
+		fdb_sync_stop();
 		pthread_join(th_netlink, NULL);
 		pthread_join(th_link, NULL);
 		pthread_join(th_tx, NULL);
+		pthread_join(th_fdb, NULL);
 	}
 
 	tun_close_all(tun_fds, num_ports);
@@ -1,14 +1,19 @@
 /*
  * Netlink listener — RTNETLINK for link, route, neigh, addr.
  * Dispatches to SDK (port enable, L3 intf, egress, route, L2).
+ * Every few seconds it also harvests the ASIC hit bits and confirms the
+ * neighbors the hardware forwarded to (see neigh_refresh).
  */
 #include "bcm56846.h"
+#include <arpa/inet.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
 #include <linux/if_link.h>
@@ -16,12 +21,19 @@
 #include <linux/if_addr.h>
 #include <linux/neighbour.h>
 
+extern void nl_add_rtattr(struct nlmsghdr *nlh, int type, const void *data, int len);
+
 #define NETLINK_BUF_SIZE 65536
 #define RTA_TB_SIZE 32
 #define NDA_TB_SIZE 32
 #define MAX_IFINDEX 512
-#define NEIGH_CACHE_SIZE 256
+#define NEIGH_CACHE_SIZE 4096
 #define MAX_PORTS 56
+#define NEIGH_REFRESH_MS 5000
+#define NEIGH_REFRESH_CHUNK 16384  /* bytes per refresh send(), well under the sndbuf */
+#define NEIGH_MSG_SPACE (NLMSG_SPACE(sizeof(struct ndmsg)) + RTA_SPACE(16) + RTA_SPACE(6))
+#define MAX_PORT_ADDRS 1024
+#define INET_ALEN(family) ((family) == AF_INET6 ? 16 : 4)
 
 #ifndef NDA_RTA
 #define NDA_RTA(r) ((struct rtattr *)(((char *)(r)) + NLMSG_ALIGN(sizeof(struct ndmsg))))
@@ -36,10 +48,24 @@ static int ifindex_to_port[MAX_IFINDEX];
 /* port (1-based) -> L3 intf_id from l3_intf_create */
 static int port_to_intf_id[MAX_PORTS];
 
+/* IPv4/IPv6 addresses on switch ports; a port keeps its L3 intf while it has any */
+struct port_addr {
+	int port;
+	int family;
+	uint8_t addr[16];
+	uint8_t prefixlen;
+};
+static struct port_addr port_addrs[MAX_PORT_ADDRS];
+static int port_addr_count;
+
 struct neigh_entry {
-	uint32_t ip;
+	int family;       /* AF_INET or AF_INET6 */
+	uint8_t addr[16]; /* network byte order, INET_ALEN(family) bytes */
 	int ifindex;
 	uint8_t mac[6];
+	uint16_t state;   /* NUD_* from the last RTM_NEWNEIGH */
+	int hit;          /* forwarded to since the last refresh */
+	int egress_id;    /* egress reference held by its L3 host entry, 0 = none */
 };
 static struct neigh_entry neigh_cache[NEIGH_CACHE_SIZE];
 static int neigh_cache_count;
@@ -66,46 +92,63 @@ static int ifname_to_port(const char *ifname, int *port)
 	return 0;
 }
 
-static void neigh_cache_set(uint32_t ip, int ifindex, const uint8_t *mac)
+static struct neigh_entry *neigh_cache_find(int family, const uint8_t *addr, int ifindex)
 {
 	int i;
-	for (i = 0; i < neigh_cache_count; i++) {
-		if (neigh_cache[i].ip == ip && neigh_cache[i].ifindex == ifindex) {
-			memcpy(neigh_cache[i].mac, mac, 6);
-			return;
-		}
-	}
-	if (neigh_cache_count >= NEIGH_CACHE_SIZE)
-		return;
-	neigh_cache[neigh_cache_count].ip = ip;
-	neigh_cache[neigh_cache_count].ifindex = ifindex;
-	memcpy(neigh_cache[neigh_cache_count].mac, mac, 6);
-	neigh_cache_count++;
+	for (i = 0; i < neigh_cache_count; i++)
+		if (neigh_cache[i].family == family && neigh_cache[i].ifindex == ifindex &&
+		    memcmp(neigh_cache[i].addr, addr, INET_ALEN(family)) == 0)
+			return &neigh_cache[i];
+	return NULL;
 }
 
-static int neigh_cache_get(uint32_t ip, int ifindex, uint8_t *mac)
+/* Returns the entry, or NULL when the cache is full. */
+static struct neigh_entry *neigh_cache_set(int family, const uint8_t *addr, int ifindex,
+					   const uint8_t *mac, uint16_t state)
 {
-	int i;
-	for (i = 0; i < neigh_cache_count; i++) {
-		if (neigh_cache[i].ip == ip && neigh_cache[i].ifindex == ifindex) {
-			memcpy(mac, neigh_cache[i].mac, 6);
-			return 0;
-		}
+	struct neigh_entry *n = neigh_cache_find(family, addr, ifindex);
+
+	if (!n) {
+		if (neigh_cache_count >= NEIGH_CACHE_SIZE)
+			return NULL;
+		n = &neigh_cache[neigh_cache_count++];
+		memset(n, 0, sizeof(*n));
+		n->family = family;
+		memcpy(n->addr, addr, INET_ALEN(family));
+		n->ifindex = ifindex;
 	}
-	return -1;
+	memcpy(n->mac, mac, 6);
+	n->state = state;
+	return n;
+}
+
+static int neigh_cache_get(int family, const uint8_t *addr, int ifindex, uint8_t *mac)
+{
+	const struct neigh_entry *n = neigh_cache_find(family, addr, ifindex);
+
+	if (!n)
+		return -1;
+	memcpy(mac, n->mac, 6);
+	return 0;
 }
 
-static void neigh_cache_remove(uint32_t ip, int ifindex)
+static void neigh_cache_remove(int family, const uint8_t *addr, int ifindex)
 {
+	struct neigh_entry *n = neigh_cache_find(family, addr, ifindex);
 	int i;
-	for (i = 0; i < neigh_cache_count; i++) {
-		if (neigh_cache[i].ip == ip && neigh_cache[i].ifindex == ifindex) {
-			memmove(&neigh_cache[i], &neigh_cache[i + 1],
-				(size_t)(neigh_cache_count - 1 - i) * sizeof(neigh_cache[0]));
-			neigh_cache_count--;
-			return;
-		}
-	}
+
+	if (!n)
+		return;
+	i = (int)(n - neigh_cache);
+	memmove(&neigh_cache[i], &neigh_cache[i + 1],
+		(size_t)(neigh_cache_count - 1 - i) * sizeof(neigh_cache[0]));
+	neigh_cache_count--;
+}
+
+/* fe80::/10 and ff00::/8 are per-link: never offloaded as hosts or routes */
+static int ipv6_is_link_scope(const uint8_t *addr)
+{
+	return addr[0] == 0xff || (addr[0] == 0xfe && (addr[1] & 0xc0) == 0x80);
 }
 
 static void handle_link(struct nlmsghdr *nlh)
@@ -135,42 +178,145 @@ static void handle_link(struct nlmsghdr *nlh)
 	}
 }
 
+static struct port_addr *port_addr_find(int port, int family, const uint8_t *addr,
+					int prefixlen)
+{
+	int i;
+	for (i = 0; i < port_addr_count; i++)
+		if (port_addrs[i].port == port && port_addrs[i].family == family &&
+		    port_addrs[i].prefixlen == prefixlen &&
+		    memcmp(port_addrs[i].addr, addr, INET_ALEN(family)) == 0)
+			return &port_addrs[i];
+	return NULL;
+}
+
+static int port_has_addr(int port)
+{
+	int i;
+	for (i = 0; i < port_addr_count; i++)
+		if (port_addrs[i].port == port)
+			return 1;
+	return 0;
+}
+
+/*
+ * One L3 intf per port, created with its first address (IPv4 or IPv6,
+ * link-local included) and destroyed with its last.  The kernel re-sends
+ * RTM_NEWADDR for addresses it already has (e.g. IPv6 lifetime updates),
+ * so addresses are tracked rather than counted.
+ */
 static void handle_addr(struct nlmsghdr *nlh)
 {
 	struct ifaddrmsg *ifa;
 	struct rtattr *tb[RTA_TB_SIZE];
+	struct port_addr *pa;
+	const uint8_t *addr;
 	int len, port, intf_id;
 	uint8_t mac[6];
 
 	if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
 		return;
 	ifa = NLMSG_DATA(nlh);
+	if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+		return;
 	len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifa));
 	parse_rtattr(tb, RTA_TB_SIZE, IFA_RTA(ifa), len);
-	if (!tb[IFA_ADDRESS])
+	if (!tb[IFA_ADDRESS] || RTA_PAYLOAD(tb[IFA_ADDRESS]) < (unsigned int)INET_ALEN(ifa->ifa_family))
 		return;
+	addr = RTA_DATA(tb[IFA_ADDRESS]);
 	if ((unsigned int)ifa->ifa_index >= MAX_IFINDEX)
 		return;
 	port = ifindex_to_port[ifa->ifa_index];
 	if (port <= 0 || port >= MAX_PORTS)
 		return;
-
-	/* Synthetic port MAC for EGR_L3_INTF: 02:00:00:00:00:XX */
-	memset(mac, 0, 6);
-	mac[0] = 0x02;
-	mac[5] = (uint8_t)port;
+	pa = port_addr_find(port, ifa->ifa_family, addr, ifa->ifa_prefixlen);
 
 	if (nlh->nlmsg_type == RTM_NEWADDR) {
+		if (!pa) {
+			if (port_addr_count >= MAX_PORT_ADDRS)
+				return;
+			pa = &port_addrs[port_addr_count++];
+			memset(pa, 0, sizeof(*pa));
+			pa->port = port;
+			pa->family = ifa->ifa_family;
+			memcpy(pa->addr, addr, INET_ALEN(ifa->ifa_family));
+			pa->prefixlen = ifa->ifa_prefixlen;
+		}
+		if (port_to_intf_id[port] != 0)
+			return;
+		/* Synthetic port MAC for EGR_L3_INTF: 02:00:00:00:00:XX */
+		memset(mac, 0, 6);
+		mac[0] = 0x02;
+		mac[5] = (uint8_t)port;
 		if (bcm56846_l3_intf_create(netlink_unit, mac, 0, &intf_id) == 0)
 			port_to_intf_id[port] = intf_id;
 	} else {
-		if (port_to_intf_id[port] != 0) {
+		if (pa)
+			*pa = port_addrs[--port_addr_count];
+		if (port_to_intf_id[port] != 0 && !port_has_addr(port)) {
 			bcm56846_l3_intf_destroy(netlink_unit, port_to_intf_id[port]);
 			port_to_intf_id[port] = 0;
 		}
 	}
 }
 
+/* L3 host key for a neighbor: addr[] in host byte order, IPv6 high word first */
+static void neigh_host_key(const struct neigh_entry *n, bcm56846_l3_host_t *host)
+{
+	uint32_t w;
+	int i;
+
+	memset(host, 0, sizeof(*host));
+	for (i = 0; i < INET_ALEN(n->family) / 4; i++) {
+		memcpy(&w, n->addr + 4 * i, 4);
+		host->addr[i] = ntohl(w);
+	}
+	host->is_ipv6 = n->family == AF_INET6;
+}
+
+/*
+ * Resolved neighbors are offloaded as L3 hosts (L3_ENTRY hash, no DEFIP
+ * slot) on the same shared egress a route via that gateway uses.  The
+ * cache entry holds the host's egress reference.  Returns the egress id,
+ * or 0 if the host was not installed (no L3 intf on the port yet, table
+ * bucket full, IPv6 link-local: the L3_ENTRY key has no interface).
+ */
+static int neigh_host_add(const struct neigh_entry *n, int port)
+{
+	bcm56846_l3_egress_t egr;
+	bcm56846_l3_host_t host;
+	int egress_id;
+
+	neigh_host_key(n, &host);
+	if (!host.addr[0] || port >= MAX_PORTS || port_to_intf_id[port] == 0)
+		return 0;
+	if (n->family == AF_INET6 && ipv6_is_link_scope(n->addr))
+		return 0;
+	memset(&egr, 0, sizeof(egr));
+	memcpy(egr.mac, n->mac, 6);
+	egr.port = port;
+	egr.intf_id = port_to_intf_id[port];
+	if (bcm56846_l3_egress_create(netlink_unit, &egr, &egress_id) != 0)
+		return 0;
+	host.egress_id = egress_id;
+	if (bcm56846_l3_host_add(netlink_unit, &host) != 0) {
+		bcm56846_l3_egress_destroy(netlink_unit, egress_id);
+		return 0;
+	}
+	return egress_id;
+}
+
+static void neigh_host_delete(const struct neigh_entry *n)
+{
+	bcm56846_l3_host_t host;
+
+	if (n->egress_id <= 0)
+		return;
+	neigh_host_key(n, &host);
+	bcm56846_l3_host_delete(netlink_unit, &host);
+	bcm56846_l3_egress_destroy(netlink_unit, n->egress_id);
+}
+
 static void handle_neigh(struct nlmsghdr *nlh)
 {
 	struct ndmsg *ndm;
@@ -179,19 +325,22 @@ static void handle_neigh(struct nlmsghdr *nlh)
 	uint8_t *lladdr = NULL;
 	uint8_t mac[6];
 	uint16_t vid = 0;
-	uint32_t dst_ip = 0;
+	const uint8_t *dst;
+	int family;
 
 	if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*ndm)))
 		return;
 	ndm = NLMSG_DATA(nlh);
-	if (ndm->ndm_family != AF_INET)
+	family = ndm->ndm_family;
+	if (family != AF_INET && family != AF_INET6)
 		return;
 	len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*ndm));
 	parse_rtattr(tb, NDA_TB_SIZE, NDA_RTA(ndm), len);
 	if (tb[NDA_LLADDR] && RTA_PAYLOAD(tb[NDA_LLADDR]) >= 6)
 		lladdr = RTA_DATA(tb[NDA_LLADDR]);
-	if (tb[NDA_DST])
-		memcpy(&dst_ip, RTA_DATA(tb[NDA_DST]), 4);
+	if (!tb[NDA_DST] || RTA_PAYLOAD(tb[NDA_DST]) < (unsigned int)INET_ALEN(family))
+		return;
+	dst = RTA_DATA(tb[NDA_DST]);
 	if (tb[NDA_VLAN])
 		vid = *(uint16_t *)RTA_DATA(tb[NDA_VLAN]);
 
@@ -202,8 +351,19 @@ static void handle_neigh(struct nlmsghdr *nlh)
 		return;
 
 	if (nlh->nlmsg_type == RTM_NEWNEIGH) {
+		struct neigh_entry *n;
+		int old_egress = 0;
+
 		if (!lladdr)
 			return;
+		/* State change only (e.g. our own refresh): L2 entry unchanged */
+		if (neigh_cache_get(family, dst, ndm->ndm_ifindex, mac) == 0 &&
+		    memcmp(mac, lladdr, 6) == 0) {
+			n = neigh_cache_set(family, dst, ndm->ndm_ifindex, lladdr, ndm->ndm_state);
+			if (n->egress_id == 0)  /* e.g. its L3 intf came up since */
+				n->egress_id = neigh_host_add(n, port);
+			return;
+		}
 		{
 			bcm56846_l2_addr_t l2;
 			memcpy(l2.mac, lladdr, 6);
@@ -212,13 +372,37 @@ static void handle_neigh(struct nlmsghdr *nlh)
 			l2.static_entry = 1;
 			bcm56846_l2_addr_add(netlink_unit, &l2);
 		}
-		neigh_cache_set(dst_ip, ndm->ndm_ifindex, lladdr);
+		n = neigh_cache_set(family, dst, ndm->ndm_ifindex, lladdr, ndm->ndm_state);
+		if (!n)
+			return;
+		/* New MAC: the host is rewritten in place, then the old egress released */
+		old_egress = n->egress_id;
+		n->egress_id = neigh_host_add(n, port);
+		if (old_egress > 0)
+			bcm56846_l3_egress_destroy(netlink_unit, old_egress);
 	} else {
+		const struct neigh_entry *n = neigh_cache_find(family, dst, ndm->ndm_ifindex);
+
 		if (lladdr)
 			bcm56846_l2_addr_delete(netlink_unit, lladdr, vid);
-		else if (dst_ip && neigh_cache_get(dst_ip, ndm->ndm_ifindex, mac) == 0)
-			bcm56846_l2_addr_delete(netlink_unit, mac, vid);
-		neigh_cache_remove(dst_ip, ndm->ndm_ifindex);
+		else if (n)
+			bcm56846_l2_addr_delete(netlink_unit, n->mac, vid);
+		if (n)
+			neigh_host_delete(n);
+		neigh_cache_remove(family, dst, ndm->ndm_ifindex);
+	}
+}
+
+/* Route key for (family, dst, len); dst in network byte order */
+static void route_key(bcm56846_l3_route_t *route, int family, const uint8_t *dst, int len)
+{
+	memset(route, 0, sizeof(*route));
+	route->prefix_len = len;
+	if (family == AF_INET6) {
+		route->is_ipv6 = 1;
+		memcpy(route->prefix6, dst, 16);
+	} else {
+		memcpy(&route->prefix, dst, 4);
 	}
 }
 
@@ -226,39 +410,47 @@ static void handle_route(struct nlmsghdr *nlh)
 {
 	struct rtmsg *rtm;
 	struct rtattr *tb[RTA_TB_SIZE];
-	int len, port, egress_id;
-	uint32_t dst = 0, gateway = 0, mask;
+	int len, port, egress_id, family, alen;
+	uint8_t dst[16], gateway[16];
 	bcm56846_l3_egress_t egr;
 	bcm56846_l3_route_t route;
 
 	if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*rtm)))
 		return;
 	rtm = NLMSG_DATA(nlh);
-	if (rtm->rtm_family != AF_INET || rtm->rtm_type != RTN_UNICAST)
+	family = rtm->rtm_family;
+	if ((family != AF_INET && family != AF_INET6) || rtm->rtm_type != RTN_UNICAST)
+		return;
+	alen = INET_ALEN(family);
+	if (rtm->rtm_dst_len > alen * 8)
 		return;
 	len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*rtm));
 	parse_rtattr(tb, RTA_TB_SIZE, RTM_RTA(rtm), len);
-	if (tb[RTA_DST])
-		memcpy(&dst, RTA_DATA(tb[RTA_DST]), 4);
-	if (rtm->rtm_dst_len > 0 && rtm->rtm_dst_len <= 32)
-		mask = (uint32_t)(0xFFFFFFFFU << (32 - rtm->rtm_dst_len));
-	else
-		mask = 0;
+	memset(dst, 0, sizeof(dst));
+	memset(gateway, 0, sizeof(gateway));
+	if (tb[RTA_DST] && RTA_PAYLOAD(tb[RTA_DST]) >= (unsigned int)alen)
+		memcpy(dst, RTA_DATA(tb[RTA_DST]), (size_t)alen);
+	if (family == AF_INET6 && rtm->rtm_dst_len >= 8 && ipv6_is_link_scope(dst))
+		return;
+	route_key(&route, family, dst, (int)rtm->rtm_dst_len);
 
+	/*
+	 * Each installed route holds one reference on its (shared) egress:
+	 * released when the route goes away or is replaced.
+	 */
 	if (nlh->nlmsg_type == RTM_DELROUTE) {
-		route.prefix = dst;
-		route.prefix_len = (int)rtm->rtm_dst_len;
-		route.egress_id = 0;
-		route.is_ipv6 = 0;
-		bcm56846_l3_route_delete(netlink_unit, &route);
+		if (bcm56846_l3_route_get(netlink_unit, &route) != 0)
+			return;
+		if (bcm56846_l3_route_delete(netlink_unit, &route) == 0)
+			bcm56846_l3_egress_destroy(netlink_unit, route.egress_id);
 		return;
 	}
 
 	/* RTM_NEWROUTE */
 	{
-		int oif = 0;
-		if (tb[RTA_GATEWAY])
-			memcpy(&gateway, RTA_DATA(tb[RTA_GATEWAY]), 4);
+		int oif = 0, old_egress = 0;
+		if (tb[RTA_GATEWAY] && RTA_PAYLOAD(tb[RTA_GATEWAY]) >= (unsigned int)alen)
+			memcpy(gateway, RTA_DATA(tb[RTA_GATEWAY]), (size_t)alen);
 		if (tb[RTA_OIF])
 			oif = *(int *)RTA_DATA(tb[RTA_OIF]);
 
@@ -272,16 +464,17 @@ static void handle_route(struct nlmsghdr *nlh)
 		egr.port = port;
 		egr.vid = 0;
 		egr.intf_id = (port < MAX_PORTS) ? port_to_intf_id[port] : 0;
-		neigh_cache_get(gateway, oif, egr.mac);
+		neigh_cache_get(family, gateway, oif, egr.mac);
 
+		if (bcm56846_l3_route_get(netlink_unit, &route) == 0)
+			old_egress = route.egress_id;
 		if (bcm56846_l3_egress_create(netlink_unit, &egr, &egress_id) != 0)
 			return;
-		memset(&route, 0, sizeof(route));
-		route.prefix = dst;
-		route.prefix_len = (int)rtm->rtm_dst_len;
 		route.egress_id = egress_id;
-		route.is_ipv6 = 0;
-		bcm56846_l3_route_add(netlink_unit, &route);
+		if (bcm56846_l3_route_add(netlink_unit, &route) != 0)
+			bcm56846_l3_egress_destroy(netlink_unit, egress_id);
+		else if (old_egress > 0)
+			bcm56846_l3_egress_destroy(netlink_unit, old_egress);
 	}
 }
 
@@ -309,16 +502,128 @@ static void dispatch(struct nlmsghdr *nlh)
 	}
 }
 
+/*
+ * ---- Neighbor refresh ----
+ * Traffic the ASIC forwards never reaches the kernel, so without help a
+ * busy neighbor goes STALE and then through DELAY/PROBE, and the kernel
+ * ARPs for a host that is plainly alive.  Every NEIGH_REFRESH_MS the hit
+ * bits of the static L2 entries (neighbor MACs) and of the L3 host
+ * entries are harvested in bulk, and only neighbors with a hit get an
+ * RTM_NEWNEIGH NUD_REACHABLE, batched into NEIGH_REFRESH_CHUNK sends.
+ * Permanent and failed entries are left alone.  The kernel echoes each
+ * update back to us; handle_neigh sees the same MAC and only records the
+ * new state.
+ */
+#define NUD_REFRESHABLE (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE)
+
+static int64_t neigh_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int neigh_l2_hit(int unit, const bcm56846_l2_addr_t *addr, void *cookie)
+{
+	int i;
+
+	(void)unit;
+	(void)cookie;
+	for (i = 0; i < neigh_cache_count; i++)
+		if (memcmp(neigh_cache[i].mac, addr->mac, 6) == 0)
+			neigh_cache[i].hit = 1;
+	return 0;
+}
+
+static int neigh_l3_hit(int unit, const bcm56846_l3_host_t *host, void *cookie)
+{
+	int family = host->is_ipv6 ? AF_INET6 : AF_INET;
+	uint8_t addr[16];
+	uint32_t w;
+	int i;
+
+	(void)unit;
+	(void)cookie;
+	for (i = 0; i < INET_ALEN(family) / 4; i++) {
+		w = htonl(host->addr[i]);
+		memcpy(addr + 4 * i, &w, 4);
+	}
+	for (i = 0; i < neigh_cache_count; i++)
+		if (neigh_cache[i].family == family &&
+		    memcmp(neigh_cache[i].addr, addr, INET_ALEN(family)) == 0)
+			neigh_cache[i].hit = 1;
+	return 0;
+}
+
+static int neigh_refresh_msg(char *buf, const struct neigh_entry *n)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *)buf;
+	struct ndmsg *ndm;
+
+	memset(buf, 0, NEIGH_MSG_SPACE);
+	nlh->nlmsg_len = NLMSG_LENGTH(sizeof(*ndm));
+	nlh->nlmsg_type = RTM_NEWNEIGH;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_REPLACE;
+	ndm = NLMSG_DATA(nlh);
+	ndm->ndm_family = (uint8_t)n->family;
+	ndm->ndm_ifindex = n->ifindex;
+	ndm->ndm_state = NUD_REACHABLE;
+	nl_add_rtattr(nlh, NDA_DST, n->addr, INET_ALEN(n->family));
+	nl_add_rtattr(nlh, NDA_LLADDR, n->mac, 6);
+	return (int)NLMSG_ALIGN(nlh->nlmsg_len);
+}
+
+static void neigh_refresh(int unit)
+{
+	static char buf[NEIGH_REFRESH_CHUNK];
+	int i, failed, len = 0, n = 0, lost = 0, err = 0;
+
+	if (neigh_cache_count == 0)
+		return;
+	if (bcm56846_l2_hit_harvest(unit, neigh_l2_hit, NULL) < 0)
+		fprintf(stderr, "netlink: L2 hit harvest failed\n");
+	if (bcm56846_l3_host_hit_harvest(unit, neigh_l3_hit, NULL) < 0)
+		fprintf(stderr, "netlink: L3 hit harvest failed\n");
+	failed = bcm56846_l3_sync(unit);  /* hit-bit clears are queued like route writes */
+	if (failed > 0)
+		fprintf(stderr, "netlink: %d L3 table writes failed\n", failed);
+	for (i = 0; i < neigh_cache_count; i++) {
+		if (!neigh_cache[i].hit)
+			continue;
+		neigh_cache[i].hit = 0;
+		if (!(neigh_cache[i].state & NUD_REFRESHABLE))
+			continue;
+		if (len + NEIGH_MSG_SPACE > NEIGH_REFRESH_CHUNK) {
+			if (send(netlink_fd, buf, (size_t)len, 0) < 0) {
+				lost += n;
+				err = errno;
+			}
+			len = n = 0;
+		}
+		len += neigh_refresh_msg(buf + len, &neigh_cache[i]);
+		n++;
+	}
+	if (len > 0 && send(netlink_fd, buf, (size_t)len, 0) < 0) {
+		lost += n;
+		err = errno;
+	}
+	if (lost > 0)
+		fprintf(stderr, "netlink: neighbor refresh: %d updates not sent: %d\n", lost, err);
+}
+
 void *netlink_thread(void *arg)
 {
 	int unit = *(int *)arg;
 	char *buf;
 	struct nlmsghdr *nlh;
+	int64_t refresh_due;
 	int len;
 
 	netlink_unit = unit;
 	memset(ifindex_to_port, 0xff, sizeof(ifindex_to_port));
 	memset(port_to_intf_id, 0, sizeof(port_to_intf_id));
+	port_addr_count = 0;
 	neigh_cache_count = 0;
 
 	buf = malloc(NETLINK_BUF_SIZE);
@@ -346,8 +651,23 @@ void *netlink_thread(void *arg)
 			return NULL;
 		}
 	}
+	/* Wake up at least once a second for the neighbor refresh */
+	{
+		struct timeval tv = { 1, 0 };
+		setsockopt(netlink_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	}
+	refresh_due = neigh_now_ms() + NEIGH_REFRESH_MS;
+
+	/* Pipeline L3 table writes across each netlink buffer */
+	bcm56846_l3_async_set(unit, 1);
 
 	while (netlink_running) {
+		int failed;
+
+		if (neigh_now_ms() >= refresh_due) {
+			neigh_refresh(unit);
+			refresh_due = neigh_now_ms() + NEIGH_REFRESH_MS;
+		}
 		len = recv(netlink_fd, buf, NETLINK_BUF_SIZE, 0);
 		if (len <= 0) {
 			if (len < 0 && (errno == EINTR || errno == EAGAIN))
@@ -359,7 +679,11 @@ void *netlink_thread(void *arg)
 				continue;
 			dispatch(nlh);
 		}
+		failed = bcm56846_l3_sync(netlink_unit);
+		if (failed > 0)
+			fprintf(stderr, "netlink: %d L3 table writes failed\n", failed);
 	}
+	bcm56846_l3_async_set(unit, 0);
 
 	close(netlink_fd);
 	netlink_fd = -1;
@@ -0,0 +1,15 @@
+/* Netlink message helpers shared by the netlink and fdb_sync threads */
+#include <string.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/* Append attribute type (len bytes of data) to nlh, which must have room. */
+void nl_add_rtattr(struct nlmsghdr *nlh, int type, const void *data, int len)
+{
+	struct rtattr *rta = (struct rtattr *)((char *)nlh + NLMSG_ALIGN(nlh->nlmsg_len));
+
+	rta->rta_type = (unsigned short)type;
+	rta->rta_len = (unsigned short)RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, (size_t)len);
+	nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
@@ -0,0 +1,1390 @@
+/*
+ * SDK regression test against the in-process ASIC simulator (bde_sim.c).
+ * Runs on the build host: attach + init, then programs L2, L3, VLAN, ECMP
+ * and bulk tables through the public API and checks the result with the
+ * simulator's lookups and table contents.
+ */
+#include "bcm56846.h"
+#include "bde_sim.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			return -1;					\
+		}							\
+	} while (0)
+
+static const uint8_t router_mac[6] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55 };
+static const uint8_t peer_mac[6]   = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+/* Empty config.bcm in a scratch directory (no rc.soc / rc.datapath_0). */
+static int test_attach_init(void)
+{
+	char dir[] = "/tmp/sim_test.XXXXXX";
+	char path[64];
+	FILE *f;
+	int rc;
+
+	CHECK(mkdtemp(dir) != NULL);
+	snprintf(path, sizeof(path), "%s/config.bcm", dir);
+	f = fopen(path, "w");
+	CHECK(f != NULL);
+	fprintf(f, "# sim_test\n");
+	fclose(f);
+
+	CHECK(bcm56846_attach(0) == 0);
+	rc = bcm56846_init(0, dir);
+	unlink(path);
+	rmdir(dir);
+	CHECK(rc == 0);
+	printf("  init: %llu SCHAN ops\n", (unsigned long long)bde_sim_op_count());
+	return 0;
+}
+
+/*
+ * Per-port modify with only some ports in the register cache: a port whose
+ * read fails is left alone, not written with an unread value.
+ */
+static int test_datapath_partial_cache(void)
+{
+	extern int bcm56846_datapath_init(void);
+	extern int sbus_reg_write(uint32_t addr, uint32_t value);
+	extern void sbus_reg_cache_invalidate(uint32_t addr);
+	const uint32_t pfc10 = 0x0050a60eu;  /* XMAC_PFC_CTRL, port 10 */
+	const uint32_t pfc11 = 0x0050b60eu;
+	uint32_t v;
+
+	/* Init cached every port; drop port 10 so only its read goes out */
+	CHECK(sbus_reg_write(pfc10, 0x5a5a5a50u) == 0);
+	CHECK(sbus_reg_write(pfc11, 0x5a5a5a57u) == 0);
+	sbus_reg_cache_invalidate(pfc10);
+	bde_sim_read_fail(pfc10);
+	bcm56846_datapath_init();
+	bde_sim_read_fail(0);
+	CHECK(bde_sim_mem_get(pfc10, &v, 1) == 0 && v == 0x5a5a5a50u);
+	CHECK(bde_sim_mem_get(pfc11, &v, 1) == 0 && v == 0x5a5a5a50u);
+	return 0;
+}
+
+static int test_l2(void)
+{
+	bcm56846_l2_addr_t a, out;
+	int port = -1;
+
+	memset(&a, 0, sizeof(a));
+	memcpy(a.mac, peer_mac, 6);
+	a.vid = 100;
+	a.port = 7;
+	CHECK(bcm56846_l2_addr_add(0, &a) == 0);
+	CHECK(bcm56846_l2_addr_get(0, peer_mac, 100, &out) == 0);
+	CHECK(out.port == 7 && out.vid == 100);
+	CHECK(bde_sim_l2_lookup(peer_mac, 100, &port) == 0 && port == 7);
+	CHECK(bde_sim_l2_lookup(peer_mac, 101, &port) == -ENOENT);
+
+	CHECK(bcm56846_l2_addr_delete(0, peer_mac, 100) == 0);
+	CHECK(bde_sim_l2_lookup(peer_mac, 100, &port) == -ENOENT);
+	return 0;
+}
+
+static void test_mac(int i, uint8_t mac[6])
+{
+	uint32_t r = (uint32_t)i * 2654435761u;
+
+	mac[0] = 0x02;
+	mac[1] = 0xaa;
+	mac[2] = (uint8_t)(r >> 24);
+	mac[3] = (uint8_t)(r >> 16);
+	mac[4] = (uint8_t)(r >> 8);
+	mac[5] = (uint8_t)r;
+}
+
+/* Nine MACs in one bucket: eight fit, the ninth is -ENOSPC. */
+static int test_l2_buckets(void)
+{
+	static uint16_t fill[16384];
+	bcm56846_l2_addr_t a, out;
+	uint8_t macs[9][6];
+	uint32_t e[4];
+	uint64_t ops;
+	int bucket = -1, n = 0, i, j, port;
+
+	/* CRC is linear: a plain counter spreads evenly, scramble the MACs */
+	memset(fill, 0, sizeof(fill));
+	for (i = 0; i < 65536 && bucket < 0; i++) {
+		uint8_t mac[6];
+		int b;
+
+		test_mac(i, mac);
+		b = bcm56846_l2_bucket_get(0, mac, 10);
+
+		CHECK(b >= 0 && b < 16384);
+		if (++fill[b] == 9)
+			bucket = b;
+	}
+	CHECK(bucket >= 0);
+	for (i = 0; i < 65536 && n < 9; i++) {
+		uint8_t mac[6];
+
+		test_mac(i, mac);
+		if (bcm56846_l2_bucket_get(0, mac, 10) == bucket)
+			memcpy(macs[n++], mac, 6);
+	}
+
+	memset(&a, 0, sizeof(a));
+	a.vid = 10;
+	for (i = 0; i < 9; i++) {
+		memcpy(a.mac, macs[i], 6);
+		a.port = 20 + i;
+		CHECK(bcm56846_l2_addr_add(0, &a) == (i < 8 ? 0 : -ENOSPC));
+	}
+	/* All eight live inside the bucket */
+	for (i = 0; i < 8; i++) {
+		CHECK(bde_sim_l2_lookup(macs[i], 10, &port) == 0 && port == 20 + i);
+		for (j = 0; j < 8; j++) {
+			CHECK(bde_sim_mem_get(0x07120000u + (uint32_t)(bucket * 8 + j), e, 4) == 0);
+			if ((e[0] & 1u) && (e[2] & 0x7f) == (uint32_t)(20 + i))
+				break;
+		}
+		CHECK(j < 8);
+	}
+
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l2_addr_get(0, macs[3], 10, &out) == 0 && out.port == 23);
+	CHECK(bde_sim_op_count() == ops);  /* served from the shadow */
+	CHECK(bcm56846_l2_addr_get(0, macs[8], 10, &out) == -ENOENT);
+	CHECK(bde_sim_op_count() - ops == 1);  /* miss: one TABLE_LOOKUP */
+	ops = bde_sim_op_count();
+
+	CHECK(bcm56846_l2_addr_delete(0, macs[3], 10) == 0);
+	CHECK(bde_sim_op_count() - ops == 1);
+	memcpy(a.mac, macs[8], 6);
+	a.port = 28;
+	CHECK(bcm56846_l2_addr_add(0, &a) == 0);  /* reuses the freed slot */
+	CHECK(bde_sim_l2_lookup(macs[8], 10, &port) == 0 && port == 28);
+
+	for (i = 0; i < 9; i++)
+		CHECK(bcm56846_l2_addr_delete(0, macs[i], 10) == 0);
+	CHECK(bde_sim_l2_lookup(macs[0], 10, NULL) == -ENOENT);
+	return 0;
+}
+
+/* An entry written behind the SDK's back is found with TABLE_LOOKUP. */
+static int test_l2_hw_lookup(void)
+{
+	bcm56846_l2_addr_t out;
+	uint8_t mac[6];
+	uint32_t e[4];
+	uint64_t ops;
+	int bucket, port;
+
+	test_mac(12345, mac);
+	bucket = bcm56846_l2_bucket_get(0, mac, 20);
+	CHECK(bucket >= 0);
+	e[0] = 1u | (20u << 4) | ((uint32_t)mac[0] << 24) | ((uint32_t)mac[1] << 16);
+	e[1] = (uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5];
+	e[2] = 9;
+	e[3] = 0;
+	CHECK(bcm56846_table_write(0, 0x07120000u, bucket * 8 + 5, 1, 4, e) == 0);
+	CHECK(bde_sim_l2_lookup(mac, 20, &port) == 0 && port == 9);
+
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l2_addr_get(0, mac, 20, &out) == 0 && out.port == 9);
+	CHECK(bde_sim_op_count() - ops == 1);
+	CHECK(bcm56846_l2_addr_get(0, mac, 20, &out) == 0);
+	CHECK(bde_sim_op_count() - ops == 1);  /* now in the shadow */
+
+	CHECK(bcm56846_l2_addr_delete(0, mac, 20) == 0);
+	CHECK(bde_sim_mem_get(0x07120000u + (uint32_t)(bucket * 8 + 5), e, 4) == 0);
+	CHECK(!(e[0] & 1u));
+	return 0;
+}
+
+/* Remove every dynamic L2_ENTRY so later tests start from a clean table. */
+static int test_l2_delete_dynamic(void)
+{
+	const uint32_t *t;
+	uint32_t *copy;
+	bcm56846_l2_addr_t a;
+	int i;
+
+	CHECK(bcm56846_table_read(0, 0x07120000u, 0, 131072, 4, &t) == 0);
+	copy = malloc(sizeof(uint32_t) * 131072 * 4);
+	if (copy)
+		memcpy(copy, t, sizeof(uint32_t) * 131072 * 4);
+	bcm56846_table_read_release(0);  /* deletes may need the view buffer */
+	CHECK(copy != NULL);
+	t = copy;
+	for (i = 0; i < 131072; i++) {
+		const uint32_t *e = t + (size_t)i * 4;
+
+		if (!(e[0] & 1u) || (e[2] & (1u << 29)))
+			continue;
+		a.vid = (uint16_t)((e[0] >> 4) & 0xfff);
+		a.mac[0] = (uint8_t)(e[0] >> 24);
+		a.mac[1] = (uint8_t)(e[0] >> 16);
+		a.mac[2] = (uint8_t)(e[1] >> 24);
+		a.mac[3] = (uint8_t)(e[1] >> 16);
+		a.mac[4] = (uint8_t)(e[1] >> 8);
+		a.mac[5] = (uint8_t)e[1];
+		CHECK(bcm56846_l2_addr_delete(0, a.mac, a.vid) == 0);
+	}
+	free(copy);
+	return 0;
+}
+
+/* Learn/move/age records drained from the L2_MOD_FIFO ring keep the shadow exact. */
+static int test_l2_learn(void)
+{
+	static bcm56846_l2_event_t ev[8192];
+	bcm56846_l2_addr_t out;
+	uint8_t mac[6];
+	uint64_t ops;
+	int i, n, learned = 0;
+
+	test_mac(777, mac);
+	CHECK(bde_sim_l2_learn(mac, 30, 3) == 0);  /* learning off: nothing */
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+
+	for (i = 0; i < 2000; i++) {
+		test_mac(100000 + i, mac);
+		n = bde_sim_l2_learn(mac, 30, 1 + i % 48);
+		CHECK(n == 1 || n == -ENOSPC);
+		learned += n == 1;
+	}
+	ops = bde_sim_op_count();
+	n = bcm56846_l2_event_poll(0, ev, 8192);
+	CHECK(n == learned);
+	CHECK(bde_sim_op_count() == ops);  /* ring + two registers, no SCHAN */
+	CHECK(ev[0].type == BCM56846_L2_EVENT_LEARN && ev[0].addr.vid == 30);
+	CHECK(bcm56846_l2_event_poll(0, ev, 8192) == 0);
+	CHECK(bcm56846_l2_addr_get(0, ev[5].addr.mac, 30, &out) == 0);
+	CHECK(out.port == ev[5].addr.port && !out.static_entry);
+	CHECK(bde_sim_op_count() == ops);  /* learned entries are in the shadow */
+
+	/* Station move, then age-out */
+	memcpy(mac, ev[5].addr.mac, 6);
+	CHECK(bde_sim_l2_learn(mac, 30, 50) == 1);
+	CHECK(bcm56846_l2_event_poll(0, ev, 8192) == 1);
+	CHECK(ev[0].type == BCM56846_L2_EVENT_MOVE && ev[0].addr.port == 50);
+	CHECK(bcm56846_l2_addr_get(0, mac, 30, &out) == 0 && out.port == 50);
+	CHECK(bde_sim_l2_age(mac, 30) == 0);
+	CHECK(bcm56846_l2_event_poll(0, ev, 8192) == 1);
+	CHECK(ev[0].type == BCM56846_L2_EVENT_AGE);
+	CHECK(bcm56846_l2_addr_get(0, mac, 30, &out) == -ENOENT);
+
+	/* More records than the ring holds: the overflow reloads the shadow */
+	for (i = 0; i < 6000; i++) {
+		test_mac(200000 + i, mac);
+		bde_sim_l2_learn(mac, 31, 2);
+	}
+	n = bcm56846_l2_event_poll(0, ev, 8192);
+	CHECK(n > 0 && n < 6000);
+	test_mac(205999, mac);
+	if (bde_sim_l2_lookup(mac, 31, NULL) == 0) {
+		CHECK(bcm56846_l2_addr_get(0, mac, 31, &out) == 0 && out.port == 2);
+		ops = bde_sim_op_count();
+		CHECK(bcm56846_l2_addr_get(0, mac, 31, &out) == 0);
+		CHECK(bde_sim_op_count() == ops);
+	}
+
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	test_mac(777, mac);
+	CHECK(bde_sim_l2_learn(mac, 30, 3) == 0);
+	return test_l2_delete_dynamic();
+}
+
+/* Pass 1 clears the hit bits; entries without traffic since are aged by pass 2. */
+static int test_l2_age(void)
+{
+	static bcm56846_l2_event_t ev[256];
+	bcm56846_l2_addr_t a, out;
+	uint8_t mac[6];
+	int i, j, n, aged = 0, secs;
+
+	CHECK(bcm56846_l2_age_timer_get(0, &secs) == 0 && secs == 300);
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+	for (i = 0; i < 64; i++) {
+		test_mac(300000 + i, mac);
+		CHECK(bde_sim_l2_learn(mac, 40, 5) == 1);
+	}
+	while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+		;
+	memset(&a, 0, sizeof(a));
+	test_mac(400000, a.mac);
+	a.vid = 40;
+	a.port = 6;
+	a.static_entry = 1;
+	CHECK(bcm56846_l2_addr_add(0, &a) == 0);
+
+	CHECK(bcm56846_l2_age_timer_set(0, 1) == 0);
+	CHECK(bcm56846_l2_age_run(0, ev, 256) == 0);  /* not due yet */
+	usleep(1100 * 1000);
+	for (i = 0; i < 32; i++)
+		CHECK(bcm56846_l2_age_run(0, ev, 256) == 0);
+	for (i = 0; i < 64; i += 2) {
+		test_mac(300000 + i, mac);
+		CHECK(bde_sim_l2_learn(mac, 40, 5) == 0);  /* traffic: HITSA */
+	}
+	usleep(1100 * 1000);
+	for (i = 0; i < 32; i++) {
+		n = bcm56846_l2_age_run(0, ev, 256);
+		CHECK(n >= 0);
+		for (j = 0; j < n; j++)
+			CHECK(ev[j].type == BCM56846_L2_EVENT_AGE && ev[j].addr.vid == 40 &&
+			      ev[j].addr.port == 5);
+		aged += n;
+	}
+	CHECK(aged == 32);
+	for (i = 0; i < 64; i++) {
+		test_mac(300000 + i, mac);
+		CHECK((bde_sim_l2_lookup(mac, 40, NULL) == 0) == !(i & 1));
+		CHECK((bcm56846_l2_addr_get(0, mac, 40, &out) == 0) == !(i & 1));
+	}
+	CHECK(bde_sim_l2_lookup(a.mac, 40, NULL) == 0);  /* static: never aged */
+
+	CHECK(bcm56846_l2_age_timer_set(0, 0) == 0);
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	CHECK(bcm56846_l2_addr_delete(0, a.mac, 40) == 0);
+	return test_l2_delete_dynamic();
+}
+
+/*
+ * More dynamic entries in one sweep chunk than one l2_age_run() may write:
+ * the calls that finish the chunk must not age the entries whose hit bits
+ * the first call just cleared.
+ */
+static int test_l2_age_capped(void)
+{
+	static bcm56846_l2_event_t ev[256];
+	uint8_t mac[6];
+	int i, k, n, learned = 0;
+
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+	/* 600 MACs in the first chunk (buckets 0..511 = entries 0..4095) */
+	for (k = 700000; learned < 600; k++) {
+		test_mac(k, mac);
+		if (bcm56846_l2_bucket_get(0, mac, 60) >= 512)
+			continue;
+		CHECK(bde_sim_l2_learn(mac, 60, 9) == 1);
+		if (++learned % 100 == 0)
+			while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+				;
+	}
+	while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+		;
+
+	CHECK(bcm56846_l2_age_timer_set(0, 1) == 0);
+	usleep(60 * 1000);  /* chunk 0 due (1 s / 32 chunks) */
+	for (i = 0; i < 8; i++) {
+		n = bcm56846_l2_age_run(0, ev, 256);
+		CHECK(n == 0);  /* every entry was just learned: hits cleared only */
+	}
+	for (k = 700000, learned = 0; learned < 600; k++) {
+		test_mac(k, mac);
+		if (bcm56846_l2_bucket_get(0, mac, 60) >= 512)
+			continue;
+		CHECK(bde_sim_l2_lookup(mac, 60, NULL) == 0);
+		learned++;
+	}
+
+	CHECK(bcm56846_l2_age_timer_set(0, 0) == 0);
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	return test_l2_delete_dynamic();
+}
+
+/* Port and VLAN flushes: one bulk delete each, DELETE events for the bridge. */
+static int test_l2_flush(void)
+{
+	static bcm56846_l2_event_t ev[512];
+	bcm56846_l2_addr_t a, out;
+	uint8_t mac[6];
+	uint64_t ops;
+	int i, n;
+
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+	for (i = 0; i < 300; i++) {
+		test_mac(500000 + i, mac);
+		CHECK(bde_sim_l2_learn(mac, i < 200 ? 50 : 51, i < 100 ? 8 : 7) == 1);
+	}
+	while (bcm56846_l2_event_poll(0, ev, 512) > 0)
+		;
+	memset(&a, 0, sizeof(a));
+	test_mac(600000, a.mac);
+	a.vid = 50;
+	a.port = 7;
+	a.static_entry = 1;
+	CHECK(bcm56846_l2_addr_add(0, &a) == 0);
+
+	/* Port 7, any VLAN: MACs 100..299 */
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l2_flush(0, 7, -1, 0) == 200);
+	CHECK(bde_sim_op_count() - ops <= 6);
+	n = bcm56846_l2_event_poll(0, ev, 512);
+	CHECK(n == 200);
+	for (i = 0; i < n; i++)
+		CHECK(ev[i].type == BCM56846_L2_EVENT_DELETE && ev[i].addr.port == 7);
+	for (i = 0; i < 300; i++) {
+		test_mac(500000 + i, mac);
+		CHECK((bde_sim_l2_lookup(mac, i < 200 ? 50 : 51, NULL) == 0) == (i < 100));
+	}
+	CHECK(bcm56846_l2_addr_get(0, a.mac, 50, &out) == 0 && out.static_entry);
+	CHECK(bcm56846_l2_flush(0, 7, -1, 0) == 0);
+	CHECK(bcm56846_l2_flush(0, 7, -1, BCM56846_L2_FLUSH_TRUNK) == 0);
+
+	/* VLAN 50, any port: MACs 0..99; the static entry stays */
+	CHECK(bcm56846_l2_flush(0, -1, 50, 0) == 100);
+	CHECK(bcm56846_l2_event_poll(0, ev, 512) == 100);
+	test_mac(500000, mac);
+	CHECK(bcm56846_l2_addr_get(0, mac, 50, &out) == -ENOENT);
+	CHECK(bde_sim_l2_lookup(a.mac, 50, NULL) == 0);
+	CHECK(bcm56846_l2_flush(0, 7, 50, BCM56846_L2_FLUSH_STATIC) == 1);
+	CHECK(bde_sim_l2_lookup(a.mac, 50, NULL) != 0);
+	CHECK(bcm56846_l2_event_poll(0, ev, 512) == 1 && ev[0].addr.static_entry);
+
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	return 0;
+}
+
+struct traverse_count {
+	int n;
+	int stop_at;
+	int port;
+};
+
+static int traverse_cb(int unit, const bcm56846_l2_addr_t *addr, void *cookie)
+{
+	struct traverse_count *c = cookie;
+	bcm56846_l2_addr_t out;
+
+	/* The L2 lock is not held: the SDK can be called from here */
+	if (bcm56846_l2_addr_get(unit, addr->mac, addr->vid, &out) != 0 || out.port != addr->port)
+		return -EIO;
+	if (c->port >= 0 && addr->port != c->port)
+		return -EINVAL;
+	return ++c->n == c->stop_at;
+}
+
+/* Chunked walk of L2_ENTRY with port, VLAN and static/dynamic filters. */
+static int test_l2_traverse(void)
+{
+	static bcm56846_l2_event_t ev[256];
+	bcm56846_l2_filter_t f;
+	struct traverse_count c;
+	bcm56846_l2_addr_t a;
+	uint8_t mac[6];
+	int i;
+
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+	for (i = 0; i < 100; i++) {
+		test_mac(800000 + i, mac);
+		CHECK(bde_sim_l2_learn(mac, i < 50 ? 60 : 61, i < 50 ? 9 : 10) == 1);
+	}
+	memset(&a, 0, sizeof(a));
+	test_mac(900000, a.mac);
+	a.vid = 60;
+	a.port = 9;
+	a.static_entry = 1;
+	CHECK(bcm56846_l2_addr_add(0, &a) == 0);
+
+	memset(&c, 0, sizeof(c));
+	c.port = 9;
+	f.port = 9;
+	f.vid = -1;
+	f.flags = 0;
+	CHECK(bcm56846_l2_traverse(0, &f, traverse_cb, &c) == 51 && c.n == 51);
+	memset(&c, 0, sizeof(c));
+	c.port = -1;
+	f.port = -1;
+	f.vid = 61;
+	CHECK(bcm56846_l2_traverse(0, &f, traverse_cb, &c) == 50);
+	f.vid = -1;
+	f.flags = BCM56846_L2_TRAVERSE_STATIC;
+	CHECK(bcm56846_l2_traverse(0, &f, traverse_cb, &c) == 1);
+	f.flags = BCM56846_L2_TRAVERSE_DYNAMIC;
+	CHECK(bcm56846_l2_traverse(0, &f, traverse_cb, &c) == 100);
+	memset(&c, 0, sizeof(c));
+	c.port = -1;
+	c.stop_at = 10;
+	CHECK(bcm56846_l2_traverse(0, NULL, traverse_cb, &c) == 10);
+
+	CHECK(bcm56846_l2_flush(0, -1, -1, BCM56846_L2_FLUSH_STATIC) == 101);
+	while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+		;
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	return 0;
+}
+
+/* Learn limit and a station-move storm on one port, then recovery. */
+static int test_l2_limit(void)
+{
+	extern int bcm56846_l2_trap_admit(int port);
+	static bcm56846_l2_event_t ev[256];
+	bcm56846_l2_port_limit_t lim;
+	bcm56846_l2_port_learn_status_t st;
+	uint8_t mac[6];
+	int i, n;
+
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+	memset(&lim, 0, sizeof(lim));
+	lim.learn_limit = 3;
+	lim.action = BCM56846_L2_LIMIT_NOLEARN;
+	CHECK(bcm56846_l2_port_limit_set(0, 20, &lim) == 0);
+	for (i = 0; i < 5; i++) {
+		test_mac(960000 + i, mac);
+		CHECK(bde_sim_l2_learn(mac, 80, 20) == 1);  /* before the SDK sees them */
+	}
+	n = bcm56846_l2_event_poll(0, ev, 256);
+	CHECK(n == 3);
+	for (i = 0; i < n; i++)
+		CHECK(ev[i].type == BCM56846_L2_EVENT_LEARN);
+	test_mac(960004, mac);
+	CHECK(bde_sim_l2_lookup(mac, 80, NULL) == -ENOENT);
+	test_mac(960005, mac);
+	CHECK(bde_sim_l2_learn(mac, 80, 20) == 0);  /* port no longer learns */
+	CHECK(bcm56846_l2_port_learn_status_get(0, 20, &st) == 0);
+	CHECK(st.learned == 3 && st.learn_blocked && st.limit_drop == 2);
+
+	test_mac(960000, mac);
+	CHECK(bde_sim_l2_age(mac, 80) == 0);
+	CHECK(bcm56846_l2_event_poll(0, ev, 256) == 1 && ev[0].type == BCM56846_L2_EVENT_AGE);
+	CHECK(bcm56846_l2_port_learn_status_get(0, 20, &st) == 0);
+	CHECK(st.learned == 2 && !st.learn_blocked);
+	test_mac(960005, mac);
+	CHECK(bde_sim_l2_learn(mac, 80, 20) == 1);
+	CHECK(bcm56846_l2_event_poll(0, ev, 256) == 1);
+
+	/* One MAC flapping between ports 21 and 22, drained in one poll */
+	lim.learn_limit = 0;
+	lim.move_limit = 2;
+	lim.action = BCM56846_L2_LIMIT_TRAP;
+	lim.trap_pps = 5;
+	CHECK(bcm56846_l2_port_limit_set(0, 22, &lim) == 0);
+	test_mac(970000, mac);
+	CHECK(bde_sim_l2_learn(mac, 80, 21) == 1);
+	for (i = 0; i < 3; i++) {
+		CHECK(bde_sim_l2_learn(mac, 80, 22) == 1);
+		CHECK(bde_sim_l2_learn(mac, 80, 21) == 1);
+	}
+	CHECK(bcm56846_l2_event_poll(0, ev, 256) == 7);
+	CHECK(bcm56846_l2_port_learn_status_get(0, 22, &st) == 0);
+	CHECK(st.move_blocked && st.move_storm == 1);
+	CHECK(bde_sim_l2_learn(mac, 80, 22) == 0);  /* trapped, not moved */
+	for (i = 0, n = 0; i < 10; i++)
+		n += bcm56846_l2_trap_admit(22);
+	CHECK(n == 5);
+	CHECK(bcm56846_l2_trap_admit(21) == 1);
+
+	memset(&lim, 0, sizeof(lim));
+	CHECK(bcm56846_l2_port_limit_set(0, 20, &lim) == 0);
+	CHECK(bcm56846_l2_port_limit_set(0, 22, &lim) == 0);
+	CHECK(bcm56846_l2_trap_admit(22) == 1);
+	CHECK(bcm56846_l2_flush(0, -1, 80, 0) == 4);
+	while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+		;
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	return 0;
+}
+
+/* Sequential MACs (one OUI, counting up) with every hash the ASIC offers. */
+static int test_l2_hash(void)
+{
+	static bcm56846_l2_event_t ev[256];
+	bcm56846_l2_hash_stats_t st, cand;
+	bcm56846_l2_hash_t hash;
+	bcm56846_l2_addr_t a, out;
+	uint32_t fail0;
+	int i, added = 0, failed = 0;
+
+	CHECK(bcm56846_l2_hash_select_get(0, &hash) == 0 && hash == BCM56846_L2_HASH_CRC32_UPPER);
+	CHECK(bcm56846_l2_hash_stats_get(0, -1, &st) == 0 && st.entries == 0);
+	fail0 = st.insert_fail;
+	memset(&a, 0, sizeof(a));
+	a.mac[0] = 0x00;
+	a.mac[1] = 0x1b;
+	a.mac[2] = 0x21;
+	a.vid = 70;
+	a.port = 3;
+	a.static_entry = 1;
+	for (i = 0; i < 6000; i++) {
+		a.mac[4] = (uint8_t)(i >> 8);
+		a.mac[5] = (uint8_t)i;
+		if (bcm56846_l2_addr_add(0, &a) == 0)
+			added++;
+		else
+			failed++;
+	}
+	CHECK(bcm56846_l2_hash_stats_get(0, -1, &st) == 0);
+	CHECK(st.hash == BCM56846_L2_HASH_CRC32_UPPER && st.entries == (uint32_t)added);
+	CHECK(st.insert_fail - fail0 == (uint32_t)failed && st.overflow == 0);
+	CHECK(st.buckets_full == st.histogram[8]);
+
+	/* What LSB would do, then switch: the table is re-bucketed and in the sim */
+	CHECK(bcm56846_l2_hash_stats_get(0, BCM56846_L2_HASH_LSB, &cand) == 0);
+	CHECK(cand.histogram[1] == (uint32_t)added && cand.overflow == 0);
+	CHECK(bcm56846_l2_hash_select_set(0, BCM56846_L2_HASH_LSB) == 0);
+	CHECK(bcm56846_l2_hash_select_get(0, &hash) == 0 && hash == BCM56846_L2_HASH_LSB);
+	for (i = 0; i < 6000; i++) {
+		a.mac[4] = (uint8_t)(i >> 8);
+		a.mac[5] = (uint8_t)i;
+		CHECK(bcm56846_l2_bucket_get(0, a.mac, 70) == (i & 0x3fff));
+		CHECK(bcm56846_l2_addr_add(0, &a) == 0);  /* fits now, or replaces in place */
+		CHECK(bde_sim_l2_lookup(a.mac, 70, NULL) == 0);
+	}
+	CHECK(bcm56846_l2_hash_stats_get(0, -1, &st) == 0);
+	CHECK(st.entries == 6000 && st.histogram[1] == 6000 && st.buckets_full == 0);
+
+	CHECK(bcm56846_l2_hash_select_set(0, BCM56846_L2_HASH_CRC32_UPPER) >= 0);
+	CHECK(bcm56846_l2_hash_stats_get(0, -1, &st) == 0 && st.entries + st.rehash_drop == 6000);
+	a.mac[4] = 0;
+	a.mac[5] = 0;
+	if (bcm56846_l2_addr_get(0, a.mac, 70, &out) == 0)
+		CHECK(bde_sim_l2_lookup(a.mac, 70, NULL) == 0);
+	CHECK(bcm56846_l2_flush(0, -1, -1, BCM56846_L2_FLUSH_STATIC) == (int)st.entries);
+	while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+		;
+	return 0;
+}
+
+/* TCAM slot holding the L2_USER_ENTRY for mac, or -1. */
+static int user_slot(const uint8_t mac[6])
+{
+	uint32_t e[5], w0 = 1u | (((uint32_t)mac[2] << 24 | (uint32_t)mac[3] << 16 |
+				   (uint32_t)mac[4] << 8 | mac[5]) & 0x7fffffffu) << 1;
+	int i;
+
+	for (i = 0; i < 512; i++) {
+		if (bde_sim_mem_get(0x06168000u + (uint32_t)i, e, 5) == 0 && e[0] == w0)
+			return i;
+	}
+	return -1;
+}
+
+/* Priority order in the TCAM; adds and deletes issue writes only. */
+static int test_l2_user(void)
+{
+	bcm56846_l2_user_addr_t u;
+	uint8_t mac[4][6];
+	uint64_t ops;
+	int id[4], i;
+
+	memset(&u, 0, sizeof(u));
+	u.mask = 0xffffffffffffull;
+	for (i = 0; i < 4; i++)
+		test_mac(700000 + i, mac[i]);
+	for (i = 0; i < 3; i++) {
+		memcpy(u.mac, mac[i], 6);
+		CHECK(bcm56846_l2_user_entry_add(0, &u, &id[i]) == 0);
+	}
+	CHECK(user_slot(mac[0]) < user_slot(mac[1]) && user_slot(mac[1]) < user_slot(mac[2]));
+
+	/* Higher priority ahead of all three: they shift down one slot */
+	memcpy(u.mac, mac[3], 6);
+	u.priority = 10;
+	u.bpdu = 1;
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l2_user_entry_add(0, &u, &id[3]) == 0);
+	CHECK(bde_sim_op_count() - ops == 4);
+	CHECK(user_slot(mac[3]) < user_slot(mac[0]) && user_slot(mac[0]) < user_slot(mac[2]));
+
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l2_user_entry_delete(0, id[1]) == 0);
+	CHECK(bde_sim_op_count() - ops == 1);
+	CHECK(user_slot(mac[1]) < 0);
+	CHECK(bcm56846_l2_user_entry_delete(0, id[1]) == -ENOENT);
+
+	/* Priority 5 lands between them; ids survive the moves */
+	memcpy(u.mac, mac[1], 6);
+	u.priority = 5;
+	CHECK(bcm56846_l2_user_entry_add(0, &u, &id[1]) == 0);
+	CHECK(user_slot(mac[3]) < user_slot(mac[1]) && user_slot(mac[1]) < user_slot(mac[0]));
+	for (i = 0; i < 4; i++) {
+		CHECK(bcm56846_l2_user_entry_delete(0, id[i]) == 0);
+		CHECK(user_slot(mac[i]) < 0);
+	}
+	return 0;
+}
+
+static int test_l3(void)
+{
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r;
+	uint8_t mac[6];
+	uint16_t vid = 0;
+	int intf, nh, port = -1;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 200, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.port = 9;
+	eg.intf_id = intf;
+	CHECK(bcm56846_l3_egress_create(0, &eg, &nh) == 0);
+
+	memset(&r, 0, sizeof(r));
+	r.prefix = htonl(0x0a010000);  /* 10.1.0.0/16 */
+	r.prefix_len = 16;
+	r.egress_id = nh;
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+
+	CHECK(bde_sim_l3_lookup(0x0a010203, &port, mac, &vid) == 0);
+	CHECK(port == 9 && vid == 200 && memcmp(mac, peer_mac, 6) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a020203, NULL, NULL, NULL) == -ENOENT);
+
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a010203, NULL, NULL, NULL) == -ENOENT);
+	return 0;
+}
+
+/*
+ * Longest match holds whatever order routes arrive in: a /8 first, one
+ * route of every other length, then far more /24s than one partition's
+ * share of the TCAM (so neighbours lend slots and entries move), then the
+ * more specific routes.  Each add stays within the move bound.
+ */
+static int test_l3_lpm(void)
+{
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r;
+	uint64_t ops, worst = 0;
+	int intf, nh[4], i, port;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 210, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.intf_id = intf;
+	for (i = 0; i < 4; i++) {
+		eg.port = i + 1;
+		CHECK(bcm56846_l3_egress_create(0, &eg, &nh[i]) == 0);
+	}
+	memset(&r, 0, sizeof(r));
+	r.prefix = htonl(0x0a000000);  /* 10.0.0.0/8 */
+	r.prefix_len = 8;
+	r.egress_id = nh[0];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	for (i = 1; i <= 32; i++) {
+		if (i == 8 || i == 24)
+			continue;
+		r.prefix = htonl(0x0b000000);  /* 11.0.0.0/i */
+		r.prefix_len = i;
+		CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	}
+	r.prefix_len = 24;
+	r.egress_id = nh[1];
+	for (i = 0; i < 1500; i++) {
+		r.prefix = htonl(0xac100000u + ((uint32_t)i << 8));  /* 172.16.i.0/24 */
+		ops = bde_sim_op_count();
+		CHECK(bcm56846_l3_route_add(0, &r) == 0);
+		if (bde_sim_op_count() - ops > worst)
+			worst = bde_sim_op_count() - ops;
+	}
+	r.prefix = htonl(0x0a010000);  /* 10.1.0.0/16 */
+	r.prefix_len = 16;
+	r.egress_id = nh[2];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	r.prefix = htonl(0x0a010200);  /* 10.1.2.0/24 */
+	r.prefix_len = 24;
+	r.egress_id = nh[3];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	CHECK(worst > 1 && worst <= 33);
+
+	CHECK(bde_sim_l3_lookup(0x0a010203, &port, NULL, NULL) == 0 && port == 4);
+	CHECK(bde_sim_l3_lookup(0x0a010303, &port, NULL, NULL) == 0 && port == 3);
+	CHECK(bde_sim_l3_lookup(0x0a020304, &port, NULL, NULL) == 0 && port == 1);
+	for (i = 0; i < 1500; i += 7) {
+		port = -1;
+		CHECK(bde_sim_l3_lookup(0xac100001u + ((uint32_t)i << 8), &port, NULL, NULL) == 0);
+		CHECK(port == 2);
+	}
+
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a010203, &port, NULL, NULL) == 0 && port == 3);
+	r.prefix_len = 24;
+	for (i = 0; i < 1500; i += 2) {
+		r.prefix = htonl(0xac100000u + ((uint32_t)i << 8));
+		CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	}
+	for (i = 0; i < 1500; i += 7)
+		CHECK((bde_sim_l3_lookup(0xac100001u + ((uint32_t)i << 8), NULL, NULL, NULL) == 0) == (i & 1));
+	for (i = 1; i < 1500; i += 2) {
+		r.prefix = htonl(0xac100000u + ((uint32_t)i << 8));
+		CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	}
+	r.prefix = htonl(0x0a010000);
+	r.prefix_len = 16;
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	for (i = 1; i <= 32; i++) {
+		r.prefix = htonl(0x0b000000);
+		r.prefix_len = i;
+		CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	}
+
+	/* Keys are (VRF, prefix, length); a re-add rewrites in place */
+	r.prefix = htonl(0x0a000000);
+	r.prefix_len = 8;
+	r.vrf = 7;
+	r.egress_id = nh[3];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a020304, &port, NULL, NULL) == 0 && port == 1);
+	r.vrf = 0;
+	r.egress_id = nh[2];
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	CHECK(bde_sim_op_count() - ops == 1);
+	CHECK(bde_sim_l3_lookup(0x0a020304, &port, NULL, NULL) == 0 && port == 3);
+	r.vrf = 7;
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a020304, &port, NULL, NULL) == 0 && port == 3);
+	r.vrf = 0;
+	r.prefix = htonl(0x0a010203);  /* host bits are ignored */
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a010203, NULL, NULL, NULL) == -ENOENT);
+	for (i = 0; i < 4; i++)
+		CHECK(bcm56846_l3_egress_destroy(0, nh[i]) == 0);
+	return 0;
+}
+
+/* Identical next hops share one index; the last reference clears it. */
+static int test_l3_nhop_share(void)
+{
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r;
+	uint64_t ops;
+	int intf, a, b, c, d, port;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 220, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.port = 5;
+	eg.intf_id = intf;
+	CHECK(bcm56846_l3_egress_create(0, &eg, &a) == 0);
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l3_egress_create(0, &eg, &b) == 0);
+	CHECK(b == a && bde_sim_op_count() == ops);
+	eg.mac[5] = 0x02;
+	CHECK(bcm56846_l3_egress_create(0, &eg, &c) == 0 && c != a);
+	eg.mac[5] = peer_mac[5];
+	eg.vid = 220;
+	CHECK(bcm56846_l3_egress_create(0, &eg, &d) == 0 && d != a && d != c);
+	CHECK(bcm56846_l3_egress_destroy(0, c) == 0);
+	CHECK(bcm56846_l3_egress_destroy(0, d) == 0);
+
+	memset(&r, 0, sizeof(r));
+	r.prefix = htonl(0x0a090000);  /* 10.9.0.0/16 */
+	r.prefix_len = 16;
+	r.egress_id = a;
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	r.egress_id = 0;
+	CHECK(bcm56846_l3_route_get(0, &r) == 0 && r.egress_id == a);
+	CHECK(bcm56846_l3_egress_destroy(0, b) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a090101, &port, NULL, NULL) == 0 && port == 5);
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bcm56846_l3_route_get(0, &r) == -ENOENT);
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l3_egress_destroy(0, a) == 0);
+	CHECK(bde_sim_op_count() - ops == 2);
+
+	/* Freed: the same next hop is programmed afresh */
+	eg.vid = 0;
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l3_egress_create(0, &eg, &b) == 0);
+	CHECK(bde_sim_op_count() - ops == 2);
+	CHECK(bcm56846_l3_egress_destroy(0, b) == 0);
+	return 0;
+}
+
+/*
+ * Hosts go in the L3_ENTRY hash, one SCHAN write each and no DEFIP slot,
+ * and win over a covering route.  Past the table's size buckets fill up
+ * and adds fail cleanly; every host that was added still resolves.
+ */
+static int test_l3_host(void)
+{
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r;
+	bcm56846_l3_host_t h;
+	uint64_t ops;
+	int intf, nh[2], i, rc, added = 0, full = 0, port;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 230, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.intf_id = intf;
+	for (i = 0; i < 2; i++) {
+		eg.port = 6 + i;
+		CHECK(bcm56846_l3_egress_create(0, &eg, &nh[i]) == 0);
+	}
+	memset(&r, 0, sizeof(r));
+	r.prefix = htonl(0x0a141e00);  /* 10.20.30.0/24 */
+	r.prefix_len = 24;
+	r.egress_id = nh[0];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+
+	memset(&h, 0, sizeof(h));
+	h.addr[0] = 0x0a141e05;
+	h.egress_id = nh[1];
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_l3_host_add(0, &h) == 0);
+	CHECK(bde_sim_op_count() - ops == 1);
+	CHECK(bde_sim_l3_lookup(0x0a141e05, &port, NULL, NULL) == 0 && port == 7);
+	CHECK(bde_sim_l3_lookup(0x0a141e06, &port, NULL, NULL) == 0 && port == 6);
+	h.egress_id = nh[0];
+	CHECK(bcm56846_l3_host_add(0, &h) == 0);  /* rewritten in place */
+	CHECK(bde_sim_l3_lookup(0x0a141e05, &port, NULL, NULL) == 0 && port == 6);
+	CHECK(bcm56846_l3_host_delete(0, &h) == 0);
+	CHECK(bcm56846_l3_host_delete(0, &h) == 0);
+
+	h.egress_id = nh[1];
+	for (i = 0; i < 20000; i++) {
+		h.addr[0] = 0x0b000000u + (uint32_t)i;
+		rc = bcm56846_l3_host_add(0, &h);
+		CHECK(rc == 0 || rc == -ENOSPC);
+		if (rc == 0)
+			added++;
+		else
+			full++;
+	}
+	CHECK(added <= 16384 && added > 12000 && full > 0);
+	for (i = 0; i < 20000; i++) {
+		rc = bde_sim_l3_lookup(0x0b000000u + (uint32_t)i, &port, NULL, NULL);
+		if (rc == 0) {
+			CHECK(port == 7);
+			added--;
+		}
+	}
+	CHECK(added == 0);
+	for (i = 0; i < 20000; i++) {
+		h.addr[0] = 0x0b000000u + (uint32_t)i;
+		CHECK(bcm56846_l3_host_delete(0, &h) == 0);
+	}
+	CHECK(bde_sim_l3_lookup(0x0b000001, NULL, NULL, NULL) == -ENOENT);
+
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	for (i = 0; i < 2; i++)
+		CHECK(bcm56846_l3_egress_destroy(0, nh[i]) == 0);
+	return 0;
+}
+
+/* Pipelined route writes (SQ/CQ) land in order and all complete. */
+static int test_l3_async(void)
+{
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r;
+	int intf, nh, i, port;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 300, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.port = 11;
+	eg.intf_id = intf;
+
+	CHECK(bcm56846_l3_async_set(0, 1) == 0);
+	CHECK(bcm56846_l3_egress_create(0, &eg, &nh) == 0);
+	memset(&r, 0, sizeof(r));
+	r.prefix_len = 32;
+	r.egress_id = nh;
+	for (i = 0; i < 1000; i++) {
+		r.prefix = htonl(0xc0a80000u + (uint32_t)i);
+		CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	}
+	CHECK(bcm56846_l3_sync(0) == 0);
+	CHECK(bcm56846_l3_async_set(0, 0) == 0);
+
+	for (i = 0; i < 1000; i++) {
+		port = -1;
+		CHECK(bde_sim_l3_lookup(0xc0a80000u + (uint32_t)i, &port, NULL, NULL) == 0);
+		CHECK(port == 11);
+	}
+	return 0;
+}
+
+struct hit_count {
+	int n;
+	uint8_t mac[6];
+	uint32_t ip;
+	uint32_t addr6[4];
+	int is_ipv6;
+	int egress_id;
+};
+
+static int l2_hit_cb(int unit, const bcm56846_l2_addr_t *addr, void *cookie)
+{
+	struct hit_count *c = cookie;
+
+	(void)unit;
+	memcpy(c->mac, addr->mac, 6);
+	c->n++;
+	return 0;
+}
+
+static int l3_hit_cb(int unit, const bcm56846_l3_host_t *host, void *cookie)
+{
+	struct hit_count *c = cookie;
+
+	(void)unit;
+	c->ip = host->addr[0];
+	memcpy(c->addr6, host->addr, sizeof(c->addr6));
+	c->is_ipv6 = host->is_ipv6;
+	c->egress_id = host->egress_id;
+	c->n++;
+	return 0;
+}
+
+static void test_in6(bcm56846_l3_route_t *r, const uint32_t ip[4], int len)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		r->prefix6[i] = htonl(ip[i]);
+	r->prefix_len = len;
+	r->is_ipv6 = 1;
+}
+
+/*
+ * IPv6 longest match across the double-wide L3_DEFIP (/0../64), the
+ * L3_DEFIP_128 (/65../128) and L3_ENTRY hosts, next to IPv4 routes.
+ */
+static int test_l3_ipv6(void)
+{
+	static const uint32_t p32[4] = { 0x20010db8, 0, 0, 0 };
+	static const uint32_t p48[4] = { 0x20010db8, 0x00010000, 0, 0 };
+	static const uint32_t p96[4] = { 0x20010db8, 0x00010002, 0, 0 };
+	static const uint32_t a5[4] = { 0x20010db8, 0x00010002, 0, 5 };
+	static const uint32_t a7[4] = { 0x20010db8, 0x00010002, 0, 7 };
+	static const uint32_t a_other[4] = { 0x20010db8, 0x00050000, 0, 1 };
+	static const uint32_t a_48[4] = { 0x20010db8, 0x00010005, 0, 1 };
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r, v4;
+	bcm56846_l3_host_t h;
+	struct hit_count c;
+	int intf, nh[3], i, port;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 240, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.intf_id = intf;
+	for (i = 0; i < 3; i++) {
+		eg.port = 8 + i;
+		CHECK(bcm56846_l3_egress_create(0, &eg, &nh[i]) == 0);
+	}
+	memset(&v4, 0, sizeof(v4));
+	v4.prefix = htonl(0x0a1e0000);  /* 10.30.0.0/16 */
+	v4.prefix_len = 16;
+	v4.egress_id = nh[1];
+	CHECK(bcm56846_l3_route_add(0, &v4) == 0);
+
+	memset(&r, 0, sizeof(r));
+	test_in6(&r, p32, 32);  /* 2001:db8::/32 */
+	r.egress_id = nh[0];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	test_in6(&r, p96, 96);  /* 2001:db8:1:2::/96 */
+	r.egress_id = nh[2];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	test_in6(&r, p48, 48);  /* 2001:db8:1::/48 */
+	r.egress_id = nh[1];
+	CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	test_in6(&r, p48, 129);
+	CHECK(bcm56846_l3_route_add(0, &r) == -EINVAL);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.addr, a5, sizeof(a5));
+	h.is_ipv6 = 1;
+	h.egress_id = nh[0];
+	CHECK(bcm56846_l3_host_add(0, &h) == 0);
+
+	CHECK(bde_sim_l3_lookup6(a_other, &port, NULL, NULL) == 0 && port == 8);
+	CHECK(bde_sim_l3_lookup6(a_48, &port, NULL, NULL) == 0 && port == 9);
+	CHECK(bde_sim_l3_lookup6(a7, &port, NULL, NULL) == 0 && port == 10);
+	CHECK(bde_sim_l3_lookup(0x0a1e0001, &port, NULL, NULL) == 0 && port == 9);
+	CHECK(bde_sim_l3_lookup(0x20010db8, NULL, NULL, NULL) == -ENOENT);
+	test_in6(&r, p96, 96);
+	r.egress_id = 0;
+	CHECK(bcm56846_l3_route_get(0, &r) == 0 && r.egress_id == nh[2]);
+
+	memset(&c, 0, sizeof(c));
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) >= 0);
+	CHECK(bde_sim_l3_lookup6(a5, &port, NULL, NULL) == 0 && port == 8);
+	memset(&c, 0, sizeof(c));
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) == 1);
+	CHECK(c.is_ipv6 && memcmp(c.addr6, a5, sizeof(a5)) == 0 && c.egress_id == nh[0]);
+
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup6(a7, &port, NULL, NULL) == 0 && port == 9);
+	CHECK(bcm56846_l3_host_delete(0, &h) == 0);
+	CHECK(bde_sim_l3_lookup6(a5, &port, NULL, NULL) == 0 && port == 9);
+	test_in6(&r, p48, 48);
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	test_in6(&r, p32, 32);
+	CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	CHECK(bde_sim_l3_lookup6(a5, NULL, NULL, NULL) == -ENOENT);
+	CHECK(bde_sim_l3_lookup(0x0a1e0001, &port, NULL, NULL) == 0 && port == 9);
+	CHECK(bcm56846_l3_route_delete(0, &v4) == 0);
+	for (i = 0; i < 3; i++)
+		CHECK(bcm56846_l3_egress_destroy(0, nh[i]) == 0);
+	return 0;
+}
+
+/*
+ * IPv4 and IPv6 routes share L3_DEFIP: an IPv4 add borrows within the
+ * IPv4 partitions while they have room, and only then across the IPv6
+ * ones, which resolve throughout.
+ */
+static int test_l3_lpm_families(void)
+{
+	static const uint32_t a6[4] = { 0x20010db8, 0x00010002, 0, 1 };
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_route_t r, v6;
+	uint64_t ops;
+	int intf, nh[3], i, port;
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 250, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.intf_id = intf;
+	for (i = 0; i < 3; i++) {
+		eg.port = 14 + i;
+		CHECK(bcm56846_l3_egress_create(0, &eg, &nh[i]) == 0);
+	}
+	memset(&v6, 0, sizeof(v6));
+	for (i = 1; i <= 64; i++) {
+		test_in6(&v6, a6, i);
+		v6.egress_id = i == 64 ? nh[0] : nh[2];
+		CHECK(bcm56846_l3_route_add(0, &v6) == 0);
+	}
+	memset(&r, 0, sizeof(r));
+	for (i = 1; i <= 32; i++) {
+		r.prefix = htonl(0x0b000000);  /* 11.0.0.0/i */
+		r.prefix_len = i;
+		r.egress_id = nh[1];
+		CHECK(bcm56846_l3_route_add(0, &r) == 0);
+	}
+	/* More /24s than the IPv4 partitions' share of the table */
+	r.prefix_len = 24;
+	for (i = 0; i < 3000; i++) {
+		r.prefix = htonl(0xac100000u + ((uint32_t)i << 8));  /* 172.16.0.0 + i/24 */
+		ops = bde_sim_op_count();
+		CHECK(bcm56846_l3_route_add(0, &r) == 0);
+		CHECK(bde_sim_op_count() - ops <= (i < 2500 ? 33 : 98));
+	}
+	port = -1;
+	CHECK(bde_sim_l3_lookup6(a6, &port, NULL, NULL) == 0 && port == 14);
+	for (i = 0; i < 3000; i += 11) {
+		port = -1;
+		CHECK(bde_sim_l3_lookup(0xac100001u + ((uint32_t)i << 8), &port, NULL, NULL) == 0);
+		CHECK(port == 15);
+	}
+
+	for (i = 0; i < 3000; i++) {
+		r.prefix = htonl(0xac100000u + ((uint32_t)i << 8));
+		CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	}
+	for (i = 1; i <= 32; i++) {
+		r.prefix = htonl(0x0b000000);
+		r.prefix_len = i;
+		CHECK(bcm56846_l3_route_delete(0, &r) == 0);
+	}
+	test_in6(&v6, a6, 64);
+	CHECK(bcm56846_l3_route_delete(0, &v6) == 0);
+	CHECK(bde_sim_l3_lookup6(a6, &port, NULL, NULL) == 0 && port == 16);
+	for (i = 1; i < 64; i++) {
+		test_in6(&v6, a6, i);
+		CHECK(bcm56846_l3_route_delete(0, &v6) == 0);
+	}
+	CHECK(bde_sim_l3_lookup6(a6, NULL, NULL, NULL) == -ENOENT);
+	for (i = 0; i < 3; i++)
+		CHECK(bcm56846_l3_egress_destroy(0, nh[i]) == 0);
+	return 0;
+}
+
+/* Static L2 neighbors and L3 hosts the pipeline hit, each reported once. */
+static int test_hit_harvest(void)
+{
+	static bcm56846_l2_event_t ev[256];
+	bcm56846_l3_egress_t eg;
+	bcm56846_l3_host_t h;
+	bcm56846_l2_addr_t a;
+	struct hit_count c;
+	uint8_t mac[6];
+	int intf, nh, nh2, port;
+
+	memset(&c, 0, sizeof(c));
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) >= 0);  /* earlier tests */
+	CHECK(bcm56846_l2_hit_harvest(0, l2_hit_cb, &c) >= 0);
+
+	memset(&a, 0, sizeof(a));
+	memcpy(a.mac, peer_mac, 6);
+	a.vid = 70;
+	a.port = 12;
+	a.static_entry = 1;
+	CHECK(bcm56846_l2_addr_add(0, &a) == 0);
+	CHECK(bcm56846_l2_learn_enable(0, 1) == 0);
+	test_mac(950000, mac);
+	CHECK(bde_sim_l2_learn(mac, 70, 12) == 1);  /* dynamic: left to aging */
+	memset(&c, 0, sizeof(c));
+	CHECK(bcm56846_l2_hit_harvest(0, l2_hit_cb, &c) == 0);
+	CHECK(bde_sim_l2_learn(peer_mac, 70, 12) == 0);
+	CHECK(bcm56846_l2_hit_harvest(0, l2_hit_cb, &c) == 1);
+	CHECK(c.n == 1 && memcmp(c.mac, peer_mac, 6) == 0);
+	CHECK(bcm56846_l2_hit_harvest(0, l2_hit_cb, &c) == 0);
+
+	CHECK(bcm56846_l3_intf_create(0, router_mac, 70, &intf) == 0);
+	memset(&eg, 0, sizeof(eg));
+	memcpy(eg.mac, peer_mac, 6);
+	eg.port = 12;
+	eg.intf_id = intf;
+	CHECK(bcm56846_l3_egress_create(0, &eg, &nh) == 0);
+	memset(&h, 0, sizeof(h));
+	h.addr[0] = 0x0a090005;
+	h.egress_id = nh;
+	CHECK(bcm56846_l3_host_add(0, &h) == 0);
+	memset(&c, 0, sizeof(c));
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a090005, NULL, NULL, NULL) == 0);
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) == 1);
+	CHECK(c.ip == 0x0a090005 && c.egress_id == nh);
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) == 0);
+
+	/* A queued host update is not undone by the HIT write-back */
+	eg.port = 13;
+	CHECK(bcm56846_l3_egress_create(0, &eg, &nh2) == 0);
+	CHECK(bcm56846_l3_async_set(0, 1) == 0);
+	h.egress_id = nh2;
+	CHECK(bcm56846_l3_host_add(0, &h) == 0);
+	CHECK(bde_sim_l3_lookup(0x0a090005, NULL, NULL, NULL) == 0);
+	CHECK(bcm56846_l3_host_hit_harvest(0, l3_hit_cb, &c) == 1);
+	CHECK(c.egress_id == nh2);
+	CHECK(bcm56846_l3_sync(0) == 0);
+	CHECK(bcm56846_l3_async_set(0, 0) == 0);
+	port = -1;
+	CHECK(bde_sim_l3_lookup(0x0a090005, &port, NULL, NULL) == 0 && port == 13);
+
+	CHECK(bcm56846_l2_flush(0, -1, -1, BCM56846_L2_FLUSH_STATIC) == 2);
+	while (bcm56846_l2_event_poll(0, ev, 256) > 0)
+		;
+	CHECK(bcm56846_l2_learn_enable(0, 0) == 0);
+	return 0;
+}
+
+static int test_vlan(void)
+{
+	int untagged = -1;
+
+	CHECK(bcm56846_vlan_create_range(0, 1000, 1099) == 0);
+	CHECK(bcm56846_vlan_port_add(0, 1050, 5, 0) == 0);
+	CHECK(bcm56846_vlan_port_add(0, 1050, 6, 1) == 0);
+	CHECK(bde_sim_vlan_member(1050, 5, &untagged) == 1 && untagged == 1);
+	CHECK(bde_sim_vlan_member(1050, 6, &untagged) == 1 && untagged == 0);
+	CHECK(bde_sim_vlan_member(1050, 7, NULL) == 0);
+	CHECK(bde_sim_vlan_member(1051, 5, NULL) == 0);
+
+	CHECK(bcm56846_vlan_destroy(0, 1050) == 0);
+	CHECK(bde_sim_vlan_member(1050, 5, NULL) == 0);
+	return 0;
+}
+
+static int test_ecmp(void)
+{
+	const uint32_t *members;
+	uint32_t group[7];
+	int egress[3] = { 21, 22, 23 };
+	int ecmp, base, ok;
+
+	CHECK(bcm56846_l3_ecmp_create(0, egress, 3, &ecmp) == 0);
+	CHECK(bde_sim_mem_get(0x0e174000u + (uint32_t)ecmp, group, 7) == 0);
+	CHECK((group[0] & 0x3ff) == 3);
+	base = (int)((group[0] >> 10) & 0xfff);
+	CHECK(bcm56846_table_read(0, 0x0e176000u, base, 3, 1, &members) == 0);
+	ok = members[0] == 21 && members[1] == 22 && members[2] == 23;
+	bcm56846_table_read_release(0);
+	CHECK(ok);
+
+	CHECK(bcm56846_l3_ecmp_destroy(0, ecmp) == 0);
+	CHECK(bde_sim_mem_get(0x0e174000u + (uint32_t)ecmp, group, 7) == 0);
+	CHECK(group[0] == 0);
+	return 0;
+}
+
+static int test_stats(void)
+{
+	uint64_t v = 0;
+
+	CHECK(bde_sim_port_count(3, 1, 10, 6400) == 0);
+	CHECK(bde_sim_port_count(52, 0, 5, 320) == 0);
+	CHECK(bcm56846_stat_get(0, 3, BCM56846_STAT_RPKT, &v) == 0 && v == 10);
+	CHECK(bcm56846_stat_get(0, 3, BCM56846_STAT_RBYT, &v) == 0 && v == 6400);
+	CHECK(bcm56846_stat_get(0, 3, BCM56846_STAT_TPKT, &v) == 0 && v == 0);
+	CHECK(bcm56846_stat_get(0, 52, BCM56846_STAT_TBYT, &v) == 0 && v == 320);
+	return 0;
+}
+
+/* SLAM a range into an unmodeled memory, TDMA it back. */
+static int test_table_bulk(void)
+{
+	uint32_t entries[64 * 3];
+	const uint32_t *view;
+	uint64_t ops;
+	int i, ok;
+
+	for (i = 0; i < 64 * 3; i++)
+		entries[i] = 0x5a000000u | (uint32_t)i;
+	CHECK(bcm56846_table_write(0, 0x03300800u, 16, 64, 3, entries) == 0);
+	ops = bde_sim_op_count();
+	CHECK(bcm56846_table_read(0, 0x03300800u, 16, 64, 3, &view) == 0);
+	ok = memcmp(view, entries, sizeof(entries)) == 0;
+	bcm56846_table_read_release(0);
+	CHECK(bde_sim_op_count() - ops == 64);
+	CHECK(ok);
+	return 0;
+}
+
+int main(void)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(void);
+	} tests[] = {
+		{ "attach + init", test_attach_init },
+		{ "datapath modify, partial cache", test_datapath_partial_cache },
+		{ "L2 add/get/delete", test_l2 },
+		{ "L2 bucket hash + shadow", test_l2_buckets },
+		{ "L2 TABLE_LOOKUP of foreign entry", test_l2_hw_lookup },
+		{ "L2 learning via L2_MOD_FIFO", test_l2_learn },
+		{ "L2 aging hit-bit sweep", test_l2_age },
+		{ "L2 aging past the op cap", test_l2_age_capped },
+		{ "L2 flush by port/VLAN", test_l2_flush },
+		{ "L2 traverse with filters", test_l2_traverse },
+		{ "L2 learn limit + station moves", test_l2_limit },
+		{ "L2 hash select + bucket stats", test_l2_hash },
+		{ "L2_USER_ENTRY priority order", test_l2_user },
+		{ "L3 intf/egress/route", test_l3 },
+		{ "L3 DEFIP longest match + moves", test_l3_lpm },
+		{ "L3 next-hop sharing", test_l3_nhop_share },
+		{ "L3 host hash table", test_l3_host },
+		{ "L3 IPv6 routes + hosts", test_l3_ipv6 },
+		{ "L3 DEFIP shared by IPv4 + IPv6", test_l3_lpm_families },
+		{ "L3 async route writes", test_l3_async },
+		{ "L2/L3 hit harvest", test_hit_harvest },
+		{ "VLAN range + members", test_vlan },
+		{ "ECMP group + members", test_ecmp },
+		{ "XLMAC counters", test_stats },
+		{ "SLAM + TDMA bulk table", test_table_bulk },
+	};
+	int n = (int)(sizeof(tests) / sizeof(tests[0]));
+	int ok = 0, i;
+
+	printf("SDK simulator tests\n");
+	for (i = 0; i < n; i++) {
+		printf("Test %d: %s\n", i + 1, tests[i].name);
+		if (tests[i].fn() == 0)
+			ok++;
+		if (i == 0 && ok == 0)
+			break; /* nothing else can run without init */
+	}
+	bcm56846_detach(0);
+	printf("Passed %d/%d\n", ok, n);
+	return ok == n ? 0 : 1;
+}
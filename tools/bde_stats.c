@@ -0,0 +1,149 @@
+/*
+ * bde_stats: dump S-Channel telemetry from nos-kernel-bde (SCHAN_STATS ioctl).
+ * Same data as /sys/kernel/debug/nos-bde/schan_stats, with SBUS block names.
+ *
+ * Usage:
+ *   bde_stats            # dump counters since load / last reset
+ *   bde_stats -r         # dump, then reset
+ *   bde_stats -i SEC     # every SEC seconds, dump and reset (per-interval view)
+ *
+ * Build: gcc -O2 -I sdk/include -o bde_stats tools/bde_stats.c
+ */
+#include "bde_ioctl.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* SBUS block numbers (OpenMDK bcm56840_b0_blocks[]) */
+static const char *blk_name(int blk)
+{
+	if (blk == 0)
+		return "cmic";
+	if (blk == 1)
+		return "ipipe";
+	if (blk == 2)
+		return "epipe";
+	if (blk == 3)
+		return "mmu";
+	if (blk == 6 || blk == 7)
+		return "port_group4";
+	if (blk == 8 || blk == 9)
+		return "port_group5";
+	if (blk == 28)
+		return "lbport";
+	if ((blk >= 10 && blk <= 27) || blk == 29 || blk == 30)
+		return "xlport";
+	return "?";
+}
+
+static const char *op_name(int op)
+{
+	switch (op) {
+	case 0x07: return "READ_MEM";
+	case 0x09: return "WRITE_MEM";
+	case 0x0b: return "READ_REG";
+	case 0x0d: return "WRITE_REG";
+	default:   return "";
+	}
+}
+
+static void dump_hist(const char *name, const uint64_t *hist)
+{
+	int b;
+
+	printf("%s (ns):\n", name);
+	for (b = 0; b < NOS_BDE_STATS_HIST; b++)
+		if (hist[b])
+			printf("  [%10llu, %10llu) %llu\n",
+			       1ULL << b, 2ULL << b, (unsigned long long)hist[b]);
+}
+
+static void dump(const struct nos_bde_schan_stats *st)
+{
+	int i;
+
+	printf("ops %llu  timeouts %llu  sbus_timeouts %llu  naks %llu"
+	       "  resp_errors %llu  irq_missed %llu\n",
+	       (unsigned long long)st->ops, (unsigned long long)st->timeouts,
+	       (unsigned long long)st->sbus_timeouts, (unsigned long long)st->naks,
+	       (unsigned long long)st->resp_errors,
+	       (unsigned long long)st->irq_missed);
+
+	printf("opcode:\n");
+	for (i = 0; i < NOS_BDE_STATS_OPCODES; i++)
+		if (st->op_count[i])
+			printf("  0x%02x %-9s count %llu errors %llu\n", i, op_name(i),
+			       (unsigned long long)st->op_count[i],
+			       (unsigned long long)st->op_errors[i]);
+
+	printf("block:\n");
+	for (i = 0; i < NOS_BDE_STATS_BLOCKS; i++)
+		if (st->blk_count[i])
+			printf("  %2d %-11s count %llu errors %llu avg_ns %llu\n",
+			       i, blk_name(i),
+			       (unsigned long long)st->blk_count[i],
+			       (unsigned long long)st->blk_errors[i],
+			       (unsigned long long)(st->blk_ns[i] / st->blk_count[i]));
+
+	dump_hist("latency", st->lat_hist);
+	dump_hist("mutex wait", st->wait_hist);
+}
+
+static int read_stats(int fd, struct nos_bde_schan_stats *st, int reset)
+{
+	struct nos_bde_stats_req req;
+
+	memset(st, 0, sizeof(*st));
+	memset(&req, 0, sizeof(req));
+	req.buf = (uint64_t)(uintptr_t)st;
+	req.len = (uint32_t)sizeof(*st);
+	req.flags = reset ? NOS_BDE_STATS_RESET : 0;
+	if (ioctl(fd, NOS_BDE_SCHAN_STATS, &req) < 0) {
+		perror("NOS_BDE_SCHAN_STATS");
+		return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct nos_bde_schan_stats st;
+	int reset = 0, interval = 0;
+	int fd, opt;
+
+	while ((opt = getopt(argc, argv, "ri:")) != -1) {
+		switch (opt) {
+		case 'r':
+			reset = 1;
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			reset = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-r] [-i SEC]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	fd = open(NOS_BDE_DEVICE, O_RDWR);
+	if (fd < 0) {
+		perror("open " NOS_BDE_DEVICE);
+		return 1;
+	}
+	do {
+		if (interval > 0)
+			sleep((unsigned int)interval);
+		if (read_stats(fd, &st, reset) < 0) {
+			close(fd);
+			return 1;
+		}
+		dump(&st);
+		if (interval > 0)
+			printf("\n");
+	} while (interval > 0);
+	close(fd);
+	return 0;
+}